@@ -0,0 +1,97 @@
+"""Local stand-in for the Overpass interpreter so the response cache can be used without network access.
+
+Point the frontend at it with
+    -ini:Engine:[ConsoleVariables]:MT.Overpass.Endpoint=http://localhost:8090/api/interpreter
+
+Responses are looked up in --responses by the SHA1 of the normalized query (<hash>.json), the same
+key the frontend cache uses. Unknown queries are answered with a small synthetic street grid.
+"""
+import argparse
+import hashlib
+import json
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+from urllib.parse import parse_qs, urlparse
+
+ORIGIN_LAT = 48.137
+ORIGIN_LON = 11.575
+BLOCK_DEGREES = 0.001
+
+
+def normalize_query(query):
+    return " ".join(query.split())
+
+
+def query_hash(query):
+    return hashlib.sha1(normalize_query(query).encode("utf-8")).hexdigest()
+
+
+def synthetic_grid(size):
+    def node_id(row, column):
+        return row * size + column + 1
+
+    def coordinates(row, column):
+        return {"lat": ORIGIN_LAT + row * BLOCK_DEGREES, "lon": ORIGIN_LON + column * BLOCK_DEGREES}
+
+    elements = []
+    for index in range(size):
+        for is_row in (True, False):
+            cells = [(index, other) if is_row else (other, index) for other in range(size)]
+            elements.append({
+                "type": "way",
+                "id": len(elements) + 1,
+                "nodes": [node_id(row, column) for row, column in cells],
+                "geometry": [coordinates(row, column) for row, column in cells],
+                "tags": {"highway": "residential", "name": f"Stand-in {'Row' if is_row else 'Column'} {index}"},
+            })
+    return {"version": 0.6, "generator": "overpass_stand_in", "elements": elements}
+
+
+class OverpassHandler(BaseHTTPRequestHandler):
+    responses_dir = None
+    grid_size = 10
+    delay = 0.0
+    request_count = 0
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        if url.path != "/api/interpreter":
+            self.send_error(404)
+            return
+
+        query = parse_qs(url.query).get("data", [""])[0]
+        OverpassHandler.request_count += 1
+        time.sleep(self.delay)
+
+        response_path = self.responses_dir / f"{query_hash(query)}.json" if self.responses_dir else None
+        if response_path and response_path.exists():
+            body = response_path.read_bytes()
+        else:
+            body = json.dumps(synthetic_grid(self.grid_size)).encode("utf-8")
+
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        print(f"[{OverpassHandler.request_count}] {format % args}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Serve canned Overpass responses")
+    parser.add_argument("--port", type=int, default=8090)
+    parser.add_argument("--responses", type=Path, help="Directory of <query sha1>.json responses")
+    parser.add_argument("--grid-size", type=int, default=10, help="Size of the synthetic grid for unknown queries")
+    parser.add_argument("--delay", type=float, default=0.0, help="Seconds to wait before answering")
+    args = parser.parse_args()
+
+    OverpassHandler.responses_dir = args.responses
+    OverpassHandler.grid_size = args.grid_size
+    OverpassHandler.delay = args.delay
+
+    server = ThreadingHTTPServer(("localhost", args.port), OverpassHandler)
+    print(f"Overpass stand-in listening on http://localhost:{args.port}/api/interpreter")
+    server.serve_forever()
@@ -0,0 +1,165 @@
+"""Reader for the columnar sample metadata shards written by FMTSampleMetadataWriter.
+
+A session directory contains Metadata/Index.json and one Shard-NNNNN.mtm per flush. Columns are
+memory mapped, numeric columns are numpy views into the mapping and are not copied. Images of sessions
+with image shards are read through ImageShards.
+
+    python sample_metadata.py <session dir> [--dataset <dataset.json>]
+"""
+import argparse
+import json
+import mmap
+from pathlib import Path, PurePath
+
+import numpy as np
+
+from dataset_types import DatasetInfo, Sample, SampleDataset
+
+SHARD_MAGIC = 0x4D544D53
+SHARD_VERSION = 1
+
+COLUMN_NAME_SIZE = 24
+HEADER_DTYPE = np.dtype([
+    ("magic", "<u4"),
+    ("version", "<u4"),
+    ("row_count", "<u4"),
+    ("column_count", "<u4"),
+    ("string_dictionary_offset", "<u8"),
+    ("reserved", "<u8"),
+])
+COLUMN_DTYPE = np.dtype([
+    ("name", f"S{COLUMN_NAME_SIZE}"),
+    ("type", "<u4"),
+    ("reserved", "<u4"),
+    ("offset", "<u8"),
+])
+COLUMN_TYPES = {0: np.dtype("<u8"), 1: np.dtype("<f8"), 2: np.dtype("<f4"), 3: np.dtype("<u4")}
+STRING_COLUMN_TYPE = 3
+
+
+class MetadataShard:
+    def __init__(self, path):
+        with open(path, "rb") as file:
+            self._buffer = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+
+        header = np.frombuffer(self._buffer, HEADER_DTYPE, count=1)[0]
+        if header["magic"] != SHARD_MAGIC or header["version"] != SHARD_VERSION:
+            raise ValueError(f"{path} is not a version {SHARD_VERSION} metadata shard")
+
+        self.row_count = int(header["row_count"])
+        column_table = np.frombuffer(
+            self._buffer, COLUMN_DTYPE, count=int(header["column_count"]), offset=HEADER_DTYPE.itemsize)
+
+        self.columns = {}
+        self.string_columns = set()
+        for column in column_table:
+            name = column["name"].decode("ascii")
+            self.columns[name] = np.frombuffer(
+                self._buffer, COLUMN_TYPES[int(column["type"])], count=self.row_count, offset=int(column["offset"]))
+            if column["type"] == STRING_COLUMN_TYPE:
+                self.string_columns.add(name)
+
+        dictionary_offset = int(header["string_dictionary_offset"])
+        string_count = int(np.frombuffer(self._buffer, "<u4", count=1, offset=dictionary_offset)[0])
+        self._string_offsets = np.frombuffer(self._buffer, "<u8", count=string_count + 1, offset=dictionary_offset + 8)
+        self._string_data_offset = dictionary_offset + 8 + self._string_offsets.nbytes
+
+    def string(self, index):
+        begin = self._string_data_offset + int(self._string_offsets[index])
+        end = self._string_data_offset + int(self._string_offsets[index + 1])
+        return self._buffer[begin:end].decode("utf-8")
+
+    def strings(self, column_name):
+        """Decodes a dictionary column, each distinct string is decoded once"""
+        indices = self.columns[column_name]
+        unique_indices, inverse = np.unique(indices, return_inverse=True)
+        decoded = np.array([self.string(index) for index in unique_indices], dtype=object)
+        return decoded[inverse]
+
+
+def load_shards(session_dir):
+    metadata_dir = Path(session_dir) / "Metadata"
+    index = json.load(open(metadata_dir / "Index.json", "r"))
+    return [MetadataShard(metadata_dir / shard["File"]) for shard in index["Shards"]]
+
+
+def load_columns(session_dir, column_names=None):
+    """Concatenates the columns of all shards, string columns are decoded"""
+    shards = load_shards(session_dir)
+    column_names = column_names or (list(shards[0].columns) if shards else [])
+    result = {}
+    for name in column_names:
+        if shards and name in shards[0].string_columns:
+            result[name] = np.concatenate([shard.strings(name) for shard in shards])
+        else:
+            result[name] = np.concatenate([shard.columns[name] for shard in shards])
+    return result
+
+
+class ImageShards:
+    """Random access to images written into Images/Shard-NNNNN.tar, falls back to plain image files"""
+
+    def __init__(self, session_dir):
+        self.image_dir = Path(session_dir) / "Images"
+        self.members = {}
+        for index_path in sorted(self.image_dir.glob("Shard-*.idx")):
+            shard_path = index_path.with_suffix(".tar")
+            for line in open(index_path, "r", encoding="utf-8"):
+                name, offset, size = line.rstrip("\n").split("\t")
+                self.members[name] = (shard_path, int(offset), int(size))
+
+    def read(self, image_path, short_side=None):
+        """image_path relative to the session directory, e.g. the image_path metadata column.
+        short_side reads the pyramid level of the image written for PyramidShortSides"""
+        path = PurePath(image_path)
+        if short_side is not None:
+            path = path.parent / str(short_side) / path.name
+        name = path.relative_to("Images").as_posix()
+        if name not in self.members:
+            return (self.image_dir / name).read_bytes()
+
+        shard_path, offset, size = self.members[name]
+        with open(shard_path, "rb") as file:
+            file.seek(offset)
+            return file.read(size)
+
+
+def load_dataset_from_metadata(session_dir):
+    columns = load_columns(session_dir)
+    samples = [
+        Sample(
+            ImagePath=image_path,
+            Lon=float(lon),
+            Lat=float(lat),
+            Altitude=float(altitude),
+            HeadingAngle=float(heading_angle),
+            StreetName=street_name,
+            ArtifactProbability=float(artifact_probability),
+            AbsoluteImagePath=str(Path(session_dir) / image_path),
+        )
+        for image_path, lon, lat, altitude, heading_angle, street_name, artifact_probability in zip(
+            columns.get("image_path", []),
+            columns.get("longitude", []),
+            columns.get("latitude", []),
+            columns.get("altitude", []),
+            columns.get("heading_angle", []),
+            columns.get("street_name", []),
+            columns.get("artifact_probability", []),
+        )
+    ]
+    return SampleDataset(Info=DatasetInfo(SampleCount=len(samples)), Samples=samples)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("session_dir")
+    parser.add_argument("--dataset", help="Writes the samples as a dataset json usable by the other scripts")
+    args = parser.parse_args()
+
+    shards = load_shards(args.session_dir)
+    print(f"{len(shards)} shards, {sum(shard.row_count for shard in shards)} samples")
+
+    if args.dataset:
+        dataset = load_dataset_from_metadata(args.session_dir)
+        with open(args.dataset, "w") as file:
+            file.write(dataset.to_json())
@@ -0,0 +1,146 @@
+"""Writes the tiny .osm.pbf extract checked by the frontend benchmark commandlet (-Mode=PBFCheck).
+
+The extract covers what MTOSMPBF::ReadStreetGraph has to handle: a raw header blob, a zlib blob with
+dense nodes, a raw blob with a plain node and ways, excluded tunnel, covered and unknown highway ways
+and a way that references a node missing from the extract. The expected counts are asserted in
+UMTWayGraphBenchmarkCommandlet::RunPBFCheck, keep both in sync.
+
+    python write_pbf_check_extract.py [output.osm.pbf]
+"""
+import sys
+import zlib
+from pathlib import Path
+
+DEFAULT_OUTPUT = (
+    Path(__file__).resolve().parents[2]
+    / "Frontend/Source/Geolocator/Benchmark/TestData/MTPBFCheck.osm.pbf"
+)
+
+# Node id -> (lat, lon), node 10 is written as a plain node, node 11 is not written at all
+DENSE_NODES = {
+    1: (52.5000, 13.4000),
+    2: (52.5000, 13.4010),
+    3: (52.5000, 13.4020),
+    4: (52.5010, 13.4000),
+    5: (52.5010, 13.4010),
+    6: (52.5010, 13.4020),
+    7: (52.4990, 13.4000),
+    8: (52.4990, 13.4010),
+    9: (52.4990, 13.4020),
+}
+PLAIN_NODE = (10, (52.5020, 13.4020))
+
+WAYS = [
+    (100, [1, 2, 3], {"highway": "residential", "name": "Alpha Street"}),
+    (101, [4, 5, 6], {"highway": "primary", "name": "Beta Avenue"}),
+    (102, [2, 5], {"highway": "service"}),
+    (103, [6, 10], {"highway": "residential", "name": "Gamma Lane"}),
+    (104, [3, 6], {"highway": "residential", "name": "Tunnel Road", "tunnel": "yes"}),
+    (105, [1, 4], {"highway": "footway", "covered": "yes"}),
+    (106, [7, 8], {"highway": "construction", "name": "Building Site"}),
+    (107, [8, 9], {"building": "yes", "name": "Shed"}),
+    (108, [1, 4], {"highway": "footway", "name": "Open Passage", "covered": "no"}),
+    (109, [3, 11], {"highway": "residential", "name": "Alpha Street"}),
+]
+
+
+def varint(value):
+    result = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            result.append(byte | 0x80)
+        else:
+            result.append(byte)
+            return bytes(result)
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 63)
+
+
+def field_varint(field, value):
+    return varint(field << 3) + varint(value)
+
+
+def field_bytes(field, data):
+    return varint(field << 3 | 2) + varint(len(data)) + data
+
+
+def packed(values):
+    return b"".join(varint(value) for value in values)
+
+
+def delta_coded(values):
+    previous = 0
+    result = []
+    for value in values:
+        result.append(zigzag(value - previous))
+        previous = value
+    return packed(result)
+
+
+def nano_units(degrees):
+    # Default granularity of 100 nanodegrees
+    return round(degrees * 1e7)
+
+
+def blob(block_type, block, compress):
+    if compress:
+        data = field_varint(2, len(block)) + field_bytes(3, zlib.compress(block, 9))
+    else:
+        data = field_bytes(1, block)
+    header = field_bytes(1, block_type.encode()) + field_varint(3, len(data))
+    return len(header).to_bytes(4, "big") + header + data
+
+
+def primitive_block(strings, groups):
+    string_table = b"".join(field_bytes(1, string.encode()) for string in strings)
+    return field_bytes(1, string_table) + b"".join(field_bytes(2, group) for group in groups)
+
+
+def write_extract(output):
+    header_block = field_bytes(4, b"OsmSchema-V0.6") + field_bytes(4, b"DenseNodes")
+
+    node_ids = sorted(DENSE_NODES)
+    dense = (
+        field_bytes(1, delta_coded(node_ids))
+        + field_bytes(8, delta_coded([nano_units(DENSE_NODES[node][0]) for node in node_ids]))
+        + field_bytes(9, delta_coded([nano_units(DENSE_NODES[node][1]) for node in node_ids]))
+    )
+    node_block = primitive_block([""], [field_bytes(2, dense)])
+
+    strings = [""]
+    for _, _, tags in WAYS:
+        for text in (text for tag in tags.items() for text in tag):
+            if text not in strings:
+                strings.append(text)
+
+    plain_id, (plain_lat, plain_lon) = PLAIN_NODE
+    plain_node = (
+        field_varint(1, zigzag(plain_id))
+        + field_varint(8, zigzag(nano_units(plain_lat)))
+        + field_varint(9, zigzag(nano_units(plain_lon)))
+    )
+    ways = b""
+    for way_id, refs, tags in WAYS:
+        way = (
+            field_varint(1, way_id)
+            + field_bytes(2, packed(strings.index(key) for key in tags))
+            + field_bytes(3, packed(strings.index(value) for value in tags.values()))
+            + field_bytes(8, delta_coded(refs))
+        )
+        ways += field_bytes(3, way)
+    way_block = primitive_block(strings, [field_bytes(1, plain_node), ways])
+
+    output.parent.mkdir(parents=True, exist_ok=True)
+    output.write_bytes(
+        blob("OSMHeader", header_block, False)
+        + blob("OSMData", node_block, True)
+        + blob("OSMData", way_block, False)
+    )
+
+
+if __name__ == "__main__":
+    write_extract(Path(sys.argv[1]) if len(sys.argv) > 1 else DEFAULT_OUTPUT)
@@ -0,0 +1,162 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTCaptureRingBenchmarkCommandlet.h"
+
+#include "Geolocator/Sampler/MTCaptureRing.h"
+
+namespace
+{
+    // Readbacks finish a number of frames after their capture, time only advances through the
+    // simulation so every run is deterministic
+    class FMockCaptureBackend final : public IMTCaptureBackend
+    {
+    public:
+        explicit FMockCaptureBackend(const int32 Depth)
+        {
+            Slots.SetNum(Depth);
+        }
+
+        void BeginCapture(const int32 SlotIndex, const int32 CaptureIndex, const int64 ReadbackFrames)
+        {
+            auto& Slot = Slots[SlotIndex];
+            if (Slot.CaptureIndex != INDEX_NONE)
+            {
+                UE_LOG(LogTemp, Error, TEXT("Capture %d overwrites capture %d in flight"), CaptureIndex, Slot.CaptureIndex);
+                bHasFailed = true;
+            }
+
+            // The GPU works through captures in order
+            LastReadyFrame = FMath::Max(LastReadyFrame, CurrentFrame + ReadbackFrames);
+            Slot = {CaptureIndex, LastReadyFrame};
+        }
+
+        virtual bool IsReadbackComplete(const int32 SlotIndex) override
+        {
+            return Slots[SlotIndex].ReadyFrame <= CurrentFrame;
+        }
+
+        virtual void WaitForReadback(const int32 SlotIndex) override
+        {
+            const auto ReadyFrame = Slots[SlotIndex].ReadyFrame;
+            if (ReadyFrame > CurrentFrame)
+            {
+                StalledFrames += ReadyFrame - CurrentFrame;
+                CurrentFrame = ReadyFrame;
+            }
+        }
+
+        virtual void CompleteCapture(const int32 SlotIndex) override
+        {
+            auto& Slot = Slots[SlotIndex];
+            if (Slot.CaptureIndex != CompletedNum || Slot.ReadyFrame > CurrentFrame)
+            {
+                UE_LOG(
+                    LogTemp,
+                    Error,
+                    TEXT("Completed capture %d in slot %d, expected capture %d"),
+                    Slot.CaptureIndex,
+                    SlotIndex,
+                    CompletedNum);
+                bHasFailed = true;
+            }
+
+            Slot = {};
+            CompletedNum++;
+        }
+
+        void AdvanceFrames(const int64 FrameNum)
+        {
+            CurrentFrame += FrameNum;
+        }
+
+        int64 CurrentFrame = 0;
+
+        int64 StalledFrames = 0;
+
+        int32 CompletedNum = 0;
+
+        bool bHasFailed = false;
+
+    private:
+        struct FSlot
+        {
+            int32 CaptureIndex = INDEX_NONE;
+
+            int64 ReadyFrame = 0;
+        };
+
+        TArray<FSlot> Slots;
+
+        int64 LastReadyFrame = 0;
+    };
+}  // namespace
+
+UMTCaptureRingBenchmarkCommandlet::UMTCaptureRingBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UMTCaptureRingBenchmarkCommandlet::Main(const FString& Params)
+{
+    int32 SampleCount = 1000;
+    FParse::Value(*Params, TEXT("Samples="), SampleCount);
+
+    int32 MaxDepth = 4;
+    FParse::Value(*Params, TEXT("MaxDepth="), MaxDepth);
+
+    // FindNextSampleLocation, PreCapture and its wait frame before the next CaptureSample
+    int32 StepFrames = 3;
+    FParse::Value(*Params, TEXT("StepFrames="), StepFrames);
+
+    int32 ReadbackFrames = 4;
+    FParse::Value(*Params, TEXT("ReadbackFrames="), ReadbackFrames);
+
+    int32 Jitter = 3;
+    FParse::Value(*Params, TEXT("Jitter="), Jitter);
+
+    int32 Seed = 0;
+    FParse::Value(*Params, TEXT("Seed="), Seed);
+
+    auto bHasFailed = false;
+    for (int32 Depth = 1; Depth <= MaxDepth; ++Depth)
+    {
+        FMockCaptureBackend Backend(Depth);
+        FMTCaptureRing Ring(Backend, Depth);
+        FRandomStream RandomStream(Seed);
+
+        int32 MaxInFlightNum = 0;
+        for (int32 CaptureIndex = 0; CaptureIndex < SampleCount; ++CaptureIndex)
+        {
+            // Same order of calls as UMTSamplerComponentBase::CaptureSample
+            Backend.AdvanceFrames(StepFrames);
+            Ring.Poll();
+
+            const auto SlotIndex = Ring.AcquireSlot();
+            Backend.BeginCapture(SlotIndex, CaptureIndex, ReadbackFrames + RandomStream.RandRange(0, Jitter));
+            Ring.MarkInFlight(SlotIndex);
+
+            MaxInFlightNum = FMath::Max(MaxInFlightNum, Ring.InFlightNum());
+        }
+        Ring.Flush();
+
+        const auto bHasDepthFailed =
+            Backend.bHasFailed || Backend.CompletedNum != SampleCount || MaxInFlightNum > Depth;
+        bHasFailed |= bHasDepthFailed;
+
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Depth %d: %lld frames %6.2f frames per sample %lld stalled frames %d max in flight%s"),
+            Depth,
+            Backend.CurrentFrame,
+            static_cast<double>(Backend.CurrentFrame) / FMath::Max(1, SampleCount),
+            Backend.StalledFrames,
+            MaxInFlightNum,
+            bHasDepthFailed ? TEXT(" FAILED") : TEXT(""));
+    }
+
+    return bHasFailed ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "CoreMinimal.h"
+
+#include "MTCaptureRingBenchmarkCommandlet.generated.h"
+
+/**
+ * Runs the capture ring scheduling against a mock backend with simulated readback latency, checks
+ * that captures complete once and in order and reports game thread stalls per ring depth
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTCaptureRingBenchmark
+ *     [-Samples=1000] [-MaxDepth=4] [-StepFrames=3] [-ReadbackFrames=4] [-Jitter=3] [-Seed=0]
+ */
+UCLASS()
+class GEOLOCATOR_API UMTCaptureRingBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UMTCaptureRingBenchmarkCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,413 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTCubemapRemapBenchmarkCommandlet.h"
+
+#include "Async/ParallelFor.h"
+#include "Geolocator/Sampler/MTCubemapRemap.h"
+#include "IImageWrapperModule.h"
+#include "RHIDefinitions.h"
+
+namespace
+{
+    // File names of the faces in ECubeFace order
+    const TCHAR* FaceNames[CubeFace_MAX] = {
+        TEXT("PosX"), TEXT("NegX"), TEXT("PosY"), TEXT("NegY"), TEXT("PosZ"), TEXT("NegZ")};
+
+    // Inverse of FMTCubemapRemap::DirectionToFaceTexel, written out per face so both are checked
+    // against each other
+    FVector FaceTexelToDirection(const int32 Face, const double TexelX, const double TexelY, const int32 FaceSize)
+    {
+        const auto S = 2. * TexelX / FaceSize - 1.;
+        const auto T = 2. * TexelY / FaceSize - 1.;
+        switch (Face)
+        {
+            case CubeFace_PosX:
+                return FVector(1., -T, -S);
+            case CubeFace_NegX:
+                return FVector(-1., -T, S);
+            case CubeFace_PosY:
+                return FVector(S, 1., T);
+            case CubeFace_NegY:
+                return FVector(S, -1., -T);
+            case CubeFace_PosZ:
+                return FVector(S, -T, 1.);
+            default:
+                return FVector(-S, -T, -1.);
+        }
+    }
+
+    // Smooth colors with some detail, bilinear taps of the faces should reproduce it closely
+    FColor SceneColor(const FVector& Direction)
+    {
+        const auto D = Direction.GetSafeNormal();
+        const auto R = 128. + 90. * D.X + 30. * FMath::Sin(4. * D.Y);
+        const auto G = 128. + 90. * D.Y + 30. * FMath::Sin(4. * D.Z);
+        const auto B = 128. + 90. * D.Z + 30. * FMath::Sin(4. * D.X);
+        return FColor(
+            static_cast<uint8>(FMath::RoundToInt(R)),
+            static_cast<uint8>(FMath::RoundToInt(G)),
+            static_cast<uint8>(FMath::RoundToInt(B)),
+            255);
+    }
+
+    TArray<FColor> RenderSceneFaces(const int32 FaceSize)
+    {
+        TArray<FColor> Faces;
+        Faces.SetNumUninitialized(CubeFace_MAX * FaceSize * FaceSize);
+        ParallelFor(
+            CubeFace_MAX * FaceSize,
+            [&Faces, FaceSize](const int32 FaceRow)
+            {
+                const auto Face = FaceRow / FaceSize;
+                const auto Y = FaceRow % FaceSize;
+                for (int32 X = 0; X < FaceSize; ++X)
+                {
+                    Faces[FaceRow * FaceSize + X] =
+                        SceneColor(FaceTexelToDirection(Face, X + 0.5, Y + 0.5, FaceSize));
+                }
+            });
+        return Faces;
+    }
+
+    TArray<FColor> RenderScene(
+        const FIntVector2& Size,
+        const TFunctionRef<FVector(const int32 X, const int32 Y)> PixelToDirection)
+    {
+        TArray<FColor> Pixels;
+        Pixels.SetNumUninitialized(Size.X * Size.Y);
+        ParallelFor(
+            Size.Y,
+            [&Pixels, &Size, &PixelToDirection](const int32 Y)
+            {
+                for (int32 X = 0; X < Size.X; ++X)
+                {
+                    Pixels[Y * Size.X + X] = SceneColor(PixelToDirection(X, Y));
+                }
+            });
+        return Pixels;
+    }
+
+    double PSNR(const TConstArrayView<FColor> Pixels, const TConstArrayView<FColor> ReferencePixels)
+    {
+        check(Pixels.Num() == ReferencePixels.Num());
+
+        double SquaredErrorSum = 0.;
+        for (int32 PixelIndex = 0; PixelIndex < Pixels.Num(); ++PixelIndex)
+        {
+            const auto& Pixel = Pixels[PixelIndex];
+            const auto& ReferencePixel = ReferencePixels[PixelIndex];
+            SquaredErrorSum += FMath::Square(static_cast<double>(Pixel.R) - ReferencePixel.R) +
+                               FMath::Square(static_cast<double>(Pixel.G) - ReferencePixel.G) +
+                               FMath::Square(static_cast<double>(Pixel.B) - ReferencePixel.B);
+        }
+
+        const auto MeanSquaredError = SquaredErrorSum / (3. * FMath::Max(1, Pixels.Num()));
+        return MeanSquaredError > 0. ? 10. * FMath::LogX(10., 255. * 255. / MeanSquaredError) : 99.;
+    }
+
+    bool LoadImage(const FString& FilePath, FImage& OutImage)
+    {
+        auto& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+
+        TArray64<uint8> ImageData;
+        if (!FFileHelper::LoadFileToArray(ImageData, *FilePath) ||
+            !ImageWrapperModule.DecompressImage(ImageData.GetData(), ImageData.Num(), OutImage))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to load %s"), *FilePath);
+            return false;
+        }
+
+        // FColor layout, same as the read back faces
+        OutImage.ChangeFormat(ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+        return true;
+    }
+
+    TConstArrayView<FColor> GetPixels(const FImage& Image)
+    {
+        return MakeArrayView(reinterpret_cast<const FColor*>(Image.RawData.GetData()), Image.GetNumPixels());
+    }
+
+    struct FRemapRunResult
+    {
+        double BuildSeconds = 0.;
+
+        double ApplySeconds = 0.;
+
+        double PSNR = 0.;
+    };
+
+    // Build is timed on a cold cache, apply is single threaded like on an encoder thread
+    FRemapRunResult RunRemap(
+        const TFunctionRef<TSharedRef<const FMTCubemapRemap>()> GetRemap,
+        const TArray<FColor>& Faces,
+        const TArray<FColor>& ReferencePixels,
+        const int32 Iterations)
+    {
+        FRemapRunResult Result;
+
+        auto StartTime = FPlatformTime::Seconds();
+        const auto Remap = GetRemap();
+        Result.BuildSeconds = FPlatformTime::Seconds() - StartTime;
+
+        TArray<FColor> Pixels;
+        StartTime = FPlatformTime::Seconds();
+        for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+        {
+            Remap->Apply(Faces, Pixels);
+        }
+        Result.ApplySeconds = (FPlatformTime::Seconds() - StartTime) / FMath::Max(1, Iterations);
+
+        Result.PSNR = PSNR(Pixels, ReferencePixels);
+        return Result;
+    }
+}  // namespace
+
+UMTCubemapRemapBenchmarkCommandlet::UMTCubemapRemapBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UMTCubemapRemapBenchmarkCommandlet::Main(const FString& Params)
+{
+    FIntVector2 TopAndBottomCrop = {512, 640};
+    FParse::Value(*Params, TEXT("TopCrop="), TopAndBottomCrop.X);
+    FParse::Value(*Params, TEXT("BottomCrop="), TopAndBottomCrop.Y);
+
+    double MinPSNR = 40.;
+    FParse::Value(*Params, TEXT("MinPSNR="), MinPSNR);
+
+    FString FacesDir;
+    FString ReferencePath;
+    if (FParse::Value(*Params, TEXT("Faces="), FacesDir))
+    {
+        if (!FParse::Value(*Params, TEXT("Reference="), ReferencePath))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Missing -Reference=<long lat unwrap of the faces>"));
+            return 1;
+        }
+        return RunReferenceBenchmark(FacesDir, ReferencePath, TopAndBottomCrop, MinPSNR);
+    }
+
+    // Face size of the default panorama width
+    int32 FaceSize = 1664;
+    FParse::Value(*Params, TEXT("FaceSize="), FaceSize);
+
+    int32 Iterations = 8;
+    FParse::Value(*Params, TEXT("Iterations="), Iterations);
+
+    return RunSyntheticBenchmark(FaceSize, TopAndBottomCrop, Iterations, MinPSNR);
+}
+
+int32 UMTCubemapRemapBenchmarkCommandlet::RunSyntheticBenchmark(
+    const int32 FaceSize,
+    const FIntVector2& TopAndBottomCrop,
+    const int32 Iterations,
+    const double MinPSNR)
+{
+    if (FaceSize < 2 || TopAndBottomCrop.X < 0 || TopAndBottomCrop.Y < 0 ||
+        TopAndBottomCrop.X + TopAndBottomCrop.Y >= FaceSize)
+    {
+        UE_LOG(
+            LogTemp,
+            Error,
+            TEXT("Crops of %d and %d do not fit a face size of %d"),
+            TopAndBottomCrop.X,
+            TopAndBottomCrop.Y,
+            FaceSize);
+        return 1;
+    }
+
+    auto bHasFailed = false;
+
+    // Every texel center has to map back onto itself
+    FRandomStream RandomStream(0);
+    for (int32 CheckIndex = 0; CheckIndex < 10000; ++CheckIndex)
+    {
+        const auto Face = RandomStream.RandRange(0, CubeFace_MAX - 1);
+        const FVector2f Texel(
+            RandomStream.RandRange(0, FaceSize - 1) + 0.5F,
+            RandomStream.RandRange(0, FaceSize - 1) + 0.5F);
+
+        int32 MappedFace;
+        const auto MappedTexel = FMTCubemapRemap::DirectionToFaceTexel(
+            FaceTexelToDirection(Face, Texel.X, Texel.Y, FaceSize), FaceSize, MappedFace);
+        if (MappedFace != Face || !MappedTexel.Equals(Texel, 1e-2F))
+        {
+            UE_LOG(
+                LogTemp,
+                Error,
+                TEXT("Texel %s of face %s maps to %s of face %s"),
+                *Texel.ToString(),
+                FaceNames[Face],
+                *MappedTexel.ToString(),
+                FaceNames[MappedFace]);
+            bHasFailed = true;
+            break;
+        }
+    }
+
+    const auto Faces = RenderSceneFaces(FaceSize);
+
+    const auto LogResult =
+        [&bHasFailed, MinPSNR](const FString& Name, const FIntVector2& Size, const FRemapRunResult& Result)
+    {
+        const auto bIsBelowMinPSNR = Result.PSNR < MinPSNR;
+        bHasFailed |= bIsBelowMinPSNR;
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("%-32s %5dx%-5d build %8.2f ms apply %8.2f ms %8.2f MP/s per core PSNR %6.2f dB%s"),
+            *Name,
+            Size.X,
+            Size.Y,
+            Result.BuildSeconds * 1000.,
+            Result.ApplySeconds * 1000.,
+            Size.X * Size.Y / 1e6 / Result.ApplySeconds,
+            Result.PSNR,
+            bIsBelowMinPSNR ? TEXT(" FAILED") : TEXT(""));
+    };
+
+    // Same directions the long lat unwrap shader samples
+    const FIntVector2 PanoramaSize = {FaceSize * 2, FaceSize};
+    for (const auto& Crop : {FIntVector2(0, 0), TopAndBottomCrop})
+    {
+        const FIntVector2 Size = {PanoramaSize.X, PanoramaSize.Y - Crop.X - Crop.Y};
+        const auto ReferencePixels = RenderScene(
+            Size,
+            [&PanoramaSize, &Crop](const int32 X, const int32 Y)
+            {
+                const auto Longitude = 2. * PI * (X + 0.5) / PanoramaSize.X;
+                const auto Colatitude = PI * (Y + Crop.X + 0.5) / PanoramaSize.Y;
+                return FVector(
+                    FMath::Sin(Colatitude) * FMath::Sin(Longitude),
+                    -FMath::Sin(Colatitude) * FMath::Cos(Longitude),
+                    FMath::Cos(Colatitude));
+            });
+
+        uint8 FaceMask = 0;
+        const auto Result = RunRemap(
+            [FaceSize, &PanoramaSize, &Crop, &FaceMask]
+            {
+                const auto Remap = FMTCubemapRemap::GetEquirect(FaceSize, PanoramaSize, Crop);
+                FaceMask = Remap->GetFaceMask();
+                return Remap;
+            },
+            Faces,
+            ReferencePixels,
+            Iterations);
+        LogResult(
+            FString::Printf(TEXT("Equirect crop %d/%d faces 0x%02x"), Crop.X, Crop.Y, FaceMask),
+            Size,
+            Result);
+    }
+
+    // Slices like the ones of the Pitts and Tokyo datasets
+    for (const auto& Rotation :
+         {FRotator(0., 0., 0.), FRotator(4., 30., 0.), FRotator(30., 0., 0.), FRotator(-45., 135., 0.)})
+    {
+        FMTCubemapSlice Slice;
+        Slice.Rotation = Rotation;
+        Slice.FOVAngle = 60.;
+        Slice.Size = {640, 480};
+
+        const auto TanHalfFOV = FMath::Tan(FMath::DegreesToRadians(Slice.FOVAngle) / 2.);
+        const auto ReferencePixels = RenderScene(
+            Slice.Size,
+            [&Slice, TanHalfFOV](const int32 X, const int32 Y)
+            {
+                const auto ScreenX = 2. * (X + 0.5) / Slice.Size.X - 1.;
+                const auto ScreenY = 1. - 2. * (Y + 0.5) / Slice.Size.Y;
+                return Slice.Rotation.RotateVector(
+                    FVector(1., ScreenX * TanHalfFOV, ScreenY * TanHalfFOV * Slice.Size.Y / Slice.Size.X));
+            });
+
+        const auto Result = RunRemap(
+            [FaceSize, &Slice]
+            {
+                return FMTCubemapRemap::GetPerspective(FaceSize, Slice);
+            },
+            Faces,
+            ReferencePixels,
+            Iterations);
+        LogResult(FString::Printf(TEXT("Perspective %s"), *Rotation.ToCompactString()), Slice.Size, Result);
+    }
+
+    return bHasFailed ? 1 : 0;
+}
+
+int32 UMTCubemapRemapBenchmarkCommandlet::RunReferenceBenchmark(
+    const FString& FacesDir,
+    const FString& ReferencePath,
+    const FIntVector2& TopAndBottomCrop,
+    const double MinPSNR)
+{
+    TArray<FColor> Faces;
+    int32 FaceSize = 0;
+    for (int32 Face = 0; Face < CubeFace_MAX; ++Face)
+    {
+        FImage FaceImage;
+        if (!LoadImage(FPaths::Combine(FacesDir, FString(FaceNames[Face]) + TEXT(".png")), FaceImage))
+        {
+            return 1;
+        }
+
+        if (Face == 0)
+        {
+            FaceSize = FaceImage.SizeX;
+        }
+        if (FaceImage.SizeX != FaceSize || FaceImage.SizeY != FaceSize)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Face %s is not %dx%d"), FaceNames[Face], FaceSize, FaceSize);
+            return 1;
+        }
+        Faces.Append(GetPixels(FaceImage));
+    }
+
+    FImage Reference;
+    if (!LoadImage(ReferencePath, Reference))
+    {
+        return 1;
+    }
+
+    // Either the full unwrap or the already cropped panorama
+    const FIntVector2 PanoramaSize = {FaceSize * 2, FaceSize};
+    const auto CroppedHeight = PanoramaSize.Y - TopAndBottomCrop.X - TopAndBottomCrop.Y;
+    auto ReferencePixels = GetPixels(Reference);
+    if (Reference.SizeX != PanoramaSize.X || (Reference.SizeY != PanoramaSize.Y && Reference.SizeY != CroppedHeight))
+    {
+        UE_LOG(
+            LogTemp,
+            Error,
+            TEXT("Reference is %dx%d, expected %dx%d or %dx%d"),
+            Reference.SizeX,
+            Reference.SizeY,
+            PanoramaSize.X,
+            PanoramaSize.Y,
+            PanoramaSize.X,
+            CroppedHeight);
+        return 1;
+    }
+    if (Reference.SizeY == PanoramaSize.Y)
+    {
+        ReferencePixels = ReferencePixels.Slice(TopAndBottomCrop.X * PanoramaSize.X, CroppedHeight * PanoramaSize.X);
+    }
+
+    const auto Remap = FMTCubemapRemap::GetEquirect(FaceSize, PanoramaSize, TopAndBottomCrop);
+    TArray<FColor> Pixels;
+    Remap->Apply(Faces, Pixels);
+
+    const auto ReferencePSNR = PSNR(Pixels, ReferencePixels);
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("%s PSNR %.2f dB against %s, faces 0x%02x%s"),
+        *FacesDir,
+        ReferencePSNR,
+        *ReferencePath,
+        Remap->GetFaceMask(),
+        ReferencePSNR < MinPSNR ? TEXT(" FAILED") : TEXT(""));
+    return ReferencePSNR < MinPSNR ? 1 : 0;
+}
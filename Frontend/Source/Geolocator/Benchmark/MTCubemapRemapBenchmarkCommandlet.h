@@ -0,0 +1,40 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "CoreMinimal.h"
+
+#include "MTCubemapRemapBenchmarkCommandlet.generated.h"
+
+/**
+ * Checks the CPU cube remaps against an analytic scene and reference images without a GPU and
+ * reports table build and unwrap speed
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTCubemapRemapBenchmark
+ *     [-FaceSize=1664] [-TopCrop=512] [-BottomCrop=640] [-Iterations=8] [-MinPSNR=40]
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTCubemapRemapBenchmark -Faces=<dir with PosX.png .. NegZ.png>
+ *     -Reference=<long lat unwrap of the same cube> [-TopCrop=512] [-BottomCrop=640] [-MinPSNR=40]
+ */
+UCLASS()
+class GEOLOCATOR_API UMTCubemapRemapBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UMTCubemapRemapBenchmarkCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+
+private:
+    int32 RunSyntheticBenchmark(
+        const int32 FaceSize,
+        const FIntVector2& TopAndBottomCrop,
+        const int32 Iterations,
+        const double MinPSNR);
+
+    int32 RunReferenceBenchmark(
+        const FString& FacesDir,
+        const FString& ReferencePath,
+        const FIntVector2& TopAndBottomCrop,
+        const double MinPSNR);
+};
@@ -0,0 +1,299 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTImageEncoderBenchmarkCommandlet.h"
+
+#include "Geolocator/Sampler/MTFrameStatistics.h"
+#include "Geolocator/Sampler/MTImageEncoder.h"
+#include "Geolocator/Sampler/MTImagePyramid.h"
+#include "Geolocator/Sampler/MTPerceptualHash.h"
+#include "IImageWrapperModule.h"
+
+namespace
+{
+    TArray<FImage> LoadFrames(const FString& FramesDir, const int32 MaxFrames)
+    {
+        TArray<FString> FrameFileNames;
+        for (const auto* Extension : {TEXT("jpg"), TEXT("png")})
+        {
+            TArray<FString> ExtensionFileNames;
+            IFileManager::Get().FindFiles(ExtensionFileNames, *FramesDir, Extension);
+            FrameFileNames.Append(ExtensionFileNames);
+        }
+        FrameFileNames.Sort();
+        FrameFileNames.SetNum(FMath::Min(FrameFileNames.Num(), MaxFrames));
+
+        auto& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+
+        TArray<FImage> Frames;
+        for (const auto& FrameFileName : FrameFileNames)
+        {
+            TArray64<uint8> FrameData;
+            FImage Frame;
+            if (!FFileHelper::LoadFileToArray(FrameData, *FPaths::Combine(FramesDir, FrameFileName)) ||
+                !ImageWrapperModule.DecompressImage(FrameData.GetData(), FrameData.Num(), Frame))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Skipping unreadable frame %s"), *FrameFileName);
+                continue;
+            }
+
+            // Same layout the sampler hands to the encoders
+            Frame.ChangeFormat(ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+            Frames.Add(MoveTemp(Frame));
+        }
+        return Frames;
+    }
+
+    struct FEncoderRunResult
+    {
+        double Seconds = 0.;
+
+        int64 EncodedSize = 0;
+
+        bool bHasFailed = false;
+    };
+
+    FEncoderRunResult RunEncoder(const IMTImageEncoder& Encoder, const TArray<FImage>& Frames, const bool bParallel)
+    {
+        TArray<int64> EncodedSizes;
+        EncodedSizes.SetNumZeroed(Frames.Num());
+
+        const auto StartTime = FPlatformTime::Seconds();
+        ParallelFor(
+            Frames.Num(),
+            [&Encoder, &Frames, &EncodedSizes](const int32 FrameIndex)
+            {
+                TArray64<uint8> EncodedData;
+                EncodedSizes[FrameIndex] = Encoder.Encode(Frames[FrameIndex], EncodedData) ? EncodedData.Num() : INDEX_NONE;
+            },
+            bParallel ? EParallelForFlags::Unbalanced : EParallelForFlags::ForceSingleThread);
+
+        FEncoderRunResult Result;
+        Result.Seconds = FPlatformTime::Seconds() - StartTime;
+        for (const auto EncodedSize : EncodedSizes)
+        {
+            Result.bHasFailed |= EncodedSize == INDEX_NONE;
+            Result.EncodedSize += FMath::Max<int64>(EncodedSize, 0);
+        }
+        return Result;
+    }
+}  // namespace
+
+UMTImageEncoderBenchmarkCommandlet::UMTImageEncoderBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UMTImageEncoderBenchmarkCommandlet::Main(const FString& Params)
+{
+    FString FramesDir;
+    if (!FParse::Value(*Params, TEXT("Frames="), FramesDir))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Missing -Frames=<directory of captured frames>"));
+        return 1;
+    }
+
+    int32 MaxFrames = 32;
+    FParse::Value(*Params, TEXT("MaxFrames="), MaxFrames);
+
+    int32 Quality = 85;
+    FParse::Value(*Params, TEXT("Quality="), Quality);
+
+    const auto Frames = LoadFrames(FramesDir, MaxFrames);
+    if (Frames.IsEmpty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("No frames in %s"), *FramesDir);
+        return 1;
+    }
+
+    double MegaPixels = 0.;
+    int64 RawSize = 0;
+    for (const auto& Frame : Frames)
+    {
+        MegaPixels += Frame.GetNumPixels() / 1e6;
+        RawSize += Frame.RawData.Num();
+    }
+
+    const auto WorkerNum = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("%d frames, %.1f megapixels, %d threads"),
+        Frames.Num(),
+        MegaPixels,
+        WorkerNum);
+
+    TArray<FMTImageEncoderSettings> EncoderSettings;
+    EncoderSettings.Add({EMTImageEncoder::ImageWrapperJPEG, Quality});
+    EncoderSettings.Add({EMTImageEncoder::TurboJPEG, Quality, EMTChromaSubsampling::Yuv420, false});
+    EncoderSettings.Add({EMTImageEncoder::TurboJPEG, Quality, EMTChromaSubsampling::Yuv420, true});
+    EncoderSettings.Add({EMTImageEncoder::TurboJPEG, Quality, EMTChromaSubsampling::Yuv444, false});
+    EncoderSettings.Add({EMTImageEncoder::PNG});
+
+    auto bHasFailed = false;
+    for (const auto& Settings : EncoderSettings)
+    {
+        const auto Encoder = IMTImageEncoder::Create(Settings);
+
+        // Single threaded run is the per core throughput, the parallel run shows how it scales
+        const auto SingleThreadResult = RunEncoder(*Encoder, Frames, false);
+        const auto ParallelResult = RunEncoder(*Encoder, Frames, true);
+        bHasFailed |= SingleThreadResult.bHasFailed || ParallelResult.bHasFailed;
+
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("%-32s %8.2f MP/s per core %8.2f MP/s on %d threads %10.1f KiB per frame %6.2f%% of raw%s"),
+            *Encoder->GetName(),
+            MegaPixels / SingleThreadResult.Seconds,
+            MegaPixels / ParallelResult.Seconds,
+            WorkerNum,
+            SingleThreadResult.EncodedSize / 1024. / Frames.Num(),
+            100. * SingleThreadResult.EncodedSize / RawSize,
+            SingleThreadResult.bHasFailed || ParallelResult.bHasFailed ? TEXT(" FAILED") : TEXT(""));
+    }
+
+    // Pyramid levels against the engine resize the sampler used to be rerun for
+    for (const auto ShortSide : {512, 128})
+    {
+        auto StartTime = FPlatformTime::Seconds();
+        TArray<FColor> LevelPixels;
+        for (const auto& Frame : Frames)
+        {
+            const FIntVector2 Size = {Frame.SizeX, Frame.SizeY};
+            FMTImagePyramid::Downsample(
+                reinterpret_cast<const FColor*>(Frame.RawData.GetData()),
+                Size,
+                FMTImagePyramid::GetLevelSize(Size, ShortSide),
+                LevelPixels);
+        }
+        const auto PyramidSeconds = FPlatformTime::Seconds() - StartTime;
+
+        StartTime = FPlatformTime::Seconds();
+        FImage Level;
+        for (const auto& Frame : Frames)
+        {
+            const auto LevelSize = FMTImagePyramid::GetLevelSize({Frame.SizeX, Frame.SizeY}, ShortSide);
+            Frame.ResizeTo(Level, LevelSize.X, LevelSize.Y, ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+        }
+        const auto ResizeSeconds = FPlatformTime::Seconds() - StartTime;
+
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Pyramid level %4d %8.2f MP/s per core, FImage::ResizeTo %8.2f MP/s per core"),
+            ShortSide,
+            MegaPixels / PyramidSeconds,
+            MegaPixels / ResizeSeconds);
+    }
+
+    // Frame scores of the captures and of frames that have to be rejected
+    {
+        constexpr auto MinEdgeEnergy = 0.01F;
+        const auto StartTime = FPlatformTime::Seconds();
+        auto MaxScore = 0.F;
+        auto ScoreSum = 0.F;
+        for (const auto& Frame : Frames)
+        {
+            const auto Score = FMTFrameStatistics::Compute(
+                                   reinterpret_cast<const FColor*>(Frame.RawData.GetData()),
+                                   {Frame.SizeX, Frame.SizeY},
+                                   FColor::Black)
+                                   .GetArtifactScore(MinEdgeEnergy);
+            MaxScore = FMath::Max(MaxScore, Score);
+            ScoreSum += Score;
+        }
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Frame statistics %8.2f MP/s per core, artifact score mean %.3f max %.3f"),
+            MegaPixels / (FPlatformTime::Seconds() - StartTime),
+            ScoreSum / Frames.Num(),
+            MaxScore);
+
+        // Odd width, covers the pixels after the last full vector of a row
+        const FIntVector2 Size = {641, 480};
+        TArray<FColor> Pixels;
+        const auto ScorePixels = [&Pixels, &Size, MinEdgeEnergy]
+        {
+            return FMTFrameStatistics::Compute(Pixels.GetData(), Size, FColor::Black).GetArtifactScore(MinEdgeEnergy);
+        };
+
+        Pixels.Init(FColor::Black, Size.X * Size.Y);
+        const auto BlackScore = ScorePixels();
+
+        Pixels.Init(FColor(128, 128, 128), Size.X * Size.Y);
+        const auto GreyScore = ScorePixels();
+
+        FRandomStream RandomStream(0);
+        for (auto& Pixel : Pixels)
+        {
+            Pixel = FColor(
+                RandomStream.RandRange(0, 255), RandomStream.RandRange(0, 255), RandomStream.RandRange(0, 255));
+        }
+        const auto NoiseScore = ScorePixels();
+
+        const auto bHasScoringFailed = BlackScore < 0.99F || GreyScore < 0.99F || NoiseScore > 0.1F;
+        bHasFailed |= bHasScoringFailed;
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Artifact score black %.3f grey %.3f noise %.3f%s"),
+            BlackScore,
+            GreyScore,
+            NoiseScore,
+            bHasScoringFailed ? TEXT(" FAILED") : TEXT(""));
+    }
+
+    // Hashes of the captures, a slightly brighter copy has to stay within the duplicate distance
+    {
+        const auto StartTime = FPlatformTime::Seconds();
+        TArray<uint64> Hashes;
+        for (const auto& Frame : Frames)
+        {
+            Hashes.Add(FMTPerceptualHash::Compute(
+                reinterpret_cast<const FColor*>(Frame.RawData.GetData()), {Frame.SizeX, Frame.SizeY}));
+        }
+        const auto HashSeconds = FPlatformTime::Seconds() - StartTime;
+
+        auto NeighbourDistanceSum = 0;
+        for (auto HashIndex = 1; HashIndex < Hashes.Num(); HashIndex++)
+        {
+            NeighbourDistanceSum += FMTPerceptualHash::GetDistance(Hashes[HashIndex - 1], Hashes[HashIndex]);
+        }
+
+        const auto& Frame = Frames[0];
+        const FIntVector2 Size = {Frame.SizeX, Frame.SizeY};
+        TArray<FColor> Brighter(reinterpret_cast<const FColor*>(Frame.RawData.GetData()), Size.X * Size.Y);
+        for (auto& Pixel : Brighter)
+        {
+            Pixel = FColor(FMath::Min(Pixel.R + 6, 255), FMath::Min(Pixel.G + 6, 255), FMath::Min(Pixel.B + 6, 255));
+        }
+        const auto BrighterHash = FMTPerceptualHash::Compute(Brighter.GetData(), Size);
+        const auto BrighterDistance = FMTPerceptualHash::GetDistance(Hashes[0], BrighterHash);
+
+        // Found near the first sample, missed far away
+        constexpr auto MaxDistance = 4;
+        constexpr auto Radius = 2000.;
+        FMTPerceptualHashIndex Index(16);
+        Index.FindOrAdd(Hashes[0], FVector::ZeroVector, 1, MaxDistance, Radius);
+        const auto NearMatch = Index.FindOrAdd(BrighterHash, {500., 0., 0.}, 2, MaxDistance, Radius);
+        const auto FarMatch = Index.FindOrAdd(BrighterHash, {1e6, 0., 0.}, 3, MaxDistance, Radius);
+
+        const auto bHasHashingFailed =
+            BrighterDistance > MaxDistance || NearMatch.Get(0) != 1 || FarMatch.IsSet() || Index.Num() != 2;
+        bHasFailed |= bHasHashingFailed;
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Perceptual hash %8.2f MP/s per core, neighbour distance mean %.1f, brighter copy %d bits%s"),
+            MegaPixels / HashSeconds,
+            Hashes.Num() > 1 ? static_cast<double>(NeighbourDistanceSum) / (Hashes.Num() - 1) : 0.,
+            BrighterDistance,
+            bHasHashingFailed ? TEXT(" FAILED") : TEXT(""));
+    }
+
+    return bHasFailed ? 1 : 0;
+}
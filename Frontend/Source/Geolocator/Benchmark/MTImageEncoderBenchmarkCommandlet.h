@@ -0,0 +1,25 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "CoreMinimal.h"
+
+#include "MTImageEncoderBenchmarkCommandlet.generated.h"
+
+/**
+ * Headless image encoder, pyramid level, frame statistics and perceptual hash benchmarks on previously
+ * captured frames
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTImageEncoderBenchmark -Frames=<Images dir of a session>
+ *     [-MaxFrames=32] [-Quality=85]
+ */
+UCLASS()
+class GEOLOCATOR_API UMTImageEncoderBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UMTImageEncoderBenchmarkCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+};
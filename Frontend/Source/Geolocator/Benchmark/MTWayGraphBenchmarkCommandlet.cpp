@@ -0,0 +1,1004 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTWayGraphBenchmarkCommandlet.h"
+
+#include "Geolocator/OSM/MTOSMPBFReader.h"
+#include "Geolocator/OSM/MTOverpassConverter.h"
+#include "Geolocator/OSM/MTOverpassStreamingParser.h"
+#include "Geolocator/Sampler/MTSampleSpatialHash.h"
+#include "Geolocator/Sampler/MTWayGraphSamplerComponent.h"
+#include "Geolocator/WayGraph/MTCompactWayGraph.h"
+#include "Geolocator/WayGraph/MTContractionHierarchy.h"
+#include "JsonObjectConverter.h"
+#include "MTWayGraphSynthetic.h"
+
+namespace
+{
+    struct FStorageQueryResult
+    {
+        double NeighbourIterationSeconds = 0.;
+        double ConnectivitySeconds = 0.;
+        double EdgeWaySeconds = 0.;
+        double LocationSeconds = 0.;
+
+        // Accumulated query results, used to verify both layouts answer identically
+        int64 NeighbourSum = 0;
+        int64 ConnectedCount = 0;
+        int64 EdgeWaySum = 0;
+        double LocationSum = 0.;
+    };
+
+    template <typename GraphType>
+    FStorageQueryResult MeasureStorageQueries(
+        const GraphType& Graph,
+        const TArray<TPair<int32, int32>>& ConnectivityQueries)
+    {
+        FStorageQueryResult Result;
+
+        auto StartTime = FPlatformTime::Seconds();
+        for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+        {
+            for (const auto Neighbour : Graph.ViewNodesConnectedToNode(NodeIndex))
+            {
+                Result.NeighbourSum += Neighbour;
+            }
+        }
+        Result.NeighbourIterationSeconds = FPlatformTime::Seconds() - StartTime;
+
+        StartTime = FPlatformTime::Seconds();
+        for (const auto& Query : ConnectivityQueries)
+        {
+            Result.ConnectedCount += Graph.AreNodesConnected(Query.Key, Query.Value) ? 1 : 0;
+        }
+        Result.ConnectivitySeconds = FPlatformTime::Seconds() - StartTime;
+
+        StartTime = FPlatformTime::Seconds();
+        for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+        {
+            for (const auto Neighbour : Graph.ViewNodesConnectedToNode(NodeIndex))
+            {
+                if (Neighbour > NodeIndex)
+                {
+                    Result.EdgeWaySum +=
+                        Graph.GetEdgeWay(Graph.NodePairToEdgeIndex(NodeIndex, Neighbour));
+                }
+            }
+        }
+        Result.EdgeWaySeconds = FPlatformTime::Seconds() - StartTime;
+
+        StartTime = FPlatformTime::Seconds();
+        for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+        {
+            const auto Location = Graph.GetNodeLocation(NodeIndex);
+            Result.LocationSum += Location.Lat + Location.Lon;
+        }
+        Result.LocationSeconds = FPlatformTime::Seconds() - StartTime;
+
+        return Result;
+    }
+
+    void LogStorageQueryResult(const TCHAR* Layout, const FStorageQueryResult& Result)
+    {
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("%s: neighbours %.2f ms, connectivity %.2f ms, edge ways %.2f ms, locations %.2f "
+                 "ms"),
+            Layout,
+            Result.NeighbourIterationSeconds * 1000.,
+            Result.ConnectivitySeconds * 1000.,
+            Result.EdgeWaySeconds * 1000.,
+            Result.LocationSeconds * 1000.);
+    }
+
+    void LogPhase(const FString& Name, const TCHAR* Phase, const double Seconds)
+    {
+        const auto MemoryStats = FPlatformMemory::GetStats();
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("%s %-12s %10.2f ms, used %8.2f MiB, peak %8.2f MiB"),
+            *Name,
+            Phase,
+            Seconds * 1000.,
+            MemoryStats.UsedPhysical / (1024. * 1024.),
+            MemoryStats.PeakUsedPhysical / (1024. * 1024.));
+    }
+
+    // Reference distances for validating the contraction hierarchy
+    double FindShortestDistanceDijkstra(
+        const FMTWayGraph& Graph,
+        const int32 StartNode,
+        const int32 EndNode,
+        TArray<double>& DistanceCache)
+    {
+        DistanceCache.Init(DBL_MAX, Graph.NodeNum());
+        DistanceCache[StartNode] = 0.;
+
+        using FHeapEntry = TPair<double, int32>;
+        const auto HeapPredicate = [](const FHeapEntry& A, const FHeapEntry& B)
+        { return A.Key < B.Key; };
+
+        TArray<FHeapEntry> Heap;
+        Heap.HeapPush({0., StartNode}, HeapPredicate);
+        while (!Heap.IsEmpty())
+        {
+            FHeapEntry Top;
+            Heap.HeapPop(Top, HeapPredicate, false);
+            if (Top.Value == EndNode)
+            {
+                return Top.Key;
+            }
+            if (Top.Key > DistanceCache[Top.Value])
+            {
+                continue;
+            }
+
+            for (const auto ConnectedNode : Graph.ViewNodesConnectedToNode(Top.Value))
+            {
+                const auto Distance =
+                    Top.Key + Graph.GetEdgeLength(Top.Value, ConnectedNode, nullptr);
+                if (Distance < DistanceCache[ConnectedNode])
+                {
+                    DistanceCache[ConnectedNode] = Distance;
+                    Heap.HeapPush({Distance, ConnectedNode}, HeapPredicate);
+                }
+            }
+        }
+        return DBL_MAX;
+    }
+
+    struct FBenchmarkSample
+    {
+        FVector Location;
+        int32 WayIndex;
+    };
+
+    // Samples along random straight streets, like the sampler produces them
+    TArray<FBenchmarkSample> GenerateBenchmarkSamples(
+        const int32 SampleCount,
+        const double SampleDistance,
+        const int32 Seed)
+    {
+        FRandomStream Random(Seed);
+        TArray<FBenchmarkSample> Samples;
+        Samples.Reserve(SampleCount);
+
+        // Roughly ten samples per street, streets overlap so that deduplication has work to do
+        const auto Extent = FMath::Sqrt(static_cast<double>(SampleCount)) * SampleDistance;
+        int32 WayIndex = 0;
+        while (Samples.Num() < SampleCount)
+        {
+            const FVector Start(Random.FRandRange(0., Extent), Random.FRandRange(0., Extent), 0.);
+            const auto Direction = FRotator(0., Random.FRandRange(0., 360.), 0.).Vector();
+            const auto StreetSampleNum = FMath::Min(Random.RandRange(2, 20), SampleCount - Samples.Num());
+            for (int32 StreetSampleIndex = 0; StreetSampleIndex < StreetSampleNum; ++StreetSampleIndex)
+            {
+                Samples.Add({Start + Direction * SampleDistance * StreetSampleIndex, WayIndex});
+            }
+            WayIndex++;
+        }
+        return Samples;
+    }
+}  // namespace
+
+UMTWayGraphBenchmarkCommandlet::UMTWayGraphBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::Main(const FString& Params)
+{
+    FString Mode = TEXT("Storage");
+    FParse::Value(*Params, TEXT("Mode="), Mode);
+
+    if (Mode == TEXT("Synthetic"))
+    {
+        FString Generator = TEXT("All");
+        FParse::Value(*Params, TEXT("Generator="), Generator);
+        int32 Size = 100;
+        FParse::Value(*Params, TEXT("Size="), Size);
+        int32 Seed = 0;
+        FParse::Value(*Params, TEXT("Seed="), Seed);
+
+        return RunSyntheticBenchmark(
+            Generator, Size, Seed, FParse::Param(*Params, TEXT("ContractionHierarchy")));
+    }
+
+    if (Mode == TEXT("PBF"))
+    {
+        FString PBFFilePath;
+        if (!FParse::Value(*Params, TEXT("PBF="), PBFFilePath))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Missing -PBF=<extract.osm.pbf>"));
+            return 1;
+        }
+
+        return RunPBFBenchmark(PBFFilePath);
+    }
+
+    if (Mode == TEXT("PBFCheck"))
+    {
+        FString PBFFilePath = FPaths::Combine(
+            FPaths::GameSourceDir(), TEXT("Geolocator/Benchmark/TestData/MTPBFCheck.osm.pbf"));
+        FParse::Value(*Params, TEXT("PBF="), PBFFilePath);
+
+        return RunPBFCheck(PBFFilePath);
+    }
+
+    if (Mode == TEXT("SpatialHash"))
+    {
+        int32 SampleCount = 1000000;
+        FParse::Value(*Params, TEXT("Samples="), SampleCount);
+        int32 Seed = 0;
+        FParse::Value(*Params, TEXT("Seed="), Seed);
+
+        return RunSpatialHashBenchmark(SampleCount, Seed);
+    }
+
+    if (Mode != TEXT("Storage"))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Unknown benchmark mode %s"), *Mode);
+        return 1;
+    }
+
+    int32 QueryCount = 1000000;
+    FParse::Value(*Params, TEXT("Queries="), QueryCount);
+
+    FString StreetDataFilePath;
+    if (!FParse::Value(*Params, TEXT("StreetData="), StreetDataFilePath))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Missing -StreetData=<StreetDataCache.json>"));
+        return 1;
+    }
+
+    // Same loading as the sampler, older caches need their edge indices migrated
+    FMTStreetData StreetData;
+    if (!FMTStreetData::LoadCache(StreetDataFilePath, StreetData))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load %s"), *StreetDataFilePath);
+        return 1;
+    }
+
+    return RunStorageBenchmark(StreetData.Graph, QueryCount);
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunStorageBenchmark(
+    const FMTWayGraph& Graph,
+    const int32 QueryCount)
+{
+    if (Graph.NodeNum() == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Way graph is empty"));
+        return 1;
+    }
+
+    const auto BuildStartTime = FPlatformTime::Seconds();
+    const FMTCompactWayGraph CompactGraph(Graph);
+    const auto BuildSeconds = FPlatformTime::Seconds() - BuildStartTime;
+
+    // Half of the queries hit existing edges, the other half random node pairs
+    FRandomStream QueryRandom(0);
+    TArray<TPair<int32, int32>> ConnectivityQueries;
+    ConnectivityQueries.Reserve(QueryCount);
+    for (int32 QueryIndex = 0; QueryIndex < QueryCount; ++QueryIndex)
+    {
+        const auto Node1 = QueryRandom.RandRange(0, Graph.NodeNum() - 1);
+        const auto Neighbours = Graph.ViewNodesConnectedToNode(Node1);
+        const auto Node2 = (QueryIndex % 2 == 0 && Neighbours.Num() > 0)
+                               ? Neighbours[QueryRandom.RandRange(0, Neighbours.Num() - 1)]
+                               : QueryRandom.RandRange(0, Graph.NodeNum() - 1);
+        ConnectivityQueries.Add({Node1, Node2});
+    }
+
+    const auto DefaultResult = MeasureStorageQueries(Graph, ConnectivityQueries);
+    const auto CompactResult = MeasureStorageQueries(CompactGraph, ConnectivityQueries);
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Nodes: %d, Edges: %d, Ways: %d"),
+        Graph.NodeNum(),
+        CompactGraph.EdgeNum(),
+        Graph.WayNum());
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Memory: default %.2f MiB, compact %.2f MiB (%.1fx), compact build %.2f ms"),
+        Graph.GetAllocatedSize() / (1024. * 1024.),
+        CompactGraph.GetAllocatedSize() / (1024. * 1024.),
+        static_cast<double>(Graph.GetAllocatedSize()) /
+            FMath::Max<SIZE_T>(CompactGraph.GetAllocatedSize(), 1),
+        BuildSeconds * 1000.);
+    LogStorageQueryResult(TEXT("Default"), DefaultResult);
+    LogStorageQueryResult(TEXT("Compact"), CompactResult);
+
+    // Fixed point coordinates round to 1e-7 degrees
+    const auto MaxLocationError = Graph.NodeNum() * 2 * 0.5 / FMTCompactCoordinates::Scale;
+    if (DefaultResult.NeighbourSum != CompactResult.NeighbourSum ||
+        DefaultResult.ConnectedCount != CompactResult.ConnectedCount ||
+        DefaultResult.EdgeWaySum != CompactResult.EdgeWaySum ||
+        FMath::Abs(DefaultResult.LocationSum - CompactResult.LocationSum) > MaxLocationError)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Compact way graph query results differ from default layout"));
+        return 1;
+    }
+
+    return 0;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunSyntheticBenchmark(
+    const FString& Generator,
+    const int32 Size,
+    const int32 Seed,
+    const bool bContractionHierarchy)
+{
+    const TPair<FString, TFunction<FOverPassQueryResult()>> Generators[] = {
+        {TEXT("Manhattan"),
+         [Size, Seed]() { return MTWayGraphSynthetic::GenerateManhattanGrid(Size, Size, 100., Seed); }},
+        {TEXT("Geometric"),
+         [Size, Seed]()
+         { return MTWayGraphSynthetic::GenerateRandomGeometricGraph(Size * Size, 4., Seed); }},
+        {TEXT("Radial"),
+         [Size, Seed]()
+         {
+             return MTWayGraphSynthetic::GenerateRadialCity(
+                 FMath::Max(Size / 2, 1), FMath::Max(Size * 2, 3), 100., Seed);
+         }}};
+
+    int32 Result = 0;
+    bool bHasRun = false;
+    for (const auto& [Name, Generate] : Generators)
+    {
+        if (Generator != TEXT("All") && Generator != Name)
+        {
+            continue;
+        }
+        bHasRun = true;
+
+        const auto StartTime = FPlatformTime::Seconds();
+        const auto Query = Generate();
+        LogPhase(Name, TEXT("Generate"), FPlatformTime::Seconds() - StartTime);
+
+        Result |= RunPipelineBenchmark(Name, Query, bContractionHierarchy);
+    }
+
+    if (!bHasRun)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Unknown generator %s"), *Generator);
+        return 1;
+    }
+
+    return Result;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunPipelineBenchmark(
+    const FString& Name,
+    const FOverPassQueryResult& Query,
+    const bool bContractionHierarchy)
+{
+    auto StartTime = FPlatformTime::Seconds();
+    const auto QueryJSONString = MTWayGraphSynthetic::ToOverpassJson(Query);
+    LogPhase(Name, TEXT("ToJson"), FPlatformTime::Seconds() - StartTime);
+
+    StartTime = FPlatformTime::Seconds();
+    FOverPassQueryResult ParsedQuery;
+    FJsonObjectConverter::JsonObjectStringToUStruct(QueryJSONString, &ParsedQuery);
+    LogPhase(Name, TEXT("ParseJson"), FPlatformTime::Seconds() - StartTime);
+
+    StartTime = FPlatformTime::Seconds();
+    const auto Graph = MTOverpass::CreateStreetGraphFromQuery(ParsedQuery);
+    LogPhase(Name, TEXT("Conversion"), FPlatformTime::Seconds() - StartTime);
+
+    // Same response fed in download sized chunks through the streaming parser
+    const FTCHARToUTF8 QueryJSONUTF8(*QueryJSONString);
+    FMTWayGraph StreamedGraph;
+    bool bIsStreamComplete;
+    StartTime = FPlatformTime::Seconds();
+    {
+        FMTWayGraphBuilder Builder(StreamedGraph, {});
+        FMTOverpassStreamingParser Parser(Builder);
+        constexpr int32 ChunkSize = 64 * 1024;
+        for (int32 Offset = 0; Offset < QueryJSONUTF8.Length(); Offset += ChunkSize)
+        {
+            Parser.Feed(TConstArrayView<uint8>(
+                reinterpret_cast<const uint8*>(QueryJSONUTF8.Get()) + Offset,
+                FMath::Min(ChunkSize, QueryJSONUTF8.Length() - Offset)));
+        }
+        bIsStreamComplete = Parser.Finish();
+    }
+    LogPhase(Name, TEXT("ParseStream"), FPlatformTime::Seconds() - StartTime);
+
+    // Node indices may differ, edges are compared by their end locations and their way
+    const auto MakeEdgeKey =
+        [](FOverpassCoordinates Start, FOverpassCoordinates End, const FString& WayName, const EMTWay WayKind)
+    {
+        if (Start.Lat > End.Lat || (Start.Lat == End.Lat && Start.Lon > End.Lon))
+        {
+            Swap(Start, End);
+        }
+        return FString::Printf(
+            TEXT("%.7f,%.7f;%.7f,%.7f;%s;%d"),
+            Start.Lat,
+            Start.Lon,
+            End.Lat,
+            End.Lon,
+            *WayName,
+            static_cast<int32>(WayKind));
+    };
+
+    const auto CollectEdges = [&MakeEdgeKey](const FMTWayGraph& EdgeGraph)
+    {
+        TSet<FString> Edges;
+        for (int32 NodeIndex = 0; NodeIndex < EdgeGraph.NodeNum(); ++NodeIndex)
+        {
+            for (const auto ConnectedNode : EdgeGraph.ViewNodesConnectedToNode(NodeIndex))
+            {
+                const auto WayIndex =
+                    EdgeGraph.GetEdgeWay(EdgeGraph.NodePairToEdgeIndex(NodeIndex, ConnectedNode));
+                Edges.Add(MakeEdgeKey(
+                    EdgeGraph.GetNodeLocation(NodeIndex),
+                    EdgeGraph.GetNodeLocation(ConnectedNode),
+                    EdgeGraph.GetWayName(WayIndex),
+                    EdgeGraph.GetWayKind(WayIndex)));
+            }
+        }
+        return Edges;
+    };
+
+    // Expected edges straight from the query with the mapping of the original DOM converter: unknown
+    // highway values are Unclassified, a way name keeps the first kind that is not Unclassified
+    TSet<FString> QueryEdges;
+    {
+        const auto IsSkipped = [](const FOverpassElement& Element)
+        {
+            return Element.Nodes.Num() < 2 || Element.Tags.Contains(TEXT("tunnel")) ||
+                   Element.Tags.FindRef(TEXT("covered")) == TEXT("yes");
+        };
+
+        TMap<FString, EMTWay> WayKinds;
+        for (const auto& Element : ParsedQuery.Elements)
+        {
+            if (IsSkipped(Element))
+            {
+                continue;
+            }
+
+            const auto* Highway = Element.Tags.Find(TEXT("highway"));
+            const auto ParsedKind = Highway ? MTOverpass::WayStringToEnum(*Highway) : EMTWay::None;
+            const auto WayKind = ParsedKind != EMTWay::None ? ParsedKind : EMTWay::Unclassified;
+            auto& NameKind = WayKinds.FindOrAdd(Element.Tags.FindRef(TEXT("name")), WayKind);
+            if (NameKind == EMTWay::Unclassified)
+            {
+                NameKind = WayKind;
+            }
+        }
+
+        // The first way that contains a segment owns it
+        TSet<FString> Segments;
+        for (const auto& Element : ParsedQuery.Elements)
+        {
+            if (IsSkipped(Element))
+            {
+                continue;
+            }
+
+            const auto WayName = Element.Tags.FindRef(TEXT("name"));
+            for (int32 NodeIndex = 0; NodeIndex < Element.Geometry.Num() - 1; ++NodeIndex)
+            {
+                const auto& Start = Element.Geometry[NodeIndex];
+                const auto& End = Element.Geometry[NodeIndex + 1];
+                bool bIsAlreadyInSet;
+                Segments.Add(MakeEdgeKey(Start, End, FString(), EMTWay::None), &bIsAlreadyInSet);
+                if (!bIsAlreadyInSet && Element.Nodes[NodeIndex] != Element.Nodes[NodeIndex + 1])
+                {
+                    QueryEdges.Add(MakeEdgeKey(Start, End, WayName, WayKinds[WayName]));
+                }
+            }
+        }
+    }
+
+    const auto Edges = CollectEdges(Graph);
+    const auto StreamedEdges = CollectEdges(StreamedGraph);
+    const auto DifferentEdgeNum = FMath::Max(
+        StreamedEdges.Difference(QueryEdges).Num(), QueryEdges.Difference(StreamedEdges).Num());
+    if (!bIsStreamComplete || StreamedGraph.NodeNum() != Graph.NodeNum() ||
+        StreamedGraph.WayNum() != Graph.WayNum() || DifferentEdgeNum > 0 ||
+        Edges.Difference(StreamedEdges).Num() > 0 || StreamedEdges.Difference(Edges).Num() > 0)
+    {
+        UE_LOG(
+            LogTemp,
+            Error,
+            TEXT("%s: streamed graph differs from converted graph or query, %d of %d edges or their ways differ"),
+            *Name,
+            DifferentEdgeNum,
+            QueryEdges.Num());
+        return 1;
+    }
+
+    FMTChinesePostManStats Stats;
+    StartTime = FPlatformTime::Seconds();
+    const auto Paths = FMTChinesePostMan::CalculatePathsThatContainAllEdges(Graph, nullptr, nullptr, &Stats);
+    const auto PostManSeconds = FPlatformTime::Seconds() - StartTime;
+
+    LogPhase(Name, TEXT("Islands"), Stats.IslandSeconds);
+    LogPhase(Name, TEXT("Pairing"), Stats.PairingSeconds);
+    LogPhase(Name, TEXT("Matching"), Stats.MatchingSeconds);
+    LogPhase(Name, TEXT("Euler"), Stats.EulerSeconds);
+    LogPhase(Name, TEXT("PostMan"), PostManSeconds);
+
+    double PathLength = 0.;
+    for (const auto& Path : Paths)
+    {
+        for (int32 PathNodeIndex = 0; PathNodeIndex < Path.Nodes.Num() - 1; ++PathNodeIndex)
+        {
+            PathLength +=
+                Graph.GetEdgeLength(Path.Nodes[PathNodeIndex], Path.Nodes[PathNodeIndex + 1], nullptr);
+        }
+    }
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("%s: %.2f MiB JSON, %d nodes, %d ways, %d islands, %d odd nodes, %d paths"),
+        *Name,
+        QueryJSONString.Len() * sizeof(TCHAR) / (1024. * 1024.),
+        Graph.NodeNum(),
+        Graph.WayNum(),
+        Stats.IslandNum,
+        Stats.OddNodeNum,
+        Paths.Num());
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("%s: edges %.2f km, tour %.2f km, deadhead %.2f km (%.1f%%)"),
+        *Name,
+        Stats.EdgeLength / 100000.,
+        PathLength / 100000.,
+        Stats.DeadheadLength / 100000.,
+        Stats.DeadheadLength / FMath::Max(Stats.EdgeLength, 1.) * 100.);
+
+    // Every edge has to be traversed at least once
+    if (PathLength + 1. < Stats.EdgeLength)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s: tour is shorter than the sum of all edges"), *Name);
+        return 1;
+    }
+
+    if (bContractionHierarchy)
+    {
+        return RunContractionHierarchyBenchmark(Graph, 1000);
+    }
+
+    return 0;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunPBFBenchmark(const FString& FilePath)
+{
+    const auto Name = FPaths::GetCleanFilename(FilePath);
+
+    FMTWayGraph Graph;
+    auto StartTime = FPlatformTime::Seconds();
+    {
+        FMTWayGraphBuilder Builder(Graph, {});
+        if (!MTOSMPBF::ReadStreetGraph(FilePath, Builder))
+        {
+            return 1;
+        }
+    }
+    LogPhase(Name, TEXT("ReadPBF"), FPlatformTime::Seconds() - StartTime);
+
+    FMTChinesePostManStats Stats;
+    StartTime = FPlatformTime::Seconds();
+    const auto Paths = FMTChinesePostMan::CalculatePathsThatContainAllEdges(Graph, nullptr, nullptr, &Stats);
+    LogPhase(Name, TEXT("PostMan"), FPlatformTime::Seconds() - StartTime);
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("%s: %d nodes, %d ways, %d islands, %d paths, deadhead %.1f%%"),
+        *Name,
+        Graph.NodeNum(),
+        Graph.WayNum(),
+        Stats.IslandNum,
+        Paths.Num(),
+        Stats.DeadheadLength / FMath::Max(Stats.EdgeLength, 1.) * 100.);
+
+    return Graph.NodeNum() > 0 ? 0 : 1;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunPBFCheck(const FString& FilePath)
+{
+    const auto Name = FPaths::GetCleanFilename(FilePath);
+
+    FMTWayGraph Graph;
+    {
+        FMTWayGraphBuilder Builder(Graph, {});
+        if (!MTOSMPBF::ReadStreetGraph(FilePath, Builder))
+        {
+            return 1;
+        }
+    }
+
+    int32 ErrorNum = 0;
+    const auto Check = [&Name, &ErrorNum](const bool bCondition, const TCHAR* Description)
+    {
+        if (!bCondition)
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s: %s"), *Name, Description);
+            ErrorNum++;
+        }
+    };
+
+    int32 UndirectedEdgeNum = 0;
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        UndirectedEdgeNum += Graph.ViewNodesConnectedToNode(NodeIndex).Num();
+    }
+    UndirectedEdgeNum /= 2;
+
+    // See Backend/Scripts/write_pbf_check_extract.py for the content of the extract
+    Check(Graph.NodeNum() == 7, TEXT("expected 7 nodes"));
+    Check(UndirectedEdgeNum == 7, TEXT("expected 7 edges"));
+    Check(Graph.WayNum() == 5, TEXT("expected 5 ways"));
+
+    const auto AreOSMNodesConnected = [&Graph](const int64 OSMID1, const int64 OSMID2)
+    {
+        const auto Node1 = Graph.FindNodeByOSMID(OSMID1);
+        const auto Node2 = Graph.FindNodeByOSMID(OSMID2);
+        return Node1 != INDEX_NONE && Node2 != INDEX_NONE && Graph.AreNodesConnected(Node1, Node2);
+    };
+
+    const auto IsEdgeOfWay = [&Graph, &AreOSMNodesConnected](
+                                 const int64 OSMID1,
+                                 const int64 OSMID2,
+                                 const TCHAR* WayName,
+                                 const EMTWay WayKind)
+    {
+        if (!AreOSMNodesConnected(OSMID1, OSMID2))
+        {
+            return false;
+        }
+        const auto WayIndex = Graph.GetEdgeWay(
+            Graph.NodePairToEdgeIndex(Graph.FindNodeByOSMID(OSMID1), Graph.FindNodeByOSMID(OSMID2)));
+        return Graph.GetWayName(WayIndex) == WayName && Graph.GetWayKind(WayIndex) == WayKind;
+    };
+
+    Check(IsEdgeOfWay(1, 2, TEXT("Alpha Street"), EMTWay::Residential), TEXT("missing edge 1-2"));
+    Check(IsEdgeOfWay(2, 3, TEXT("Alpha Street"), EMTWay::Residential), TEXT("missing edge 2-3"));
+    Check(IsEdgeOfWay(4, 5, TEXT("Beta Avenue"), EMTWay::Primary), TEXT("missing edge 4-5"));
+    Check(IsEdgeOfWay(5, 6, TEXT("Beta Avenue"), EMTWay::Primary), TEXT("missing edge 5-6"));
+    Check(IsEdgeOfWay(2, 5, TEXT(""), EMTWay::Service), TEXT("missing unnamed edge 2-5"));
+    Check(IsEdgeOfWay(6, 10, TEXT("Gamma Lane"), EMTWay::Residential), TEXT("missing edge to the plain node"));
+    Check(IsEdgeOfWay(1, 4, TEXT("Open Passage"), EMTWay::Footway), TEXT("covered=no way was filtered"));
+
+    Check(!AreOSMNodesConnected(3, 6), TEXT("tunnel way was not filtered"));
+    Check(Graph.FindNodeByOSMID(7) == INDEX_NONE, TEXT("unknown highway way was not filtered"));
+    Check(Graph.FindNodeByOSMID(9) == INDEX_NONE, TEXT("way without highway was not filtered"));
+    Check(Graph.FindNodeByOSMID(11) == INDEX_NONE, TEXT("node missing from the extract was added"));
+
+    const auto PlainNode = Graph.FindNodeByOSMID(10);
+    Check(
+        PlainNode != INDEX_NONE && FMath::IsNearlyEqual(Graph.GetNodeLocation(PlainNode).Lat, 52.502, 1e-7) &&
+            FMath::IsNearlyEqual(Graph.GetNodeLocation(PlainNode).Lon, 13.402, 1e-7),
+        TEXT("wrong location of the plain node"));
+    const auto DenseNode = Graph.FindNodeByOSMID(5);
+    Check(
+        DenseNode != INDEX_NONE && FMath::IsNearlyEqual(Graph.GetNodeLocation(DenseNode).Lat, 52.501, 1e-7) &&
+            FMath::IsNearlyEqual(Graph.GetNodeLocation(DenseNode).Lon, 13.401, 1e-7),
+        TEXT("wrong location of a dense node"));
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("%s: %d nodes, %d edges, %d ways, %d failed checks"),
+        *Name,
+        Graph.NodeNum(),
+        UndirectedEdgeNum,
+        Graph.WayNum(),
+        ErrorNum);
+
+    return ErrorNum > 0 ? 1 : 0;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunContractionHierarchyBenchmark(
+    const FMTWayGraph& Graph,
+    const int32 QueryCount)
+{
+    if (Graph.NodeNum() == 0)
+    {
+        return 0;
+    }
+
+    auto StartTime = FPlatformTime::Seconds();
+    const auto Hierarchy = FMTContractionHierarchy::Build(Graph, nullptr);
+    const auto BuildSeconds = FPlatformTime::Seconds() - StartTime;
+
+    FRandomStream QueryRandom(0);
+    TArray<TPair<int32, int32>> Queries;
+    Queries.Reserve(QueryCount);
+    for (int32 QueryIndex = 0; QueryIndex < QueryCount; ++QueryIndex)
+    {
+        Queries.Add(
+            {QueryRandom.RandRange(0, Graph.NodeNum() - 1),
+             QueryRandom.RandRange(0, Graph.NodeNum() - 1)});
+    }
+
+    TArray<double> HierarchyDistances;
+    HierarchyDistances.Reserve(QueryCount);
+    StartTime = FPlatformTime::Seconds();
+    for (const auto& Query : Queries)
+    {
+        HierarchyDistances.Add(Hierarchy.FindShortestPath(Query.Key, Query.Value).Distance);
+    }
+    const auto HierarchySeconds = FPlatformTime::Seconds() - StartTime;
+
+    TArray<double> DijkstraDistances;
+    TArray<double> DistanceCache;
+    DijkstraDistances.Reserve(QueryCount);
+    StartTime = FPlatformTime::Seconds();
+    for (const auto& Query : Queries)
+    {
+        DijkstraDistances.Add(
+            FindShortestDistanceDijkstra(Graph, Query.Key, Query.Value, DistanceCache));
+    }
+    const auto DijkstraSeconds = FPlatformTime::Seconds() - StartTime;
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Contraction hierarchy: build %.2f ms, %d shortcuts, query %.2f us, Dijkstra %.2f us"),
+        BuildSeconds * 1000.,
+        Hierarchy.ShortcutNum(),
+        HierarchySeconds * 1000000. / QueryCount,
+        DijkstraSeconds * 1000000. / QueryCount);
+
+    for (int32 QueryIndex = 0; QueryIndex < QueryCount; ++QueryIndex)
+    {
+        if (!FMath::IsNearlyEqual(
+                HierarchyDistances[QueryIndex], DijkstraDistances[QueryIndex], 1e-3))
+        {
+            UE_LOG(
+                LogTemp,
+                Error,
+                TEXT("Contraction hierarchy distance %f differs from Dijkstra %f for %d -> %d"),
+                HierarchyDistances[QueryIndex],
+                DijkstraDistances[QueryIndex],
+                Queries[QueryIndex].Key,
+                Queries[QueryIndex].Value);
+            return 1;
+        }
+    }
+
+    // Odd node pairing asks for all pairs of a node set at once
+    TArray<int32> PairingNodes;
+    for (int32 PairingIndex = 0; PairingIndex < FMath::Min(QueryCount, 200); ++PairingIndex)
+    {
+        PairingNodes.Add(QueryRandom.RandRange(0, Graph.NodeNum() - 1));
+    }
+
+    StartTime = FPlatformTime::Seconds();
+    const auto ManyToManyDistances = Hierarchy.FindShortestDistances(PairingNodes);
+    const auto ManyToManySeconds = FPlatformTime::Seconds() - StartTime;
+
+    TArray<double> PointToPointDistances;
+    PointToPointDistances.Reserve(ManyToManyDistances.Num());
+    StartTime = FPlatformTime::Seconds();
+    for (const auto StartNode : PairingNodes)
+    {
+        for (const auto EndNode : PairingNodes)
+        {
+            PointToPointDistances.Add(Hierarchy.FindShortestDistance(StartNode, EndNode));
+        }
+    }
+    const auto PointToPointSeconds = FPlatformTime::Seconds() - StartTime;
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Contraction hierarchy distances between %d nodes: many to many %.2f ms, point to point %.2f ms"),
+        PairingNodes.Num(),
+        ManyToManySeconds * 1000.,
+        PointToPointSeconds * 1000.);
+
+    for (int32 PairIndex = 0; PairIndex < ManyToManyDistances.Num(); ++PairIndex)
+    {
+        if (!FMath::IsNearlyEqual(ManyToManyDistances[PairIndex], PointToPointDistances[PairIndex], 1e-3))
+        {
+            UE_LOG(
+                LogTemp,
+                Error,
+                TEXT("Many to many distance %f differs from point to point %f for %d -> %d"),
+                ManyToManyDistances[PairIndex],
+                PointToPointDistances[PairIndex],
+                PairingNodes[PairIndex / PairingNodes.Num()],
+                PairingNodes[PairIndex % PairingNodes.Num()]);
+            return 1;
+        }
+    }
+
+    // Same graph with the first node moved, a cached hierarchy must not be reused for it
+    FMTWayGraph MovedGraph;
+    for (int32 WayIndex = 0; WayIndex < Graph.WayNum(); ++WayIndex)
+    {
+        MovedGraph.AddWay(Graph.GetWayName(WayIndex), Graph.GetWayKind(WayIndex));
+    }
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        auto Location = Graph.GetNodeLocation(NodeIndex);
+        Location.Lat += NodeIndex == 0 ? 1e-4 : 0.;
+        MovedGraph.AddNode(Location);
+    }
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        for (const auto ConnectedNode : Graph.ViewNodesConnectedToNode(NodeIndex))
+        {
+            if (NodeIndex < ConnectedNode)
+            {
+                MovedGraph.ConnectNodes(
+                    NodeIndex,
+                    ConnectedNode,
+                    Graph.GetEdgeWay(Graph.NodePairToEdgeIndex(NodeIndex, ConnectedNode)));
+            }
+        }
+    }
+    if (!Hierarchy.IsBuiltFor(Graph) || Hierarchy.IsBuiltFor(MovedGraph))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Contraction hierarchy does not detect a moved node"));
+        return 1;
+    }
+
+    // Odd nodes paired through the hierarchy, greedy matching may break distance ties differently
+    FMTChinesePostManStats DijkstraStats;
+    StartTime = FPlatformTime::Seconds();
+    FMTChinesePostMan::CalculatePathsThatContainAllEdges(Graph, nullptr, nullptr, &DijkstraStats);
+    const auto DijkstraPostManSeconds = FPlatformTime::Seconds() - StartTime;
+
+    FMTChinesePostManStats HierarchyStats;
+    StartTime = FPlatformTime::Seconds();
+    FMTChinesePostMan::CalculatePathsThatContainAllEdges(Graph, nullptr, &Hierarchy, &HierarchyStats);
+    const auto HierarchyPostManSeconds = FPlatformTime::Seconds() - StartTime;
+
+    const auto bHasDeadheadFailed = !FMath::IsNearlyEqual(
+        HierarchyStats.DeadheadLength,
+        DijkstraStats.DeadheadLength,
+        FMath::Max(DijkstraStats.DeadheadLength * 0.05, 1.));
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Postman with hierarchy %.2f ms, pairing %.2f ms, deadhead %.2f km, "
+             "with Dijkstra %.2f ms, pairing %.2f ms, deadhead %.2f km%s"),
+        HierarchyPostManSeconds * 1000.,
+        HierarchyStats.PairingSeconds * 1000.,
+        HierarchyStats.DeadheadLength / 100000.,
+        DijkstraPostManSeconds * 1000.,
+        DijkstraStats.PairingSeconds * 1000.,
+        DijkstraStats.DeadheadLength / 100000.,
+        bHasDeadheadFailed ? TEXT(" FAILED") : TEXT(""));
+
+    return bHasDeadheadFailed ? 1 : 0;
+}
+
+int32 UMTWayGraphBenchmarkCommandlet::RunSpatialHashBenchmark(const int32 SampleCount, const int32 Seed)
+{
+    constexpr auto SampleDistance = 800.;
+    constexpr auto MinDistanceBetweenSamples = SampleDistance * 0.5;
+
+    const auto Samples = GenerateBenchmarkSamples(SampleCount, MinDistanceBetweenSamples, Seed);
+
+    auto StartTime = FPlatformTime::Seconds();
+    FMTSampleSpatialHash SpatialHash(MinDistanceBetweenSamples);
+    int32 SpatialHashAcceptedNum = 0;
+    for (const auto& Sample : Samples)
+    {
+        SpatialHashAcceptedNum += SpatialHash.AddIfNoPointWithinRadius(Sample.Location, Sample.WayIndex) ? 1 : 0;
+    }
+    const auto SpatialHashSeconds = FPlatformTime::Seconds() - StartTime;
+
+    // Same keys as the deduplication the sampler used before
+    StartTime = FPlatformTime::Seconds();
+    TSet<TPair<FVector, int32>> Grid;
+    int32 GridAcceptedNum = 0;
+    for (const auto& Sample : Samples)
+    {
+        const TPair<FVector, int32> Key(
+            FVector(
+                FMath::Floor(Sample.Location.X / MinDistanceBetweenSamples),
+                FMath::Floor(Sample.Location.Y / MinDistanceBetweenSamples),
+                0.),
+            Sample.WayIndex);
+        if (!Grid.Contains(Key))
+        {
+            Grid.Add(Key);
+            GridAcceptedNum++;
+        }
+    }
+    const auto GridSeconds = FPlatformTime::Seconds() - StartTime;
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Spatial hash: %d samples, %.2f ms, %8.2f MiB, %d accepted"),
+        SampleCount,
+        SpatialHashSeconds * 1000.,
+        SpatialHash.GetAllocatedSize() / (1024. * 1024.),
+        SpatialHashAcceptedNum);
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Grid:         %d samples, %.2f ms, %8.2f MiB, %d accepted"),
+        SampleCount,
+        GridSeconds * 1000.,
+        Grid.GetAllocatedSize() / (1024. * 1024.),
+        GridAcceptedNum);
+
+    // Brute force is quadratic, only check a prefix
+    const auto CheckedSampleNum = FMath::Min(SampleCount, 20000);
+    TArray<FBenchmarkSample> AcceptedSamples;
+    FMTSampleSpatialHash CheckedSpatialHash(MinDistanceBetweenSamples);
+    Grid.Reset();
+    int32 GridFalseAcceptNum = 0;
+    int32 GridFalseRejectNum = 0;
+    for (int32 SampleIndex = 0; SampleIndex < CheckedSampleNum; ++SampleIndex)
+    {
+        const auto& Sample = Samples[SampleIndex];
+
+        auto MinDistanceSquared = DBL_MAX;
+        for (const auto& AcceptedSample : AcceptedSamples)
+        {
+            if (AcceptedSample.WayIndex == Sample.WayIndex)
+            {
+                MinDistanceSquared = FMath::Min(
+                    MinDistanceSquared, FVector::DistSquared2D(AcceptedSample.Location, Sample.Location));
+            }
+        }
+        const auto bIsBruteForceAccepted =
+            MinDistanceSquared >= MinDistanceBetweenSamples * MinDistanceBetweenSamples;
+
+        // The spatial hash stores float offsets, samples right at the radius may round either way
+        const auto bIsSpatialHashAccepted =
+            CheckedSpatialHash.AddIfNoPointWithinRadius(Sample.Location, Sample.WayIndex);
+        if (bIsSpatialHashAccepted != bIsBruteForceAccepted &&
+            !FMath::IsNearlyEqual(FMath::Sqrt(MinDistanceSquared), MinDistanceBetweenSamples, 0.01))
+        {
+            UE_LOG(
+                LogTemp,
+                Error,
+                TEXT("Spatial hash %s sample %d, brute force %s it"),
+                bIsSpatialHashAccepted ? TEXT("accepted") : TEXT("rejected"),
+                SampleIndex,
+                bIsBruteForceAccepted ? TEXT("accepted") : TEXT("rejected"));
+            return 1;
+        }
+
+        // Both continue from the same accepted samples
+        if (bIsSpatialHashAccepted)
+        {
+            AcceptedSamples.Add(Sample);
+        }
+
+        const TPair<FVector, int32> Key(
+            FVector(
+                FMath::Floor(Sample.Location.X / MinDistanceBetweenSamples),
+                FMath::Floor(Sample.Location.Y / MinDistanceBetweenSamples),
+                0.),
+            Sample.WayIndex);
+        const auto bIsGridAccepted = !Grid.Contains(Key);
+        Grid.Add(Key);
+        GridFalseAcceptNum += bIsGridAccepted && !bIsBruteForceAccepted ? 1 : 0;
+        GridFalseRejectNum += !bIsGridAccepted && bIsBruteForceAccepted ? 1 : 0;
+    }
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Spatial hash matches brute force for %d samples, the grid wrongly accepted %d and rejected %d"),
+        CheckedSampleNum,
+        GridFalseAcceptNum,
+        GridFalseRejectNum);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "CoreMinimal.h"
+#include "Geolocator/WayGraph/MTWayGraph.h"
+
+#include "MTWayGraphBenchmarkCommandlet.generated.h"
+
+/**
+ * Headless way graph benchmarks
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTWayGraphBenchmark -StreetData=<StreetDataCache.json>
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTWayGraphBenchmark -Mode=Synthetic
+ *     [-Generator=All|Manhattan|Geometric|Radial] [-Size=100] [-Seed=0] [-ContractionHierarchy]
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTWayGraphBenchmark -Mode=PBF -PBF=<extract.osm.pbf>
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTWayGraphBenchmark -Mode=PBFCheck [-PBF=<extract.osm.pbf>]
+ * UnrealEditor-Cmd Geolocator.uproject -run=MTWayGraphBenchmark -Mode=SpatialHash [-Samples=1000000] [-Seed=0]
+ */
+UCLASS()
+class GEOLOCATOR_API UMTWayGraphBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UMTWayGraphBenchmarkCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+
+private:
+    // Compares memory and query speed of FMTWayGraph and FMTCompactWayGraph
+    int32 RunStorageBenchmark(const FMTWayGraph& Graph, const int32 QueryCount);
+
+    // Runs JSON parsing, graph conversion and the postman on generated street networks of roughly
+    // Size * Size intersections
+    int32 RunSyntheticBenchmark(
+        const FString& Generator,
+        const int32 Size,
+        const int32 Seed,
+        const bool bContractionHierarchy);
+
+    int32 RunPipelineBenchmark(
+        const FString& Name,
+        const FOverPassQueryResult& Query,
+        const bool bContractionHierarchy);
+
+    // Builds a street graph from a local extract and runs the postman on it
+    int32 RunPBFBenchmark(const FString& FilePath);
+
+    // Checks node, edge and way counts and tag filtering against the tiny extract in Benchmark/TestData
+    int32 RunPBFCheck(const FString& FilePath);
+
+    // Compares query speed and results of the contraction hierarchy against plain Dijkstra, on its own
+    // and inside the postman
+    int32 RunContractionHierarchyBenchmark(const FMTWayGraph& Graph, const int32 QueryCount);
+
+    // Compares sample deduplication with FMTSampleSpatialHash against the floored grid it replaced
+    // and checks its decisions against brute force
+    int32 RunSpatialHashBenchmark(const int32 SampleCount, const int32 Seed);
+};
@@ -0,0 +1,248 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTWayGraphSynthetic.h"
+
+#include "JsonObjectConverter.h"
+
+namespace MTWayGraphSynthetic
+{
+    namespace
+    {
+        constexpr double OriginLat = 48.137;
+        constexpr double OriginLon = 11.575;
+        constexpr double MetersPerDegreeLat = 111320.;
+
+        const TCHAR* const HighwayKinds[] = {
+            TEXT("primary"),
+            TEXT("secondary"),
+            TEXT("tertiary"),
+            TEXT("residential"),
+            TEXT("residential"),
+            TEXT("service")};
+
+        class FSyntheticQueryBuilder
+        {
+        public:
+            explicit FSyntheticQueryBuilder(const int32 Seed) : Random(Seed)
+            {
+            }
+
+            int64 AddNode(const FVector2D& MetersFromOrigin)
+            {
+                const auto MetersPerDegreeLon =
+                    MetersPerDegreeLat * FMath::Cos(FMath::DegreesToRadians(OriginLat));
+                NodeLocations.Add(
+                    {OriginLat + MetersFromOrigin.Y / MetersPerDegreeLat,
+                     OriginLon + MetersFromOrigin.X / MetersPerDegreeLon});
+                // OSM IDs start at 1
+                return NodeLocations.Num();
+            }
+
+            void AddWay(const TConstArrayView<int64> NodeIDs)
+            {
+                if (NodeIDs.Num() < 2)
+                {
+                    return;
+                }
+
+                auto& Element = Result.Elements.Emplace_GetRef();
+                Element.ID = Result.Elements.Num();
+                Element.Nodes.Append(NodeIDs.GetData(), NodeIDs.Num());
+                Element.Geometry.Reserve(NodeIDs.Num());
+                for (const auto NodeID : NodeIDs)
+                {
+                    Element.Geometry.Add(NodeLocations[NodeID - 1]);
+                }
+                const auto KindIndex =
+                    Random.RandHelper(static_cast<int32>(UE_ARRAY_COUNT(HighwayKinds)));
+                Element.Tags.Add(TEXT("highway"), HighwayKinds[KindIndex]);
+                Element.Tags.Add(
+                    TEXT("name"), FString::Printf(TEXT("Synthetic Way %d"), Result.Elements.Num()));
+            }
+
+            FRandomStream Random;
+
+            FOverPassQueryResult Result;
+
+        private:
+            TArray<FOverpassCoordinates> NodeLocations;
+        };
+    }  // namespace
+
+    FOverPassQueryResult GenerateManhattanGrid(
+        const int32 Rows,
+        const int32 Columns,
+        const double BlockLength,
+        const int32 Seed)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTWayGraphSynthetic::GenerateManhattanGrid);
+
+        // Probability that a street segment is missing, creates odd intersections and dead ends
+        constexpr float MissingSegmentProbability = 0.05f;
+
+        FSyntheticQueryBuilder Builder(Seed);
+
+        TArray<int64> GridNodeIDs;
+        GridNodeIDs.Reserve(Rows * Columns);
+        for (int32 Row = 0; Row < Rows; ++Row)
+        {
+            for (int32 Column = 0; Column < Columns; ++Column)
+            {
+                GridNodeIDs.Add(Builder.AddNode({Column * BlockLength, Row * BlockLength}));
+            }
+        }
+
+        // A street is split into several ways wherever a segment is missing
+        TArray<int64> WayNodeIDs;
+        const auto AddStreet = [&Builder, &WayNodeIDs, &GridNodeIDs](
+                                   const int32 StartIndex, const int32 Stride, const int32 Length)
+        {
+            WayNodeIDs.Reset();
+            for (int32 Step = 0; Step < Length; ++Step)
+            {
+                WayNodeIDs.Add(GridNodeIDs[StartIndex + Step * Stride]);
+                if (Step < Length - 1 && Builder.Random.FRand() < MissingSegmentProbability)
+                {
+                    Builder.AddWay(WayNodeIDs);
+                    WayNodeIDs.Reset();
+                }
+            }
+            Builder.AddWay(WayNodeIDs);
+        };
+
+        for (int32 Row = 0; Row < Rows; ++Row)
+        {
+            AddStreet(Row * Columns, 1, Columns);
+        }
+        for (int32 Column = 0; Column < Columns; ++Column)
+        {
+            AddStreet(Column, Columns, Rows);
+        }
+
+        return MoveTemp(Builder.Result);
+    }
+
+    FOverPassQueryResult GenerateRandomGeometricGraph(
+        const int32 NodeCount,
+        const double AverageDegree,
+        const int32 Seed)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTWayGraphSynthetic::GenerateRandomGeometricGraph);
+
+        // One intersection per 100m x 100m on average
+        const auto Extent = FMath::Sqrt(static_cast<double>(NodeCount)) * 100.;
+        const auto Radius =
+            FMath::Sqrt(AverageDegree * Extent * Extent / (UE_DOUBLE_PI * FMath::Max(NodeCount, 1)));
+
+        FSyntheticQueryBuilder Builder(Seed);
+
+        TArray<FVector2D> Locations;
+        TArray<int64> NodeIDs;
+        Locations.Reserve(NodeCount);
+        NodeIDs.Reserve(NodeCount);
+        for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            const FVector2D Location(Builder.Random.FRand() * Extent, Builder.Random.FRand() * Extent);
+            Locations.Add(Location);
+            NodeIDs.Add(Builder.AddNode(Location));
+        }
+
+        // Buckets of the connection radius so only the 3x3 neighbourhood has to be tested
+        TMultiMap<FIntPoint, int32> Buckets;
+        const auto ToBucket = [Radius](const FVector2D& Location)
+        { return FIntPoint(FMath::FloorToInt(Location.X / Radius), FMath::FloorToInt(Location.Y / Radius)); };
+
+        for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            Buckets.Add(ToBucket(Locations[NodeIndex]), NodeIndex);
+        }
+
+        TArray<int32> BucketNodes;
+        for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            const auto Bucket = ToBucket(Locations[NodeIndex]);
+            for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+            {
+                for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+                {
+                    BucketNodes.Reset();
+                    Buckets.MultiFind(Bucket + FIntPoint(OffsetX, OffsetY), BucketNodes);
+                    for (const auto OtherNodeIndex : BucketNodes)
+                    {
+                        if (OtherNodeIndex > NodeIndex &&
+                            FVector2D::DistSquared(Locations[NodeIndex], Locations[OtherNodeIndex]) <=
+                                Radius * Radius)
+                        {
+                            Builder.AddWay({NodeIDs[NodeIndex], NodeIDs[OtherNodeIndex]});
+                        }
+                    }
+                }
+            }
+        }
+
+        return MoveTemp(Builder.Result);
+    }
+
+    FOverPassQueryResult GenerateRadialCity(
+        const int32 RingCount,
+        const int32 SpokeCount,
+        const double RingSpacing,
+        const int32 Seed)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTWayGraphSynthetic::GenerateRadialCity);
+
+        FSyntheticQueryBuilder Builder(Seed);
+
+        const auto CenterNodeID = Builder.AddNode(FVector2D::ZeroVector);
+
+        // Ring major, slight angular jitter so not all segments have the same length
+        TArray<int64> RingNodeIDs;
+        RingNodeIDs.Reserve(RingCount * SpokeCount);
+        for (int32 Ring = 0; Ring < RingCount; ++Ring)
+        {
+            for (int32 Spoke = 0; Spoke < SpokeCount; ++Spoke)
+            {
+                const auto Angle = (Spoke + Builder.Random.FRandRange(-0.2f, 0.2f)) *
+                                   UE_DOUBLE_TWO_PI / SpokeCount;
+                const auto Distance = (Ring + 1) * RingSpacing;
+                RingNodeIDs.Add(Builder.AddNode(
+                    {FMath::Cos(Angle) * Distance, FMath::Sin(Angle) * Distance}));
+            }
+        }
+
+        TArray<int64> WayNodeIDs;
+        for (int32 Ring = 0; Ring < RingCount; ++Ring)
+        {
+            WayNodeIDs.Reset();
+            for (int32 Spoke = 0; Spoke < SpokeCount; ++Spoke)
+            {
+                WayNodeIDs.Add(RingNodeIDs[Ring * SpokeCount + Spoke]);
+            }
+            // Closed ring road
+            WayNodeIDs.Add(RingNodeIDs[Ring * SpokeCount]);
+            Builder.AddWay(WayNodeIDs);
+        }
+
+        for (int32 Spoke = 0; Spoke < SpokeCount; ++Spoke)
+        {
+            WayNodeIDs.Reset();
+            WayNodeIDs.Add(CenterNodeID);
+            for (int32 Ring = 0; Ring < RingCount; ++Ring)
+            {
+                WayNodeIDs.Add(RingNodeIDs[Ring * SpokeCount + Spoke]);
+            }
+            Builder.AddWay(WayNodeIDs);
+        }
+
+        return MoveTemp(Builder.Result);
+    }
+
+    FString ToOverpassJson(const FOverPassQueryResult& Query)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTWayGraphSynthetic::ToOverpassJson);
+
+        FString Result;
+        FJsonObjectConverter::UStructToJsonObjectString(Query, Result, 0, 0, 0, nullptr, false);
+        return Result;
+    }
+}  // namespace MTWayGraphSynthetic
@@ -0,0 +1,37 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Geolocator/OSM/MTOverpassSchema.h"
+
+/**
+ * Deterministic synthetic street networks in the shape of Overpass query results, so the way graph
+ * pipeline can be measured without an Overpass server or a loaded map.
+ * Distances are in meters, all networks are placed around a fixed origin.
+ */
+namespace MTWayGraphSynthetic
+{
+    // Streets on a regular grid with Rows * Columns intersections, some blocks are merged at random
+    FOverPassQueryResult GenerateManhattanGrid(
+        const int32 Rows,
+        const int32 Columns,
+        const double BlockLength,
+        const int32 Seed);
+
+    // Uniformly distributed intersections connected to all others within a radius
+    FOverPassQueryResult GenerateRandomGeometricGraph(
+        const int32 NodeCount,
+        const double AverageDegree,
+        const int32 Seed);
+
+    // Ring roads around a center connected by spokes
+    FOverPassQueryResult GenerateRadialCity(
+        const int32 RingCount,
+        const int32 SpokeCount,
+        const double RingSpacing,
+        const int32 Seed);
+
+    // Overpass style JSON of a query result, e.g. to measure parsing at scale
+    FString ToOverpassJson(const FOverPassQueryResult& Query);
+}
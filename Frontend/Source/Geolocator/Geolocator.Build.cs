@@ -17,6 +17,17 @@ public class Geolocator : ModuleRules
 			PrivateDependencyModuleNames.Add("EasyFileDialog");
 		}
 
+		// Same platforms as the ImageWrapper module, other platforms encode through ImageWrapper
+		if (Target.Platform == UnrealTargetPlatform.Win64 || Target.Platform == UnrealTargetPlatform.Linux || Target.Platform == UnrealTargetPlatform.Mac)
+		{
+			AddEngineThirdPartyPrivateStaticDependencies(Target, "LibJpegTurbo");
+			PrivateDefinitions.Add("WITH_MT_LIBJPEGTURBO=1");
+		}
+		else
+		{
+			PrivateDefinitions.Add("WITH_MT_LIBJPEGTURBO=0");
+		}
+
 		// PublicDefinitions.AddRange(
 		// 	new string[]
 		// 	{
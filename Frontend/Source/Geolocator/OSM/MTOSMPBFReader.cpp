@@ -0,0 +1,698 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTOSMPBFReader.h"
+
+#include <atomic>
+
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Compression.h"
+
+namespace MTOSMPBF
+{
+    namespace
+    {
+        // Upper bounds from the OSM PBF specification
+        constexpr int32 MaxBlobHeaderSize = 64 * 1024;
+        constexpr int32 MaxBlobSize = 32 * 1024 * 1024;
+
+        class FProtobufReader
+        {
+        public:
+            explicit FProtobufReader(const TConstArrayView<uint8> Data)
+                : Current(Data.GetData())
+                , End(Data.GetData() + Data.Num())
+            {
+            }
+
+            bool Next(uint32& OutField, uint32& OutWireType)
+            {
+                if (bHasError || Current >= End)
+                {
+                    return false;
+                }
+
+                const auto Key = ReadVarint();
+                OutField = static_cast<uint32>(Key >> 3);
+                OutWireType = static_cast<uint32>(Key & 7);
+                return !bHasError;
+            }
+
+            uint64 ReadVarint()
+            {
+                uint64 Result = 0;
+                for (uint32 Shift = 0; Shift < 64; Shift += 7)
+                {
+                    if (Current >= End)
+                    {
+                        bHasError = true;
+                        return 0;
+                    }
+
+                    const auto Byte = *Current++;
+                    Result |= static_cast<uint64>(Byte & 0x7F) << Shift;
+                    if ((Byte & 0x80) == 0)
+                    {
+                        return Result;
+                    }
+                }
+                bHasError = true;
+                return 0;
+            }
+
+            int64 ReadSignedVarint()
+            {
+                const auto Value = ReadVarint();
+                return static_cast<int64>(Value >> 1) ^ -static_cast<int64>(Value & 1);
+            }
+
+            TConstArrayView<uint8> ReadBytes()
+            {
+                const auto Length = ReadVarint();
+                if (bHasError || Length > static_cast<uint64>(End - Current))
+                {
+                    bHasError = true;
+                    return {};
+                }
+
+                const TConstArrayView<uint8> Result(Current, static_cast<int32>(Length));
+                Current += Length;
+                return Result;
+            }
+
+            void Skip(const uint32 WireType)
+            {
+                switch (WireType)
+                {
+                    case 0:
+                        ReadVarint();
+                        break;
+                    case 1:
+                        Advance(8);
+                        break;
+                    case 2:
+                        ReadBytes();
+                        break;
+                    case 5:
+                        Advance(4);
+                        break;
+                    default:
+                        bHasError = true;
+                        break;
+                }
+            }
+
+            bool HasError() const
+            {
+                return bHasError;
+            }
+
+            bool IsAtEnd() const
+            {
+                return bHasError || Current >= End;
+            }
+
+        private:
+            const uint8* Current;
+
+            const uint8* End;
+
+            bool bHasError = false;
+
+            void Advance(const int64 Num)
+            {
+                if (Num > End - Current)
+                {
+                    bHasError = true;
+                    return;
+                }
+                Current += Num;
+            }
+        };
+
+        struct FBlobLocation
+        {
+            int64 Offset;
+            int32 Size;
+        };
+
+        struct FPrimitiveBlock
+        {
+            TArray<TConstArrayView<uint8>> Strings;
+
+            TArray<TConstArrayView<uint8>> Groups;
+
+            int64 Granularity = 100;
+
+            int64 LatOffset = 0;
+
+            int64 LonOffset = 0;
+
+            FOverpassCoordinates ToCoordinates(const int64 Lat, const int64 Lon) const
+            {
+                return {
+                    1e-9 * (LatOffset + Granularity * Lat), 1e-9 * (LonOffset + Granularity * Lon)};
+            }
+        };
+
+        struct FPBFWay
+        {
+            TArray<int64> NodeIDs;
+
+            FString Highway;
+
+            FString Name;
+        };
+
+        struct FDecodeContext
+        {
+            TUniquePtr<IFileHandle> File;
+
+            TArray<uint8> BlobData;
+
+            TArray<uint8> BlockData;
+        };
+
+        bool StringEquals(const TConstArrayView<uint8> String, const ANSICHAR* Literal)
+        {
+            const auto Length = FCStringAnsi::Strlen(Literal);
+            return String.Num() == Length && FMemory::Memcmp(String.GetData(), Literal, Length) == 0;
+        }
+
+        FString StringToFString(const TConstArrayView<uint8> String)
+        {
+            const FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(String.GetData()), String.Num());
+            return FString(Converted.Length(), Converted.Get());
+        }
+
+        bool ReadBlobLocations(const FString& FilePath, TArray<FBlobLocation>& OutLocations)
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(MTOSMPBF::ReadBlobLocations);
+
+            const TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*FilePath));
+            if (!Reader)
+            {
+                UE_LOG(LogTemp, Error, TEXT("Failed to open %s"), *FilePath);
+                return false;
+            }
+
+            TArray<uint8> HeaderData;
+            while (Reader->Tell() < Reader->TotalSize())
+            {
+                uint8 HeaderLengthBytes[4];
+                Reader->Serialize(HeaderLengthBytes, 4);
+                // Network byte order
+                const auto HeaderLength = static_cast<int32>(
+                    (HeaderLengthBytes[0] << 24) | (HeaderLengthBytes[1] << 16) |
+                    (HeaderLengthBytes[2] << 8) | HeaderLengthBytes[3]);
+                if (HeaderLength <= 0 || HeaderLength > MaxBlobHeaderSize)
+                {
+                    UE_LOG(LogTemp, Error, TEXT("Invalid blob header in %s"), *FilePath);
+                    return false;
+                }
+
+                HeaderData.SetNumUninitialized(HeaderLength);
+                Reader->Serialize(HeaderData.GetData(), HeaderLength);
+
+                bool bIsData = false;
+                int32 DataSize = 0;
+                FProtobufReader HeaderReader(HeaderData);
+                uint32 Field;
+                uint32 WireType;
+                while (HeaderReader.Next(Field, WireType))
+                {
+                    if (Field == 1 && WireType == 2)
+                    {
+                        bIsData = StringEquals(HeaderReader.ReadBytes(), "OSMData");
+                    }
+                    else if (Field == 3 && WireType == 0)
+                    {
+                        DataSize = static_cast<int32>(HeaderReader.ReadVarint());
+                    }
+                    else
+                    {
+                        HeaderReader.Skip(WireType);
+                    }
+                }
+
+                if (HeaderReader.HasError() || DataSize <= 0 || DataSize > MaxBlobSize)
+                {
+                    UE_LOG(LogTemp, Error, TEXT("Invalid blob header in %s"), *FilePath);
+                    return false;
+                }
+
+                // OSMHeader blobs only contain metadata
+                if (bIsData)
+                {
+                    OutLocations.Add({Reader->Tell(), DataSize});
+                }
+                Reader->Seek(Reader->Tell() + DataSize);
+
+                if (Reader->IsError())
+                {
+                    UE_LOG(LogTemp, Error, TEXT("Failed to read %s"), *FilePath);
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool DecodeBlob(
+            const FString& FilePath,
+            const FBlobLocation& Location,
+            FDecodeContext& Context,
+            FPrimitiveBlock& OutBlock)
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(MTOSMPBF::DecodeBlob);
+
+            if (!Context.File)
+            {
+                Context.File.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*FilePath));
+            }
+
+            Context.BlobData.SetNumUninitialized(Location.Size);
+            if (!Context.File || !Context.File->Seek(Location.Offset) ||
+                !Context.File->Read(Context.BlobData.GetData(), Location.Size))
+            {
+                return false;
+            }
+
+            TConstArrayView<uint8> RawData;
+            TConstArrayView<uint8> ZlibData;
+            int32 RawSize = 0;
+
+            FProtobufReader BlobReader(Context.BlobData);
+            uint32 Field;
+            uint32 WireType;
+            while (BlobReader.Next(Field, WireType))
+            {
+                if (Field == 1 && WireType == 2)
+                {
+                    RawData = BlobReader.ReadBytes();
+                }
+                else if (Field == 2 && WireType == 0)
+                {
+                    RawSize = static_cast<int32>(BlobReader.ReadVarint());
+                }
+                else if (Field == 3 && WireType == 2)
+                {
+                    ZlibData = BlobReader.ReadBytes();
+                }
+                else
+                {
+                    BlobReader.Skip(WireType);
+                }
+            }
+
+            if (BlobReader.HasError())
+            {
+                return false;
+            }
+
+            if (RawData.Num() > 0)
+            {
+                Context.BlockData.Reset();
+                Context.BlockData.Append(RawData.GetData(), RawData.Num());
+            }
+            else if (ZlibData.Num() > 0 && RawSize > 0 && RawSize <= MaxBlobSize)
+            {
+                Context.BlockData.SetNumUninitialized(RawSize);
+                if (!FCompression::UncompressMemory(
+                        NAME_Zlib, Context.BlockData.GetData(), RawSize, ZlibData.GetData(), ZlibData.Num()))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                UE_LOG(LogTemp, Error, TEXT("Unsupported blob compression in %s"), *FilePath);
+                return false;
+            }
+
+            OutBlock = {};
+            FProtobufReader BlockReader(Context.BlockData);
+            while (BlockReader.Next(Field, WireType))
+            {
+                if (Field == 1 && WireType == 2)
+                {
+                    FProtobufReader StringTableReader(BlockReader.ReadBytes());
+                    while (StringTableReader.Next(Field, WireType))
+                    {
+                        if (Field == 1 && WireType == 2)
+                        {
+                            OutBlock.Strings.Add(StringTableReader.ReadBytes());
+                        }
+                        else
+                        {
+                            StringTableReader.Skip(WireType);
+                        }
+                    }
+                }
+                else if (Field == 2 && WireType == 2)
+                {
+                    OutBlock.Groups.Add(BlockReader.ReadBytes());
+                }
+                else if (Field == 17 && WireType == 0)
+                {
+                    OutBlock.Granularity = static_cast<int64>(BlockReader.ReadVarint());
+                }
+                else if (Field == 19 && WireType == 0)
+                {
+                    OutBlock.LatOffset = static_cast<int64>(BlockReader.ReadVarint());
+                }
+                else if (Field == 20 && WireType == 0)
+                {
+                    OutBlock.LonOffset = static_cast<int64>(BlockReader.ReadVarint());
+                }
+                else
+                {
+                    BlockReader.Skip(WireType);
+                }
+            }
+
+            return !BlockReader.HasError();
+        }
+
+        void ReadPackedVarints(const TConstArrayView<uint8> Data, TArray<uint64>& OutValues)
+        {
+            OutValues.Reset();
+            FProtobufReader Reader(Data);
+            while (!Reader.IsAtEnd())
+            {
+                OutValues.Add(Reader.ReadVarint());
+            }
+        }
+
+        // Ways that pass the tag rules of the Overpass query, see MTOverpass::IsIncludedHighway
+        void ParseWays(const FPrimitiveBlock& Block, TArray<FPBFWay>& OutWays)
+        {
+            TArray<uint64> Keys;
+            TArray<uint64> Values;
+
+            for (const auto& Group : Block.Groups)
+            {
+                FProtobufReader GroupReader(Group);
+                uint32 Field;
+                uint32 WireType;
+                while (GroupReader.Next(Field, WireType))
+                {
+                    if (Field != 3 || WireType != 2)
+                    {
+                        GroupReader.Skip(WireType);
+                        continue;
+                    }
+
+                    FProtobufReader WayReader(GroupReader.ReadBytes());
+                    TConstArrayView<uint8> Refs;
+                    Keys.Reset();
+                    Values.Reset();
+                    while (WayReader.Next(Field, WireType))
+                    {
+                        if (Field == 2 && WireType == 2)
+                        {
+                            ReadPackedVarints(WayReader.ReadBytes(), Keys);
+                        }
+                        else if (Field == 3 && WireType == 2)
+                        {
+                            ReadPackedVarints(WayReader.ReadBytes(), Values);
+                        }
+                        else if (Field == 8 && WireType == 2)
+                        {
+                            Refs = WayReader.ReadBytes();
+                        }
+                        else
+                        {
+                            WayReader.Skip(WireType);
+                        }
+                    }
+
+                    if (WayReader.HasError() || Keys.Num() != Values.Num())
+                    {
+                        continue;
+                    }
+
+                    FPBFWay Way;
+                    bool bIsExcluded = false;
+                    for (int32 TagIndex = 0; TagIndex < Keys.Num(); ++TagIndex)
+                    {
+                        if (Keys[TagIndex] >= static_cast<uint64>(Block.Strings.Num()) ||
+                            Values[TagIndex] >= static_cast<uint64>(Block.Strings.Num()))
+                        {
+                            bIsExcluded = true;
+                            break;
+                        }
+
+                        const auto& Key = Block.Strings[Keys[TagIndex]];
+                        const auto& Value = Block.Strings[Values[TagIndex]];
+                        if (StringEquals(Key, "highway"))
+                        {
+                            Way.Highway = StringToFString(Value);
+                        }
+                        else if (StringEquals(Key, "name"))
+                        {
+                            Way.Name = StringToFString(Value);
+                        }
+                        else if (StringEquals(Key, "tunnel") ||
+                                 (StringEquals(Key, "covered") && StringEquals(Value, "yes")))
+                        {
+                            bIsExcluded = true;
+                        }
+                    }
+
+                    if (bIsExcluded || !MTOverpass::IsIncludedHighway(Way.Highway))
+                    {
+                        continue;
+                    }
+
+                    // Delta coded
+                    FProtobufReader RefReader(Refs);
+                    int64 NodeID = 0;
+                    while (!RefReader.IsAtEnd())
+                    {
+                        NodeID += RefReader.ReadSignedVarint();
+                        Way.NodeIDs.Add(NodeID);
+                    }
+
+                    OutWays.Add(MoveTemp(Way));
+                }
+            }
+        }
+
+        void ParseNodes(
+            const FPrimitiveBlock& Block,
+            const TSet<int64>& NeededNodeIDs,
+            TArray<TPair<int64, FOverpassCoordinates>>& OutNodes)
+        {
+            for (const auto& Group : Block.Groups)
+            {
+                FProtobufReader GroupReader(Group);
+                uint32 Field;
+                uint32 WireType;
+                while (GroupReader.Next(Field, WireType))
+                {
+                    if (Field == 1 && WireType == 2)
+                    {
+                        FProtobufReader NodeReader(GroupReader.ReadBytes());
+                        int64 NodeID = 0;
+                        int64 Lat = 0;
+                        int64 Lon = 0;
+                        while (NodeReader.Next(Field, WireType))
+                        {
+                            if (Field == 1 && WireType == 0)
+                            {
+                                NodeID = NodeReader.ReadSignedVarint();
+                            }
+                            else if (Field == 8 && WireType == 0)
+                            {
+                                Lat = NodeReader.ReadSignedVarint();
+                            }
+                            else if (Field == 9 && WireType == 0)
+                            {
+                                Lon = NodeReader.ReadSignedVarint();
+                            }
+                            else
+                            {
+                                NodeReader.Skip(WireType);
+                            }
+                        }
+
+                        if (!NodeReader.HasError() && NeededNodeIDs.Contains(NodeID))
+                        {
+                            OutNodes.Add({NodeID, Block.ToCoordinates(Lat, Lon)});
+                        }
+                    }
+                    else if (Field == 2 && WireType == 2)
+                    {
+                        FProtobufReader DenseReader(GroupReader.ReadBytes());
+                        TConstArrayView<uint8> IDs;
+                        TConstArrayView<uint8> Lats;
+                        TConstArrayView<uint8> Lons;
+                        while (DenseReader.Next(Field, WireType))
+                        {
+                            if (Field == 1 && WireType == 2)
+                            {
+                                IDs = DenseReader.ReadBytes();
+                            }
+                            else if (Field == 8 && WireType == 2)
+                            {
+                                Lats = DenseReader.ReadBytes();
+                            }
+                            else if (Field == 9 && WireType == 2)
+                            {
+                                Lons = DenseReader.ReadBytes();
+                            }
+                            else
+                            {
+                                DenseReader.Skip(WireType);
+                            }
+                        }
+
+                        // All three columns are delta coded
+                        FProtobufReader IDReader(IDs);
+                        FProtobufReader LatReader(Lats);
+                        FProtobufReader LonReader(Lons);
+                        int64 NodeID = 0;
+                        int64 Lat = 0;
+                        int64 Lon = 0;
+                        while (!IDReader.IsAtEnd() && !LatReader.IsAtEnd() && !LonReader.IsAtEnd())
+                        {
+                            NodeID += IDReader.ReadSignedVarint();
+                            Lat += LatReader.ReadSignedVarint();
+                            Lon += LonReader.ReadSignedVarint();
+
+                            if (NeededNodeIDs.Contains(NodeID))
+                            {
+                                OutNodes.Add({NodeID, Block.ToCoordinates(Lat, Lon)});
+                            }
+                        }
+                    }
+                    else
+                    {
+                        GroupReader.Skip(WireType);
+                    }
+                }
+            }
+        }
+    }  // namespace
+
+    bool ReadStreetGraph(const FString& FilePath, FMTWayGraphBuilder& Builder)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTOSMPBF::ReadStreetGraph);
+
+        TArray<FBlobLocation> BlobLocations;
+        if (!ReadBlobLocations(FilePath, BlobLocations))
+        {
+            return false;
+        }
+
+        TArray<FDecodeContext> DecodeContexts;
+        std::atomic<bool> bHasError = false;
+
+        TArray<TArray<FPBFWay>> BlobWays;
+        BlobWays.SetNum(BlobLocations.Num());
+
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(ReadWays);
+
+            ParallelForWithTaskContext(
+                DecodeContexts,
+                BlobLocations.Num(),
+                [](int32 ContextIndex, int32 NumContexts) { return FDecodeContext{}; },
+                [&FilePath, &BlobLocations, &BlobWays, &bHasError](
+                    FDecodeContext& Context, int32 BlobIndex)
+                {
+                    FPrimitiveBlock Block;
+                    if (!DecodeBlob(FilePath, BlobLocations[BlobIndex], Context, Block))
+                    {
+                        bHasError = true;
+                        return;
+                    }
+                    ParseWays(Block, BlobWays[BlobIndex]);
+                });
+        }
+
+        if (bHasError)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to decode ways of %s"), *FilePath);
+            return false;
+        }
+
+        TSet<int64> NeededNodeIDs;
+        for (const auto& Ways : BlobWays)
+        {
+            for (const auto& Way : Ways)
+            {
+                NeededNodeIDs.Append(Way.NodeIDs);
+            }
+        }
+
+        TArray<TArray<TPair<int64, FOverpassCoordinates>>> BlobNodes;
+        BlobNodes.SetNum(BlobLocations.Num());
+
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(ReadNodes);
+
+            ParallelForWithTaskContext(
+                DecodeContexts,
+                BlobLocations.Num(),
+                [](int32 ContextIndex, int32 NumContexts) { return FDecodeContext{}; },
+                [&FilePath, &BlobLocations, &BlobNodes, &NeededNodeIDs, &bHasError](
+                    FDecodeContext& Context, int32 BlobIndex)
+                {
+                    FPrimitiveBlock Block;
+                    if (!DecodeBlob(FilePath, BlobLocations[BlobIndex], Context, Block))
+                    {
+                        bHasError = true;
+                        return;
+                    }
+                    ParseNodes(Block, NeededNodeIDs, BlobNodes[BlobIndex]);
+                });
+        }
+
+        if (bHasError)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to decode nodes of %s"), *FilePath);
+            return false;
+        }
+
+        TMap<int64, FOverpassCoordinates> NodeLocations;
+        NodeLocations.Reserve(NeededNodeIDs.Num());
+        for (const auto& Nodes : BlobNodes)
+        {
+            for (const auto& [NodeID, Coords] : Nodes)
+            {
+                NodeLocations.Add(NodeID, Coords);
+            }
+        }
+        BlobNodes.Empty();
+
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(BuildGraph);
+
+            TArray<FOverpassCoordinates> Geometry;
+            for (const auto& Ways : BlobWays)
+            {
+                for (const auto& Way : Ways)
+                {
+                    // Nodes missing from the extract are treated as outside of the bounding polygon
+                    Geometry.Reset();
+                    for (const auto NodeID : Way.NodeIDs)
+                    {
+                        const auto* Coords = NodeLocations.Find(NodeID);
+                        Geometry.Add(Coords ? *Coords : FOverpassCoordinates{NAN, NAN});
+                    }
+
+                    FMTOSMWayTags Tags;
+                    Tags.Highway = Builder.InternTagValue(Way.Highway);
+                    if (!Way.Name.IsEmpty())
+                    {
+                        Tags.Name = Builder.InternTagValue(Way.Name);
+                    }
+                    Builder.AddWay(Way.NodeIDs, Geometry, Tags);
+                }
+            }
+        }
+
+        return true;
+    }
+}  // namespace MTOSMPBF
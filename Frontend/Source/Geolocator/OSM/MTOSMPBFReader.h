@@ -0,0 +1,19 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MTWayGraphBuilder.h"
+
+/**
+ * Offline alternative to an Overpass query that reads a local .osm.pbf extract.
+ *
+ * Blobs are decoded in parallel in two passes. The first pass collects all ways that pass the same
+ * tag rules as the Overpass query, the second one only the locations of nodes those ways reference.
+ * Ways are then added to the builder in file order, so the resulting graph is deterministic.
+ */
+namespace MTOSMPBF
+{
+    // False if the file could not be read, only zlib compressed and raw blobs are supported
+    bool ReadStreetGraph(const FString& FilePath, FMTWayGraphBuilder& Builder);
+}
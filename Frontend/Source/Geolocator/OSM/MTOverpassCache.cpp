@@ -0,0 +1,332 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTOverpassCache.h"
+
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Compression.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+
+namespace
+{
+    TAutoConsoleVariable<FString> CVarOverpassEndpoint(
+        TEXT("MT.Overpass.Endpoint"),
+        TEXT("http://www.overpass-api.de/api/interpreter"),
+        TEXT("URL of the Overpass interpreter"));
+
+    TAutoConsoleVariable<float> CVarOverpassCacheTTLHours(
+        TEXT("MT.Overpass.CacheTTLHours"),
+        24.f * 7.f,
+        TEXT("Hours until a cached Overpass response expires, 0 disables the cache"));
+
+    TAutoConsoleVariable<int32> CVarOverpassCacheMaxSizeMB(
+        TEXT("MT.Overpass.CacheMaxSizeMB"),
+        2048,
+        TEXT("Size limit of the Overpass response cache in megabytes"));
+
+    constexpr uint32 CacheFileMagic = 0x4D544F43;
+    constexpr int32 CacheFileVersion = 1;
+    constexpr int32 CacheChunkSize = 1024 * 1024;
+    const TCHAR* const CacheFileExtension = TEXT(".mtoc");
+    const TCHAR* const TempFileExtension = TEXT(".tmp");
+
+    bool IsCacheEnabled()
+    {
+        return CVarOverpassCacheTTLHours.GetValueOnAnyThread() > 0.f;
+    }
+
+    FTimespan GetCacheTTL()
+    {
+        return FTimespan::FromHours(CVarOverpassCacheTTLHours.GetValueOnAnyThread());
+    }
+
+    FString GetCacheDirectory()
+    {
+        return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("OverpassCache"));
+    }
+
+    // Whitespace and line breaks do not change the query result
+    FString NormalizeQueryString(const FString& OverpassQueryString)
+    {
+        FString Result;
+        Result.Reserve(OverpassQueryString.Len());
+        for (const auto Char : OverpassQueryString)
+        {
+            if (FChar::IsWhitespace(Char))
+            {
+                if (!Result.IsEmpty() && Result[Result.Len() - 1] != TEXT(' '))
+                {
+                    Result.AppendChar(TEXT(' '));
+                }
+                continue;
+            }
+            Result.AppendChar(Char);
+        }
+        Result.TrimEndInline();
+        return Result;
+    }
+
+    FString GetCacheFilePath(const FString& OverpassQueryString)
+    {
+        const FTCHARToUTF8 NormalizedQuery(*NormalizeQueryString(OverpassQueryString));
+
+        uint8 Hash[FSHA1::DigestSize];
+        FSHA1::HashBuffer(NormalizedQuery.Get(), NormalizedQuery.Length(), Hash);
+
+        return FPaths::Combine(GetCacheDirectory(), BytesToHex(Hash, FSHA1::DigestSize) + CacheFileExtension);
+    }
+
+    bool IsExpired(const FDateTime& TimeStamp)
+    {
+        return FDateTime::UtcNow() - TimeStamp > GetCacheTTL();
+    }
+}  // namespace
+
+FString MTOverpass::GetEndpointURL()
+{
+    return CVarOverpassEndpoint.GetValueOnAnyThread();
+}
+
+bool MTOverpass::ReadCachedResponse(
+    const FString& OverpassQueryString,
+    TFunctionRef<bool(TConstArrayView<uint8>)> ChunkConsumer)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(MTOverpass::ReadCachedResponse);
+
+    if (!IsCacheEnabled())
+    {
+        return false;
+    }
+
+    const auto FilePath = GetCacheFilePath(OverpassQueryString);
+    const auto TimeStamp = IFileManager::Get().GetTimeStamp(*FilePath);
+    if (TimeStamp == FDateTime::MinValue() || IsExpired(TimeStamp))
+    {
+        return false;
+    }
+
+    // Another process may trim the entry at any point, a failed open is a regular cache miss
+    const TUniquePtr<FArchive> File(IFileManager::Get().CreateFileReader(*FilePath, FILEREAD_Silent));
+    if (!File)
+    {
+        return false;
+    }
+
+    uint32 Magic = 0;
+    int32 Version = 0;
+    *File << Magic;
+    *File << Version;
+    if (File->IsError() || Magic != CacheFileMagic || Version != CacheFileVersion)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Ignoring invalid Overpass cache entry %s"), *FilePath);
+        return false;
+    }
+
+    TArray<uint8> CompressedChunk;
+    TArray<uint8> Chunk;
+    while (File->Tell() < File->TotalSize())
+    {
+        int32 RawSize = 0;
+        int32 CompressedSize = 0;
+        *File << RawSize;
+        *File << CompressedSize;
+        if (File->IsError() || RawSize <= 0 || RawSize > CacheChunkSize || CompressedSize <= 0 ||
+            CompressedSize > File->TotalSize() - File->Tell())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Ignoring corrupted Overpass cache entry %s"), *FilePath);
+            return false;
+        }
+
+        CompressedChunk.SetNumUninitialized(CompressedSize, false);
+        File->Serialize(CompressedChunk.GetData(), CompressedSize);
+        Chunk.SetNumUninitialized(RawSize, false);
+        if (File->IsError() ||
+            !FCompression::UncompressMemory(NAME_Zlib, Chunk.GetData(), RawSize, CompressedChunk.GetData(), CompressedSize))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Ignoring corrupted Overpass cache entry %s"), *FilePath);
+            return false;
+        }
+
+        if (!ChunkConsumer(Chunk))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MTOverpass::TrimResponseCache()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(MTOverpass::TrimResponseCache);
+
+    struct FCacheEntry
+    {
+        FString FilePath;
+        int64 Size;
+        FDateTime TimeStamp;
+    };
+
+    TArray<FCacheEntry> Entries;
+    int64 TotalSize = 0;
+    const auto CacheDirectory = GetCacheDirectory();
+    IFileManager::Get().IterateDirectoryStat(
+        *CacheDirectory,
+        [&Entries, &TotalSize](const TCHAR* FilePath, const FFileStatData& StatData)
+        {
+            if (StatData.bIsDirectory)
+            {
+                return true;
+            }
+
+            const FString Path(FilePath);
+            if (Path.EndsWith(TempFileExtension))
+            {
+                // Left behind by a process that died while writing, live writers finish within the TTL
+                if (IsExpired(StatData.ModificationTime))
+                {
+                    IFileManager::Get().Delete(FilePath, false, false, true);
+                }
+                return true;
+            }
+
+            if (Path.EndsWith(CacheFileExtension))
+            {
+                Entries.Add({Path, StatData.FileSize, StatData.ModificationTime});
+                TotalSize += StatData.FileSize;
+            }
+            return true;
+        });
+
+    Entries.Sort([](const FCacheEntry& A, const FCacheEntry& B) { return A.TimeStamp < B.TimeStamp; });
+
+    const auto MaxSize = static_cast<int64>(CVarOverpassCacheMaxSizeMB.GetValueOnAnyThread()) * 1024 * 1024;
+    for (const auto& Entry : Entries)
+    {
+        if (TotalSize <= MaxSize && !IsExpired(Entry.TimeStamp))
+        {
+            break;
+        }
+
+        // Fails if another process is reading the entry, it is tried again on the next trim
+        if (IFileManager::Get().Delete(*Entry.FilePath, false, false, true))
+        {
+            TotalSize -= Entry.Size;
+        }
+    }
+}
+
+FMTOverpassCacheWriter::FMTOverpassCacheWriter(const FString& OverpassQueryString)
+{
+    if (!IsCacheEnabled())
+    {
+        bHasError = true;
+        return;
+    }
+
+    FilePath = GetCacheFilePath(OverpassQueryString);
+    // Unique per writer so concurrent processes never write into the same file
+    TempFilePath = FPaths::Combine(
+        GetCacheDirectory(),
+        FPaths::GetBaseFilename(FilePath) + TEXT(".") + FGuid::NewGuid().ToString() + TempFileExtension);
+
+    File.Reset(IFileManager::Get().CreateFileWriter(*TempFilePath, FILEWRITE_Silent));
+    if (!File)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to create Overpass cache entry %s"), *TempFilePath);
+        bHasError = true;
+        return;
+    }
+
+    uint32 Magic = CacheFileMagic;
+    int32 Version = CacheFileVersion;
+    *File << Magic;
+    *File << Version;
+
+    PendingChunk.Reserve(CacheChunkSize);
+}
+
+FMTOverpassCacheWriter::~FMTOverpassCacheWriter()
+{
+    Discard();
+}
+
+void FMTOverpassCacheWriter::Append(const TConstArrayView<uint8> Data)
+{
+    int32 Offset = 0;
+    while (!bHasError && Offset < Data.Num())
+    {
+        const auto AppendSize = FMath::Min(Data.Num() - Offset, CacheChunkSize - PendingChunk.Num());
+        PendingChunk.Append(Data.GetData() + Offset, AppendSize);
+        Offset += AppendSize;
+
+        if (PendingChunk.Num() == CacheChunkSize)
+        {
+            FlushChunk();
+        }
+    }
+}
+
+bool FMTOverpassCacheWriter::Commit()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTOverpassCacheWriter::Commit);
+
+    if (bHasError)
+    {
+        Discard();
+        return false;
+    }
+
+    FlushChunk();
+    const auto bWriteSucceeded = File->Close() && !File->IsError();
+    File.Reset();
+
+    // Replaces an entry another process committed in the meantime, both hold the same response
+    if (!bWriteSucceeded || !IFileManager::Get().Move(*FilePath, *TempFilePath, true, true, false, true))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to commit Overpass cache entry %s"), *FilePath);
+        Discard();
+        return false;
+    }
+
+    TempFilePath.Empty();
+    MTOverpass::TrimResponseCache();
+    return true;
+}
+
+void FMTOverpassCacheWriter::FlushChunk()
+{
+    if (bHasError || PendingChunk.IsEmpty())
+    {
+        return;
+    }
+
+    int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, PendingChunk.Num());
+    TArray<uint8> CompressedChunk;
+    CompressedChunk.SetNumUninitialized(CompressedSize);
+    if (!FCompression::CompressMemory(NAME_Zlib, CompressedChunk.GetData(), CompressedSize, PendingChunk.GetData(), PendingChunk.Num()))
+    {
+        bHasError = true;
+        return;
+    }
+
+    int32 RawSize = PendingChunk.Num();
+    *File << RawSize;
+    *File << CompressedSize;
+    File->Serialize(CompressedChunk.GetData(), CompressedSize);
+    bHasError = File->IsError();
+
+    PendingChunk.Reset();
+}
+
+void FMTOverpassCacheWriter::Discard()
+{
+    bHasError = true;
+    File.Reset();
+    if (!TempFilePath.IsEmpty())
+    {
+        IFileManager::Get().Delete(*TempFilePath, false, false, true);
+        TempFilePath.Empty();
+    }
+}
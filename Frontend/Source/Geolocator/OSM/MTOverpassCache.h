@@ -0,0 +1,56 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+namespace MTOverpass
+{
+    // Endpoint of the Overpass interpreter, can point to a local stand-in (Backend/Scripts/overpass_stand_in.py)
+    FString GetEndpointURL();
+
+    // Feeds the cached response for the query in chunks, returns false if there is no valid cache entry
+    // or the consumer rejected a chunk
+    bool ReadCachedResponse(
+        const FString& OverpassQueryString,
+        TFunctionRef<bool(TConstArrayView<uint8>)> ChunkConsumer);
+
+    // Removes expired entries and the oldest entries until the cache fits the size limit
+    void TrimResponseCache();
+}
+
+/**
+ * Compresses a response into a temporary file while it is received.
+ * Commit moves it into the cache in one step, so other processes never see partially written entries.
+ * Uncommitted responses are discarded on destruction.
+ */
+class GEOLOCATOR_API FMTOverpassCacheWriter
+{
+public:
+    explicit FMTOverpassCacheWriter(const FString& OverpassQueryString);
+
+    ~FMTOverpassCacheWriter();
+
+    FMTOverpassCacheWriter(const FMTOverpassCacheWriter&) = delete;
+
+    FMTOverpassCacheWriter& operator=(const FMTOverpassCacheWriter&) = delete;
+
+    void Append(const TConstArrayView<uint8> Data);
+
+    bool Commit();
+
+private:
+    void FlushChunk();
+
+    void Discard();
+
+    FString FilePath;
+
+    FString TempFilePath;
+
+    TUniquePtr<FArchive> File;
+
+    TArray<uint8> PendingChunk;
+
+    bool bHasError = false;
+};
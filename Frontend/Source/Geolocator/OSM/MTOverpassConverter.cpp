@@ -5,101 +5,217 @@
 
 #include "CesiumCartographicPolygon.h"
 #include "GeomTools.h"
+#include "MTWayGraphBuilder.h"
+#include "String/Find.h"
 
 namespace MTOverpass
 {
     EMTWay WayStringToEnum(const FString& Way)
     {
-        return static_cast<EMTWay>(FindObject<UEnum>(ANY_PACKAGE, TEXT("EMTWay"))->GetValueByName(FName(*Way)));
+        // StaticEnum instead of FindObject so ways can be converted off the game thread
+        return static_cast<EMTWay>(StaticEnum<EMTWay>()->GetValueByName(FName(*Way)));
     };
 
-    FMTWayGraph CreateStreetGraphFromQuery(const FOverPassQueryResult& Query, const ACesiumCartographicPolygon* BoundingPolygon)
+    namespace
     {
-        TArray<FVector> BoundingPolyline;
-        TArray<FVector2D> BoundingPolyline2D;
-        FBox2d BoundingBox2D;
-        
-        if (BoundingPolygon)
+        const TCHAR* const IncludedHighways[] = {
+            TEXT("motorway"),
+            TEXT("motorway_link"),
+            TEXT("trunk"),
+            TEXT("trunk_link"),
+            TEXT("primary"),
+            TEXT("primary_link"),
+            TEXT("secondary"),
+            TEXT("secondary_link"),
+            TEXT("tertiary"),
+            TEXT("tertiary_link"),
+            TEXT("service"),
+            TEXT("residential"),
+            TEXT("living_street"),
+            TEXT("pedestrian"),
+            TEXT("unclassified"),
+            TEXT("cycleway"),
+            TEXT("footway"),
+            TEXT("path")};
+
+        FString BuildQueryString(const TCHAR* SpatialFilter, const int32 Timeout)
         {
+            const auto HighwayPattern = FString::Join(IncludedHighways, TEXT("|"));
+
+            // Tunnel and covered rules are mirrored in FMTWayGraphBuilder::AddWay
+            return FString::Printf(
+                TEXT("[out:json][timeout:%d];way['highway'~'%s']['covered'!~'yes'][!'tunnel']%s;out geom;"),
+                Timeout,
+                *HighwayPattern,
+                SpatialFilter);
+        }
+    }  // namespace
 
-            
-            BoundingPolygon->Polygon->ConvertSplineToPolyLine(ESplineCoordinateSpace::World, 1., BoundingPolyline);
-            BoundingPolyline2D.Reserve(BoundingPolyline.Num());
-            for (const auto& Vert : BoundingPolyline)
+    bool IsIncludedHighway(const FStringView Highway)
+    {
+        // Overpass matches the pattern as an unanchored regex, e.g. services is included as well
+        for (const auto* IncludedHighway : IncludedHighways)
+        {
+            if (UE::String::FindFirst(Highway, IncludedHighway) != INDEX_NONE)
             {
-                BoundingPolyline2D.Add(FVector2D(Vert.X, Vert.Y));
+                return true;
             }
+        }
+        return false;
+    }
 
-            BoundingPolyline2D.RemoveAtSwap(BoundingPolyline2D.Num() - 1);
+    FMTGeoPolygon::FMTGeoPolygon(const ACesiumCartographicPolygon* BoundingPolygon)
+    {
+        if (!BoundingPolygon)
+        {
+            return;
+        }
 
-            BoundingBox2D = FBox2d(BoundingPolyline2D);
+        // Same vertices that are sent to Overpass, see BuildQueryStringFromBoundingPolygon
+        const auto PolygonGlobalSpaceVertices = BoundingPolygon->CreateCartographicPolygon(FTransform::Identity).getVertices();
+        Vertices.Reserve(PolygonGlobalSpaceVertices.size());
+        for (const auto& Vertex : PolygonGlobalSpaceVertices)
+        {
+            Vertices.Add(FVector2D(FMath::RadiansToDegrees(Vertex.x), FMath::RadiansToDegrees(Vertex.y)));
         }
 
-        TMap<int64, int32> OSMNodeIDToNodeIndex;
-        TMap<FString, int32> OSMWayNameToWayIndex;
+        Bounds = FBox2d(Vertices);
+    }
 
-        int32 CurrentWayIndex = 0;
-        
-        FMTWayGraph Result;
-    
-        for (const auto& Element : Query.Elements)
+    bool FMTGeoPolygon::IsInside(const FOverpassCoordinates& Coords) const
+    {
+        if (Vertices.IsEmpty())
+        {
+            return true;
+        }
+
+        const FVector2D TestPoint(Coords.Lon, Coords.Lat);
+        return Bounds.IsInsideOrOn(TestPoint) && FGeomTools2D::IsPointInPolygon(TestPoint, Vertices);
+    }
+
+    bool FMTGeoPolygon::IsUnbounded() const
+    {
+        return Vertices.IsEmpty();
+    }
+
+    const FBox2d& FMTGeoPolygon::GetBounds() const
+    {
+        return Bounds;
+    }
+
+    bool FMTGeoPolygon::IntersectsBox(const FBox2d& Box) const
+    {
+        if (Vertices.IsEmpty())
+        {
+            return true;
+        }
+
+        if (!Bounds.Intersect(Box))
+        {
+            return false;
+        }
+
+        // Box inside of the polygon
+        if (FGeomTools2D::IsPointInPolygon(Box.GetCenter(), Vertices))
+        {
+            return true;
+        }
+
+        const FVector2D Corners[] = {
+            Box.Min, FVector2D(Box.Max.X, Box.Min.Y), Box.Max, FVector2D(Box.Min.X, Box.Max.Y)};
+
+        constexpr int32 CornerNum = UE_ARRAY_COUNT(Corners);
+        for (int32 VertexIndex = 0; VertexIndex < Vertices.Num(); ++VertexIndex)
         {
-            for (int32 NodeIndex = 0; NodeIndex < Element.Nodes.Num(); NodeIndex++)
+            const auto& Vertex = Vertices[VertexIndex];
+            const auto& NextVertex = Vertices[(VertexIndex + 1) % Vertices.Num()];
+
+            // Polygon inside of the box
+            if (Box.IsInsideOrOn(Vertex))
             {
-                const auto NodeID  = Element.Nodes[NodeIndex];
-                
-                if (!OSMNodeIDToNodeIndex.Contains(Element.Nodes[NodeIndex]))
+                return true;
+            }
+
+            for (int32 CornerIndex = 0; CornerIndex < CornerNum; ++CornerIndex)
+            {
+                FVector Intersection;
+                if (FMath::SegmentIntersection2D(
+                        FVector(Vertex, 0.),
+                        FVector(NextVertex, 0.),
+                        FVector(Corners[CornerIndex], 0.),
+                        FVector(Corners[(CornerIndex + 1) % CornerNum], 0.),
+                        Intersection))
                 {
-                    if (!BoundingPolygon) {
-                        OSMNodeIDToNodeIndex.Add(NodeID, Result.AddNode(Element.Geometry[NodeIndex]));
-                    }
-                    else
-                    {
-                        const auto TestPoint3D = ACesiumGeoreference::GetDefaultGeoreference(BoundingPolygon)->TransformLongitudeLatitudeHeightPositionToUnreal(FVector(Element.Geometry[NodeIndex].Lon, Element.Geometry[NodeIndex].Lat, 0.));
-                        const auto TestPoint2D = FVector2D(TestPoint3D.X, TestPoint3D.Y);
-                        if (BoundingBox2D.IsInsideOrOn(TestPoint2D) && FGeomTools2D::IsPointInPolygon(TestPoint2D, BoundingPolyline2D))
-                        {
-                            OSMNodeIDToNodeIndex.Add(NodeID, Result.AddNode(Element.Geometry[NodeIndex]));
-                        }
-                    }
+                    return true;
                 }
             }
         }
-        
+
+        return false;
+    }
+
+    TArray<int32> FMTWayGraphDelta::GetChangedNodes() const
+    {
+        TSet<int32> ChangedNodes(AddedNodes);
+        for (const auto& [Node1, Node2] : AddedEdges)
+        {
+            ChangedNodes.Add(Node1);
+            ChangedNodes.Add(Node2);
+        }
+        return ChangedNodes.Array();
+    }
+
+    FMTWayGraph CreateStreetGraphFromQuery(const FOverPassQueryResult& Query, const ACesiumCartographicPolygon* BoundingPolygon)
+    {
+        FMTWayGraph Result;
+        MergeQueryIntoStreetGraph(Result, Query, BoundingPolygon);
+        return Result;
+    }
+
+    FMTWayGraphDelta MergeQueryIntoStreetGraph(FMTWayGraph& Graph, const FOverPassQueryResult& Query, const ACesiumCartographicPolygon* BoundingPolygon)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTOverpass::MergeQueryIntoStreetGraph);
+
+        FMTWayGraphBuilder Builder(Graph, FMTGeoPolygon(BoundingPolygon));
+
         for (const auto& Element : Query.Elements)
         {
-            for (int32 NodeIndex = 0; NodeIndex < Element.Nodes.Num() - 1; NodeIndex++)
+            FMTOSMWayTags Tags;
+            if (const auto* Highway = Element.Tags.Find(TEXT("highway")))
             {
-                const auto NodeID  = Element.Nodes[NodeIndex];
+                Tags.Highway = Builder.InternTagValue(*Highway);
+            }
+            if (const auto* Name = Element.Tags.Find(TEXT("name")))
+            {
+                Tags.Name = Builder.InternTagValue(*Name);
+            }
+            Tags.bIsTunnel = Element.Tags.Contains(TEXT("tunnel"));
+            Tags.bIsCovered = Element.Tags.FindRef(TEXT("covered")) == TEXT("yes");
 
-                const auto NextNodeIndex = NodeIndex + 1;
-                const auto NextNodeID  = Element.Nodes[NextNodeIndex];
-                
-                const auto WayName = Element.Tags.Contains("name") ? Element.Tags["name"] : FString();
-                const auto WayType = Element.Tags["highway"];
-                const auto WayKind = static_cast<int32>(WayStringToEnum(*WayType)) != -1 ? WayStringToEnum(WayType) : EMTWay::Unclassified;
+            Builder.AddWay(Element.Nodes, Element.Geometry, Tags);
+        }
 
-                if (!OSMWayNameToWayIndex.Contains(WayName))
-                {
-                    Result.AddWay(WayName, WayKind);
-                    OSMWayNameToWayIndex.Add(WayName, CurrentWayIndex);
-                    CurrentWayIndex++;
-                }
+        return Builder.GetDelta();
+    }
 
-                const auto WayIndex = OSMWayNameToWayIndex[WayName];
-                if (WayKind != EMTWay::Unclassified && Result.GetWayKind(WayIndex) == EMTWay::Unclassified)
-                {
-                    Result.UpdateWayKind(WayIndex, WayKind);
-                }
+    bool CanMergeQueryIntoStreetGraph(const FMTWayGraph& Graph, const ACesiumCartographicPolygon* BoundingPolygon)
+    {
+        if (!Graph.HasOSMIDs())
+        {
+            return false;
+        }
 
-                if(OSMNodeIDToNodeIndex.Contains(NodeID) && OSMNodeIDToNodeIndex.Contains(NextNodeID) && OSMNodeIDToNodeIndex[NodeID] != OSMNodeIDToNodeIndex[NextNodeID] && !Result.AreNodesConnected(OSMNodeIDToNodeIndex[NodeID], OSMNodeIDToNodeIndex[NextNodeID]))
-                {
-                    Result.ConnectNodes(OSMNodeIDToNodeIndex[NodeID], OSMNodeIDToNodeIndex[NextNodeID], WayIndex);
-                }
+        // Merging only adds to the graph, a polygon that no longer contains all nodes requires a rebuild
+        const FMTGeoPolygon GeoPolygon(BoundingPolygon);
+        for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+        {
+            if (!GeoPolygon.IsInside(Graph.GetNodeLocation(NodeIndex)))
+            {
+                return false;
             }
         }
 
-        return Result;
+        return true;
     }
 
     FString BuildQueryStringFromBoundingPolygon(const ACesiumCartographicPolygon* BoundingPolygon)
@@ -118,8 +234,22 @@ namespace MTOverpass
         }
         // Remove last space
         PolygonStringBuilder.RemoveSuffix(1);
-        PolygonStringBuilder << TEXT("');");
+        PolygonStringBuilder << TEXT("')");
+
+        return BuildQueryString(PolygonStringBuilder.ToString(), 600);
+    }
 
-        return FString::Printf(TEXT("[out:json][timeout:600];way['highway'~'motorway|motorway_link|trunk|trunk_link|primary|primary_link|secondary|secondary_link|tertiary|tertiary_link|service|residential|living_street|pedestrian|unclassified|cycleway|footway|path']['covered'!~'yes'][!'tunnel']%sout geom;"), PolygonStringBuilder.ToString());
+    FString BuildQueryStringFromBox(const FBox2d& Box)
+    {
+        // Overpass boxes are south, west, north, east
+        const auto BoxFilter = FString::Printf(
+            TEXT("(%s,%s,%s,%s)"),
+            *FString::SanitizeFloat(Box.Min.Y),
+            *FString::SanitizeFloat(Box.Min.X),
+            *FString::SanitizeFloat(Box.Max.Y),
+            *FString::SanitizeFloat(Box.Max.X));
+
+        // Tiles are small, a tile that times out is split instead of waiting for minutes
+        return BuildQueryString(*BoxFilter, 180);
     }
 }
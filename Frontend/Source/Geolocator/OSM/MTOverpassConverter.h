@@ -11,8 +11,57 @@ class ACesiumCartographicPolygon;
 namespace MTOverpass
 {
     EMTWay WayStringToEnum(const FString& Way);
+
+    // Highway values the street graph consists of, shared by the Overpass query and offline sources
+    bool IsIncludedHighway(const FStringView Highway);
+
+    // Bounding polygon in longitude/latitude degrees, does not touch any actor and can be used off
+    // the game thread. A default constructed polygon contains everything.
+    class GEOLOCATOR_API FMTGeoPolygon
+    {
+    public:
+        FMTGeoPolygon() = default;
+
+        explicit FMTGeoPolygon(const ACesiumCartographicPolygon* BoundingPolygon);
+
+        bool IsInside(const FOverpassCoordinates& Coords) const;
+
+        // True for default constructed polygons
+        bool IsUnbounded() const;
+
+        const FBox2d& GetBounds() const;
+
+        // Conservative, a box that only touches the polygon counts as intersecting
+        bool IntersectsBox(const FBox2d& Box) const;
+
+    private:
+        // X is longitude, Y is latitude
+        TArray<FVector2D> Vertices;
+
+        FBox2d Bounds;
+    };
+
+    // Nodes and edges added to a way graph by a merge
+    struct FMTWayGraphDelta
+    {
+        TArray<int32> AddedNodes;
+
+        TArray<TPair<int32, int32>> AddedEdges;
+
+        // Added nodes and nodes that gained an edge
+        TArray<int32> GetChangedNodes() const;
+    };
     
     FMTWayGraph CreateStreetGraphFromQuery(const FOverPassQueryResult& Query, const ACesiumCartographicPolygon* BoundingPolygon = nullptr);
 
+    // Adds nodes and edges of the query that are not part of the graph yet, nodes are deduplicated by OSM ID
+    FMTWayGraphDelta MergeQueryIntoStreetGraph(FMTWayGraph& Graph, const FOverPassQueryResult& Query, const ACesiumCartographicPolygon* BoundingPolygon = nullptr);
+
+    // True if the graph has OSM IDs and lies completely inside the bounding polygon e.g. because the polygon was extended
+    bool CanMergeQueryIntoStreetGraph(const FMTWayGraph& Graph, const ACesiumCartographicPolygon* BoundingPolygon);
+
     FString BuildQueryStringFromBoundingPolygon(const ACesiumCartographicPolygon* BoundingPolygon);
+
+    // Same ways as BuildQueryStringFromBoundingPolygon but for a longitude/latitude box
+    FString BuildQueryStringFromBox(const FBox2d& Box);
 }
@@ -8,74 +8,193 @@
 
 #include "Interfaces/IHttpResponse.h"
 
+#include "MTOverpassCache.h"
+#include "MTOverpassStreamingParser.h"
+
+FString MTOverpass::BuildQueryURL(const FString& OverpassQueryString)
+{
+    return FString::Printf(TEXT("%s?data=%s"), *GetEndpointURL(), *FGenericPlatformHttp::UrlEncode(OverpassQueryString.Replace(TEXT("\n"), TEXT(""))));
+}
+
 namespace
 {
-    void AsyncQueryInternal(
+    struct FStreetGraphQueryState
+    {
+        FStreetGraphQueryState(const FMTWayGraph& BaseGraph, const MTOverpass::FMTGeoPolygon& BoundingPolygon)
+            : Result{BaseGraph}
+            , Builder(Result.Graph, BoundingPolygon)
+            , Parser(Builder)
+        {
+        }
+
+        void Feed(const TConstArrayView<uint8> Data)
+        {
+            Parser.Feed(Data);
+            if (CacheWriter)
+            {
+                CacheWriter->Append(Data);
+            }
+        }
+
+        FMTStreetGraphQueryResult Result;
+        FMTWayGraphBuilder Builder;
+        FMTOverpassStreamingParser Parser;
+        // Only set for downloaded responses
+        TUniquePtr<FMTOverpassCacheWriter> CacheWriter;
+    };
+
+    // Receives the response body on the HTTP thread and parses it right away
+    class FStreetGraphResponseStream : public FArchive
+    {
+    public:
+        explicit FStreetGraphResponseStream(const TSharedRef<FStreetGraphQueryState>& InState)
+            : State(InState)
+        {
+            SetIsSaving(true);
+        }
+
+        virtual void Serialize(void* Data, int64 Num) override
+        {
+            State->Feed(TConstArrayView<uint8>(static_cast<const uint8*>(Data), Num));
+        }
+
+    private:
+        TSharedRef<FStreetGraphQueryState> State;
+    };
+
+    void AsyncQueryStreetGraphInternal(
         const FString& OverpassQueryString,
-        const FMTOverPassQueryCompletionDelegate& CompletionDelegate,
+        const MTOverpass::FMTGeoPolygon& BoundingPolygon,
+        const TSharedRef<const FMTWayGraph>& BaseGraph,
+        const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate,
         const int32 CurrentTry)
     {
         constexpr auto MaxRetries = 3;
         if (CurrentTry >= MaxRetries)
         {
-            CompletionDelegate.ExecuteIfBound({}, false);
+            FMTStreetGraphQueryResult EmptyResult;
+            CompletionDelegate.ExecuteIfBound(EmptyResult, false);
 
             return;
         }
-        FHttpModule& HTTP = FHttpModule::Get();
-        
-        const auto QueryRequest = HTTP.CreateRequest();
-        QueryRequest->SetVerb(TEXT("GET"));
 
-        const auto EscapedUrl = FString::Printf(TEXT("http://www.overpass-api.de/api/interpreter?data=%s"), *FGenericPlatformHttp::UrlEncode(OverpassQueryString.Replace(TEXT("\n"), TEXT(""))));
-        QueryRequest->SetURL(EscapedUrl);
+        // Every try starts from the base graph again
+        const auto State = MakeShared<FStreetGraphQueryState>(*BaseGraph, BoundingPolygon);
+        State->CacheWriter = MakeUnique<FMTOverpassCacheWriter>(OverpassQueryString);
+
+        const auto QueryRequest = FHttpModule::Get().CreateRequest();
+        QueryRequest->SetVerb(TEXT("GET"));
+        QueryRequest->SetURL(MTOverpass::BuildQueryURL(OverpassQueryString));
+        const auto bIsStreaming = QueryRequest->SetResponseBodyReceiveStream(MakeShared<FStreetGraphResponseStream>(State));
 
         QueryRequest->OnProcessRequestComplete().BindLambda(
-            [&CompletionDelegate, CurrentTry, OverpassQueryString](
+            [&CompletionDelegate, CurrentTry, OverpassQueryString, BoundingPolygon, BaseGraph, State, bIsStreaming](
                 FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
             {
-                if (bConnectedSuccessfully)
+                // Retried like incomplete responses, the delegate is called once the tries are exhausted
+                if (!bConnectedSuccessfully || !Response)
                 {
-                    // if we receive html it means we got an error from overpass API
-                    if (Response->GetContentType().Contains(TEXT("text/html")))
-                    {
-                        // TODO restart reequest a couple of times
-                        AsyncQueryInternal(OverpassQueryString, CompletionDelegate, CurrentTry + 1);
-                    }
-                    else
+                    UE_LOG(LogTemp, Warning, TEXT("Overpass request failed to connect, retrying"));
+                    AsyncQueryStreetGraphInternal(OverpassQueryString, BoundingPolygon, BaseGraph, CompletionDelegate, CurrentTry + 1);
+                    return;
+                }
+
+                // if we receive html it means we got an error from overpass API
+                if (Response->GetContentType().Contains(TEXT("text/html")))
+                {
+                    AsyncQueryStreetGraphInternal(OverpassQueryString, BoundingPolygon, BaseGraph, CompletionDelegate, CurrentTry + 1);
+                    return;
+                }
+
+                // Platforms without response streams only provide the body once it is complete
+                TArray<uint8> Content;
+                if (!bIsStreaming)
+                {
+                    Content = Response->GetContent();
+                }
+
+                AsyncTask(
+                    ENamedThreads::AnyBackgroundThreadNormalTask,
+                    [State, Content = MoveTemp(Content), &CompletionDelegate, CurrentTry, OverpassQueryString, BoundingPolygon, BaseGraph]()
                     {
-                        const auto Content = Response->GetContentAsString();
+                        if (Content.Num() > 0)
+                        {
+                            State->Feed(Content);
+                        }
+
+                        const auto bSuccess = State->Parser.Finish();
+                        State->Result.Delta = State->Builder.GetDelta();
+
+                        // Only complete responses are cached, a 200 response can still end in a
+                        // runtime error remark after partial elements
+                        if (bSuccess)
+                        {
+                            State->CacheWriter->Commit();
+                        }
+
                         AsyncTask(
-                            ENamedThreads::AnyBackgroundThreadNormalTask,
-                            [Content, &CompletionDelegate]()
+                            ENamedThreads::GameThread,
+                            [State, bSuccess, &CompletionDelegate, CurrentTry, OverpassQueryString, BoundingPolygon, BaseGraph]()
                             {
-                                FOverPassQueryResult Result;
-                                FJsonObjectConverter::JsonObjectStringToUStruct(Content, &Result);
+                                if (!bSuccess)
+                                {
+                                    UE_LOG(
+                                        LogTemp,
+                                        Warning,
+                                        TEXT("%s, retrying"),
+                                        State->Parser.HasRemark() ? TEXT("Overpass reported a runtime error")
+                                                                  : TEXT("Incomplete Overpass response"));
+                                    AsyncQueryStreetGraphInternal(OverpassQueryString, BoundingPolygon, BaseGraph, CompletionDelegate, CurrentTry + 1);
+                                    return;
+                                }
 
-                                AsyncTask(
-                                    ENamedThreads::GameThread,
-                                    [Result, &CompletionDelegate]()
-                                    { CompletionDelegate.ExecuteIfBound(Result, true); });
+                                CompletionDelegate.ExecuteIfBound(State->Result, true);
                             });
-                    }
-                }
-                else
-                {
-                    switch (Request->GetStatus())
-                    {
-                        case EHttpRequestStatus::Failed_ConnectionError:
-                            UE_LOG(LogTemp, Error, TEXT("Connection failed."));
-                        default:
-                            UE_LOG(LogTemp, Error, TEXT("Request failed."));
-                    }
-                }
+                    });
             });
 
         QueryRequest->ProcessRequest();
     }
 }  // namespace
 
-void MTOverpass::AsyncQuery(const FString& OverpassQueryString, const FMTOverPassQueryCompletionDelegate& CompletionDelegate)
+void MTOverpass::AsyncQueryStreetGraph(
+    const FString& OverpassQueryString,
+    const FMTGeoPolygon& BoundingPolygon,
+    const FMTWayGraph& BaseGraph,
+    const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate)
 {
-    AsyncQueryInternal(OverpassQueryString, CompletionDelegate, 0);
+    const auto SharedBaseGraph = MakeShared<const FMTWayGraph>(BaseGraph);
+
+    AsyncTask(
+        ENamedThreads::AnyBackgroundThreadNormalTask,
+        [OverpassQueryString, BoundingPolygon, SharedBaseGraph, &CompletionDelegate]()
+        {
+            FStreetGraphQueryState CachedState(*SharedBaseGraph, BoundingPolygon);
+            const auto bIsCached =
+                MTOverpass::ReadCachedResponse(
+                    OverpassQueryString,
+                    [&CachedState](const TConstArrayView<uint8> Chunk) { return CachedState.Parser.Feed(Chunk); }) &&
+                CachedState.Parser.Finish();
+
+            TOptional<FMTStreetGraphQueryResult> CachedResult;
+            if (bIsCached)
+            {
+                CachedState.Result.Delta = CachedState.Builder.GetDelta();
+                CachedResult.Emplace(MoveTemp(CachedState.Result));
+            }
+
+            AsyncTask(
+                ENamedThreads::GameThread,
+                [OverpassQueryString, BoundingPolygon, SharedBaseGraph, CachedResult = MoveTemp(CachedResult), &CompletionDelegate]() mutable
+                {
+                    if (CachedResult.IsSet())
+                    {
+                        UE_LOG(LogTemp, Display, TEXT("Using cached Overpass response"));
+                        CompletionDelegate.ExecuteIfBound(CachedResult.GetValue(), true);
+                        return;
+                    }
+
+                    AsyncQueryStreetGraphInternal(OverpassQueryString, BoundingPolygon, SharedBaseGraph, CompletionDelegate, 0);
+                });
+        });
 }
@@ -6,10 +6,29 @@
 
 #include "JsonObjectConverter.h"
 
+#include "MTOverpassConverter.h"
 #include "MTOverpassSchema.h"
 
+struct FMTStreetGraphQueryResult
+{
+    FMTWayGraph Graph;
+
+    MTOverpass::FMTWayGraphDelta Delta;
+};
+
+// The result can be moved out of by the receiver
+DECLARE_DELEGATE_TwoParams(FMTStreetGraphQueryCompletionDelegate, FMTStreetGraphQueryResult&, const bool);
+
 namespace MTOverpass
 {
-    void AsyncQuery(const FString& OverpassQueryString, const FMTOverPassQueryCompletionDelegate& CompletionDelegate);
+    FString BuildQueryURL(const FString& OverpassQueryString);
+
+    // Parses the response while it is downloaded and adds the ways directly to a copy of BaseGraph,
+    // pass an empty graph to build a new one. Completes on the game thread.
+    void AsyncQueryStreetGraph(
+        const FString& OverpassQueryString,
+        const FMTGeoPolygon& BoundingPolygon,
+        const FMTWayGraph& BaseGraph,
+        const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate);
 }
 
@@ -50,5 +50,3 @@ struct FOverPassQueryResult
     UPROPERTY()
     TArray<FOverpassElement> Elements;
 };
-
-DECLARE_DELEGATE_TwoParams(FMTOverPassQueryCompletionDelegate, const FOverPassQueryResult&, const bool);
@@ -0,0 +1,607 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTOverpassStreamingParser.h"
+
+namespace
+{
+    // Recursive descent reader over the complete bytes of a single element
+    class FElementReader
+    {
+    public:
+        explicit FElementReader(const TConstArrayView<uint8> Data)
+            : Current(Data.GetData())
+            , End(Data.GetData() + Data.Num())
+        {
+        }
+
+        bool HasError() const
+        {
+            return bHasError;
+        }
+
+        void SkipWhitespace()
+        {
+            while (Current < End && (*Current == ' ' || *Current == '\n' || *Current == '\r' ||
+                                     *Current == '\t'))
+            {
+                Current++;
+            }
+        }
+
+        bool Consume(const uint8 Char)
+        {
+            SkipWhitespace();
+            if (Current < End && *Current == Char)
+            {
+                Current++;
+                return true;
+            }
+            return false;
+        }
+
+        bool Expect(const uint8 Char)
+        {
+            if (!Consume(Char))
+            {
+                bHasError = true;
+            }
+            return !bHasError;
+        }
+
+        bool ConsumeLiteral(const ANSICHAR* Literal)
+        {
+            SkipWhitespace();
+            const auto Length = FCStringAnsi::Strlen(Literal);
+            if (End - Current >= Length && FMemory::Memcmp(Current, Literal, Length) == 0)
+            {
+                Current += Length;
+                return true;
+            }
+            return false;
+        }
+
+        // Raw bytes between the quotes, escapes are not resolved
+        bool ReadRawString(FUtf8StringView& OutString)
+        {
+            if (!Expect('"'))
+            {
+                return false;
+            }
+
+            const auto* Start = Current;
+            while (Current < End && *Current != '"')
+            {
+                Current += *Current == '\\' ? 2 : 1;
+            }
+
+            if (Current >= End)
+            {
+                bHasError = true;
+                return false;
+            }
+
+            OutString = FUtf8StringView(
+                reinterpret_cast<const UTF8CHAR*>(Start), static_cast<int32>(Current - Start));
+            Current++;
+            return true;
+        }
+
+        bool ReadString(TArray<UTF8CHAR>& OutString)
+        {
+            FUtf8StringView RawString;
+            if (!ReadRawString(RawString))
+            {
+                return false;
+            }
+
+            OutString.Reset();
+            for (int32 Index = 0; Index < RawString.Len(); ++Index)
+            {
+                const auto Char = RawString[Index];
+                if (Char != '\\' || Index + 1 >= RawString.Len())
+                {
+                    OutString.Add(Char);
+                    continue;
+                }
+
+                const auto Escaped = RawString[++Index];
+                switch (Escaped)
+                {
+                    case 'b':
+                        OutString.Add('\b');
+                        break;
+                    case 'f':
+                        OutString.Add('\f');
+                        break;
+                    case 'n':
+                        OutString.Add('\n');
+                        break;
+                    case 'r':
+                        OutString.Add('\r');
+                        break;
+                    case 't':
+                        OutString.Add('\t');
+                        break;
+                    case 'u':
+                    {
+                        uint32 CodePoint = ReadHex4(RawString, Index + 1);
+                        Index += 4;
+                        // Surrogate pair
+                        if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF &&
+                            Index + 6 < RawString.Len() && RawString[Index + 1] == '\\' &&
+                            RawString[Index + 2] == 'u')
+                        {
+                            const auto LowSurrogate = ReadHex4(RawString, Index + 3);
+                            CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (LowSurrogate - 0xDC00);
+                            Index += 6;
+                        }
+                        AppendUtf8(CodePoint, OutString);
+                        break;
+                    }
+                    default:
+                        OutString.Add(Escaped);
+                        break;
+                }
+            }
+            return true;
+        }
+
+        bool ReadNumber(double& OutNumber)
+        {
+            ANSICHAR NumberString[64];
+            if (!ReadNumberString(NumberString))
+            {
+                return false;
+            }
+            OutNumber = FCStringAnsi::Atod(NumberString);
+            return true;
+        }
+
+        bool ReadInteger(int64& OutNumber)
+        {
+            ANSICHAR NumberString[64];
+            if (!ReadNumberString(NumberString))
+            {
+                return false;
+            }
+            OutNumber = FCStringAnsi::Atoi64(NumberString);
+            return true;
+        }
+
+        void SkipValue()
+        {
+            SkipWhitespace();
+            if (Current >= End)
+            {
+                bHasError = true;
+                return;
+            }
+
+            if (*Current == '"')
+            {
+                FUtf8StringView Ignored;
+                ReadRawString(Ignored);
+                return;
+            }
+
+            if (*Current == '{' || *Current == '[')
+            {
+                int32 NestedDepth = 0;
+                while (Current < End)
+                {
+                    if (*Current == '"')
+                    {
+                        FUtf8StringView Ignored;
+                        ReadRawString(Ignored);
+                        continue;
+                    }
+                    if (*Current == '{' || *Current == '[')
+                    {
+                        NestedDepth++;
+                    }
+                    else if (*Current == '}' || *Current == ']')
+                    {
+                        NestedDepth--;
+                        if (NestedDepth == 0)
+                        {
+                            Current++;
+                            return;
+                        }
+                    }
+                    Current++;
+                }
+                bHasError = true;
+                return;
+            }
+
+            // Numbers, true, false, null
+            while (Current < End && *Current != ',' && *Current != '}' && *Current != ']')
+            {
+                Current++;
+            }
+        }
+
+    private:
+        const uint8* Current;
+
+        const uint8* End;
+
+        bool bHasError = false;
+
+        bool ReadNumberString(ANSICHAR (&OutNumberString)[64])
+        {
+            SkipWhitespace();
+            int32 Length = 0;
+            while (Current < End && Length < 63 &&
+                   ((*Current >= '0' && *Current <= '9') || *Current == '-' || *Current == '+' ||
+                    *Current == '.' || *Current == 'e' || *Current == 'E'))
+            {
+                OutNumberString[Length++] = static_cast<ANSICHAR>(*Current++);
+            }
+            OutNumberString[Length] = '\0';
+
+            if (Length == 0)
+            {
+                bHasError = true;
+            }
+            return Length > 0;
+        }
+
+        static uint32 ReadHex4(const FUtf8StringView String, const int32 Start)
+        {
+            uint32 Result = 0;
+            for (int32 Index = Start; Index < Start + 4 && Index < String.Len(); ++Index)
+            {
+                const auto Char = String[Index];
+                Result <<= 4;
+                if (Char >= '0' && Char <= '9')
+                {
+                    Result |= Char - '0';
+                }
+                else if (Char >= 'a' && Char <= 'f')
+                {
+                    Result |= Char - 'a' + 10;
+                }
+                else if (Char >= 'A' && Char <= 'F')
+                {
+                    Result |= Char - 'A' + 10;
+                }
+            }
+            return Result;
+        }
+
+        static void AppendUtf8(const uint32 CodePoint, TArray<UTF8CHAR>& OutString)
+        {
+            if (CodePoint < 0x80)
+            {
+                OutString.Add(static_cast<UTF8CHAR>(CodePoint));
+            }
+            else if (CodePoint < 0x800)
+            {
+                OutString.Add(static_cast<UTF8CHAR>(0xC0 | (CodePoint >> 6)));
+                OutString.Add(static_cast<UTF8CHAR>(0x80 | (CodePoint & 0x3F)));
+            }
+            else if (CodePoint < 0x10000)
+            {
+                OutString.Add(static_cast<UTF8CHAR>(0xE0 | (CodePoint >> 12)));
+                OutString.Add(static_cast<UTF8CHAR>(0x80 | ((CodePoint >> 6) & 0x3F)));
+                OutString.Add(static_cast<UTF8CHAR>(0x80 | (CodePoint & 0x3F)));
+            }
+            else
+            {
+                OutString.Add(static_cast<UTF8CHAR>(0xF0 | (CodePoint >> 18)));
+                OutString.Add(static_cast<UTF8CHAR>(0x80 | ((CodePoint >> 12) & 0x3F)));
+                OutString.Add(static_cast<UTF8CHAR>(0x80 | ((CodePoint >> 6) & 0x3F)));
+                OutString.Add(static_cast<UTF8CHAR>(0x80 | (CodePoint & 0x3F)));
+            }
+        }
+    };
+}  // namespace
+
+FMTOverpassStreamingParser::FMTOverpassStreamingParser(FMTWayGraphBuilder& InBuilder)
+    : Builder(InBuilder)
+{
+}
+
+bool FMTOverpassStreamingParser::Feed(const TConstArrayView<uint8> Data)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTOverpassStreamingParser::Feed);
+
+    if (bHasError)
+    {
+        return false;
+    }
+
+    // Start of the not yet buffered bytes of the current element in this chunk
+    int32 CaptureStart = 0;
+
+    for (int32 Index = 0; Index < Data.Num(); ++Index)
+    {
+        const auto Char = Data[Index];
+
+        if (bIsInString)
+        {
+            if (bIsEscaped)
+            {
+                bIsEscaped = false;
+            }
+            else if (Char == '\\')
+            {
+                bIsEscaped = true;
+            }
+            else if (Char == '"')
+            {
+                bIsInString = false;
+                continue;
+            }
+
+            if (Depth == 1 && TopLevelString.Num() < 64)
+            {
+                TopLevelString.Add(Char);
+            }
+            continue;
+        }
+
+        switch (Char)
+        {
+            case '"':
+                bIsInString = true;
+                if (Depth == 1)
+                {
+                    TopLevelString.Reset();
+                }
+                break;
+            case '{':
+            case '[':
+                if (Depth == 0 && Char != '{')
+                {
+                    bHasError = true;
+                    return false;
+                }
+                if (Depth == 1 && Char == '[' && TopLevelString.Num() == 8 &&
+                    FMemory::Memcmp(TopLevelString.GetData(), "elements", 8) == 0)
+                {
+                    bIsInElements = true;
+                }
+                Depth++;
+                if (bIsInElements && Depth == 3 && Char == '{')
+                {
+                    bIsCapturingElement = true;
+                    ElementBuffer.Reset();
+                    CaptureStart = Index;
+                }
+                break;
+            case '}':
+            case ']':
+                Depth--;
+                if (bIsCapturingElement && Depth == 2)
+                {
+                    bIsCapturingElement = false;
+                    ElementBuffer.Append(Data.GetData() + CaptureStart, Index + 1 - CaptureStart);
+                    ParseElement(ElementBuffer);
+                }
+                else if (bIsInElements && Depth == 1)
+                {
+                    bIsInElements = false;
+                }
+                else if (Depth == 0)
+                {
+                    bIsDone = true;
+                }
+                else if (Depth < 0)
+                {
+                    bHasError = true;
+                    return false;
+                }
+                break;
+            case ':':
+                if (Depth == 1 && TopLevelString.Num() == 6 &&
+                    FMemory::Memcmp(TopLevelString.GetData(), "remark", 6) == 0)
+                {
+                    bHasRemark = true;
+                }
+                break;
+            case ' ':
+            case '\n':
+            case '\r':
+            case '\t':
+                break;
+            default:
+                // Anything but whitespace before the first object is not JSON
+                if (Depth == 0)
+                {
+                    bHasError = true;
+                    return false;
+                }
+                break;
+        }
+    }
+
+    if (bIsCapturingElement)
+    {
+        ElementBuffer.Append(Data.GetData() + CaptureStart, Data.Num() - CaptureStart);
+    }
+
+    return !bHasError;
+}
+
+bool FMTOverpassStreamingParser::Finish() const
+{
+    return bIsDone && !bHasError && !bHasRemark;
+}
+
+bool FMTOverpassStreamingParser::HasError() const
+{
+    return bHasError;
+}
+
+bool FMTOverpassStreamingParser::HasRemark() const
+{
+    return bHasRemark;
+}
+
+int32 FMTOverpassStreamingParser::GetParsedWayNum() const
+{
+    return ParsedWayNum;
+}
+
+void FMTOverpassStreamingParser::ParseElement(const TConstArrayView<uint8> Element)
+{
+    FElementReader Reader(Element);
+
+    // Elements without a type are treated as ways, nodes and relations have no node list anyway
+    bool bIsWay = true;
+    FMTOSMWayTags Tags;
+    WayNodeIDs.Reset();
+    WayGeometry.Reset();
+
+    Reader.Expect('{');
+    if (Reader.Consume('}'))
+    {
+        return;
+    }
+
+    do
+    {
+        FUtf8StringView Key;
+        if (!Reader.ReadRawString(Key) || !Reader.Expect(':'))
+        {
+            break;
+        }
+
+        if (Key == UTF8TEXTVIEW("type"))
+        {
+            FUtf8StringView Type;
+            Reader.ReadRawString(Type);
+            bIsWay = Type == UTF8TEXTVIEW("way");
+        }
+        else if (Key == UTF8TEXTVIEW("nodes"))
+        {
+            Reader.Expect('[');
+            if (!Reader.Consume(']'))
+            {
+                do
+                {
+                    int64 NodeID;
+                    if (Reader.ReadInteger(NodeID))
+                    {
+                        WayNodeIDs.Add(NodeID);
+                    }
+                } while (!Reader.HasError() && Reader.Consume(','));
+                Reader.Expect(']');
+            }
+        }
+        else if (Key == UTF8TEXTVIEW("geometry"))
+        {
+            Reader.Expect('[');
+            if (!Reader.Consume(']'))
+            {
+                do
+                {
+                    // Nodes outside of the queried area have no geometry
+                    auto& Coords = WayGeometry.Add_GetRef({NAN, NAN});
+                    if (Reader.ConsumeLiteral("null"))
+                    {
+                        continue;
+                    }
+
+                    Reader.Expect('{');
+                    do
+                    {
+                        FUtf8StringView CoordKey;
+                        if (!Reader.ReadRawString(CoordKey) || !Reader.Expect(':'))
+                        {
+                            break;
+                        }
+                        if (CoordKey == UTF8TEXTVIEW("lat"))
+                        {
+                            Reader.ReadNumber(Coords.Lat);
+                        }
+                        else if (CoordKey == UTF8TEXTVIEW("lon"))
+                        {
+                            Reader.ReadNumber(Coords.Lon);
+                        }
+                        else
+                        {
+                            Reader.SkipValue();
+                        }
+                    } while (!Reader.HasError() && Reader.Consume(','));
+                    Reader.Expect('}');
+                } while (!Reader.HasError() && Reader.Consume(','));
+                Reader.Expect(']');
+            }
+        }
+        else if (Key == UTF8TEXTVIEW("tags"))
+        {
+            Reader.Expect('{');
+            if (!Reader.Consume('}'))
+            {
+                do
+                {
+                    FUtf8StringView TagKey;
+                    if (!Reader.ReadRawString(TagKey) || !Reader.Expect(':'))
+                    {
+                        break;
+                    }
+
+                    const auto bIsHighway = TagKey == UTF8TEXTVIEW("highway");
+                    const auto bIsName = TagKey == UTF8TEXTVIEW("name");
+                    const auto bIsTunnel = TagKey == UTF8TEXTVIEW("tunnel");
+                    const auto bIsCovered = TagKey == UTF8TEXTVIEW("covered");
+
+                    if (!bIsHighway && !bIsName && !bIsTunnel && !bIsCovered)
+                    {
+                        Reader.SkipValue();
+                        continue;
+                    }
+
+                    Reader.ReadString(DecodedString);
+
+                    if (bIsHighway || bIsName)
+                    {
+                        const FUTF8ToTCHAR Value(
+                            reinterpret_cast<const ANSICHAR*>(DecodedString.GetData()),
+                            DecodedString.Num());
+                        const auto TagValueID =
+                            Builder.InternTagValue(FStringView(Value.Get(), Value.Length()));
+                        if (bIsHighway)
+                        {
+                            Tags.Highway = TagValueID;
+                        }
+                        else
+                        {
+                            Tags.Name = TagValueID;
+                        }
+                    }
+                    else if (bIsTunnel)
+                    {
+                        Tags.bIsTunnel = true;
+                    }
+                    else
+                    {
+                        Tags.bIsCovered =
+                            FUtf8StringView(DecodedString.GetData(), DecodedString.Num()) ==
+                            UTF8TEXTVIEW("yes");
+                    }
+                } while (!Reader.HasError() && Reader.Consume(','));
+                Reader.Expect('}');
+            }
+        }
+        else
+        {
+            Reader.SkipValue();
+        }
+    } while (!Reader.HasError() && Reader.Consume(','));
+
+    if (Reader.HasError())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Skipping malformed Overpass element"));
+        return;
+    }
+
+    if (bIsWay && WayNodeIDs.Num() > 0 && WayNodeIDs.Num() == WayGeometry.Num())
+    {
+        Builder.AddWay(WayNodeIDs, WayGeometry, Tags);
+        ParsedWayNum++;
+    }
+}
@@ -0,0 +1,67 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MTWayGraphBuilder.h"
+
+/**
+ * Incremental parser for Overpass "out geom" JSON responses that feeds ways directly into a
+ * FMTWayGraphBuilder. Input can be fed in chunks of any size as it is downloaded, only the bytes
+ * of the element that is currently parsed are buffered and only the tags the way graph uses are
+ * kept.
+ */
+class GEOLOCATOR_API FMTOverpassStreamingParser
+{
+public:
+    explicit FMTOverpassStreamingParser(FMTWayGraphBuilder& InBuilder);
+
+    // Returns false once the input turned out not to be an Overpass JSON response e.g. an HTML
+    // error page
+    bool Feed(const TConstArrayView<uint8> Data);
+
+    // True if a complete response was parsed. Overpass reports timeouts and memory limits in a
+    // remark after the elements that were found so far, such responses are not complete.
+    bool Finish() const;
+
+    bool HasError() const;
+
+    bool HasRemark() const;
+
+    int32 GetParsedWayNum() const;
+
+private:
+    FMTWayGraphBuilder& Builder;
+
+    int32 Depth = 0;
+
+    bool bIsInString = false;
+
+    bool bIsEscaped = false;
+
+    bool bIsInElements = false;
+
+    bool bIsDone = false;
+
+    bool bHasError = false;
+
+    bool bHasRemark = false;
+
+    int32 ParsedWayNum = 0;
+
+    // Last string on the top level, used to find the elements array
+    TArray<uint8> TopLevelString;
+
+    // Bytes of the current element, can span multiple chunks
+    TArray<uint8> ElementBuffer;
+
+    bool bIsCapturingElement = false;
+
+    TArray<int64> WayNodeIDs;
+
+    TArray<FOverpassCoordinates> WayGeometry;
+
+    TArray<UTF8CHAR> DecodedString;
+
+    void ParseElement(const TConstArrayView<uint8> Element);
+};
@@ -0,0 +1,384 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTOverpassTiledQuery.h"
+
+#include "HttpModule.h"
+
+#include "Containers/Ticker.h"
+#include "Interfaces/IHttpResponse.h"
+
+#include "MTOverpassCache.h"
+#include "MTOverpassStreamingParser.h"
+#include "MTWayGraphBuilder.h"
+
+namespace
+{
+    constexpr auto MaxTileTries = 3;
+
+    // Only the start of a body is kept to tell timeout pages apart from other errors
+    constexpr int32 MaxErrorBodySize = 4096;
+
+    struct FTile
+    {
+        FBox2d Box;
+
+        int32 Try = 0;
+    };
+
+    enum class ETileResult : uint8
+    {
+        Success,
+        // The tile was too large for the server, smaller tiles can succeed
+        Timeout,
+        // Connection failures, rate limits and other errors, retrying the same tile later can succeed
+        Retry
+    };
+
+    struct FTileDownload
+    {
+        FTileDownload(FMTWayGraphBuilder& Builder, const FString& OverpassQueryString)
+            : Parser(Builder)
+            , CacheWriter(OverpassQueryString)
+        {
+        }
+
+        FMTOverpassStreamingParser Parser;
+
+        FMTOverpassCacheWriter CacheWriter;
+
+        TArray<uint8> BodyStart;
+    };
+
+    bool IsTimeoutPage(const TArray<uint8>& BodyStart)
+    {
+        const FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(BodyStart.GetData()), BodyStart.Num());
+        const FString Body(Converted.Length(), Converted.Get());
+        return Body.Contains(TEXT("runtime error")) || Body.Contains(TEXT("timed out")) ||
+               Body.Contains(TEXT("timeout"));
+    }
+
+    class FTiledStreetGraphQuery : public TSharedFromThis<FTiledStreetGraphQuery>
+    {
+    public:
+        FTiledStreetGraphQuery(
+            const FMTWayGraph& BaseGraph,
+            const MTOverpass::FMTGeoPolygon& InBoundingPolygon,
+            const MTOverpass::FMTTiledQuerySettings& InSettings,
+            const FMTStreetGraphQueryCompletionDelegate& InCompletionDelegate)
+            : Result{BaseGraph}
+            , Builder(Result.Graph, InBoundingPolygon)
+            , BoundingPolygon(InBoundingPolygon)
+            , Settings(InSettings)
+            , CompletionDelegate(InCompletionDelegate)
+        {
+        }
+
+        void Start()
+        {
+            const auto& Bounds = BoundingPolygon.GetBounds();
+            const auto TileSize = FMath::Max(Settings.TileSize, Settings.MinTileSize);
+            const auto Columns = FMath::Max(1, FMath::CeilToInt32(Bounds.GetSize().X / TileSize));
+            const auto Rows = FMath::Max(1, FMath::CeilToInt32(Bounds.GetSize().Y / TileSize));
+
+            for (int32 Row = 0; Row < Rows; ++Row)
+            {
+                for (int32 Column = 0; Column < Columns; ++Column)
+                {
+                    const FVector2D TileMin = Bounds.Min + FVector2D(Column, Row) * TileSize;
+                    AddTile({FBox2d(TileMin, FVector2D::Min(TileMin + TileSize, Bounds.Max))});
+                }
+            }
+
+            UE_LOG(LogTemp, Display, TEXT("Querying Overpass in %d tiles"), PendingTiles.Num());
+
+            ProcessPendingTiles();
+        }
+
+    private:
+        void AddTile(const FTile& Tile)
+        {
+            // Tiles of a concave polygon can be empty
+            if (BoundingPolygon.IntersectsBox(Tile.Box))
+            {
+                PendingTiles.Add(Tile);
+                TotalTileNum++;
+            }
+        }
+
+        void ProcessPendingTiles()
+        {
+            // Retries back off for all tiles, a rate limited or unreachable server gets fewer requests
+            const auto RemainingPauseSeconds = PausedUntilSeconds - FPlatformTime::Seconds();
+            if (RemainingPauseSeconds > 0. && !PendingTiles.IsEmpty())
+            {
+                if (!bIsResumeScheduled)
+                {
+                    bIsResumeScheduled = true;
+                    FTSTicker::GetCoreTicker().AddTicker(
+                        FTickerDelegate::CreateLambda(
+                            [This = AsShared()](float)
+                            {
+                                This->bIsResumeScheduled = false;
+                                This->ProcessPendingTiles();
+                                return false;
+                            }),
+                        RemainingPauseSeconds);
+                }
+                return;
+            }
+
+            while (InFlightTileNum < Settings.MaxConcurrentRequests && !PendingTiles.IsEmpty())
+            {
+                QueryTile(PendingTiles.Pop(false));
+            }
+
+            if (InFlightTileNum == 0 && PendingTiles.IsEmpty())
+            {
+                Complete();
+            }
+        }
+
+        void QueryTile(const FTile& Tile)
+        {
+            InFlightTileNum++;
+
+            AsyncTask(
+                ENamedThreads::AnyBackgroundThreadNormalTask,
+                [This = AsShared(), Tile]()
+                {
+                    const auto OverpassQueryString = MTOverpass::BuildQueryStringFromBox(Tile.Box);
+                    const auto bIsCached = This->MergeResponse(
+                        [&OverpassQueryString](FMTOverpassStreamingParser& Parser)
+                        {
+                            return MTOverpass::ReadCachedResponse(
+                                       OverpassQueryString,
+                                       [&Parser](const TConstArrayView<uint8> Chunk) { return Parser.Feed(Chunk); }) &&
+                                   Parser.Finish();
+                        });
+
+                    AsyncTask(
+                        ENamedThreads::GameThread,
+                        [This, Tile, OverpassQueryString, bIsCached]()
+                        {
+                            if (bIsCached)
+                            {
+                                This->OnTileCompleted(Tile, ETileResult::Success);
+                                return;
+                            }
+
+                            This->DownloadTile(Tile, OverpassQueryString);
+                        });
+                });
+        }
+
+        void DownloadTile(const FTile& Tile, const FString& OverpassQueryString)
+        {
+            const auto Download = MakeShared<FTileDownload>(Builder, OverpassQueryString);
+
+            const auto QueryRequest = FHttpModule::Get().CreateRequest();
+            QueryRequest->SetVerb(TEXT("GET"));
+            QueryRequest->SetURL(MTOverpass::BuildQueryURL(OverpassQueryString));
+            const auto bIsStreaming =
+                QueryRequest->SetResponseBodyReceiveStream(MakeShared<FTileResponseStream>(AsShared(), Download));
+
+            QueryRequest->OnProcessRequestComplete().BindLambda(
+                [This = AsShared(), Tile, Download, bIsStreaming](
+                    FHttpRequestPtr Request, FHttpResponsePtr Response, bool bConnectedSuccessfully)
+                {
+                    if (!bConnectedSuccessfully || !Response)
+                    {
+                        UE_LOG(LogTemp, Warning, TEXT("Overpass tile request failed to connect"));
+                        This->OnTileCompleted(Tile, ETileResult::Retry);
+                        return;
+                    }
+
+                    const auto ResponseCode = Response->GetResponseCode();
+                    // Platforms without response streams only provide the body once it is complete
+                    TArray<uint8> Content;
+                    if (!bIsStreaming)
+                    {
+                        Content = Response->GetContent();
+                    }
+
+                    const auto RetryAfterSeconds = FCString::Atod(*Response->GetHeader(TEXT("Retry-After")));
+                    const auto bIsHtml = Response->GetContentType().Contains(TEXT("text/html"));
+
+                    AsyncTask(
+                        ENamedThreads::AnyBackgroundThreadNormalTask,
+                        [This, Tile, Download, Content = MoveTemp(Content), ResponseCode, RetryAfterSeconds, bIsHtml]()
+                        {
+                            if (Content.Num() > 0)
+                            {
+                                This->FeedTile(*Download, Content);
+                            }
+
+                            auto Result = ETileResult::Retry;
+                            if (ResponseCode == 200 && !bIsHtml)
+                            {
+                                if (Download->Parser.Finish())
+                                {
+                                    Result = ETileResult::Success;
+                                    Download->CacheWriter.Commit();
+                                }
+                                else if (Download->Parser.HasRemark())
+                                {
+                                    // Finish rejects responses that end in a runtime error remark
+                                    Result = ETileResult::Timeout;
+                                }
+                            }
+                            // Rate limits are always retried, even if their page mentions a timeout
+                            else if (
+                                ResponseCode == 504 ||
+                                (ResponseCode != 429 && bIsHtml && IsTimeoutPage(Download->BodyStart)))
+                            {
+                                Result = ETileResult::Timeout;
+                            }
+
+                            if (Result == ETileResult::Retry)
+                            {
+                                UE_LOG(LogTemp, Warning, TEXT("Overpass tile failed with status %d"), ResponseCode);
+                            }
+
+                            AsyncTask(
+                                ENamedThreads::GameThread,
+                                [This, Tile, Result, RetryAfterSeconds]()
+                                { This->OnTileCompleted(Tile, Result, RetryAfterSeconds); });
+                        });
+                });
+
+            QueryRequest->ProcessRequest();
+        }
+
+        // Called on the HTTP thread as the body arrives, ways of a partially parsed response stay in the
+        // graph, they are complete and later responses containing them again are deduplicated by OSM ID
+        void FeedTile(FTileDownload& Download, const TConstArrayView<uint8> Data)
+        {
+            if (Download.BodyStart.Num() < MaxErrorBodySize)
+            {
+                Download.BodyStart.Append(
+                    Data.GetData(), FMath::Min(Data.Num(), MaxErrorBodySize - Download.BodyStart.Num()));
+            }
+            Download.CacheWriter.Append(Data);
+
+            FScopeLock Lock(&BuilderCriticalSection);
+            Download.Parser.Feed(Data);
+        }
+
+        bool MergeResponse(TFunctionRef<bool(FMTOverpassStreamingParser&)> Parse)
+        {
+            FScopeLock Lock(&BuilderCriticalSection);
+            FMTOverpassStreamingParser Parser(Builder);
+            return Parse(Parser);
+        }
+
+        void OnTileCompleted(const FTile& Tile, const ETileResult TileResult, const double RetryAfterSeconds = 0.)
+        {
+            InFlightTileNum--;
+
+            if (TileResult == ETileResult::Success)
+            {
+                CompletedTileNum++;
+                UE_LOG(LogTemp, Display, TEXT("Overpass tile %d/%d"), CompletedTileNum, TotalTileNum);
+            }
+            else if (TileResult == ETileResult::Timeout && Tile.Box.GetSize().GetMax() > Settings.MinTileSize)
+            {
+                // Subdivided tiles replace the failed one
+                TotalTileNum--;
+                const auto Center = Tile.Box.GetCenter();
+                AddTile({FBox2d(Tile.Box.Min, Center)});
+                AddTile({FBox2d(FVector2D(Center.X, Tile.Box.Min.Y), FVector2D(Tile.Box.Max.X, Center.Y))});
+                AddTile({FBox2d(FVector2D(Tile.Box.Min.X, Center.Y), FVector2D(Center.X, Tile.Box.Max.Y))});
+                AddTile({FBox2d(Center, Tile.Box.Max)});
+                UE_LOG(LogTemp, Warning, TEXT("Overpass tile timed out, splitting it"));
+            }
+            else if (Tile.Try + 1 < MaxTileTries)
+            {
+                const auto RetryDelaySeconds =
+                    FMath::Max(Settings.RetryDelaySeconds * (1 << Tile.Try), RetryAfterSeconds);
+                PausedUntilSeconds = FMath::Max(PausedUntilSeconds, FPlatformTime::Seconds() + RetryDelaySeconds);
+                PendingTiles.Add({Tile.Box, Tile.Try + 1});
+                UE_LOG(LogTemp, Warning, TEXT("Overpass tile failed, retrying in %.0f s"), RetryDelaySeconds);
+            }
+            else
+            {
+                FailedTileNum++;
+                UE_LOG(LogTemp, Error, TEXT("Overpass tile failed %d times"), MaxTileTries);
+            }
+
+            ProcessPendingTiles();
+        }
+
+        void Complete()
+        {
+            if (FailedTileNum > 0)
+            {
+                UE_LOG(LogTemp, Error, TEXT("%d of %d Overpass tiles failed"), FailedTileNum, TotalTileNum);
+            }
+
+            Result.Delta = Builder.GetDelta();
+            CompletionDelegate.ExecuteIfBound(Result, FailedTileNum == 0);
+        }
+
+        FMTStreetGraphQueryResult Result;
+
+        // Tiles are merged on background threads as soon as they arrive
+        FMTWayGraphBuilder Builder;
+
+        FCriticalSection BuilderCriticalSection;
+
+        MTOverpass::FMTGeoPolygon BoundingPolygon;
+
+        MTOverpass::FMTTiledQuerySettings Settings;
+
+        const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate;
+
+        TArray<FTile> PendingTiles;
+
+        int32 InFlightTileNum = 0;
+
+        int32 CompletedTileNum = 0;
+
+        int32 FailedTileNum = 0;
+
+        int32 TotalTileNum = 0;
+
+        double PausedUntilSeconds = 0.;
+
+        bool bIsResumeScheduled = false;
+
+        // Receives the body of a tile on the HTTP thread and merges it right away
+        class FTileResponseStream : public FArchive
+        {
+        public:
+            FTileResponseStream(
+                const TSharedRef<FTiledStreetGraphQuery>& InQuery,
+                const TSharedRef<FTileDownload>& InDownload)
+                : Query(InQuery)
+                , Download(InDownload)
+            {
+                SetIsSaving(true);
+            }
+
+            virtual void Serialize(void* Data, int64 Num) override
+            {
+                Query->FeedTile(*Download, TConstArrayView<uint8>(static_cast<const uint8*>(Data), Num));
+            }
+
+        private:
+            TSharedRef<FTiledStreetGraphQuery> Query;
+
+            TSharedRef<FTileDownload> Download;
+        };
+    };
+}  // namespace
+
+void MTOverpass::AsyncQueryStreetGraphTiled(
+    const FMTGeoPolygon& BoundingPolygon,
+    const FMTWayGraph& BaseGraph,
+    const FMTTiledQuerySettings& Settings,
+    const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate)
+{
+    check(!BoundingPolygon.IsUnbounded());
+
+    MakeShared<FTiledStreetGraphQuery>(BaseGraph, BoundingPolygon, Settings, CompletionDelegate)->Start();
+}
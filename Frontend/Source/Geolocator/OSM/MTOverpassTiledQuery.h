@@ -0,0 +1,33 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MTOverpassQuery.h"
+
+namespace MTOverpass
+{
+    struct FMTTiledQuerySettings
+    {
+        // Edge length of the initial tiles in degrees
+        double TileSize = 0.05;
+
+        // Tiles that time out are split until they reach this size, then they are retried
+        double MinTileSize = 0.005;
+
+        int32 MaxConcurrentRequests = 4;
+
+        // Other failures pause all requests for this long before the tile is retried, doubled with
+        // every try of the tile. Retry-After of rate limited responses is respected.
+        double RetryDelaySeconds = 5.;
+    };
+
+    // Splits the bounding polygon into a grid of tiles that are queried concurrently and merged into a
+    // copy of BaseGraph by OSM ID. Every finished tile is cached, a failed query resumes from the
+    // remaining tiles when it is started again. Completes on the game thread, fails if any tile failed.
+    void AsyncQueryStreetGraphTiled(
+        const FMTGeoPolygon& BoundingPolygon,
+        const FMTWayGraph& BaseGraph,
+        const FMTTiledQuerySettings& Settings,
+        const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate);
+}
@@ -0,0 +1,69 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTStreetGraphSource.h"
+
+#include "MTOSMPBFReader.h"
+
+FString FMTStreetGraphSource::GetCacheKey(const FString& OverpassQueryString) const
+{
+    if (Type == EMTStreetGraphSourceType::PBFFile)
+    {
+        return FString::Printf(
+            TEXT("pbf:%s;%s"), *FPaths::GetCleanFilename(PBFFile.FilePath), *OverpassQueryString);
+    }
+
+    return OverpassQueryString;
+}
+
+FString FMTStreetGraphSource::GetPBFFilePath() const
+{
+    if (FPaths::IsRelative(PBFFile.FilePath))
+    {
+        return FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), PBFFile.FilePath);
+    }
+
+    return PBFFile.FilePath;
+}
+
+void MTOverpass::AsyncLoadStreetGraph(
+    const FMTStreetGraphSource& Source,
+    const FString& OverpassQueryString,
+    const FMTGeoPolygon& BoundingPolygon,
+    const FMTWayGraph& BaseGraph,
+    const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate)
+{
+    if (Source.Type == EMTStreetGraphSourceType::Overpass)
+    {
+        if (Source.OverpassTileSize > 0. && !BoundingPolygon.IsUnbounded())
+        {
+            FMTTiledQuerySettings Settings;
+            Settings.TileSize = Source.OverpassTileSize;
+            Settings.MinTileSize = FMath::Min(Settings.MinTileSize, Source.OverpassTileSize);
+            Settings.MaxConcurrentRequests = Source.MaxConcurrentOverpassRequests;
+            AsyncQueryStreetGraphTiled(BoundingPolygon, BaseGraph, Settings, CompletionDelegate);
+            return;
+        }
+
+        AsyncQueryStreetGraph(OverpassQueryString, BoundingPolygon, BaseGraph, CompletionDelegate);
+        return;
+    }
+
+    const auto Result = MakeShared<FMTStreetGraphQueryResult>(FMTStreetGraphQueryResult{BaseGraph});
+
+    AsyncTask(
+        ENamedThreads::AnyBackgroundThreadNormalTask,
+        [Result, BoundingPolygon, FilePath = Source.GetPBFFilePath(), &CompletionDelegate]()
+        {
+            bool bSuccess;
+            {
+                FMTWayGraphBuilder Builder(Result->Graph, BoundingPolygon);
+                bSuccess = MTOSMPBF::ReadStreetGraph(FilePath, Builder);
+                Result->Delta = Builder.GetDelta();
+            }
+
+            AsyncTask(
+                ENamedThreads::GameThread,
+                [Result, bSuccess, &CompletionDelegate]()
+                { CompletionDelegate.ExecuteIfBound(*Result, bSuccess); });
+        });
+}
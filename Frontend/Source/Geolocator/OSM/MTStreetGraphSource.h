@@ -0,0 +1,60 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MTOverpassQuery.h"
+#include "MTOverpassTiledQuery.h"
+
+#include "MTStreetGraphSource.generated.h"
+
+UENUM()
+enum class EMTStreetGraphSourceType : uint8
+{
+    // Live query against the Overpass API
+    Overpass,
+    // Local .osm.pbf extract, e.g. for machines without network access
+    PBFFile
+};
+
+USTRUCT()
+struct FMTStreetGraphSource
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere)
+    EMTStreetGraphSourceType Type = EMTStreetGraphSourceType::Overpass;
+
+    // Relative paths are resolved against the project directory
+    UPROPERTY(
+        EditAnywhere,
+        meta = (EditCondition = "Type == EMTStreetGraphSourceType::PBFFile", FilePathFilter = "pbf"))
+    FFilePath PBFFile;
+
+    // Splits the Overpass query into tiles of this size in degrees, 0 sends the whole polygon at once
+    UPROPERTY(
+        EditAnywhere,
+        meta = (EditCondition = "Type == EMTStreetGraphSourceType::Overpass", ClampMin = 0))
+    double OverpassTileSize = 0.05;
+
+    UPROPERTY(
+        EditAnywhere,
+        meta = (EditCondition = "Type == EMTStreetGraphSourceType::Overpass", ClampMin = 1))
+    int32 MaxConcurrentOverpassRequests = 4;
+
+    // Identifies the graph this source produces for a query, Overpass sources use the query itself
+    FString GetCacheKey(const FString& OverpassQueryString) const;
+
+    FString GetPBFFilePath() const;
+};
+
+namespace MTOverpass
+{
+    // Same as AsyncQueryStreetGraph but builds the graph from the configured source
+    void AsyncLoadStreetGraph(
+        const FMTStreetGraphSource& Source,
+        const FString& OverpassQueryString,
+        const FMTGeoPolygon& BoundingPolygon,
+        const FMTWayGraph& BaseGraph,
+        const FMTStreetGraphQueryCompletionDelegate& CompletionDelegate);
+}
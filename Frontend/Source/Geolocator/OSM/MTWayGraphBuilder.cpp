@@ -0,0 +1,113 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTWayGraphBuilder.h"
+
+FMTWayGraphBuilder::FMTWayGraphBuilder(
+    FMTWayGraph& InGraph,
+    const MTOverpass::FMTGeoPolygon& InBoundingPolygon)
+    : Graph(InGraph)
+    , BoundingPolygon(InBoundingPolygon)
+{
+    ensureMsgf(Graph.HasOSMIDs(), TEXT("Nodes without OSM ID can not be deduplicated"));
+
+    for (int32 WayIndex = 0; WayIndex < Graph.WayNum(); ++WayIndex)
+    {
+        WayNameToWayIndex.Add(Graph.GetWayName(WayIndex), WayIndex);
+    }
+}
+
+int32 FMTWayGraphBuilder::InternTagValue(const FStringView Value)
+{
+    // Reuses the scratch allocation, most values are already interned
+    TagValueScratch = Value;
+    if (const auto* TagValueID = TagValueToID.Find(TagValueScratch))
+    {
+        return *TagValueID;
+    }
+
+    const auto TagValueID = TagValues.Add(TagValueScratch);
+    TagValueWayKinds.Add(EMTWay::None);
+    TagValueToID.Add(TagValueScratch, TagValueID);
+    return TagValueID;
+}
+
+const FString& FMTWayGraphBuilder::GetTagValue(const int32 TagValueID) const
+{
+    return TagValues[TagValueID];
+}
+
+void FMTWayGraphBuilder::AddWay(
+    const TConstArrayView<int64> NodeIDs,
+    const TConstArrayView<FOverpassCoordinates> Geometry,
+    const FMTOSMWayTags& Tags)
+{
+    check(NodeIDs.Num() == Geometry.Num());
+
+    if (Tags.bIsTunnel || Tags.bIsCovered)
+    {
+        return;
+    }
+
+    for (int32 NodeIndex = 0; NodeIndex < NodeIDs.Num(); NodeIndex++)
+    {
+        const auto& Coords = Geometry[NodeIndex];
+        if (Graph.FindNodeByOSMID(NodeIDs[NodeIndex]) == INDEX_NONE &&
+            !FMath::IsNaN(Coords.Lat) && BoundingPolygon.IsInside(Coords))
+        {
+            Delta.AddedNodes.Add(Graph.AddNode(Coords, NodeIDs[NodeIndex]));
+        }
+    }
+
+    if (NodeIDs.Num() < 2)
+    {
+        return;
+    }
+
+    const auto& WayName = Tags.Name != INDEX_NONE ? TagValues[Tags.Name] : FString();
+    const auto WayKind = GetWayKind(Tags.Highway);
+
+    auto* WayIndex = WayNameToWayIndex.Find(WayName);
+    if (!WayIndex)
+    {
+        WayIndex = &WayNameToWayIndex.Add(WayName, Graph.AddWay(WayName, WayKind));
+    }
+
+    if (WayKind != EMTWay::Unclassified && Graph.GetWayKind(*WayIndex) == EMTWay::Unclassified)
+    {
+        Graph.UpdateWayKind(*WayIndex, WayKind);
+    }
+
+    for (int32 NodeIndex = 0; NodeIndex < NodeIDs.Num() - 1; NodeIndex++)
+    {
+        const auto GraphNode = Graph.FindNodeByOSMID(NodeIDs[NodeIndex]);
+        const auto NextGraphNode = Graph.FindNodeByOSMID(NodeIDs[NodeIndex + 1]);
+
+        if (GraphNode != INDEX_NONE && NextGraphNode != INDEX_NONE && GraphNode != NextGraphNode &&
+            !Graph.AreNodesConnected(GraphNode, NextGraphNode))
+        {
+            Graph.ConnectNodes(GraphNode, NextGraphNode, *WayIndex);
+            Delta.AddedEdges.Add({GraphNode, NextGraphNode});
+        }
+    }
+}
+
+const MTOverpass::FMTWayGraphDelta& FMTWayGraphBuilder::GetDelta() const
+{
+    return Delta;
+}
+
+EMTWay FMTWayGraphBuilder::GetWayKind(const int32 HighwayTagValueID)
+{
+    if (HighwayTagValueID == INDEX_NONE)
+    {
+        return EMTWay::Unclassified;
+    }
+
+    auto& WayKind = TagValueWayKinds[HighwayTagValueID];
+    if (WayKind == EMTWay::None)
+    {
+        const auto ParsedWayKind = MTOverpass::WayStringToEnum(TagValues[HighwayTagValueID]);
+        WayKind = ParsedWayKind != EMTWay::None ? ParsedWayKind : EMTWay::Unclassified;
+    }
+    return WayKind;
+}
@@ -0,0 +1,62 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Geolocator/WayGraph/MTWayGraph.h"
+#include "MTOverpassConverter.h"
+
+// The only OSM way tags the way graph uses, values are interned by FMTWayGraphBuilder
+struct FMTOSMWayTags
+{
+    int32 Highway = INDEX_NONE;
+
+    int32 Name = INDEX_NONE;
+
+    bool bIsTunnel = false;
+
+    bool bIsCovered = false;
+};
+
+/**
+ * Adds OSM ways one by one to a FMTWayGraph, nodes are deduplicated by OSM ID and clipped to the
+ * bounding polygon. Every graph source goes through the builder so they all produce the same graph.
+ */
+class GEOLOCATOR_API FMTWayGraphBuilder
+{
+public:
+    FMTWayGraphBuilder(FMTWayGraph& InGraph, const MTOverpass::FMTGeoPolygon& InBoundingPolygon);
+
+    int32 InternTagValue(const FStringView Value);
+
+    const FString& GetTagValue(const int32 TagValueID) const;
+
+    // Tunnels and covered ways are skipped, same as in the Overpass query.
+    // Geometry entries with NaN coordinates are treated as outside of the bounding polygon.
+    void AddWay(
+        const TConstArrayView<int64> NodeIDs,
+        const TConstArrayView<FOverpassCoordinates> Geometry,
+        const FMTOSMWayTags& Tags);
+
+    const MTOverpass::FMTWayGraphDelta& GetDelta() const;
+
+private:
+    FMTWayGraph& Graph;
+
+    MTOverpass::FMTGeoPolygon BoundingPolygon;
+
+    MTOverpass::FMTWayGraphDelta Delta;
+
+    TMap<FString, int32> TagValueToID;
+
+    TArray<FString> TagValues;
+
+    // Way kinds of interned highway values, resolved on first use
+    TArray<EMTWay> TagValueWayKinds;
+
+    TMap<FString, int32> WayNameToWayIndex;
+
+    FString TagValueScratch;
+
+    EMTWay GetWayKind(const int32 HighwayTagValueID);
+};
@@ -0,0 +1,71 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTCaptureRing.h"
+
+FMTCaptureRing::FMTCaptureRing(IMTCaptureBackend& InBackend, const int32 InDepth)
+    : Backend(InBackend), Depth(FMath::Max(1, InDepth))
+{
+}
+
+int32 FMTCaptureRing::AcquireSlot()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTCaptureRing::AcquireSlot);
+
+    Poll();
+
+    if (InFlightCount == Depth)
+    {
+        Backend.WaitForReadback(HeadSlotIndex);
+        CompleteHead();
+    }
+
+    return GetNextSlotIndex();
+}
+
+void FMTCaptureRing::MarkInFlight(const int32 SlotIndex)
+{
+    check(InFlightCount < Depth && SlotIndex == GetNextSlotIndex());
+    InFlightCount++;
+}
+
+void FMTCaptureRing::Poll()
+{
+    // Readbacks finish in order, a later slot is never complete before the head
+    while (InFlightCount > 0 && Backend.IsReadbackComplete(HeadSlotIndex))
+    {
+        CompleteHead();
+    }
+}
+
+void FMTCaptureRing::Flush()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTCaptureRing::Flush);
+
+    while (InFlightCount > 0)
+    {
+        Backend.WaitForReadback(HeadSlotIndex);
+        CompleteHead();
+    }
+}
+
+int32 FMTCaptureRing::GetDepth() const
+{
+    return Depth;
+}
+
+int32 FMTCaptureRing::InFlightNum() const
+{
+    return InFlightCount;
+}
+
+int32 FMTCaptureRing::GetNextSlotIndex() const
+{
+    return (HeadSlotIndex + InFlightCount) % Depth;
+}
+
+void FMTCaptureRing::CompleteHead()
+{
+    Backend.CompleteCapture(HeadSlotIndex);
+    HeadSlotIndex = (HeadSlotIndex + 1) % Depth;
+    InFlightCount--;
+}
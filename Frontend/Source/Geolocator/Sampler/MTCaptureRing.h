@@ -0,0 +1,65 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Slots a capture is rendered and read back into, e.g. scene captures with their own render targets
+ * and pixel buffers. Implemented by a mock to run the scheduling headless.
+ */
+class IMTCaptureBackend
+{
+public:
+    virtual ~IMTCaptureBackend() = default;
+
+    // True once the pixels of the slot are in CPU memory
+    virtual bool IsReadbackComplete(const int32 SlotIndex) = 0;
+
+    virtual void WaitForReadback(const int32 SlotIndex) = 0;
+
+    // Hands the pixels of the slot on to encoding, the slot can be captured into afterwards
+    virtual void CompleteCapture(const int32 SlotIndex) = 0;
+};
+
+/**
+ * Schedules the slots of a capture backend as a ring.
+ *
+ * Up to Depth captures are in flight, a capture only waits for its readback when its slot is needed
+ * again. Captures complete in the order they were started.
+ */
+class GEOLOCATOR_API FMTCaptureRing
+{
+public:
+    FMTCaptureRing(IMTCaptureBackend& InBackend, const int32 InDepth);
+
+    // Slot for the next capture, completes the oldest capture first if all slots are in flight
+    int32 AcquireSlot();
+
+    // The backend started rendering into the slot returned by AcquireSlot
+    void MarkInFlight(const int32 SlotIndex);
+
+    // Completes captures whose readback finished, never waits
+    void Poll();
+
+    // Waits for and completes all captures in flight
+    void Flush();
+
+    int32 GetDepth() const;
+
+    int32 InFlightNum() const;
+
+private:
+    IMTCaptureBackend& Backend;
+
+    int32 Depth;
+
+    // Oldest capture in flight
+    int32 HeadSlotIndex = 0;
+
+    int32 InFlightCount = 0;
+
+    int32 GetNextSlotIndex() const;
+
+    void CompleteHead();
+};
@@ -0,0 +1,241 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTCubemapRemap.h"
+
+#include "Async/ParallelFor.h"
+#include "Math/VectorRegister.h"
+#include "RHIDefinitions.h"
+
+namespace
+{
+    constexpr int32 MaxCachedRemapNum = 32;
+
+    constexpr float WeightScale = 65535.F;
+
+    // Perspective and equirect keys differ in the first element
+    using FRemapKey = TTuple<int32, int32, int32, int32, int32, int32, int32, int32>;
+
+    FCriticalSection RemapCacheLock;
+
+    TMap<FRemapKey, TSharedRef<const FMTCubemapRemap>> RemapCache;
+
+    // Rotations are quantized, the slices of a dataset repeat exactly but go through float math
+    FRemapKey MakePerspectiveKey(const int32 FaceSize, const FMTCubemapSlice& Slice)
+    {
+        return MakeTuple(
+            0,
+            FaceSize,
+            FMath::RoundToInt(Slice.Rotation.Pitch * 100.),
+            FMath::RoundToInt(Slice.Rotation.Yaw * 100.),
+            FMath::RoundToInt(Slice.Rotation.Roll * 100.),
+            FMath::RoundToInt(Slice.FOVAngle * 100.),
+            Slice.Size.X,
+            Slice.Size.Y);
+    }
+
+    TSharedPtr<const FMTCubemapRemap> FindCachedRemap(const FRemapKey& Key)
+    {
+        FScopeLock Lock(&RemapCacheLock);
+        if (const auto* Remap = RemapCache.Find(Key))
+        {
+            return *Remap;
+        }
+        return nullptr;
+    }
+
+    void AddCachedRemap(const FRemapKey& Key, const TSharedRef<const FMTCubemapRemap>& Remap)
+    {
+        FScopeLock Lock(&RemapCacheLock);
+        // Tables of a few megabytes each, a dataset only uses a handful of views
+        if (RemapCache.Num() >= MaxCachedRemapNum)
+        {
+            RemapCache.Reset();
+        }
+        RemapCache.Add(Key, Remap);
+    }
+}  // namespace
+
+TSharedRef<const FMTCubemapRemap> FMTCubemapRemap::GetPerspective(const int32 FaceSize, const FMTCubemapSlice& Slice)
+{
+    const auto Key = MakePerspectiveKey(FaceSize, Slice);
+    if (const auto Remap = FindCachedRemap(Key))
+    {
+        return Remap.ToSharedRef();
+    }
+
+    const auto TanHalfFOV = FMath::Tan(FMath::DegreesToRadians(Slice.FOVAngle) / 2.);
+    const auto AspectRatio = static_cast<double>(Slice.Size.Y) / Slice.Size.X;
+    const auto Rotation = Slice.Rotation.Quaternion();
+
+    // Camera space of a scene capture, X forward, Y right and Z up
+    TSharedRef<const FMTCubemapRemap> Remap = MakeShareable(new FMTCubemapRemap(
+        FaceSize,
+        Slice.Size,
+        [&](const int32 X, const int32 Y)
+        {
+            const auto ScreenX = 2. * (X + 0.5) / Slice.Size.X - 1.;
+            const auto ScreenY = 1. - 2. * (Y + 0.5) / Slice.Size.Y;
+            return Rotation.RotateVector(FVector(1., ScreenX * TanHalfFOV, ScreenY * TanHalfFOV * AspectRatio));
+        }));
+
+    AddCachedRemap(Key, Remap);
+    return Remap;
+}
+
+TSharedRef<const FMTCubemapRemap> FMTCubemapRemap::GetEquirect(
+    const int32 FaceSize,
+    const FIntVector2& Size,
+    const FIntVector2& TopAndBottomCrop)
+{
+    const auto Key = MakeTuple(1, FaceSize, Size.X, Size.Y, TopAndBottomCrop.X, TopAndBottomCrop.Y, 0, 0);
+    if (const auto Remap = FindCachedRemap(Key))
+    {
+        return Remap.ToSharedRef();
+    }
+
+    // Longitude along X starting at -Y, colatitude along Y starting at +Z. Same directions the
+    // long lat unwrap shader samples the cube with.
+    TSharedRef<const FMTCubemapRemap> Remap = MakeShareable(new FMTCubemapRemap(
+        FaceSize,
+        {Size.X, Size.Y - TopAndBottomCrop.X - TopAndBottomCrop.Y},
+        [&](const int32 X, const int32 Y)
+        {
+            const auto Longitude = 2. * PI * (X + 0.5) / Size.X;
+            const auto Colatitude = PI * (Y + TopAndBottomCrop.X + 0.5) / Size.Y;
+            const auto SinColatitude = FMath::Sin(Colatitude);
+            return FVector(
+                SinColatitude * FMath::Sin(Longitude),
+                -SinColatitude * FMath::Cos(Longitude),
+                FMath::Cos(Colatitude));
+        }));
+
+    AddCachedRemap(Key, Remap);
+    return Remap;
+}
+
+FMTCubemapRemap::FMTCubemapRemap(
+    const int32 InFaceSize,
+    const FIntVector2& InSize,
+    const TFunctionRef<FVector(const int32 X, const int32 Y)> PixelToDirection)
+    : FaceSize(InFaceSize), Size(InSize)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTCubemapRemap::Build);
+
+    check(FaceSize >= 2 && Size.X > 0 && Size.Y > 0);
+
+    TArray<uint8> RowFaceMasks;
+    RowFaceMasks.SetNumZeroed(Size.Y);
+
+    Entries.SetNumUninitialized(Size.X * Size.Y);
+    ParallelFor(
+        Size.Y,
+        [this, &PixelToDirection, &RowFaceMasks](const int32 Y)
+        {
+            for (int32 X = 0; X < Size.X; ++X)
+            {
+                int32 Face;
+                const auto Texel = DirectionToFaceTexel(PixelToDirection(X, Y), FaceSize, Face);
+
+                // Taps are clamped to their face, the seams are below a texel
+                const auto TexelX = FMath::Clamp(Texel.X - 0.5F, 0.F, FaceSize - 1.F);
+                const auto TexelY = FMath::Clamp(Texel.Y - 0.5F, 0.F, FaceSize - 1.F);
+                const auto X0 = FMath::Min(static_cast<int32>(TexelX), FaceSize - 2);
+                const auto Y0 = FMath::Min(static_cast<int32>(TexelY), FaceSize - 2);
+
+                auto& Entry = Entries[Y * Size.X + X];
+                Entry.TexelIndex = (Face * FaceSize + Y0) * FaceSize + X0;
+                Entry.WeightX = static_cast<uint16>(FMath::RoundToInt((TexelX - X0) * WeightScale));
+                Entry.WeightY = static_cast<uint16>(FMath::RoundToInt((TexelY - Y0) * WeightScale));
+
+                RowFaceMasks[Y] |= 1 << Face;
+            }
+        });
+
+    for (const auto RowFaceMask : RowFaceMasks)
+    {
+        FaceMask |= RowFaceMask;
+    }
+}
+
+void FMTCubemapRemap::Apply(const TConstArrayView<FColor> Faces, TArray<FColor>& OutPixels) const
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTCubemapRemap::Apply);
+
+    check(Faces.Num() == 6 * FaceSize * FaceSize);
+
+    OutPixels.SetNumUninitialized(Entries.Num(), false);
+
+    const auto* Texels = Faces.GetData();
+    auto* OutPixel = OutPixels.GetData();
+    const auto RowStride = FaceSize;
+    const auto Half = VectorSetFloat1(0.5F);
+
+    // One pixel per iteration, the four channels of a texel are lanes of one register
+    for (const auto& Entry : Entries)
+    {
+        const auto* Tap = Texels + Entry.TexelIndex;
+        const auto Texel00 = VectorLoadByte4(Tap);
+        const auto Texel10 = VectorLoadByte4(Tap + 1);
+        const auto Texel01 = VectorLoadByte4(Tap + RowStride);
+        const auto Texel11 = VectorLoadByte4(Tap + RowStride + 1);
+
+        const auto WeightX = VectorSetFloat1(Entry.WeightX / WeightScale);
+        const auto WeightY = VectorSetFloat1(Entry.WeightY / WeightScale);
+
+        const auto Top = VectorMultiplyAdd(VectorSubtract(Texel10, Texel00), WeightX, Texel00);
+        const auto Bottom = VectorMultiplyAdd(VectorSubtract(Texel11, Texel01), WeightX, Texel01);
+        const auto Result = VectorMultiplyAdd(VectorSubtract(Bottom, Top), WeightY, Top);
+
+        // Store truncates
+        VectorStoreByte4(VectorAdd(Result, Half), OutPixel++);
+    }
+}
+
+FIntVector2 FMTCubemapRemap::GetSize() const
+{
+    return Size;
+}
+
+int32 FMTCubemapRemap::GetFaceSize() const
+{
+    return FaceSize;
+}
+
+uint8 FMTCubemapRemap::GetFaceMask() const
+{
+    return FaceMask;
+}
+
+FVector2f FMTCubemapRemap::DirectionToFaceTexel(const FVector& Direction, const int32 FaceSize, int32& OutFace)
+{
+    // D3D cube map convention, faces in ECubeFace order
+    const auto AbsDirection = Direction.GetAbs();
+    double MajorAxis;
+    double S;
+    double T;
+    if (AbsDirection.X >= AbsDirection.Y && AbsDirection.X >= AbsDirection.Z)
+    {
+        OutFace = Direction.X >= 0. ? CubeFace_PosX : CubeFace_NegX;
+        MajorAxis = AbsDirection.X;
+        S = Direction.X >= 0. ? -Direction.Z : Direction.Z;
+        T = -Direction.Y;
+    }
+    else if (AbsDirection.Y >= AbsDirection.Z)
+    {
+        OutFace = Direction.Y >= 0. ? CubeFace_PosY : CubeFace_NegY;
+        MajorAxis = AbsDirection.Y;
+        S = Direction.X;
+        T = Direction.Y >= 0. ? Direction.Z : -Direction.Z;
+    }
+    else
+    {
+        OutFace = Direction.Z >= 0. ? CubeFace_PosZ : CubeFace_NegZ;
+        MajorAxis = AbsDirection.Z;
+        S = Direction.Z >= 0. ? Direction.X : -Direction.X;
+        T = -Direction.Y;
+    }
+
+    return FVector2f(
+        static_cast<float>((S / MajorAxis + 1.) * 0.5 * FaceSize),
+        static_cast<float>((T / MajorAxis + 1.) * 0.5 * FaceSize));
+}
@@ -0,0 +1,75 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Perspective view into a cube capture, relative to the rotation of the cube
+struct FMTCubemapSlice
+{
+    FRotator Rotation = FRotator::ZeroRotator;
+
+    // Horizontal, like USceneCaptureComponent2D::FOVAngle
+    double FOVAngle = 90.;
+
+    FIntVector2 Size = {512, 512};
+};
+
+/**
+ * Precomputed lookup from output pixels to bilinear taps in the six faces of a cube capture.
+ *
+ * Faces are FaceSize * FaceSize texels each, in ECubeFace order as read back by ReadSurfaceData.
+ * Tables are built once per view and resolution and shared between encoder threads, applying one
+ * only loads four texels per pixel.
+ */
+class GEOLOCATOR_API FMTCubemapRemap
+{
+public:
+    // Cached, slices with the same relative rotation share their table
+    static TSharedRef<const FMTCubemapRemap> GetPerspective(const int32 FaceSize, const FMTCubemapSlice& Slice);
+
+    // Cached, same layout as CubemapHelpers::GenerateLongLatUnwrap. The cropped rows are never
+    // sampled, the output is Width * (Height - TopCrop - BottomCrop).
+    static TSharedRef<const FMTCubemapRemap> GetEquirect(
+        const int32 FaceSize,
+        const FIntVector2& Size,
+        const FIntVector2& TopAndBottomCrop);
+
+    // Resizes OutPixels to the output size
+    void Apply(const TConstArrayView<FColor> Faces, TArray<FColor>& OutPixels) const;
+
+    FIntVector2 GetSize() const;
+
+    int32 GetFaceSize() const;
+
+    // Bit per ECubeFace, faces outside of the mask are never read and need not be read back
+    uint8 GetFaceMask() const;
+
+    // Face and texel coordinates of a direction in cube space. Same selection as a TextureCube sample,
+    // the cube capture renders its faces with the matching basis.
+    static FVector2f DirectionToFaceTexel(const FVector& Direction, const int32 FaceSize, int32& OutFace);
+
+private:
+    FMTCubemapRemap(
+        const int32 InFaceSize,
+        const FIntVector2& InSize,
+        const TFunctionRef<FVector(const int32 X, const int32 Y)> PixelToDirection);
+
+    struct FEntry
+    {
+        // Top left tap, the other three are the next texel and the texels of the next row
+        uint32 TexelIndex;
+
+        uint16 WeightX;
+
+        uint16 WeightY;
+    };
+
+    int32 FaceSize;
+
+    FIntVector2 Size;
+
+    uint8 FaceMask = 0;
+
+    TArray<FEntry> Entries;
+};
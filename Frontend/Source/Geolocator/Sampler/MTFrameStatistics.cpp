@@ -0,0 +1,164 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTFrameStatistics.h"
+
+#include "Math/VectorRegister.h"
+
+namespace
+{
+    // Below it a frame is grey, untextured Cesium tiles are rendered with the default material
+    constexpr float MinSaturation = 0.05F;
+
+    float HorizontalSum(const VectorRegister4Float& Vector)
+    {
+        float Lanes[4];
+        VectorStore(Vector, Lanes);
+        return Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+    }
+
+    int32 HorizontalSum(const VectorRegister4Int& Vector)
+    {
+        int32 Lanes[4];
+        VectorIntStore(Vector, Lanes);
+        return Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+    }
+}  // namespace
+
+FMTFrameStatistics FMTFrameStatistics::Compute(const FColor* Pixels, const FIntVector2& Size, const FColor& ClearColor)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTFrameStatistics::Compute);
+
+    check(Size.X > 0 && Size.Y > 0);
+
+    // FColor is BGRA in memory, lanes hold one pixel each
+    const auto ChannelMask = VectorIntSet1(0xFF);
+    const auto ColorMask = VectorIntSet1(0x00FFFFFF);
+    const auto MaskedClearColor = VectorIntSet1(static_cast<int32>(ClearColor.DWColor() & 0x00FFFFFF));
+    const auto LumaB = VectorSetFloat1(0.114F);
+    const auto LumaG = VectorSetFloat1(0.587F);
+    const auto LumaR = VectorSetFloat1(0.299F);
+    const auto One = VectorSetFloat1(1.F);
+
+    auto SaturationSum = VectorZeroFloat();
+    auto EdgeSum = VectorZeroFloat();
+    auto ClearColorCount = VectorIntSet1(0);
+
+    // Two rows of luma for the gradients, padded so the last vector of a row can be loaded whole
+    const auto PaddedWidth = Align(Size.X, 4) + 4;
+    thread_local TArray<float> LumaRows;
+    LumaRows.SetNumZeroed(2 * PaddedWidth, false);
+    auto* LumaRow = LumaRows.GetData();
+    auto* PreviousLumaRow = LumaRows.GetData() + PaddedWidth;
+
+    uint32 Histogram[LumaHistogramBinNum] = {};
+    double LumaSum = 0.;
+
+    // Pixels of rows that are not a multiple of four wide
+    double SaturationTailSum = 0.;
+    int32 ClearColorTailCount = 0;
+
+    const auto VectorWidth = Size.X & ~3;
+    for (int32 Y = 0; Y < Size.Y; ++Y)
+    {
+        const auto* Row = Pixels + Y * Size.X;
+
+        for (int32 X = 0; X < VectorWidth; X += 4)
+        {
+            const auto Pixel = VectorIntLoad(Row + X);
+            const auto B = VectorIntToFloat(VectorIntAnd(Pixel, ChannelMask));
+            const auto G = VectorIntToFloat(VectorIntAnd(VectorShiftRightImmLogical(Pixel, 8), ChannelMask));
+            const auto R = VectorIntToFloat(VectorIntAnd(VectorShiftRightImmLogical(Pixel, 16), ChannelMask));
+
+            VectorStore(
+                VectorMultiplyAdd(R, LumaR, VectorMultiplyAdd(G, LumaG, VectorMultiply(B, LumaB))), LumaRow + X);
+
+            // HSV saturation, black counts as unsaturated
+            const auto Max = VectorMax(R, VectorMax(G, B));
+            const auto Min = VectorMin(R, VectorMin(G, B));
+            SaturationSum = VectorAdd(SaturationSum, VectorDivide(VectorSubtract(Max, Min), VectorMax(Max, One)));
+
+            // Lanes are -1 where equal
+            ClearColorCount = VectorIntSubtract(
+                ClearColorCount, VectorIntCompareEQ(VectorIntAnd(Pixel, ColorMask), MaskedClearColor));
+        }
+
+        for (int32 X = VectorWidth; X < Size.X; ++X)
+        {
+            const auto& Pixel = Row[X];
+            LumaRow[X] = 0.299F * Pixel.R + 0.587F * Pixel.G + 0.114F * Pixel.B;
+            const auto Max = FMath::Max3(Pixel.R, Pixel.G, Pixel.B);
+            const auto Min = FMath::Min3(Pixel.R, Pixel.G, Pixel.B);
+            SaturationTailSum += static_cast<double>(Max - Min) / FMath::Max<uint8>(Max, 1);
+            ClearColorTailCount += (Pixel.DWColor() & 0x00FFFFFF) == (ClearColor.DWColor() & 0x00FFFFFF);
+        }
+
+        for (int32 X = 0; X < Size.X - 1; X += 4)
+        {
+            const auto Luma = VectorLoad(LumaRow + X);
+            auto Gradient = VectorAbs(VectorSubtract(VectorLoad(LumaRow + X + 1), Luma));
+            if (Y > 0)
+            {
+                Gradient = VectorAdd(Gradient, VectorAbs(VectorSubtract(VectorLoad(PreviousLumaRow + X), Luma)));
+            }
+
+            // Lanes past the row end read the padding
+            if (X + 4 > Size.X - 1)
+            {
+                float Lanes[4];
+                VectorStore(Gradient, Lanes);
+                for (int32 Lane = Size.X - 1 - X; Lane < 4; ++Lane)
+                {
+                    Lanes[Lane] = 0.F;
+                }
+                Gradient = VectorLoad(Lanes);
+            }
+            EdgeSum = VectorAdd(EdgeSum, Gradient);
+        }
+
+        for (int32 X = 0; X < Size.X; ++X)
+        {
+            const auto Luma = LumaRow[X];
+            LumaSum += Luma;
+            Histogram[FMath::Min(static_cast<int32>(Luma) >> 4, LumaHistogramBinNum - 1)]++;
+        }
+
+        Swap(LumaRow, PreviousLumaRow);
+    }
+
+    const auto PixelNum = static_cast<double>(Size.X) * Size.Y;
+
+    FMTFrameStatistics Statistics;
+    for (int32 Bin = 0; Bin < LumaHistogramBinNum; ++Bin)
+    {
+        Statistics.LumaHistogram[Bin] = static_cast<float>(Histogram[Bin] / PixelNum);
+    }
+    Statistics.MeanLuma = static_cast<float>(LumaSum / PixelNum / 255.);
+    Statistics.MeanSaturation = static_cast<float>((HorizontalSum(SaturationSum) + SaturationTailSum) / PixelNum);
+    Statistics.EdgeEnergy = static_cast<float>(HorizontalSum(EdgeSum) / PixelNum / 255.);
+    Statistics.ClearColorFraction =
+        static_cast<float>((HorizontalSum(ClearColorCount) + ClearColorTailCount) / PixelNum);
+    return Statistics;
+}
+
+float FMTFrameStatistics::GetArtifactScore(const float MinEdgeEnergy) const
+{
+    // Black frames, e.g. captures inside geometry or before the tiles are shaded
+    const auto Dark = LumaHistogram[0];
+
+    const auto SafeMinEdgeEnergy = FMath::Max(MinEdgeEnergy, UE_SMALL_NUMBER);
+    const auto Flat = 1.F - FMath::Clamp(EdgeEnergy / SafeMinEdgeEnergy, 0.F, 1.F);
+    const auto LowDetail = 1.F - FMath::Clamp(EdgeEnergy / (2.F * SafeMinEdgeEnergy), 0.F, 1.F);
+
+    // Most pixels in one luma range with little detail, sky only frames
+    auto MaxBinFraction = 0.F;
+    for (const auto BinFraction : LumaHistogram)
+    {
+        MaxBinFraction = FMath::Max(MaxBinFraction, BinFraction);
+    }
+    const auto SkyOnly = FMath::Min(FMath::Clamp(2.F * MaxBinFraction - 1.F, 0.F, 1.F), LowDetail);
+
+    // Untextured tiles are grey and have little detail, either alone is common in real frames
+    const auto Untextured = FMath::Min(1.F - FMath::Clamp(MeanSaturation / MinSaturation, 0.F, 1.F), LowDetail);
+
+    return FMath::Max(FMath::Max3(Dark, ClearColorFraction, Flat), FMath::Max(SkyOnly, Untextured));
+}
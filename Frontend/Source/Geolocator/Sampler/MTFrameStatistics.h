@@ -0,0 +1,36 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Image statistics of a captured frame, computed before it is encoded.
+ *
+ * Catches what the artifact traces of PreCapture miss: black frames, frames inside geometry, sky
+ * only frames and untextured tiles. One pass over the pixels, four at a time.
+ */
+struct GEOLOCATOR_API FMTFrameStatistics
+{
+    static constexpr int32 LumaHistogramBinNum = 16;
+
+    // Fractions of the pixels per luma range of 16
+    TStaticArray<float, LumaHistogramBinNum> LumaHistogram;
+
+    // All of the following are 0 to 1
+    float MeanLuma = 0.F;
+
+    float MeanSaturation = 0.F;
+
+    // Mean absolute luma difference to the right and lower neighbour
+    float EdgeEnergy = 0.F;
+
+    // Pixels with exactly the clear color, alpha is ignored
+    float ClearColorFraction = 0.F;
+
+    static FMTFrameStatistics Compute(const FColor* Pixels, const FIntVector2& Size, const FColor& ClearColor);
+
+    // 0 for a plausible frame, 1 for a certainly broken one. Frames with less EdgeEnergy than
+    // MinEdgeEnergy are treated as flat, e.g. sky, untextured tiles and the inside of buildings.
+    float GetArtifactScore(const float MinEdgeEnergy) const;
+};
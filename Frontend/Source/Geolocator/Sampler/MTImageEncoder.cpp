@@ -0,0 +1,167 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTImageEncoder.h"
+
+#include "IImageWrapperModule.h"
+
+#if WITH_MT_LIBJPEGTURBO
+THIRD_PARTY_INCLUDES_START
+#include "turbojpeg.h"
+THIRD_PARTY_INCLUDES_END
+#endif
+
+namespace
+{
+    class FImageWrapperEncoder final : public IMTImageEncoder
+    {
+    public:
+        FImageWrapperEncoder(const EImageFormat InFormat, const int32 InQuality)
+            : Format(InFormat)
+            , Quality(InQuality)
+        {
+        }
+
+        virtual bool Encode(const FImageView& Image, TArray64<uint8>& OutData) const override
+        {
+            auto& ImageWrapperModule = FModuleManager::GetModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+            return ImageWrapperModule.CompressImage(OutData, Format, Image, Quality);
+        }
+
+        virtual const TCHAR* GetExtension() const override
+        {
+            return Format == EImageFormat::PNG ? TEXT("png") : TEXT("jpg");
+        }
+
+        virtual FString GetName() const override
+        {
+            return Format == EImageFormat::PNG ? TEXT("PNG") : FString::Printf(TEXT("ImageWrapperJPEG q%d"), Quality);
+        }
+
+    private:
+        EImageFormat Format;
+
+        int32 Quality;
+    };
+
+#if WITH_MT_LIBJPEGTURBO
+    // Destroyed when its encoder thread exits, the pool recreates its threads for every session
+    struct FTurboJPEGCompressor
+    {
+        tjhandle Handle = tjInitCompress();
+
+        FTurboJPEGCompressor() = default;
+
+        FTurboJPEGCompressor(const FTurboJPEGCompressor&) = delete;
+
+        FTurboJPEGCompressor& operator=(const FTurboJPEGCompressor&) = delete;
+
+        ~FTurboJPEGCompressor()
+        {
+            if (Handle)
+            {
+                tjDestroy(Handle);
+            }
+        }
+    };
+
+    class FTurboJPEGEncoder final : public IMTImageEncoder
+    {
+    public:
+        explicit FTurboJPEGEncoder(const FMTImageEncoderSettings& InSettings)
+            : Settings(InSettings)
+        {
+        }
+
+        virtual bool Encode(const FImageView& Image, TArray64<uint8>& OutData) const override
+        {
+            check(Image.Format == ERawImageFormat::BGRA8);
+
+            const auto Subsampling = GetSubsampling();
+
+            // Compressors are not thread safe, one per encoder thread
+            static thread_local FTurboJPEGCompressor ThreadCompressor;
+            const auto Compressor = ThreadCompressor.Handle;
+            if (!Compressor)
+            {
+                return false;
+            }
+
+            // Compressed straight into the output, tjBufSize is the worst case size
+            OutData.SetNumUninitialized(tjBufSize(Image.SizeX, Image.SizeY, Subsampling), false);
+            auto* CompressedData = OutData.GetData();
+            unsigned long CompressedSize = OutData.Num();
+
+            const auto Flags = TJFLAG_NOREALLOC | (Settings.bFastDCT ? TJFLAG_FASTDCT : 0);
+            if (tjCompress2(
+                    Compressor,
+                    static_cast<const unsigned char*>(Image.RawData),
+                    Image.SizeX,
+                    Image.SizeX * sizeof(FColor),
+                    Image.SizeY,
+                    TJPF_BGRA,
+                    &CompressedData,
+                    &CompressedSize,
+                    Subsampling,
+                    Settings.Quality,
+                    Flags) != 0)
+            {
+                UE_LOG(LogTemp, Error, TEXT("TurboJPEG encoding failed: %hs"), tjGetErrorStr2(Compressor));
+                OutData.Reset();
+                return false;
+            }
+
+            OutData.SetNum(CompressedSize, false);
+            return true;
+        }
+
+        virtual const TCHAR* GetExtension() const override
+        {
+            return TEXT("jpg");
+        }
+
+        virtual FString GetName() const override
+        {
+            return FString::Printf(
+                TEXT("TurboJPEG q%d %s%s"),
+                Settings.Quality,
+                *StaticEnum<EMTChromaSubsampling>()->GetNameStringByValue(static_cast<int64>(Settings.ChromaSubsampling)),
+                Settings.bFastDCT ? TEXT(" fast DCT") : TEXT(""));
+        }
+
+    private:
+        FMTImageEncoderSettings Settings;
+
+        int GetSubsampling() const
+        {
+            switch (Settings.ChromaSubsampling)
+            {
+                case EMTChromaSubsampling::Yuv444:
+                    return TJSAMP_444;
+                case EMTChromaSubsampling::Yuv422:
+                    return TJSAMP_422;
+                default:
+                    return TJSAMP_420;
+            }
+        }
+    };
+#endif
+}  // namespace
+
+TSharedRef<const IMTImageEncoder> IMTImageEncoder::Create(const FMTImageEncoderSettings& Settings)
+{
+    switch (Settings.Encoder)
+    {
+        case EMTImageEncoder::TurboJPEG:
+#if WITH_MT_LIBJPEGTURBO
+            return MakeShared<FTurboJPEGEncoder>(Settings);
+#else
+            UE_LOG(LogTemp, Warning, TEXT("libjpeg-turbo is not available on this platform, using ImageWrapper"));
+            return MakeShared<FImageWrapperEncoder>(EImageFormat::JPEG, Settings.Quality);
+#endif
+        case EMTImageEncoder::PNG:
+            // Quality is the zlib level for PNG, default compression
+            return MakeShared<FImageWrapperEncoder>(EImageFormat::PNG, 0);
+        default:
+            return MakeShared<FImageWrapperEncoder>(EImageFormat::JPEG, Settings.Quality);
+    }
+}
@@ -0,0 +1,64 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ImageCore.h"
+
+#include "MTImageEncoder.generated.h"
+
+UENUM()
+enum class EMTImageEncoder : uint8
+{
+    // JPEG through the ImageWrapper module
+    ImageWrapperJPEG,
+    // JPEG through libjpeg-turbo directly, falls back to ImageWrapperJPEG where unavailable
+    TurboJPEG,
+    // Lossless, for ground truth sets
+    PNG,
+};
+
+UENUM()
+enum class EMTChromaSubsampling : uint8
+{
+    Yuv444,
+    Yuv422,
+    Yuv420,
+};
+
+USTRUCT()
+struct GEOLOCATOR_API FMTImageEncoderSettings
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere)
+    EMTImageEncoder Encoder = EMTImageEncoder::ImageWrapperJPEG;
+
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 1, ClampMax = 100, EditCondition = "Encoder != EMTImageEncoder::PNG"))
+    int32 Quality = 85;
+
+    UPROPERTY(EditAnywhere, meta = (EditCondition = "Encoder == EMTImageEncoder::TurboJPEG"))
+    EMTChromaSubsampling ChromaSubsampling = EMTChromaSubsampling::Yuv420;
+
+    // Faster, slightly less accurate DCT
+    UPROPERTY(EditAnywhere, meta = (EditCondition = "Encoder == EMTImageEncoder::TurboJPEG"))
+    bool bFastDCT = false;
+};
+
+/**
+ * Encodes captured BGRA8 images, used concurrently by the encoder pool threads.
+ */
+class GEOLOCATOR_API IMTImageEncoder
+{
+public:
+    virtual ~IMTImageEncoder() = default;
+
+    virtual bool Encode(const FImageView& Image, TArray64<uint8>& OutData) const = 0;
+
+    // Without dot, e.g. jpg
+    virtual const TCHAR* GetExtension() const = 0;
+
+    virtual FString GetName() const = 0;
+
+    static TSharedRef<const IMTImageEncoder> Create(const FMTImageEncoderSettings& Settings);
+};
@@ -0,0 +1,90 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTImageEncoderPool.h"
+
+#include "Async/Async.h"
+#include "HAL/Event.h"
+#include "Misc/QueuedThreadPool.h"
+
+FMTImageEncoderPool::FMTImageEncoderPool(const int32 InWorkerNum, const int32 InMaxQueuedNum)
+    : WorkerNum(FMath::Max(1, InWorkerNum))
+    , MaxQueuedNum(FMath::Max(WorkerNum, InMaxQueuedNum))
+{
+    DequeuedEvent = FPlatformProcess::GetSynchEventFromPool();
+
+    // Encoders need more than the default stack
+    ThreadPool = FQueuedThreadPool::Allocate();
+    ThreadPool->Create(WorkerNum, 1024 * 1024, TPri_BelowNormal, TEXT("MTImageEncoderPool"));
+}
+
+FMTImageEncoderPool::~FMTImageEncoderPool()
+{
+    // Timed, the last worker might still trigger the event after the count reached zero
+    while (QueuedNum > 0)
+    {
+        DequeuedEvent->Wait(10);
+    }
+
+    // Joins the workers, nothing touches the event afterwards
+    ThreadPool->Destroy();
+    delete ThreadPool;
+
+    FPlatformProcess::ReturnSynchEventToPool(DequeuedEvent);
+}
+
+TArray<FColor> FMTImageEncoderPool::AcquirePixelBuffer()
+{
+    FScopeLock Lock(&PixelBuffersLock);
+    if (FreePixelBuffers.IsEmpty())
+    {
+        return {};
+    }
+    return FreePixelBuffers.Pop(false);
+}
+
+TFuture<void> FMTImageEncoderPool::Enqueue(
+    TArray<FColor>&& PixelBuffer,
+    TUniqueFunction<void(TArray<FColor>&)>&& Encode)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTImageEncoderPool::Enqueue);
+
+    // Backpressure, capturing faster than encoding would only grow the queue
+    while (QueuedNum >= MaxQueuedNum)
+    {
+        DequeuedEvent->Wait();
+    }
+    QueuedNum++;
+
+    return AsyncPool(
+        *ThreadPool,
+        [this, PixelBuffer = MoveTemp(PixelBuffer), Encode = MoveTemp(Encode)]() mutable
+        {
+            Encode(PixelBuffer);
+            ReleasePixelBuffer(MoveTemp(PixelBuffer));
+
+            QueuedNum--;
+            DequeuedEvent->Trigger();
+        });
+}
+
+int32 FMTImageEncoderPool::GetWorkerNum() const
+{
+    return WorkerNum;
+}
+
+int32 FMTImageEncoderPool::GetMaxQueuedNum() const
+{
+    return MaxQueuedNum;
+}
+
+void FMTImageEncoderPool::ReleasePixelBuffer(TArray<FColor>&& PixelBuffer)
+{
+    PixelBuffer.Reset();
+
+    FScopeLock Lock(&PixelBuffersLock);
+    // Every queued image and capture holds one, more are never needed at the same time
+    if (FreePixelBuffers.Num() < MaxQueuedNum)
+    {
+        FreePixelBuffers.Add(MoveTemp(PixelBuffer));
+    }
+}
@@ -0,0 +1,58 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+class FEvent;
+class FQueuedThreadPool;
+
+/**
+ * Fixed number of image encoder threads with a bounded queue and recycled pixel buffers.
+ *
+ * Pixel buffers are moved into the pool and handed back to AcquirePixelBuffer once encoded, so a
+ * panorama is never copied and its allocation is reused by later captures.
+ */
+class GEOLOCATOR_API FMTImageEncoderPool
+{
+public:
+    FMTImageEncoderPool(const int32 InWorkerNum, const int32 InMaxQueuedNum);
+
+    // Waits for all queued images
+    ~FMTImageEncoderPool();
+
+    FMTImageEncoderPool(const FMTImageEncoderPool&) = delete;
+
+    FMTImageEncoderPool& operator=(const FMTImageEncoderPool&) = delete;
+
+    // Empty, but usually with the capacity of a previous image
+    TArray<FColor> AcquirePixelBuffer();
+
+    // Blocks while the queue is full, Encode runs on one of the workers. Encode may overwrite the
+    // buffer, e.g. to reproject a capture into it.
+    TFuture<void> Enqueue(TArray<FColor>&& PixelBuffer, TUniqueFunction<void(TArray<FColor>&)>&& Encode);
+
+    int32 GetWorkerNum() const;
+
+    int32 GetMaxQueuedNum() const;
+
+private:
+    int32 WorkerNum;
+
+    int32 MaxQueuedNum;
+
+    FQueuedThreadPool* ThreadPool = nullptr;
+
+    std::atomic<int32> QueuedNum = 0;
+
+    // Triggered whenever an image leaves the queue
+    FEvent* DequeuedEvent = nullptr;
+
+    FCriticalSection PixelBuffersLock;
+
+    TArray<TArray<FColor>> FreePixelBuffers;
+
+    void ReleasePixelBuffer(TArray<FColor>&& PixelBuffer);
+};
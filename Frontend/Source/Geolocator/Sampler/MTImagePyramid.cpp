@@ -0,0 +1,171 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTImagePyramid.h"
+
+#include "Math/VectorRegister.h"
+
+namespace
+{
+    // Source texels covered by each output texel of one axis, weights sum up to one per output
+    struct FAreaFilter
+    {
+        TArray<int32> FirstTaps;
+
+        TArray<int32> TapNums;
+
+        // TapNums[I] weights per output texel, consecutive
+        TArray<float> Weights;
+
+        TArray<int32> FirstWeights;
+
+        void Init(const int32 Size, const int32 LevelSize)
+        {
+            FirstTaps.Reset(LevelSize);
+            TapNums.Reset(LevelSize);
+            FirstWeights.Reset(LevelSize);
+            Weights.Reset();
+
+            const auto Scale = static_cast<double>(Size) / LevelSize;
+            for (int32 I = 0; I < LevelSize; ++I)
+            {
+                const auto Begin = I * Scale;
+                const auto End = FMath::Min((I + 1) * Scale, static_cast<double>(Size));
+                const auto FirstTap = FMath::FloorToInt(Begin);
+                const auto LastTap = FMath::Min(FMath::CeilToInt(End), Size) - 1;
+
+                FirstTaps.Add(FirstTap);
+                TapNums.Add(LastTap - FirstTap + 1);
+                FirstWeights.Add(Weights.Num());
+                for (int32 Tap = FirstTap; Tap <= LastTap; ++Tap)
+                {
+                    const auto Coverage = FMath::Min(End, Tap + 1.) - FMath::Max(Begin, static_cast<double>(Tap));
+                    Weights.Add(static_cast<float>(Coverage / (End - Begin)));
+                }
+            }
+        }
+    };
+
+    // Filters of both axes for one source and level size
+    struct FAreaFilters
+    {
+        FIntVector2 Size;
+
+        FIntVector2 LevelSize;
+
+        FAreaFilter X;
+
+        FAreaFilter Y;
+    };
+
+    // Every pyramid level and the perceptual hash downsample the same capture on one encoder thread,
+    // so the filters are kept per size pair instead of evicting each other
+    const FAreaFilters& FindOrInitFilters(const FIntVector2& Size, const FIntVector2& LevelSize)
+    {
+        // A handful of levels per capture size, cleared if the capture resolution keeps changing
+        constexpr auto MaxCachedFilters = 16;
+        thread_local TArray<FAreaFilters> CachedFilters;
+
+        for (const auto& Filters : CachedFilters)
+        {
+            if (Filters.Size == Size && Filters.LevelSize == LevelSize)
+            {
+                return Filters;
+            }
+        }
+
+        if (CachedFilters.Num() >= MaxCachedFilters)
+        {
+            CachedFilters.Reset();
+        }
+
+        auto& Filters = CachedFilters.AddDefaulted_GetRef();
+        Filters.Size = Size;
+        Filters.LevelSize = LevelSize;
+        Filters.X.Init(Size.X, LevelSize.X);
+        Filters.Y.Init(Size.Y, LevelSize.Y);
+        return Filters;
+    }
+}  // namespace
+
+FIntVector2 FMTImagePyramid::GetLevelSize(const FIntVector2& Size, const int32 ShortSide)
+{
+    if (ShortSide <= 0 || ShortSide >= FMath::Min(Size.X, Size.Y))
+    {
+        return Size;
+    }
+
+    // Same integer math as ChangeCapture2DResolution
+    if (Size.Y > Size.X)
+    {
+        return {ShortSide, ShortSide * Size.Y / Size.X};
+    }
+    return {ShortSide * Size.X / Size.Y, ShortSide};
+}
+
+FString FMTImagePyramid::GetLevelPath(const FString& ImagePath, const int32 ShortSide)
+{
+    return FPaths::Combine(
+        FPaths::GetPath(ImagePath), FString::FromInt(ShortSide), FPaths::GetCleanFilename(ImagePath));
+}
+
+void FMTImagePyramid::Downsample(
+    const FColor* Pixels,
+    const FIntVector2& Size,
+    const FIntVector2& LevelSize,
+    TArray<FColor>& OutPixels)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTImagePyramid::Downsample);
+
+    check(LevelSize.X > 0 && LevelSize.Y > 0 && LevelSize.X <= Size.X && LevelSize.Y <= Size.Y);
+
+    // Called per image on the encoder threads, filters are only built for new size pairs
+    const auto& Filters = FindOrInitFilters(Size, LevelSize);
+    const auto& FilterX = Filters.X;
+    const auto& FilterY = Filters.Y;
+
+    // Vertically filtered source row, the four channels of a texel are lanes of one register
+    thread_local TArray<VectorRegister4Float> Row;
+    Row.SetNumUninitialized(Size.X, false);
+
+    OutPixels.SetNumUninitialized(LevelSize.X * LevelSize.Y, false);
+    auto* OutPixel = OutPixels.GetData();
+    const auto Half = VectorSetFloat1(0.5F);
+
+    for (int32 LevelY = 0; LevelY < LevelSize.Y; ++LevelY)
+    {
+        const auto* WeightsY = FilterY.Weights.GetData() + FilterY.FirstWeights[LevelY];
+        const auto* SourceRow = Pixels + FilterY.FirstTaps[LevelY] * Size.X;
+
+        const auto FirstWeightY = VectorSetFloat1(WeightsY[0]);
+        for (int32 X = 0; X < Size.X; ++X)
+        {
+            Row[X] = VectorMultiply(VectorLoadByte4(SourceRow + X), FirstWeightY);
+        }
+        for (int32 Tap = 1; Tap < FilterY.TapNums[LevelY]; ++Tap)
+        {
+            SourceRow += Size.X;
+            const auto WeightY = VectorSetFloat1(WeightsY[Tap]);
+            for (int32 X = 0; X < Size.X; ++X)
+            {
+                Row[X] = VectorMultiplyAdd(VectorLoadByte4(SourceRow + X), WeightY, Row[X]);
+            }
+        }
+
+        for (int32 LevelX = 0; LevelX < LevelSize.X; ++LevelX)
+        {
+            const auto* WeightsX = FilterX.Weights.GetData() + FilterX.FirstWeights[LevelX];
+            const auto* RowTexel = Row.GetData() + FilterX.FirstTaps[LevelX];
+
+            auto Result = Half;
+            for (int32 Tap = 0; Tap < FilterX.TapNums[LevelX]; ++Tap)
+            {
+                Result = VectorMultiplyAdd(RowTexel[Tap], VectorSetFloat1(WeightsX[Tap]), Result);
+            }
+
+            // Store truncates, rounded by the half added above
+            VectorStoreByte4(Result, OutPixel);
+            OutPixel->A = 255;
+            ++OutPixel;
+        }
+    }
+}
@@ -0,0 +1,29 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Smaller copies of a captured image, e.g. the 512 short side inputs of the retrieval models next to
+ * the full resolution.
+ *
+ * Levels are area averages of the capture. Each source row is loaded once per level and the result
+ * is written in the layout the encoders take, alpha is made opaque in the same pass.
+ */
+class GEOLOCATOR_API FMTImagePyramid
+{
+public:
+    // Short side scaled to ShortSide like torchvision Resize, never larger than Size
+    static FIntVector2 GetLevelSize(const FIntVector2& Size, const int32 ShortSide);
+
+    // <image dir>/<short side>/<image name>, every level is a dataset with the same image names
+    static FString GetLevelPath(const FString& ImagePath, const int32 ShortSide);
+
+    // Resizes OutPixels to LevelSize, LevelSize must not be larger than Size
+    static void Downsample(
+        const FColor* Pixels,
+        const FIntVector2& Size,
+        const FIntVector2& LevelSize,
+        TArray<FColor>& OutPixels);
+};
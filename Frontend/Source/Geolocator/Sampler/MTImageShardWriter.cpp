@@ -0,0 +1,265 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTImageShardWriter.h"
+
+#include "HAL/Event.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/RunnableThread.h"
+
+namespace
+{
+    constexpr int32 TarBlockSize = 512;
+
+    void WriteOctal(uint8* Field, const int32 FieldSize, const int64 Value)
+    {
+        // Zero padded and NUL terminated
+        auto RemainingValue = static_cast<uint64>(Value);
+        for (int32 I = FieldSize - 2; I >= 0; --I)
+        {
+            Field[I] = static_cast<uint8>('0' + (RemainingValue & 7));
+            RemainingValue >>= 3;
+        }
+    }
+
+    void WriteString(uint8* Field, const int32 FieldSize, const FTCHARToUTF8& String)
+    {
+        FMemory::Memcpy(Field, String.Get(), FMath::Min(String.Length(), FieldSize));
+    }
+
+    void AppendTarHeader(TArray<uint8>& Data, const FTCHARToUTF8& Name, const int64 Size, const ANSICHAR TypeFlag)
+    {
+        const auto HeaderOffset = Data.Num();
+        Data.AddZeroed(TarBlockSize);
+        auto* Header = Data.GetData() + HeaderOffset;
+
+        WriteString(Header, 100, Name);
+        WriteOctal(Header + 100, 8, 0644);
+        WriteOctal(Header + 108, 8, 0);
+        WriteOctal(Header + 116, 8, 0);
+        WriteOctal(Header + 124, 12, Size);
+        WriteOctal(Header + 136, 12, FDateTime::UtcNow().ToUnixTimestamp());
+        Header[156] = TypeFlag;
+        FMemory::Memcpy(Header + 257, "ustar", 6);
+        FMemory::Memcpy(Header + 263, "00", 2);
+
+        // Checksum is computed with its own field set to spaces
+        FMemory::Memset(Header + 148, ' ', 8);
+        uint32 Checksum = 0;
+        for (int32 I = 0; I < TarBlockSize; ++I)
+        {
+            Checksum += Header[I];
+        }
+        WriteOctal(Header + 148, 7, Checksum);
+    }
+
+    void AppendTarPadding(TArray<uint8>& Data, const int64 Size)
+    {
+        Data.AddZeroed(Align(Size, TarBlockSize) - Size);
+    }
+
+    // ustar names are limited to 100 bytes, longer names, e.g. with metadata, need a pax header
+    void AppendTarMemberHeader(TArray<uint8>& Data, const FString& MemberName, const int64 Size)
+    {
+        const FTCHARToUTF8 NameUTF8(*MemberName);
+        if (NameUTF8.Length() > 100)
+        {
+            const auto Record = FString::Printf(TEXT(" path=%s\n"), *MemberName);
+            const FTCHARToUTF8 RecordUTF8(*Record);
+
+            // The record length includes its own digits
+            int32 DigitNum = 1;
+            while (FString::FromInt(RecordUTF8.Length() + DigitNum).Len() != DigitNum)
+            {
+                DigitNum++;
+            }
+            const auto RecordLength = RecordUTF8.Length() + DigitNum;
+            const FTCHARToUTF8 PaxRecord(*FString::Printf(TEXT("%d%s"), RecordLength, *Record));
+
+            AppendTarHeader(Data, FTCHARToUTF8(TEXT("PaxHeader")), PaxRecord.Length(), 'x');
+            Data.Append(reinterpret_cast<const uint8*>(PaxRecord.Get()), PaxRecord.Length());
+            AppendTarPadding(Data, PaxRecord.Length());
+        }
+
+        AppendTarHeader(Data, NameUTF8, Size, '0');
+    }
+}  // namespace
+
+FMTImageShardWriter::FMTImageShardWriter(const FString& InImageDir, const int64 InMaxShardSize)
+    : ImageDir(InImageDir)
+    , MaxShardSize(InMaxShardSize)
+{
+    // Shards of previous runs are never appended to, their tail might be torn
+    TArray<FString> ShardFileNames;
+    IFileManager::Get().FindFiles(ShardFileNames, *FPaths::Combine(ImageDir, TEXT("Shard-*.tar")), true, false);
+    for (const auto& ShardFileName : ShardFileNames)
+    {
+        const auto ShardNumber = FPaths::GetBaseFilename(ShardFileName).RightChop(6);
+        ShardIndex = FMath::Max(ShardIndex, FCString::Atoi(*ShardNumber));
+    }
+
+    RequestEvent = FPlatformProcess::GetSynchEventFromPool();
+    Thread = FRunnableThread::Create(this, TEXT("MTImageShardWriter"));
+}
+
+FMTImageShardWriter::~FMTImageShardWriter()
+{
+    // Drains the queue before closing the shard
+    bIsStopping = true;
+    RequestEvent->Trigger();
+    Thread->WaitForCompletion();
+    delete Thread;
+
+    FPlatformProcess::ReturnSynchEventToPool(RequestEvent);
+}
+
+TFuture<bool> FMTImageShardWriter::Write(const FString& ImagePath, TArray64<uint8>&& ImageData)
+{
+    auto Request = MakeUnique<FWriteRequest>();
+    Request->MemberName = ImagePath;
+    FPaths::MakePathRelativeTo(Request->MemberName, *(ImageDir + TEXT("/")));
+    Request->Data = MoveTemp(ImageData);
+
+    auto Future = Request->Promise.GetFuture();
+    Requests.Enqueue(MoveTemp(Request));
+    RequestEvent->Trigger();
+
+    return Future;
+}
+
+FString FMTImageShardWriter::GetImageDir() const
+{
+    return ImageDir;
+}
+
+TArray<FString> FMTImageShardWriter::ReadShardIndex(const FString& IndexFilePath)
+{
+    TArray<FString> Lines;
+    FFileHelper::LoadFileToStringArray(Lines, *IndexFilePath);
+
+    TArray<FString> MemberNames;
+    MemberNames.Reserve(Lines.Num());
+    for (const auto& Line : Lines)
+    {
+        FString MemberName;
+        if (Line.Split(TEXT("\t"), &MemberName, nullptr))
+        {
+            MemberNames.Add(MoveTemp(MemberName));
+        }
+    }
+    return MemberNames;
+}
+
+uint32 FMTImageShardWriter::Run()
+{
+    TArray<TUniquePtr<FWriteRequest>> UnflushedRequests;
+
+    while (true)
+    {
+        TUniquePtr<FWriteRequest> Request;
+        while (Requests.Dequeue(Request))
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(FMTImageShardWriter::WriteMember);
+
+            if (!WriteMember(*Request))
+            {
+                Request->Promise.SetValue(false);
+                continue;
+            }
+            UnflushedRequests.Add(MoveTemp(Request));
+        }
+
+        // One flush for everything that queued up while writing
+        if (!UnflushedRequests.IsEmpty())
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(FMTImageShardWriter::Flush);
+
+            const auto bIsFlushed = ShardFile->Flush(true) && ShardIndexFile->Flush(true);
+            for (auto& UnflushedRequest : UnflushedRequests)
+            {
+                UnflushedRequest->Promise.SetValue(bIsFlushed);
+            }
+            UnflushedRequests.Reset();
+        }
+
+        if (bIsStopping && Requests.IsEmpty())
+        {
+            break;
+        }
+
+        RequestEvent->Wait();
+    }
+
+    CloseShard();
+    return 0;
+}
+
+bool FMTImageShardWriter::WriteMember(const FWriteRequest& Request)
+{
+    if ((!ShardFile || ShardSize + Request.Data.Num() > MaxShardSize) && !OpenNextShard())
+    {
+        return false;
+    }
+
+    TArray<uint8> Header;
+    AppendTarMemberHeader(Header, Request.MemberName, Request.Data.Num());
+
+    TArray<uint8> Padding;
+    AppendTarPadding(Padding, Request.Data.Num());
+
+    const auto DataOffset = ShardSize + Header.Num();
+    if (!ShardFile->Write(Header.GetData(), Header.Num()) ||
+        !ShardFile->Write(Request.Data.GetData(), Request.Data.Num()) ||
+        !ShardFile->Write(Padding.GetData(), Padding.Num()))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write %s into image shard %d"), *Request.MemberName, ShardIndex);
+        return false;
+    }
+    ShardSize = DataOffset + Request.Data.Num() + Padding.Num();
+
+    // After the data, an indexed member is always complete
+    const FTCHARToUTF8 IndexLine(
+        *FString::Printf(TEXT("%s\t%lld\t%lld\n"), *Request.MemberName, DataOffset, Request.Data.Num()));
+    return ShardIndexFile->Write(reinterpret_cast<const uint8*>(IndexLine.Get()), IndexLine.Length());
+}
+
+bool FMTImageShardWriter::OpenNextShard()
+{
+    CloseShard();
+
+    ShardIndex++;
+    const auto ShardFilePath = FPaths::Combine(ImageDir, FString::Printf(TEXT("Shard-%05d.tar"), ShardIndex));
+    const auto ShardIndexFilePath = FPaths::ChangeExtension(ShardFilePath, TEXT("idx"));
+
+    auto& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+    PlatformFile.CreateDirectoryTree(*ImageDir);
+    ShardFile.Reset(PlatformFile.OpenWrite(*ShardFilePath));
+    ShardIndexFile.Reset(PlatformFile.OpenWrite(*ShardIndexFilePath));
+    ShardSize = 0;
+
+    if (!ShardFile || !ShardIndexFile)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to open image shard %s"), *ShardFilePath);
+        ShardFile.Reset();
+        ShardIndexFile.Reset();
+        return false;
+    }
+
+    return true;
+}
+
+void FMTImageShardWriter::CloseShard()
+{
+    if (!ShardFile)
+    {
+        return;
+    }
+
+    // End of archive marker
+    TArray<uint8> EndOfArchive;
+    EndOfArchive.AddZeroed(2 * TarBlockSize);
+    ShardFile->Write(EndOfArchive.GetData(), EndOfArchive.Num());
+    ShardFile->Flush(true);
+
+    ShardFile.Reset();
+    ShardIndexFile.Reset();
+}
@@ -0,0 +1,81 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Containers/Queue.h"
+#include "CoreMinimal.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/Runnable.h"
+
+#include <atomic>
+
+class FEvent;
+class FRunnableThread;
+
+/**
+ * Appends encoded images to tar shards in the image directory instead of writing a file per image.
+ *
+ * Shards are named Shard-NNNNN.tar and rotated once they exceed the maximum size, every shard has a
+ * Shard-NNNNN.idx next to it with one "<member name>\t<data offset>\t<size>" line per image.
+ * Members are named by their path relative to the image directory, which also makes the shards
+ * readable as WebDataset. All file writes happen on a dedicated thread, in order of submission.
+ */
+class GEOLOCATOR_API FMTImageShardWriter : public FRunnable
+{
+public:
+    FMTImageShardWriter(const FString& InImageDir, const int64 InMaxShardSize);
+
+    virtual ~FMTImageShardWriter() override;
+
+    FMTImageShardWriter(const FMTImageShardWriter&) = delete;
+
+    FMTImageShardWriter& operator=(const FMTImageShardWriter&) = delete;
+
+    // Thread safe, the future is set once the image is flushed to disk
+    TFuture<bool> Write(const FString& ImagePath, TArray64<uint8>&& ImageData);
+
+    FString GetImageDir() const;
+
+    // Member names of a shard index, relative to the image directory
+    static TArray<FString> ReadShardIndex(const FString& IndexFilePath);
+
+    virtual uint32 Run() override;
+
+private:
+    struct FWriteRequest
+    {
+        FString MemberName;
+
+        TArray64<uint8> Data;
+
+        TPromise<bool> Promise;
+    };
+
+    FString ImageDir;
+
+    int64 MaxShardSize;
+
+    TQueue<TUniquePtr<FWriteRequest>, EQueueMode::Mpsc> Requests;
+
+    FEvent* RequestEvent = nullptr;
+
+    std::atomic<bool> bIsStopping = false;
+
+    FRunnableThread* Thread = nullptr;
+
+    // Only accessed by the writer thread
+
+    int32 ShardIndex = INDEX_NONE;
+
+    int64 ShardSize = 0;
+
+    TUniquePtr<IFileHandle> ShardFile;
+
+    TUniquePtr<IFileHandle> ShardIndexFile;
+
+    bool WriteMember(const FWriteRequest& Request);
+
+    bool OpenNextShard();
+
+    void CloseShard();
+};
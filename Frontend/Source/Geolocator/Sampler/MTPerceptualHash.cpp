@@ -0,0 +1,180 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTPerceptualHash.h"
+
+#include "Algo/Sort.h"
+#include "MTImagePyramid.h"
+
+namespace
+{
+    constexpr int32 HashImageSize = 32;
+
+    constexpr int32 HashFrequencyNum = 8;
+
+    // DCT-II basis of the lowest frequencies, scale factors do not change the comparison to the median
+    struct FDCTBasis
+    {
+        float Cosines[HashFrequencyNum][HashImageSize];
+
+        FDCTBasis()
+        {
+            for (int32 Frequency = 0; Frequency < HashFrequencyNum; ++Frequency)
+            {
+                for (int32 X = 0; X < HashImageSize; ++X)
+                {
+                    Cosines[Frequency][X] =
+                        FMath::Cos((2. * X + 1.) * Frequency * PI / (2. * HashImageSize));
+                }
+            }
+        }
+    };
+}  // namespace
+
+uint64 FMTPerceptualHash::Compute(const FColor* Pixels, const FIntVector2& Size)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTPerceptualHash::Compute);
+
+    static const FDCTBasis Basis;
+
+    thread_local TArray<FColor> HashPixels;
+    FMTImagePyramid::Downsample(Pixels, Size, {HashImageSize, HashImageSize}, HashPixels);
+
+    float Luma[HashImageSize][HashImageSize];
+    for (int32 Y = 0; Y < HashImageSize; ++Y)
+    {
+        for (int32 X = 0; X < HashImageSize; ++X)
+        {
+            const auto& Pixel = HashPixels[Y * HashImageSize + X];
+            Luma[Y][X] = 0.299F * Pixel.R + 0.587F * Pixel.G + 0.114F * Pixel.B;
+        }
+    }
+
+    // Separable, rows first
+    float RowCoefficients[HashImageSize][HashFrequencyNum];
+    for (int32 Y = 0; Y < HashImageSize; ++Y)
+    {
+        for (int32 FrequencyX = 0; FrequencyX < HashFrequencyNum; ++FrequencyX)
+        {
+            auto Sum = 0.F;
+            for (int32 X = 0; X < HashImageSize; ++X)
+            {
+                Sum += Luma[Y][X] * Basis.Cosines[FrequencyX][X];
+            }
+            RowCoefficients[Y][FrequencyX] = Sum;
+        }
+    }
+
+    float Coefficients[HashFrequencyNum * HashFrequencyNum];
+    for (int32 FrequencyY = 0; FrequencyY < HashFrequencyNum; ++FrequencyY)
+    {
+        for (int32 FrequencyX = 0; FrequencyX < HashFrequencyNum; ++FrequencyX)
+        {
+            auto Sum = 0.F;
+            for (int32 Y = 0; Y < HashImageSize; ++Y)
+            {
+                Sum += RowCoefficients[Y][FrequencyX] * Basis.Cosines[FrequencyY][Y];
+            }
+            Coefficients[FrequencyY * HashFrequencyNum + FrequencyX] = Sum;
+        }
+    }
+
+    // DC is the mean brightness, it would only shift the median
+    float SortedCoefficients[HashFrequencyNum * HashFrequencyNum - 1];
+    FMemory::Memcpy(SortedCoefficients, Coefficients + 1, sizeof(SortedCoefficients));
+    const auto CoefficientNum = static_cast<int32>(UE_ARRAY_COUNT(SortedCoefficients));
+    Algo::Sort(SortedCoefficients);
+    const auto Median = SortedCoefficients[CoefficientNum / 2];
+
+    uint64 Hash = 0;
+    for (int32 Index = 1; Index < HashFrequencyNum * HashFrequencyNum; ++Index)
+    {
+        Hash |= static_cast<uint64>(Coefficients[Index] > Median) << Index;
+    }
+    return Hash;
+}
+
+int32 FMTPerceptualHash::GetDistance(const uint64 Hash, const uint64 OtherHash)
+{
+    return static_cast<int32>(FPlatformMath::CountBits(Hash ^ OtherHash));
+}
+
+FMTPerceptualHashIndex::FMTPerceptualHashIndex(const int32 InMaxEntryNum)
+    : MaxEntryNum(FMath::Max(1, InMaxEntryNum))
+{
+    Entries.Reserve(MaxEntryNum);
+}
+
+TOptional<uint64> FMTPerceptualHashIndex::FindOrAdd(
+    const uint64 Hash,
+    const FVector& Location,
+    const uint64 ID,
+    const int32 MaxDistance,
+    const double Radius)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTPerceptualHashIndex::FindOrAdd);
+
+    const auto ClampedMaxDistance = FMath::Clamp(MaxDistance, 0, MaxSupportedDistance);
+    const auto bShouldProbeNeighbours = ClampedMaxDistance >= ChunkNum;
+    const auto RadiusSquared = Radius * Radius;
+
+    FScopeLock ScopeLock(&Lock);
+
+    TArray<int32, TInlineAllocator<16>> CandidateIndices;
+    for (int32 ChunkIndex = 0; ChunkIndex < ChunkNum; ++ChunkIndex)
+    {
+        const auto Chunk = GetChunk(Hash, ChunkIndex);
+        const auto ProbeNum = bShouldProbeNeighbours ? 17 : 1;
+        for (int32 Probe = 0; Probe < ProbeNum; ++Probe)
+        {
+            // Probe 0 is the chunk itself, the others flip one bit
+            const auto ProbeChunk = Probe == 0 ? Chunk : static_cast<uint16>(Chunk ^ (1 << (Probe - 1)));
+
+            CandidateIndices.Reset();
+            ChunkEntryIndices[ChunkIndex].MultiFind(ProbeChunk, CandidateIndices);
+            for (const auto EntryIndex : CandidateIndices)
+            {
+                const auto& Entry = Entries[EntryIndex];
+                if (FMTPerceptualHash::GetDistance(Entry.Hash, Hash) <= ClampedMaxDistance &&
+                    FVector::DistSquared(Entry.Location, Location) <= RadiusSquared)
+                {
+                    return Entry.ID;
+                }
+            }
+        }
+    }
+
+    auto EntryIndex = Entries.Num();
+    if (Entries.Num() < MaxEntryNum)
+    {
+        Entries.Add({Hash, Location, ID});
+    }
+    else
+    {
+        EntryIndex = NextEntryIndex;
+        NextEntryIndex = (NextEntryIndex + 1) % MaxEntryNum;
+
+        const auto OldHash = Entries[EntryIndex].Hash;
+        for (int32 ChunkIndex = 0; ChunkIndex < ChunkNum; ++ChunkIndex)
+        {
+            ChunkEntryIndices[ChunkIndex].RemoveSingle(GetChunk(OldHash, ChunkIndex), EntryIndex);
+        }
+        Entries[EntryIndex] = {Hash, Location, ID};
+    }
+
+    for (int32 ChunkIndex = 0; ChunkIndex < ChunkNum; ++ChunkIndex)
+    {
+        ChunkEntryIndices[ChunkIndex].Add(GetChunk(Hash, ChunkIndex), EntryIndex);
+    }
+    return {};
+}
+
+int32 FMTPerceptualHashIndex::Num() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return Entries.Num();
+}
+
+uint16 FMTPerceptualHashIndex::GetChunk(const uint64 Hash, const int32 ChunkIndex)
+{
+    return static_cast<uint16>(Hash >> (ChunkIndex * 16));
+}
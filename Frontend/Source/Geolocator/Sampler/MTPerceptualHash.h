@@ -0,0 +1,68 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * DCT perceptual hash of a frame. The frame is area averaged to 32 x 32 luma, the 63 lowest
+ * frequency DCT coefficients besides DC are compared against their median. Near identical views
+ * differ in a few bits, compared with the Hamming distance.
+ */
+struct GEOLOCATOR_API FMTPerceptualHash
+{
+    // Frames must be at least 32 x 32
+    static uint64 Compute(const FColor* Pixels, const FIntVector2& Size);
+
+    static int32 GetDistance(const uint64 Hash, const uint64 OtherHash);
+};
+
+/**
+ * Multi-index hash table over the hashes of the recent samples, shared by the encoder threads.
+ *
+ * Hashes are split into four 16 bit chunks with a table each. Two hashes within 7 bits have a chunk
+ * within 1 bit, so a query probes every chunk and its one bit neighbours instead of all entries.
+ */
+class GEOLOCATOR_API FMTPerceptualHashIndex
+{
+public:
+    static constexpr int32 MaxSupportedDistance = 7;
+
+    explicit FMTPerceptualHashIndex(const int32 InMaxEntryNum);
+
+    // ID of a recent hash within MaxDistance bits that was added within Radius of Location. Without
+    // one the hash is added and replaces the oldest entry once full.
+    TOptional<uint64> FindOrAdd(
+        const uint64 Hash,
+        const FVector& Location,
+        const uint64 ID,
+        const int32 MaxDistance,
+        const double Radius);
+
+    int32 Num() const;
+
+private:
+    static constexpr int32 ChunkNum = 4;
+
+    struct FEntry
+    {
+        uint64 Hash;
+
+        FVector Location;
+
+        uint64 ID;
+    };
+
+    mutable FCriticalSection Lock;
+
+    int32 MaxEntryNum;
+
+    // Ring of the recent entries, NextEntryIndex is the oldest once full
+    TArray<FEntry> Entries;
+
+    int32 NextEntryIndex = 0;
+
+    TMultiMap<uint16, int32> ChunkEntryIndices[ChunkNum];
+
+    static uint16 GetChunk(const uint64 Hash, const int32 ChunkIndex);
+};
@@ -66,7 +66,7 @@ void UMTSFXLSamplerComponent::BeginPlay()
             const auto AbsoluteFileName =
                 FPaths::Combine(GetSessionDir(), "Images", Locations[I].Path);
 
-            if (FPaths::FileExists(AbsoluteFileName))
+            if (GetSampleJournal().IsCompleted(GetSampleJournal().MakeSampleID(AbsoluteFileName)))
             {
                 Locations.RemoveAtSwap(I);
                 I--;
@@ -49,4 +49,16 @@ struct GEOLOCATOR_API FMTSample
     FString AbsoluteImagePath;
 
     int32 ImageID;
+
+    // Time the sampler waited for tiles, collision and rendering before capturing
+    double ReadinessWaitSeconds = 0.;
+
+    // Scored from the captured pixels, see FMTFrameStatistics
+    float FrameArtifactScore = 0.F;
+
+    // DCT hash of the captured frame, see FMTPerceptualHash
+    uint64 PerceptualHash = 0;
+
+    // Sample ID of an earlier sample with nearly the same image, 0 if there is none
+    uint64 DuplicateSampleID = 0;
 };
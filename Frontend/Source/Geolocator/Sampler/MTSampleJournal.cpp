@@ -0,0 +1,277 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTSampleJournal.h"
+
+#include "HAL/PlatformFileManager.h"
+#include "Hash/CityHash.h"
+#include "MTImageShardWriter.h"
+
+namespace
+{
+    constexpr uint32 JournalFileMagic = 0x4D54534A;
+
+    constexpr uint32 JournalFileVersion = 2;
+
+    constexpr int32 JournalHeaderSize = 2 * sizeof(uint32);
+
+    // Sample ID, cursor scope, cursor position and checksum
+    constexpr int32 JournalRecordDataSize = 3 * sizeof(uint64);
+
+    constexpr int32 JournalRecordSize = JournalRecordDataSize + sizeof(uint32);
+
+    // Version 1 records have no cursor scope, they are read with scope 0
+    constexpr int32 JournalRecordDataSizeV1 = 2 * sizeof(uint64);
+
+    // A crash loses at most this many records, the images are simply captured again
+    constexpr int32 JournalRecordsPerFlush = 64;
+
+    template <typename T>
+    void AppendValue(TArray<uint8>& Data, const T Value)
+    {
+        Data.Append(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+    }
+
+    void AppendRecord(TArray<uint8>& Data, const uint64 SampleID, const FMTSamplingCursor& Cursor)
+    {
+        const auto RecordOffset = Data.Num();
+        AppendValue(Data, SampleID);
+        AppendValue(Data, Cursor.Scope);
+        AppendValue(Data, Cursor.Position);
+        AppendValue(Data, FCrc::MemCrc32(Data.GetData() + RecordOffset, JournalRecordDataSize));
+    }
+
+    template <typename T>
+    T ReadValue(const uint8* Data)
+    {
+        T Value;
+        FMemory::Memcpy(&Value, Data, sizeof(T));
+        return Value;
+    }
+}  // namespace
+
+FMTSampleJournal::FMTSampleJournal(const FString& InSessionDir)
+    : SessionDir(InSessionDir)
+    , NormalizedSessionDir(FPaths::ConvertRelativePathToFull(InSessionDir))
+    , FilePath(FPaths::Combine(InSessionDir, TEXT("SampleJournal.bin")))
+{
+    FPaths::NormalizeDirectoryName(NormalizedSessionDir);
+    Load();
+}
+
+FMTSampleJournal::~FMTSampleJournal()
+{
+    Flush();
+}
+
+uint64 FMTSampleJournal::MakeSampleID(const FString& ImagePath) const
+{
+    auto RelativePath = FPaths::ConvertRelativePathToFull(NormalizedSessionDir, ImagePath);
+    FPaths::NormalizeFilename(RelativePath);
+    if (RelativePath.StartsWith(NormalizedSessionDir))
+    {
+        RelativePath.RightChopInline(NormalizedSessionDir.Len());
+    }
+    RelativePath.RemoveFromStart(TEXT("/"));
+
+    const FTCHARToUTF8 RelativePathUTF8(*RelativePath);
+    return CityHash64(RelativePathUTF8.Get(), RelativePathUTF8.Length());
+}
+
+bool FMTSampleJournal::IsCompleted(const uint64 SampleID) const
+{
+    return CompletedSampleIDs.Contains(SampleID);
+}
+
+void FMTSampleJournal::MarkCompleted(const uint64 SampleID, const FMTSamplingCursor& InCursor)
+{
+    CompletedSampleIDs.Add(SampleID);
+    UpdateCursor(InCursor);
+
+    AppendRecord(PendingRecords, SampleID, InCursor);
+    if (PendingRecords.Num() >= JournalRecordsPerFlush * JournalRecordSize)
+    {
+        Flush();
+    }
+}
+
+int64 FMTSampleJournal::GetCursor(const uint64 Scope) const
+{
+    return Cursor.Scope == Scope ? Cursor.Position : INDEX_NONE;
+}
+
+int32 FMTSampleJournal::CompletedNum() const
+{
+    return CompletedSampleIDs.Num();
+}
+
+void FMTSampleJournal::Flush()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSampleJournal::Flush);
+
+    if (PendingRecords.IsEmpty())
+    {
+        return;
+    }
+
+    if (!File)
+    {
+        OpenForAppend();
+    }
+
+    if (File)
+    {
+        File->Write(PendingRecords.GetData(), PendingRecords.Num());
+        // Make the batch durable, not just handed to the OS
+        File->Flush(true);
+    }
+
+    PendingRecords.Reset();
+}
+
+void FMTSampleJournal::RepairFromImages(const FString& ImageDir)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSampleJournal::RepairFromImages);
+
+    Flush();
+
+    TArray<FString> ImageFilePaths;
+    IFileManager::Get().FindFilesRecursive(ImageFilePaths, *ImageDir, TEXT("*.*"), true, false);
+
+    // Samples before the cursor are not all captured anymore, completed ones are skipped by ID
+    Cursor.Position = INDEX_NONE;
+    CompletedSampleIDs.Reset();
+    for (const auto& ImageFilePath : ImageFilePaths)
+    {
+        const auto Extension = FPaths::GetExtension(ImageFilePath);
+        if (Extension == TEXT("idx"))
+        {
+            // Shard members are named relative to the image directory
+            for (const auto& MemberName : FMTImageShardWriter::ReadShardIndex(ImageFilePath))
+            {
+                CompletedSampleIDs.Add(MakeSampleID(FPaths::Combine(FPaths::GetPath(ImageFilePath), MemberName)));
+            }
+        }
+        else if (Extension != TEXT("tar"))
+        {
+            CompletedSampleIDs.Add(MakeSampleID(ImageFilePath));
+        }
+    }
+
+    UE_LOG(LogTemp, Display, TEXT("Repaired sample journal from %d images"), CompletedSampleIDs.Num());
+
+    Rewrite();
+}
+
+FString FMTSampleJournal::GetSessionDir() const
+{
+    return SessionDir;
+}
+
+void FMTSampleJournal::Load()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSampleJournal::Load);
+
+    TArray<uint8> Data;
+    if (!FFileHelper::LoadFileToArray(Data, *FilePath, FILEREAD_Silent))
+    {
+        return;
+    }
+
+    const auto Version = Data.Num() >= JournalHeaderSize ? ReadValue<uint32>(Data.GetData() + sizeof(uint32)) : 0;
+    if (Data.Num() < JournalHeaderSize || ReadValue<uint32>(Data.GetData()) != JournalFileMagic ||
+        (Version != JournalFileVersion && Version != 1))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Ignoring invalid sample journal %s"), *FilePath);
+        Rewrite();
+        return;
+    }
+
+    const auto RecordDataSize = Version == 1 ? JournalRecordDataSizeV1 : JournalRecordDataSize;
+    const auto RecordSize = RecordDataSize + static_cast<int32>(sizeof(uint32));
+    const auto RecordNum = (Data.Num() - JournalHeaderSize) / RecordSize;
+    CompletedSampleIDs.Reserve(RecordNum);
+
+    auto bIsTorn = (Data.Num() - JournalHeaderSize) % RecordSize != 0;
+    for (int32 RecordIndex = 0; RecordIndex < RecordNum; ++RecordIndex)
+    {
+        const auto* RecordData = Data.GetData() + JournalHeaderSize + RecordIndex * RecordSize;
+        const auto Checksum = ReadValue<uint32>(RecordData + RecordDataSize);
+        if (FCrc::MemCrc32(RecordData, RecordDataSize) != Checksum)
+        {
+            bIsTorn = true;
+            break;
+        }
+
+        CompletedSampleIDs.Add(ReadValue<uint64>(RecordData));
+        if (Version == 1)
+        {
+            UpdateCursor({0, ReadValue<int64>(RecordData + sizeof(uint64))});
+        }
+        else
+        {
+            UpdateCursor(
+                {ReadValue<uint64>(RecordData + sizeof(uint64)), ReadValue<int64>(RecordData + 2 * sizeof(uint64))});
+        }
+    }
+
+    // Appending after a torn record would hide all following records, older versions are upgraded
+    if (bIsTorn || Version != JournalFileVersion)
+    {
+        if (bIsTorn)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Dropping torn records of sample journal %s"), *FilePath);
+        }
+        Rewrite();
+    }
+}
+
+void FMTSampleJournal::UpdateCursor(const FMTSamplingCursor& InCursor)
+{
+    // A new scope replaces the cursor, e.g. the sample plan was rebuilt
+    if (InCursor.Scope != Cursor.Scope)
+    {
+        Cursor = InCursor;
+        return;
+    }
+    Cursor.Position = FMath::Max(Cursor.Position, InCursor.Position);
+}
+
+void FMTSampleJournal::Rewrite()
+{
+    // Pending records are part of the rewritten journal
+    File.Reset();
+    PendingRecords.Reset();
+
+    TArray<uint8> Data;
+    Data.Reserve(JournalHeaderSize + CompletedSampleIDs.Num() * JournalRecordSize);
+    AppendValue(Data, JournalFileMagic);
+    AppendValue(Data, JournalFileVersion);
+    for (const auto SampleID : CompletedSampleIDs)
+    {
+        AppendRecord(Data, SampleID, Cursor);
+    }
+
+    // Written next to the journal and moved over it, a crash leaves either the old or the new one
+    const auto TempFilePath = FilePath + TEXT(".tmp");
+    if (!FFileHelper::SaveArrayToFile(Data, *TempFilePath) ||
+        !IFileManager::Get().Move(*FilePath, *TempFilePath, true, true))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write sample journal %s"), *FilePath);
+    }
+}
+
+void FMTSampleJournal::OpenForAppend()
+{
+    auto& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+    if (!PlatformFile.FileExists(*FilePath))
+    {
+        PlatformFile.CreateDirectoryTree(*SessionDir);
+        Rewrite();
+    }
+
+    File.Reset(PlatformFile.OpenWrite(*FilePath, true));
+    if (!File)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to open sample journal %s"), *FilePath);
+    }
+}
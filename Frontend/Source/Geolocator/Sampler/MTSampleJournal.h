@@ -0,0 +1,79 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+
+struct FMTSamplingCursor
+{
+    // Positions of different scopes are not comparable, e.g. of different sample plans
+    uint64 Scope = 0;
+
+    int64 Position = INDEX_NONE;
+};
+
+/**
+ * Append only record of the completed samples of a session, replaces checking image files on resume.
+ *
+ * Every record holds a sample ID and the sampler cursor at the time the sample was captured. Only
+ * the cursor of the scope of the latest record is kept, the ones of earlier scopes are stale.
+ * Records are written in batches and flushed to disk with each batch, a record torn by a crash
+ * fails its checksum and is dropped on the next open.
+ */
+class GEOLOCATOR_API FMTSampleJournal
+{
+public:
+    explicit FMTSampleJournal(const FString& InSessionDir);
+
+    ~FMTSampleJournal();
+
+    FMTSampleJournal(const FMTSampleJournal&) = delete;
+
+    FMTSampleJournal& operator=(const FMTSampleJournal&) = delete;
+
+    // Stable across machines, derived from the image path relative to the session directory
+    uint64 MakeSampleID(const FString& ImagePath) const;
+
+    bool IsCompleted(const uint64 SampleID) const;
+
+    // Cursor is sampler specific, e.g. the index of the next planned sample
+    void MarkCompleted(const uint64 SampleID, const FMTSamplingCursor& InCursor);
+
+    // Largest cursor position of the completed samples, INDEX_NONE for new sessions and other scopes
+    int64 GetCursor(const uint64 Scope) const;
+
+    int32 CompletedNum() const;
+
+    void Flush();
+
+    // Rebuilds the journal from the images and image shards in the image directory, e.g. after images were deleted.
+    // Drops the cursor, deleted images before it have to be captured again.
+    void RepairFromImages(const FString& ImageDir);
+
+    FString GetSessionDir() const;
+
+private:
+    FString SessionDir;
+
+    // Full path without trailing slash, sample IDs are relative to it
+    FString NormalizedSessionDir;
+
+    FString FilePath;
+
+    TSet<uint64> CompletedSampleIDs;
+
+    FMTSamplingCursor Cursor;
+
+    void UpdateCursor(const FMTSamplingCursor& InCursor);
+
+    TUniquePtr<IFileHandle> File;
+
+    TArray<uint8> PendingRecords;
+
+    void Load();
+
+    void Rewrite();
+
+    void OpenForAppend();
+};
@@ -0,0 +1,285 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTSampleMetadataWriter.h"
+
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+    constexpr uint32 MetadataShardMagic = 0x4D544D53;
+
+    constexpr uint32 MetadataShardVersion = 1;
+
+    constexpr int32 MetadataRowsPerShard = 4096;
+
+    constexpr int32 ColumnNameSize = 24;
+
+    enum class EColumnType : uint32
+    {
+        UInt64 = 0,
+        Float64 = 1,
+        Float32 = 2,
+        // Index into the string dictionary
+        String = 3,
+    };
+
+    struct FColumn
+    {
+        const ANSICHAR* Name;
+
+        EColumnType Type;
+
+        const void* Data;
+
+        int32 Stride;
+    };
+
+    template <typename T>
+    void AppendValue(TArray<uint8>& Data, const T Value)
+    {
+        Data.Append(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+    }
+
+    void AlignTo8(TArray<uint8>& Data)
+    {
+        Data.AddZeroed(Align(Data.Num(), 8) - Data.Num());
+    }
+
+    template <typename T>
+    void PatchValue(TArray<uint8>& Data, const int32 Offset, const T Value)
+    {
+        FMemory::Memcpy(Data.GetData() + Offset, &Value, sizeof(T));
+    }
+}  // namespace
+
+FMTSampleMetadataWriter::FMTSampleMetadataWriter(const FString& InSessionDir)
+    : SessionDir(InSessionDir)
+    , MetadataDir(FPaths::Combine(InSessionDir, TEXT("Metadata")))
+{
+    LoadIndex();
+}
+
+FMTSampleMetadataWriter::~FMTSampleMetadataWriter()
+{
+    Flush();
+}
+
+void FMTSampleMetadataWriter::Add(const uint64 SampleID, const FString& ImagePath, const FMTSample& Sample)
+{
+    SampleIDs.Add(SampleID);
+    Latitudes.Add(Sample.LonLatAltitude.Y);
+    Longitudes.Add(Sample.LonLatAltitude.X);
+    Altitudes.Add(Sample.LonLatAltitude.Z);
+    HeadingAngles.Add(Sample.HeadingAngle);
+    Pitches.Add(Sample.Pitch);
+    Rolls.Add(Sample.Roll);
+    ArtifactProbabilities.Add(Sample.ArtifactProbability);
+    ReadinessWaitSeconds.Add(Sample.ReadinessWaitSeconds);
+    FrameArtifactScores.Add(Sample.FrameArtifactScore);
+    PerceptualHashes.Add(Sample.PerceptualHash);
+    DuplicateSampleIDs.Add(Sample.DuplicateSampleID);
+    ImagePaths.Add(InternString(ImagePath));
+    StreetNames.Add(InternString(Sample.StreetName));
+    Regions.Add(InternString(Sample.Region));
+}
+
+bool FMTSampleMetadataWriter::ShouldFlush() const
+{
+    return PendingNum() >= MetadataRowsPerShard;
+}
+
+int32 FMTSampleMetadataWriter::PendingNum() const
+{
+    return SampleIDs.Num();
+}
+
+bool FMTSampleMetadataWriter::Flush()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSampleMetadataWriter::Flush);
+
+    if (SampleIDs.IsEmpty())
+    {
+        return true;
+    }
+
+    const FColumn Columns[] = {
+        {"sample_id", EColumnType::UInt64, SampleIDs.GetData(), sizeof(uint64)},
+        {"latitude", EColumnType::Float64, Latitudes.GetData(), sizeof(double)},
+        {"longitude", EColumnType::Float64, Longitudes.GetData(), sizeof(double)},
+        {"altitude", EColumnType::Float32, Altitudes.GetData(), sizeof(float)},
+        {"heading_angle", EColumnType::Float32, HeadingAngles.GetData(), sizeof(float)},
+        {"pitch", EColumnType::Float32, Pitches.GetData(), sizeof(float)},
+        {"roll", EColumnType::Float32, Rolls.GetData(), sizeof(float)},
+        {"artifact_probability", EColumnType::Float32, ArtifactProbabilities.GetData(), sizeof(float)},
+        {"readiness_wait_seconds", EColumnType::Float32, ReadinessWaitSeconds.GetData(), sizeof(float)},
+        {"frame_artifact_score", EColumnType::Float32, FrameArtifactScores.GetData(), sizeof(float)},
+        {"perceptual_hash", EColumnType::UInt64, PerceptualHashes.GetData(), sizeof(uint64)},
+        {"duplicate_sample_id", EColumnType::UInt64, DuplicateSampleIDs.GetData(), sizeof(uint64)},
+        {"image_path", EColumnType::String, ImagePaths.GetData(), sizeof(uint32)},
+        {"street_name", EColumnType::String, StreetNames.GetData(), sizeof(uint32)},
+        {"region", EColumnType::String, Regions.GetData(), sizeof(uint32)},
+    };
+    constexpr int32 ColumnNum = UE_ARRAY_COUNT(Columns);
+    const auto RowNum = SampleIDs.Num();
+
+    TArray<uint8> Data;
+
+    // Header, the string dictionary offset is patched once known
+    AppendValue(Data, MetadataShardMagic);
+    AppendValue(Data, MetadataShardVersion);
+    AppendValue(Data, static_cast<uint32>(RowNum));
+    AppendValue(Data, static_cast<uint32>(ColumnNum));
+    const auto StringDictionaryOffsetPosition = Data.Num();
+    AppendValue(Data, static_cast<uint64>(0));
+    AppendValue(Data, static_cast<uint64>(0));
+
+    // Column table, data offsets are patched while writing the columns
+    const auto ColumnTableOffset = Data.Num();
+    constexpr int32 ColumnTableEntrySize = ColumnNameSize + 2 * sizeof(uint32) + sizeof(uint64);
+    for (const auto& Column : Columns)
+    {
+        const auto NameOffset = Data.Num();
+        Data.AddZeroed(ColumnNameSize);
+        FMemory::Memcpy(
+            Data.GetData() + NameOffset, Column.Name, FMath::Min<int32>(FCStringAnsi::Strlen(Column.Name), ColumnNameSize - 1));
+        AppendValue(Data, static_cast<uint32>(Column.Type));
+        AppendValue(Data, static_cast<uint32>(0));
+        AppendValue(Data, static_cast<uint64>(0));
+    }
+
+    for (int32 ColumnIndex = 0; ColumnIndex < ColumnNum; ++ColumnIndex)
+    {
+        AlignTo8(Data);
+        PatchValue(
+            Data,
+            ColumnTableOffset + ColumnIndex * ColumnTableEntrySize + ColumnNameSize + 2 * sizeof(uint32),
+            static_cast<uint64>(Data.Num()));
+        Data.Append(static_cast<const uint8*>(Columns[ColumnIndex].Data), RowNum * Columns[ColumnIndex].Stride);
+    }
+
+    // String dictionary, UTF-8 strings addressed by an offset array with a trailing end offset
+    AlignTo8(Data);
+    PatchValue(Data, StringDictionaryOffsetPosition, static_cast<uint64>(Data.Num()));
+    AppendValue(Data, static_cast<uint32>(Strings.Num()));
+    AppendValue(Data, static_cast<uint32>(0));
+
+    const auto StringOffsetsPosition = Data.Num();
+    Data.AddZeroed((Strings.Num() + 1) * sizeof(uint64));
+    const auto StringDataPosition = Data.Num();
+    for (int32 StringIndex = 0; StringIndex < Strings.Num(); ++StringIndex)
+    {
+        PatchValue(
+            Data, StringOffsetsPosition + StringIndex * sizeof(uint64), static_cast<uint64>(Data.Num() - StringDataPosition));
+        const FTCHARToUTF8 StringUTF8(*Strings[StringIndex]);
+        Data.Append(reinterpret_cast<const uint8*>(StringUTF8.Get()), StringUTF8.Length());
+    }
+    PatchValue(
+        Data, StringOffsetsPosition + Strings.Num() * sizeof(uint64), static_cast<uint64>(Data.Num() - StringDataPosition));
+
+    // Shards are never modified, a new one is written for every flush
+    const auto ShardFileName = FString::Printf(TEXT("Shard-%05d.mtm"), Shards.Num());
+    const auto ShardFilePath = FPaths::Combine(MetadataDir, ShardFileName);
+    const auto TempShardFilePath = ShardFilePath + TEXT(".tmp");
+    if (!FFileHelper::SaveArrayToFile(Data, *TempShardFilePath) ||
+        !IFileManager::Get().Move(*ShardFilePath, *TempShardFilePath, true, true))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write sample metadata shard %s"), *ShardFilePath);
+        return false;
+    }
+
+    Shards.Add({ShardFileName, RowNum});
+    if (!SaveIndex())
+    {
+        return false;
+    }
+
+    SampleIDs.Reset();
+    Latitudes.Reset();
+    Longitudes.Reset();
+    Altitudes.Reset();
+    HeadingAngles.Reset();
+    Pitches.Reset();
+    Rolls.Reset();
+    ArtifactProbabilities.Reset();
+    ReadinessWaitSeconds.Reset();
+    FrameArtifactScores.Reset();
+    PerceptualHashes.Reset();
+    DuplicateSampleIDs.Reset();
+    ImagePaths.Reset();
+    StreetNames.Reset();
+    Regions.Reset();
+    Strings.Reset();
+    StringIndices.Reset();
+
+    return true;
+}
+
+FString FMTSampleMetadataWriter::GetSessionDir() const
+{
+    return SessionDir;
+}
+
+uint32 FMTSampleMetadataWriter::InternString(const FString& String)
+{
+    if (const auto* StringIndex = StringIndices.Find(String))
+    {
+        return *StringIndex;
+    }
+
+    const auto StringIndex = static_cast<uint32>(Strings.Add(String));
+    StringIndices.Add(String, StringIndex);
+    return StringIndex;
+}
+
+void FMTSampleMetadataWriter::LoadIndex()
+{
+    FString IndexJson;
+    if (!FFileHelper::LoadFileToString(IndexJson, *FPaths::Combine(MetadataDir, TEXT("Index.json"))))
+    {
+        return;
+    }
+
+    TSharedPtr<FJsonObject> Index;
+    if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(IndexJson), Index) || !Index.IsValid())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Ignoring invalid sample metadata index in %s"), *MetadataDir);
+        return;
+    }
+
+    for (const auto& ShardValue : Index->GetArrayField(TEXT("Shards")))
+    {
+        const auto& ShardObject = ShardValue->AsObject();
+        Shards.Add({ShardObject->GetStringField(TEXT("File")), ShardObject->GetIntegerField(TEXT("RowCount"))});
+    }
+}
+
+bool FMTSampleMetadataWriter::SaveIndex() const
+{
+    TArray<TSharedPtr<FJsonValue>> ShardValues;
+    for (const auto& Shard : Shards)
+    {
+        const auto ShardObject = MakeShared<FJsonObject>();
+        ShardObject->SetStringField(TEXT("File"), Shard.FileName);
+        ShardObject->SetNumberField(TEXT("RowCount"), Shard.RowNum);
+        ShardValues.Add(MakeShared<FJsonValueObject>(ShardObject));
+    }
+
+    const auto Index = MakeShared<FJsonObject>();
+    Index->SetNumberField(TEXT("Version"), MetadataShardVersion);
+    Index->SetArrayField(TEXT("Shards"), ShardValues);
+
+    FString IndexJson;
+    FJsonSerializer::Serialize(Index, TJsonWriterFactory<>::Create(&IndexJson));
+
+    const auto IndexFilePath = FPaths::Combine(MetadataDir, TEXT("Index.json"));
+    const auto TempIndexFilePath = IndexFilePath + TEXT(".tmp");
+    if (!FFileHelper::SaveStringToFile(IndexJson, *TempIndexFilePath) ||
+        !IFileManager::Get().Move(*IndexFilePath, *TempIndexFilePath, true, true))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write sample metadata index %s"), *IndexFilePath);
+        return false;
+    }
+
+    return true;
+}
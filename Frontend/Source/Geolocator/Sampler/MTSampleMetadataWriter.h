@@ -0,0 +1,92 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MTSample.h"
+
+/**
+ * Writes sample metadata as columnar shards into <SessionDir>/Metadata, see Backend/Scripts/sample_metadata.py.
+ *
+ * A shard is a header, a column table, one fixed width column per field and a string dictionary
+ * shared by all string columns. Sections are 8 byte aligned so readers can map columns without copying.
+ * Index.json lists the completed shards and their row counts.
+ */
+class GEOLOCATOR_API FMTSampleMetadataWriter
+{
+public:
+    explicit FMTSampleMetadataWriter(const FString& InSessionDir);
+
+    ~FMTSampleMetadataWriter();
+
+    FMTSampleMetadataWriter(const FMTSampleMetadataWriter&) = delete;
+
+    FMTSampleMetadataWriter& operator=(const FMTSampleMetadataWriter&) = delete;
+
+    void Add(const uint64 SampleID, const FString& ImagePath, const FMTSample& Sample);
+
+    // True once enough rows are pending for a full shard
+    bool ShouldFlush() const;
+
+    int32 PendingNum() const;
+
+    // Writes the pending rows into a new shard and updates the index
+    bool Flush();
+
+    FString GetSessionDir() const;
+
+private:
+    struct FShardInfo
+    {
+        FString FileName;
+
+        int32 RowNum;
+    };
+
+    FString SessionDir;
+
+    FString MetadataDir;
+
+    TArray<FShardInfo> Shards;
+
+    TArray<uint64> SampleIDs;
+
+    TArray<double> Latitudes;
+
+    TArray<double> Longitudes;
+
+    TArray<float> Altitudes;
+
+    TArray<float> HeadingAngles;
+
+    TArray<float> Pitches;
+
+    TArray<float> Rolls;
+
+    TArray<float> ArtifactProbabilities;
+
+    TArray<float> ReadinessWaitSeconds;
+
+    TArray<float> FrameArtifactScores;
+
+    TArray<uint64> PerceptualHashes;
+
+    TArray<uint64> DuplicateSampleIDs;
+
+    TArray<uint32> ImagePaths;
+
+    TArray<uint32> StreetNames;
+
+    TArray<uint32> Regions;
+
+    // Per shard, most street and region names repeat
+    TArray<FString> Strings;
+
+    TMap<FString, uint32> StringIndices;
+
+    uint32 InternString(const FString& String);
+
+    void LoadIndex();
+
+    bool SaveIndex() const;
+};
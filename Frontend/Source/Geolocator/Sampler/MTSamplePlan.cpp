@@ -0,0 +1,253 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTSamplePlan.h"
+
+#include "MTSampleSpatialHash.h"
+
+#include "Hash/CityHash.h"
+
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+    constexpr uint32 SamplePlanFileMagic = 0x4D545350;
+
+    constexpr int32 SamplePlanFileVersion = 3;
+
+    struct FSampleCandidate
+    {
+        FVector Location;
+
+        FQuat Rotation;
+
+        int32 WayIndex;
+    };
+
+    void WalkPath(
+        const FMTWayGraph& Graph,
+        const FMTWayGraphPath& Path,
+        const ACesiumGeoreference* GeoRef,
+        const double SampleDistance,
+        TArray<FSampleCandidate>& OutCandidates)
+    {
+        if (Path.Nodes.Num() < 2)
+        {
+            return;
+        }
+
+        TArray<FVector> NodeLocations;
+        NodeLocations.Reserve(Path.Nodes.Num());
+        for (const auto Node : Path.Nodes)
+        {
+            NodeLocations.Add(Graph.GetNodeLocationUnreal(Node, GeoRef));
+        }
+
+        // Cumulative distance at the start of every node
+        TArray<double> NodeDistances;
+        NodeDistances.Reserve(Path.Nodes.Num());
+        NodeDistances.Add(0.);
+        for (int32 NodeIndex = 1; NodeIndex < NodeLocations.Num(); ++NodeIndex)
+        {
+            NodeDistances.Add(
+                NodeDistances.Last() + FVector::Dist(NodeLocations[NodeIndex - 1], NodeLocations[NodeIndex]));
+        }
+
+        const auto PathLength = NodeDistances.Last();
+        const auto LastSegmentIndex = NodeLocations.Num() - 2;
+
+        int32 SegmentIndex = 0;
+
+        // The last sample lands on the path end if the path is not a multiple of SampleDistance long
+        for (auto SampleDistanceOnPath = SampleDistance;; SampleDistanceOnPath += SampleDistance)
+        {
+            const auto bIsPastEnd = SampleDistanceOnPath > PathLength;
+            const auto Distance = FMath::Min(SampleDistanceOnPath, PathLength);
+
+            while (SegmentIndex < LastSegmentIndex && NodeDistances[SegmentIndex + 1] < Distance)
+            {
+                SegmentIndex++;
+            }
+
+            const auto& StartPoint = NodeLocations[SegmentIndex];
+            const auto& EndPoint = NodeLocations[SegmentIndex + 1];
+            const auto SegmentLength = NodeDistances[SegmentIndex + 1] - NodeDistances[SegmentIndex];
+            const auto Alpha = SegmentLength > 0. ? (Distance - NodeDistances[SegmentIndex]) / SegmentLength : 1.;
+
+            FSampleCandidate Candidate;
+            Candidate.Location = FMath::Lerp(StartPoint, EndPoint, Alpha);
+            Candidate.Rotation = (EndPoint - StartPoint).Rotation().Quaternion();
+            Candidate.WayIndex = Graph.GetEdgeWay(
+                Graph.NodePairToEdgeIndex(Path.Nodes[SegmentIndex], Path.Nodes[SegmentIndex + 1]));
+            OutCandidates.Add(Candidate);
+
+            if (bIsPastEnd || SampleDistanceOnPath == PathLength)
+            {
+                break;
+            }
+        }
+    }
+}  // namespace
+
+FMTSamplePlan FMTSamplePlan::Build(
+    const FMTWayGraph& Graph,
+    const TConstArrayView<FMTWayGraphPath> Paths,
+    const ACesiumGeoreference* GeoRef,
+    const double SampleDistance,
+    const double MinDistanceBetweenSamples,
+    const bool bDeduplicatePerWay)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSamplePlan::Build);
+
+    check(SampleDistance > 0. && MinDistanceBetweenSamples > 0.);
+
+    FMTSamplePlan Plan;
+    Plan.PathsHash = HashPaths(Paths);
+    Plan.GeoRefOrigin = GeoRef->GetOriginLongitudeLatitudeHeight();
+    Plan.SampleDistance = SampleDistance;
+    Plan.MinDistanceBetweenSamples = MinDistanceBetweenSamples;
+    Plan.bDeduplicatePerWay = bDeduplicatePerWay;
+
+    TArray<TArray<FSampleCandidate>> PathCandidates;
+    PathCandidates.SetNum(Paths.Num());
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(FMTSamplePlan::WalkPaths);
+        ParallelFor(
+            Paths.Num(),
+            [&](const int32 PathIndex)
+            { WalkPath(Graph, Paths[PathIndex], GeoRef, SampleDistance, PathCandidates[PathIndex]); });
+    }
+
+    // Depends on all previous decisions, cheap compared to walking the paths
+    TArray<const FSampleCandidate*> AcceptedCandidates;
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(FMTSamplePlan::Deduplicate);
+
+        // Paths cover edges more than once, repeated candidates are dropped here
+        FMTSampleSpatialHash AcceptedLocations(MinDistanceBetweenSamples);
+        for (const auto& Candidates : PathCandidates)
+        {
+            for (const auto& Candidate : Candidates)
+            {
+                if (AcceptedLocations.AddIfNoPointWithinRadius(
+                        Candidate.Location, bDeduplicatePerWay ? Candidate.WayIndex : INDEX_NONE))
+                {
+                    AcceptedCandidates.Add(&Candidate);
+                }
+            }
+        }
+    }
+
+    Plan.Samples.SetNum(AcceptedCandidates.Num());
+    ParallelFor(
+        AcceptedCandidates.Num(),
+        [&Plan, &AcceptedCandidates](const int32 SampleIndex)
+        {
+            const auto& Candidate = *AcceptedCandidates[SampleIndex];
+            auto& Sample = Plan.Samples[SampleIndex];
+            Sample.Transform = FTransform(Candidate.Rotation, Candidate.Location);
+            Sample.WayIndex = Candidate.WayIndex;
+        });
+
+    return Plan;
+}
+
+int32 FMTSamplePlan::Num() const
+{
+    return Samples.Num();
+}
+
+const FMTPlannedSample& FMTSamplePlan::operator[](const int32 SampleIndex) const
+{
+    return Samples[SampleIndex];
+}
+
+bool FMTSamplePlan::IsBuiltFor(
+    const TConstArrayView<FMTWayGraphPath> Paths,
+    const ACesiumGeoreference* GeoRef,
+    const double InSampleDistance,
+    const double InMinDistanceBetweenSamples,
+    const bool bInDeduplicatePerWay) const
+{
+    return PathsHash == HashPaths(Paths) && GeoRefOrigin == GeoRef->GetOriginLongitudeLatitudeHeight() &&
+           SampleDistance == InSampleDistance && MinDistanceBetweenSamples == InMinDistanceBetweenSamples &&
+           bDeduplicatePerWay == bInDeduplicatePerWay;
+}
+
+uint64 FMTSamplePlan::GetHash() const
+{
+    // Everything the plan is built from, the version covers changes of the build itself
+    const auto HashValue = [](const auto& Value, const uint64 Seed)
+    { return CityHash64WithSeed(reinterpret_cast<const char*>(&Value), sizeof(Value), Seed); };
+
+    auto Hash = HashValue(PathsHash, SamplePlanFileVersion);
+    Hash = HashValue(GeoRefOrigin, Hash);
+    Hash = HashValue(SampleDistance, Hash);
+    Hash = HashValue(MinDistanceBetweenSamples, Hash);
+    Hash = HashValue(bDeduplicatePerWay, Hash);
+    return HashValue(Samples.Num(), Hash);
+}
+
+bool FMTSamplePlan::SaveToFile(const FString& FilePath) const
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSamplePlan::SaveToFile);
+
+    TArray<uint8> Data;
+    FMemoryWriter Writer(Data);
+    Writer << const_cast<FMTSamplePlan&>(*this);
+    return FFileHelper::SaveArrayToFile(Data, *FilePath);
+}
+
+bool FMTSamplePlan::LoadFromFile(const FString& FilePath)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSamplePlan::LoadFromFile);
+
+    TArray<uint8> Data;
+    if (!FFileHelper::LoadFileToArray(Data, *FilePath, FILEREAD_Silent))
+    {
+        return false;
+    }
+
+    FMemoryReader Reader(Data);
+    Reader << *this;
+    if (Reader.IsError())
+    {
+        *this = {};
+        return false;
+    }
+    return true;
+}
+
+FArchive& operator<<(FArchive& Ar, FMTSamplePlan& Plan)
+{
+    uint32 Magic = SamplePlanFileMagic;
+    int32 Version = SamplePlanFileVersion;
+    Ar << Magic;
+    Ar << Version;
+    if (Ar.IsLoading() && (Magic != SamplePlanFileMagic || Version != SamplePlanFileVersion))
+    {
+        Ar.SetError();
+        return Ar;
+    }
+
+    Ar << Plan.PathsHash;
+    Ar << Plan.GeoRefOrigin;
+    Ar << Plan.SampleDistance;
+    Ar << Plan.MinDistanceBetweenSamples;
+    Ar << Plan.bDeduplicatePerWay;
+    Ar << Plan.Samples;
+    return Ar;
+}
+
+uint32 FMTSamplePlan::HashPaths(const TConstArrayView<FMTWayGraphPath> Paths)
+{
+    uint32 Hash = 0;
+    for (const auto& Path : Paths)
+    {
+        Hash = FCrc::MemCrc32(Path.Nodes.GetData(), Path.Nodes.Num() * static_cast<int32>(sizeof(int32)), Hash);
+        // Separates [1, 2], [3] from [1], [2, 3]
+        const auto NodeNum = Path.Nodes.Num();
+        Hash = FCrc::MemCrc32(&NodeNum, sizeof(NodeNum), Hash);
+    }
+    return Hash;
+}
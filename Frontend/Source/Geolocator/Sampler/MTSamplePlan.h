@@ -0,0 +1,76 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CesiumGeoreference.h"
+#include "CoreMinimal.h"
+#include "Geolocator/WayGraph/MTChinesePostMan.h"
+#include "Geolocator/WayGraph/MTWayGraph.h"
+
+struct FMTPlannedSample
+{
+    FTransform Transform;
+
+    int32 WayIndex = INDEX_NONE;
+
+    friend FArchive& operator<<(FArchive& Ar, FMTPlannedSample& Sample)
+    {
+        return Ar << Sample.Transform << Sample.WayIndex;
+    }
+};
+
+/**
+ * Every sample location of a way graph sampling run, computed up front so capturing only has to
+ * consume it.
+ *
+ * Each path is walked as an arc length parameterized polyline with a sample every SampleDistance,
+ * the paths are walked in parallel. Deduplication then runs once over all candidates in path order.
+ */
+class GEOLOCATOR_API FMTSamplePlan
+{
+public:
+    // GeoRef is only read, the plan is in Unreal coordinates of its current origin
+    static FMTSamplePlan Build(
+        const FMTWayGraph& Graph,
+        const TConstArrayView<FMTWayGraphPath> Paths,
+        const ACesiumGeoreference* GeoRef,
+        const double SampleDistance,
+        const double MinDistanceBetweenSamples,
+        const bool bDeduplicatePerWay);
+
+    int32 Num() const;
+
+    const FMTPlannedSample& operator[](const int32 SampleIndex) const;
+
+    // True if the plan was built from the same paths, georeference origin and distances
+    bool IsBuiltFor(
+        const TConstArrayView<FMTWayGraphPath> Paths,
+        const ACesiumGeoreference* GeoRef,
+        const double SampleDistance,
+        const double MinDistanceBetweenSamples,
+        const bool bDeduplicatePerWay) const;
+
+    // Identifies the plan across runs, changes whenever the samples may have changed
+    uint64 GetHash() const;
+
+    bool SaveToFile(const FString& FilePath) const;
+
+    bool LoadFromFile(const FString& FilePath);
+
+    friend FArchive& operator<<(FArchive& Ar, FMTSamplePlan& Plan);
+
+private:
+    TArray<FMTPlannedSample> Samples;
+
+    uint32 PathsHash = 0;
+
+    FVector GeoRefOrigin = FVector::ZeroVector;
+
+    double SampleDistance = 0.;
+
+    double MinDistanceBetweenSamples = 0.;
+
+    bool bDeduplicatePerWay = true;
+
+    static uint32 HashPaths(const TConstArrayView<FMTWayGraphPath> Paths);
+};
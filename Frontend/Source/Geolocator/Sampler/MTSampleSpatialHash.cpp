@@ -0,0 +1,158 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTSampleSpatialHash.h"
+
+namespace
+{
+    constexpr int32 InitialCellSlotNum = 1024;
+
+    int64 ToCellKey(const FIntPoint& Cell)
+    {
+        return (static_cast<int64>(Cell.X) << 32) | static_cast<uint32>(Cell.Y);
+    }
+
+    uint32 HashCellKey(const int64 CellKey)
+    {
+        // Neighbouring cells differ in few bits, mix them before masking
+        auto Hash = static_cast<uint64>(CellKey);
+        Hash ^= Hash >> 33;
+        Hash *= 0xff51afd7ed558ccdull;
+        Hash ^= Hash >> 33;
+        return static_cast<uint32>(Hash);
+    }
+}  // namespace
+
+FMTSampleSpatialHash::FMTSampleSpatialHash(const double InRadius)
+    : Radius(InRadius)
+{
+    check(Radius > 0.);
+    Reset();
+}
+
+bool FMTSampleSpatialHash::HasPointWithinRadius(const FVector& Location, const int32 Filter) const
+{
+    const auto Cell = ToCell(Location);
+    const auto RadiusSquared = Radius * Radius;
+
+    for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+    {
+        for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+        {
+            const FIntPoint NeighbourCell(Cell.X + OffsetX, Cell.Y + OffsetY);
+            const auto Slot = FindCellSlot(ToCellKey(NeighbourCell));
+            if (CellHeads[Slot] == INDEX_NONE)
+            {
+                continue;
+            }
+
+            // Relative to the neighbour cell, keeps the float offsets exact enough
+            const auto LocalX = Location.X - NeighbourCell.X * Radius;
+            const auto LocalY = Location.Y - NeighbourCell.Y * Radius;
+
+            for (auto PointIndex = CellHeads[Slot]; PointIndex != INDEX_NONE; PointIndex = Points[PointIndex].Next)
+            {
+                const auto& Point = Points[PointIndex];
+                if (Filter != INDEX_NONE && Point.Filter != Filter)
+                {
+                    continue;
+                }
+
+                const auto DeltaX = LocalX - Point.CellOffset.X;
+                const auto DeltaY = LocalY - Point.CellOffset.Y;
+                if (DeltaX * DeltaX + DeltaY * DeltaY < RadiusSquared)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+void FMTSampleSpatialHash::Add(const FVector& Location, const int32 Filter)
+{
+    // Keep the load factor below one half, probe sequences stay short
+    if ((CellNum + 1) * 2 > CellKeys.Num())
+    {
+        GrowCells();
+    }
+
+    const auto Cell = ToCell(Location);
+    const auto CellKey = ToCellKey(Cell);
+    const auto Slot = FindCellSlot(CellKey);
+    if (CellHeads[Slot] == INDEX_NONE)
+    {
+        CellKeys[Slot] = CellKey;
+        CellNum++;
+    }
+
+    const FVector2f CellOffset(Location.X - Cell.X * Radius, Location.Y - Cell.Y * Radius);
+    CellHeads[Slot] = Points.Add({CellOffset, Filter, CellHeads[Slot]});
+}
+
+bool FMTSampleSpatialHash::AddIfNoPointWithinRadius(const FVector& Location, const int32 Filter)
+{
+    if (HasPointWithinRadius(Location, Filter))
+    {
+        return false;
+    }
+
+    Add(Location, Filter);
+    return true;
+}
+
+int32 FMTSampleSpatialHash::Num() const
+{
+    return Points.Num();
+}
+
+void FMTSampleSpatialHash::Reset()
+{
+    CellKeys.SetNumUninitialized(InitialCellSlotNum);
+    CellHeads.Init(INDEX_NONE, InitialCellSlotNum);
+    CellNum = 0;
+    Points.Reset();
+}
+
+SIZE_T FMTSampleSpatialHash::GetAllocatedSize() const
+{
+    return CellKeys.GetAllocatedSize() + CellHeads.GetAllocatedSize() + Points.GetAllocatedSize();
+}
+
+FIntPoint FMTSampleSpatialHash::ToCell(const FVector& Location) const
+{
+    return FIntPoint(FMath::FloorToInt32(Location.X / Radius), FMath::FloorToInt32(Location.Y / Radius));
+}
+
+int32 FMTSampleSpatialHash::FindCellSlot(const int64 CellKey) const
+{
+    const auto SlotMask = static_cast<uint32>(CellKeys.Num() - 1);
+    auto Slot = HashCellKey(CellKey) & SlotMask;
+    while (CellHeads[Slot] != INDEX_NONE && CellKeys[Slot] != CellKey)
+    {
+        Slot = (Slot + 1) & SlotMask;
+    }
+    return static_cast<int32>(Slot);
+}
+
+void FMTSampleSpatialHash::GrowCells()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTSampleSpatialHash::GrowCells);
+
+    const auto OldCellKeys = MoveTemp(CellKeys);
+    const auto OldCellHeads = MoveTemp(CellHeads);
+
+    CellKeys.SetNumUninitialized(OldCellKeys.Num() * 2);
+    CellHeads.Init(INDEX_NONE, OldCellKeys.Num() * 2);
+
+    for (int32 OldSlot = 0; OldSlot < OldCellKeys.Num(); ++OldSlot)
+    {
+        if (OldCellHeads[OldSlot] != INDEX_NONE)
+        {
+            const auto Slot = FindCellSlot(OldCellKeys[OldSlot]);
+            CellKeys[Slot] = OldCellKeys[OldSlot];
+            CellHeads[Slot] = OldCellHeads[OldSlot];
+        }
+    }
+}
@@ -0,0 +1,60 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Points in the XY plane with an exact minimum distance test.
+ *
+ * The cell size equals the test radius, so only the 3x3 cells around a point can contain points
+ * within the radius. Cells live in an open addressing table keyed by integer cell coordinates,
+ * points of a cell form a linked list through a flat array and store float offsets to their cell.
+ * A point costs 16 bytes plus its share of the table, there are no per cell allocations.
+ */
+class GEOLOCATOR_API FMTSampleSpatialHash
+{
+public:
+    explicit FMTSampleSpatialHash(const double InRadius);
+
+    // Only points with the same filter count if Filter is not INDEX_NONE, e.g. way indices
+    bool HasPointWithinRadius(const FVector& Location, const int32 Filter = INDEX_NONE) const;
+
+    void Add(const FVector& Location, const int32 Filter);
+
+    // Adds the point unless HasPointWithinRadius
+    bool AddIfNoPointWithinRadius(const FVector& Location, const int32 Filter = INDEX_NONE);
+
+    int32 Num() const;
+
+    void Reset();
+
+    SIZE_T GetAllocatedSize() const;
+
+private:
+    struct FPoint
+    {
+        FVector2f CellOffset;
+
+        int32 Filter;
+
+        int32 Next;
+    };
+
+    double Radius;
+
+    TArray<int64> CellKeys;
+
+    // First point of each cell, INDEX_NONE marks free slots
+    TArray<int32> CellHeads;
+
+    int32 CellNum = 0;
+
+    TArray<FPoint> Points;
+
+    FIntPoint ToCell(const FVector& Location) const;
+
+    int32 FindCellSlot(const int64 CellKey) const;
+
+    void GrowCells();
+};
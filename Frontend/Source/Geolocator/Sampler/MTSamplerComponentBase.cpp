@@ -4,6 +4,7 @@
 
 #include "Camera/CameraComponent.h"
 #include "Cesium3DTileset.h"
+#include "CesiumCamera.h"
 #include "CesiumCameraManager.h"
 #include "Components/SceneCaptureComponent2D.h"
 #include "Components/SceneCaptureComponentCube.h"
@@ -12,11 +13,45 @@
 #include "EngineUtils.h"
 #include "Geolocator/Interaction/MTPlayerPawn.h"
 #include "JsonDomBuilder.h"
+#include "MTFrameStatistics.h"
+#include "MTPerceptualHash.h"
 #include "MTSample.h"
 #include "MTSamplingFunctionLibrary.h"
 #include "MTSceneCaptureCube.h"
 #include "MTWayGraphSamplerConfig.h"
 
+namespace
+{
+    // Faces in ECubeFace order, faces outside of FaceMask are left uninitialized
+    void ReadCubeFaces(AMTSceneCaptureCube* CubeCapture, const uint8 FaceMask, FRHICommandListImmediate& RHICmdList)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::ReadCubeFaces);
+
+        const auto* Resource = CubeCapture->GetCaptureComponentCube()->TextureTarget->GetRenderTargetResource();
+        const auto FaceSize = static_cast<int32>(Resource->GetSizeX());
+        const auto FacePixelNum = FaceSize * FaceSize;
+
+        auto& Faces = CubeCapture->GetMutableImageDataRef();
+        Faces.SetNumUninitialized(CubeFace_MAX * FacePixelNum, false);
+
+        TArray<FColor> Face;
+        for (int32 FaceIndex = 0; FaceIndex < CubeFace_MAX; ++FaceIndex)
+        {
+            if ((FaceMask & (1 << FaceIndex)) == 0)
+            {
+                continue;
+            }
+
+            RHICmdList.ReadSurfaceData(
+                Resource->GetRenderTargetTexture(),
+                FIntRect(0, 0, FaceSize, FaceSize),
+                Face,
+                FReadSurfaceDataFlags(RCM_UNorm, static_cast<ECubeFace>(FaceIndex)));
+            FMemory::Memcpy(Faces.GetData() + FaceIndex * FacePixelNum, Face.GetData(), FacePixelNum * sizeof(FColor));
+        }
+    }
+}  // namespace
+
 UMTSamplerComponentBase::UMTSamplerComponentBase()
 {
     PrimaryComponentTick.bCanEverTick = true;
@@ -25,16 +60,33 @@ UMTSamplerComponentBase::UMTSamplerComponentBase()
 void UMTSamplerComponentBase::BeginPlay()
 {
     Super::BeginPlay();
-    
-    PanoramaCapture = GetWorld()->SpawnActor<AMTSceneCaptureCube>();
+
+    // Every frame in flight can hold a full batch of 2D captures
+    const auto CaptureSlotNum = FMath::Max(1, GetActiveConfig()->CaptureRingDepth) *
+                                FMath::Max(1, GetActiveConfig()->MaxCapturesPerFrame);
+    for (int32 SlotIndex = 0; SlotIndex < CaptureSlotNum; ++SlotIndex)
+    {
+        SpawnCaptureSlot();
+    }
+
+    CaptureBackend = MakeUnique<FSceneCaptureBackend>(*this);
+    CaptureRing = MakeUnique<FMTCaptureRing>(*CaptureBackend, CaptureSlotNum);
+    CapturesPerFrame = 1;
+}
+
+AMTSceneCaptureCube* UMTSamplerComponentBase::SpawnPanoramaCapture()
+{
+    // Captures keep the settings of the component config, see SetActiveConfig
+    auto* PanoramaCapture = GetWorld()->SpawnActor<AMTSceneCaptureCube>();
     PanoramaCapture->GetCaptureComponentCube()->TextureTarget =
         NewObject<UTextureRenderTargetCube>(this);
     PanoramaCapture->GetCaptureComponentCube()->TextureTarget->CompressionSettings =
         TextureCompressionSettings::TC_Default;
     PanoramaCapture->GetCaptureComponentCube()->TextureTarget->TargetGamma = 2.2F;
     PanoramaCapture->GetCaptureComponentCube()->TextureTarget->Init(
-        GetActiveConfig()->PanoramaWidth / 2, EPixelFormat::PF_B8G8R8A8);
-    PanoramaCapture->GetCaptureComponentCube()->ShowFlags.SetToneCurve(ShouldUseToneCurve());
+        GetComponentConfig()->PanoramaWidth / 2, EPixelFormat::PF_B8G8R8A8);
+    PanoramaCapture->GetCaptureComponentCube()->ShowFlags.SetToneCurve(
+        GetComponentConfig()->bShouldUseToneCurve);
 
     PanoramaCapture->GetRenderTargetLongLat()->InitCustomFormat(
         PanoramaCapture->GetCaptureComponentCube()->TextureTarget->SizeX * 2,
@@ -42,7 +94,23 @@ void UMTSamplerComponentBase::BeginPlay()
         EPixelFormat::PF_B8G8R8A8,
         false);
 
-    Capture2D = GetWorld()->SpawnActor<AMTSceneCapture>();
+    return PanoramaCapture;
+}
+
+AMTSceneCaptureCube* UMTSamplerComponentBase::GetPanoramaCapture(const int32 SlotIndex)
+{
+    // Spawned on first use, samplers of 2D datasets never pay for the cube render targets
+    if (!PanoramaCaptures[SlotIndex])
+    {
+        PanoramaCaptures[SlotIndex] = SpawnPanoramaCapture();
+    }
+
+    return PanoramaCaptures[SlotIndex];
+}
+
+void UMTSamplerComponentBase::SpawnCaptureSlot()
+{
+    auto* Capture2D = GetWorld()->SpawnActor<AMTSceneCapture>();
     Capture2D->GetCaptureComponent2D()->FOVAngle = 65   ;
     Capture2D->GetCaptureComponent2D()->TextureTarget = NewObject<UTextureRenderTarget2D>(this);
     Capture2D->GetCaptureComponent2D()->TextureTarget->bAutoGenerateMips = false;
@@ -56,6 +124,10 @@ void UMTSamplerComponentBase::BeginPlay()
     Capture2D->GetCaptureComponent2D()->ShowFlags.SetToneCurve(ShouldUseToneCurve());
     Capture2D->GetCaptureComponent2D()->TextureTarget->InitCustomFormat(
         512, 512, EPixelFormat::PF_B8G8R8A8, false);
+
+    PanoramaCaptures.Add(nullptr);
+    Capture2Ds.Add(Capture2D);
+    CaptureSlots.AddDefaulted();
 }
 
 void UMTSamplerComponentBase::BeginSampling()
@@ -67,9 +139,28 @@ void UMTSamplerComponentBase::BeginSampling()
 
     bIsSampling = true;
     CurrentSampleCount = 0;
+    TotalReadinessWaitSeconds = 0.;
+    ReadinessTimeoutCount = 0;
+    RejectedFrameCount = 0;
+    NearDuplicateCount = 0;
+    SkippedDuplicateCount = 0;
+    WrittenImageCount = 0;
+    FailedImageWriteCount = 0;
+    WrittenImageBytes = 0;
+    PrefetchHitCount = 0;
+    PrefetchMissCount = 0;
+
+    // Batch regions can use configs with different encoders
+    ImageEncoder.Reset();
     CurrentSampleCount = 0;
 
-    GotoNextSampleStep(ENextSampleStep::InitSampling, 4);
+    DuplicateIndex = GetActiveConfig()->bDetectNearDuplicates
+        ? MakeShared<FMTPerceptualHashIndex>(GetActiveConfig()->DuplicateHistoryNum)
+        : nullptr;
+
+    // Waits until the tilesets settled instead of a fixed number of frames, e.g. after a batch region
+    // moved the georeference origin
+    GotoNextSampleStep(ENextSampleStep::InitSampling, 1, EMTStepReadiness::Tiles);
 }
 
 bool UMTSamplerComponentBase::IsSampling()
@@ -84,29 +175,40 @@ int32 UMTSamplerComponentBase::GetCurrentSampleCount()
 
 UMTWayGraphSamplerConfig* UMTSamplerComponentBase::GetActiveConfig() const
 {
-    return Config;
+    return ConfigOverride ? ConfigOverride : Config;
 }
 
-void UMTSamplerComponentBase::InitSampling()
+void UMTSamplerComponentBase::SetActiveConfig(UMTWayGraphSamplerConfig* InConfig)
 {
-    auto* CameraManager = ACesiumCameraManager::GetDefaultCameraManager(GetWorld());
-    CesiumGroundLoaderCameraID = CameraManager->AddCamera(
-        {{128, 128}, GetComponentLocation() + FVector(0, 0, 1000), {-90., 0., 0.}, 50.});
+    ConfigOverride = InConfig;
+}
 
+void UMTSamplerComponentBase::InitSampling()
+{
     for (auto* Tileset : TActorRange<ACesium3DTileset>(GetWorld()))
     {
         Tileset->SetShouldIgnorePlayerCamera(true);
         Tileset->PlayMovieSequencer();
     }
 
-    for (int32 I = 0; I < CesiumPanoramaLoaderCameraIDs.Num(); ++I)
+    // Following runs of a batch reuse the cameras
+    if (!bHasCesiumCameras)
     {
-        CesiumPanoramaLoaderCameraIDs[I] = CameraManager->AddCamera(
-            {{static_cast<double>(GetActiveConfig()->PanoramaWidth / 2.),
-              GetActiveConfig()->PanoramaWidth / 2.},
-             GetComponentLocation(),
-             {0., I * 90., 0.},
-             110.});
+        auto* CameraManager = ACesiumCameraManager::GetDefaultCameraManager(GetWorld());
+        CesiumGroundLoaderCameraID = CameraManager->AddCamera(
+            {{128, 128}, GetComponentLocation() + FVector(0, 0, 1000), {-90., 0., 0.}, 50.});
+
+        for (int32 I = 0; I < CesiumPanoramaLoaderCameraIDs.Num(); ++I)
+        {
+            CesiumPanoramaLoaderCameraIDs[I] = CameraManager->AddCamera(
+                {{static_cast<double>(GetActiveConfig()->PanoramaWidth / 2.),
+                  GetActiveConfig()->PanoramaWidth / 2.},
+                 GetComponentLocation(),
+                 {0., I * 90., 0.},
+                 110.});
+        }
+
+        bHasCesiumCameras = true;
     }
 
     // TODO refactor into GetPriamryPlayerPawn
@@ -120,6 +222,8 @@ void UMTSamplerComponentBase::InitSampling()
 
 void UMTSamplerComponentBase::FindNextSampleLocation()
 {
+    SampleReadinessWaitSeconds = 0.;
+
     CurrentSampleCount++;
 
     auto PossibleSampleLocation = SampleNextLocation();
@@ -136,26 +240,49 @@ void UMTSamplerComponentBase::FindNextSampleLocation()
         }
     }
 
-    const FTransform SampleTransform = PossibleSampleLocation.GetValue();
+    MoveToSample(PossibleSampleLocation.GetValue());
+}
 
+void UMTSamplerComponentBase::MoveToSample(const FTransform& SampleTransform)
+{
     GetOwner()->SetActorTransform(SampleTransform);
 
+    // Window of the previous sample, planned transforms match exactly
+    bIsSamplePrefetched = PrefetchLocations.ContainsByPredicate(
+        [this](const FVector& PrefetchLocation)
+        { return FVector::DistSquared(PrefetchLocation, GetComponentLocation()) < 1.; });
+
     // make sure ground and surroudnigs are loaded
     UpdateCesiumCameras();
 
-    GotoNextSampleStep(ENextSampleStep::PreCaptureSample);
+    // Tilesets see the moved cameras on their next tick, the artifact traces need the ground collision
+    GotoNextSampleStep(
+        ENextSampleStep::PreCaptureSample, 1, EMTStepReadiness::Tiles | EMTStepReadiness::Ground);
 }
 
 void UMTSamplerComponentBase::PreCapture()
 {
     TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::PreCapture);
 
+    if (!PlaceSample())
+    {
+        GotoNextSampleStep(ENextSampleStep::FindNextSampleLocation);
+        return;
+    }
+
+    UpdateCesiumCameras();
+
+    GotoNextSampleStep(
+        ENextSampleStep::CaptureSample, 1, EMTStepReadiness::Tiles | EMTStepReadiness::Render);
+}
+
+bool UMTSamplerComponentBase::PlaceSample()
+{
     const auto PossibleUpdatedTransform = ValidateSampleLocation();
 
     if (!PossibleUpdatedTransform)
     {
-        GotoNextSampleStep(ENextSampleStep::FindNextSampleLocation);
-        return;
+        return false;
     }
 
     const auto UpdatedTransform = PossibleUpdatedTransform.GetValue();
@@ -200,127 +327,358 @@ void UMTSamplerComponentBase::PreCapture()
     PlayerPawn->SetActorTransform(UpdatedTransform);
     PlayerPawn->GetCaptureCameraComponent()->SetWorldRotation(GetOwner()->GetActorRotation());
 
-    PanoramaCapture->SetActorTransform(UpdatedTransform);
-    PanoramaCapture->AddActorWorldRotation(FRotator(0., 90., 0.));
-    Capture2D->SetActorTransform(UpdatedTransform);
-
-    UpdateCesiumCameras();
+    // The captures of a slot are only known once CaptureSample acquired it
+    CaptureTransform = UpdatedTransform;
 
-    GotoNextSampleStep(ENextSampleStep::CaptureSample, 1);
+    return true;
 }
 
 void UMTSamplerComponentBase::CaptureSample()
 {
     TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::CaptureSample);
 
-    // Write images from previous run doing this here gives them a couple of frames to complete
-    // during this time we can already go to the next sample etc.
-    // now we are about to capture again and therefore need to make sure the images are stored
+    // Hand finished readbacks to the encoder, captures still rendering stay in their slots
+    CompleteImageWrites(false);
+    CaptureRing->Poll();
+
+    AdaptCapturesPerFrame();
+
+    // Prefetch cameras stay registered while the current samples wait and capture, only the window moves
+    ensureMsgf(
+        CesiumPrefetchCameraIDs.Num() == PrefetchLocations.Num() * CesiumPanoramaLoaderCameraIDs.Num() &&
+            PrefetchLocations.Num() <= GetActiveConfig()->PrefetchSampleNum,
+        TEXT("%d prefetch cameras registered for %d upcoming samples"),
+        CesiumPrefetchCameraIDs.Num(),
+        PrefetchLocations.Num());
+
+    // Once for all captures of the batch instead of once per capture, the captures read their
+    // transforms on the game thread when they are enqueued
+    GetWorld()->SendAllEndOfFrameUpdates();
+
+    auto RenderedNum = CaptureCurrentSample() ? 1 : 0;
 
-    WaitForRenderThreadReadSurfaceAndWriteImages();
+    // Nearby samples share the loaded tiles, capture them in the same frame. Cube slices cost no
+    // render and are always taken. Panoramas are too expensive to batch.
+    const auto BatchOrigin = CaptureTransform.GetLocation();
+    const auto bCanBatch = !bCapturePanorama && (CapturesPerFrame > 1 || GetActiveConfig()->bSliceFromCubemap);
+    while (bCanBatch)
+    {
+        SampleReadinessWaitSeconds = 0.;
+        CurrentSampleCount++;
+
+        const auto PossibleSampleLocation = SampleNextLocation();
+        if (!bIsSampling)
+        {
+            return;
+        }
+
+        if (!PossibleSampleLocation)
+        {
+            continue;
+        }
+
+        // Outside of the loaded tiles, continues as a regular sample
+        if (FVector::Dist(PossibleSampleLocation->GetLocation(), BatchOrigin) >
+            GetActiveConfig()->BatchCaptureRadius)
+        {
+            MoveToSample(PossibleSampleLocation.GetValue());
+            return;
+        }
 
+        GetOwner()->SetActorTransform(PossibleSampleLocation.GetValue());
+        if (!PlaceSample())
+        {
+            continue;
+        }
+
+        if (RenderedNum >= CapturesPerFrame && !IsCubemapSliceLocation(CaptureTransform.GetLocation()))
+        {
+            MoveToSample(PossibleSampleLocation.GetValue());
+            return;
+        }
+
+        RenderedNum += CaptureCurrentSample() ? 1 : 0;
+    }
+
+    // Call Capture function on remaining samples
+    GotoNextSampleStep(ENextSampleStep::FindNextSampleLocation);
+}
+
+bool UMTSamplerComponentBase::CaptureCurrentSample()
+{
     FMTSample Sample = CollectSampleMetadata();
     
     const auto AbsoluteImageFilePath = CreateImagePathForSample(Sample);
+    const auto SampleID = GetSampleJournal().MakeSampleID(AbsoluteImageFilePath);
 
     CapturedImageCount++;
 
     // Assume we are resuming previous run and don't overwrite image or metadata
-    if (FPaths::FileExists(AbsoluteImageFilePath))
+    if (GetSampleJournal().IsCompleted(SampleID))
     {
-        GotoNextSampleStep(ENextSampleStep::FindNextSampleLocation);
-        return;
+        return false;
     }
 
     Sample.ArtifactProbability = SampleArtifactProbability;
+    Sample.ReadinessWaitSeconds = SampleReadinessWaitSeconds;
+    if (Sample.Region.IsEmpty())
+    {
+        Sample.Region = GetSessionName();
+    }
+
+    if (!bCapturePanorama && GetActiveConfig()->bSliceFromCubemap)
+    {
+        return CaptureCubemapSlice(
+            {nullptr, AbsoluteImageFilePath, SampleID, GetSamplingCursor(), Sample, CaptureTransform.GetLocation()});
+    }
 
+    // Only waits if every slot is still in flight
+    const auto SlotIndex = CaptureRing->AcquireSlot();
+
+    ASceneCapture* Capture = Capture2Ds[SlotIndex];
     if (bCapturePanorama)
     {
-        EnqueueCapture({PanoramaCapture, AbsoluteImageFilePath});
+        Capture = GetPanoramaCapture(SlotIndex);
+    }
+    BeginCapture(
+        SlotIndex,
+        {Capture, AbsoluteImageFilePath, SampleID, GetSamplingCursor(), Sample, CaptureTransform.GetLocation()});
+    CaptureRing->MarkInFlight(SlotIndex);
+    return true;
+}
+
+bool UMTSamplerComponentBase::CaptureCubemapSlice(FMTCaptureImagePathPair&& CaptureData)
+{
+    const auto bIsAtCubemap = IsCubemapSliceLocation(CaptureTransform.GetLocation());
+
+    // Might complete the previous cube capture, acquired before the new cube replaces it
+    const auto SlotIndex = bIsAtCubemap ? INDEX_NONE : CaptureRing->AcquireSlot();
+    if (!bIsAtCubemap)
+    {
+        bHasCubemap = true;
+        CubemapLocation = CaptureTransform.GetLocation();
+        CubemapRotation = FRotator(0., CaptureTransform.Rotator().Yaw, 0.).Quaternion();
+        CubemapSlotIndex = SlotIndex;
+        CubemapFaces.Reset();
+    }
+
+    // Same view the 2D capture would render, see ChangeCapture2DResolution
+    const auto* Capture2DComponent = Capture2Ds[0]->GetCaptureComponent2D();
+    FMTCubemapSlice Slice;
+    Slice.Rotation = (CubemapRotation.Inverse() * CaptureTransform.GetRotation()).Rotator();
+    Slice.FOVAngle = Capture2DComponent->FOVAngle;
+    Slice.Size = {Capture2DComponent->TextureTarget->SizeX, Capture2DComponent->TextureTarget->SizeY};
+    CaptureData.CubemapSlice = Slice;
+
+    if (!bIsAtCubemap)
+    {
+        CaptureData.Capture = GetPanoramaCapture(SlotIndex);
+        BeginCapture(SlotIndex, MoveTemp(CaptureData));
+        CaptureRing->MarkInFlight(SlotIndex);
+        return true;
+    }
+
+    if (CubemapSlotIndex != INDEX_NONE)
+    {
+        CaptureSlots[CubemapSlotIndex].CubemapSlices.Add(MoveTemp(CaptureData));
     }
     else
     {
-        EnqueueCapture({Capture2D, AbsoluteImageFilePath});
+        EncodeCubemapSlice(CubemapFaces.ToSharedRef(), CaptureData);
     }
+    return false;
+}
 
-    if (!CaptureQueue.IsEmpty())
+bool UMTSamplerComponentBase::IsCubemapSliceLocation(const FVector& Location) const
+{
+    return GetActiveConfig()->bSliceFromCubemap && bHasCubemap &&
+           FVector::DistSquared(Location, CubemapLocation) < 1.;
+}
+
+void UMTSamplerComponentBase::AdaptCapturesPerFrame()
+{
+    // Frames since the last capture include the rendering of the previous batch
+    const auto FrameBudgetSeconds = GetActiveConfig()->CaptureFrameBudgetMs / 1000.;
+    if (MaxFrameSecondsSinceCapture > FrameBudgetSeconds)
     {
-        // Basically the same as in CaptureScene()
-        // But we only call SendAllEndOfFrameUpdates once
-        GetWorld()->SendAllEndOfFrameUpdates();
-        for (const auto& CaptureData : CaptureQueue)
-        {
-            if (CaptureData.Capture->IsA<AMTSceneCaptureCube>())
-            {
-                const auto* CubeCapture = CastChecked<AMTSceneCaptureCube>(CaptureData.Capture);
+        CapturesPerFrame = FMath::Max(1, CapturesPerFrame / 2);
+    }
+    else if (MaxFrameSecondsSinceCapture < 0.75 * FrameBudgetSeconds)
+    {
+        CapturesPerFrame = FMath::Min(GetActiveConfig()->MaxCapturesPerFrame, CapturesPerFrame + 1);
+    }
 
-                CubeCapture->GetCaptureComponentCube()->UpdateSceneCaptureContents(
-                    GetWorld()->Scene);
-            }
-            else if (CaptureData.Capture->IsA<AMTSceneCapture>())
+    MaxFrameSecondsSinceCapture = 0.;
+}
+
+void UMTSamplerComponentBase::BeginCapture(const int32 SlotIndex, FMTCaptureImagePathPair&& CaptureData)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::BeginCapture);
+
+    auto& Slot = CaptureSlots[SlotIndex];
+    Slot.CaptureData = MoveTemp(CaptureData);
+
+    // Basically the same as in CaptureScene(), but SendAllEndOfFrameUpdates already ran once for the
+    // whole batch in CaptureSample
+    if (auto* CubeCapture = Cast<AMTSceneCaptureCube>(Slot.CaptureData.Capture);
+        CubeCapture && Slot.CaptureData.CubemapSlice.IsSet())
+    {
+        CubeCapture->SetActorLocationAndRotation(CubemapLocation, CubemapRotation);
+
+        CubeCapture->GetCaptureComponentCube()->UpdateSceneCaptureContents(GetWorld()->Scene);
+
+        // Faces are read back as rendered, slices are cut from them on the encoder threads
+        ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)
+        (
+            [CubeCapture](FRHICommandListImmediate& RHICmdList)
             {
-                const auto* Capture = CastChecked<AMTSceneCapture>(CaptureData.Capture);
+                ReadCubeFaces(CubeCapture, (1 << CubeFace_MAX) - 1, RHICmdList);
+            });
+    }
+    else if (auto* CubeCapture = Cast<AMTSceneCaptureCube>(Slot.CaptureData.Capture))
+    {
+        CubeCapture->SetActorTransform(CaptureTransform);
+        CubeCapture->AddActorWorldRotation(FRotator(0., 90., 0.));
 
-                Capture->GetCaptureComponent2D()->UpdateSceneCaptureContents(GetWorld()->Scene);
-            }
+        CubeCapture->GetCaptureComponentCube()->UpdateSceneCaptureContents(GetWorld()->Scene);
+
+        if (GetActiveConfig()->bUnwrapPanoramaOnCPU)
+        {
+            // Built once per resolution, decides which faces the cropped panorama needs
+            const auto FaceMask = GetPanoramaUnwrap(*CubeCapture)->GetFaceMask();
+            ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)
+            (
+                [CubeCapture, FaceMask](FRHICommandListImmediate& RHICmdList)
+                {
+                    ReadCubeFaces(CubeCapture, FaceMask, RHICmdList);
+                });
+        }
+        else
+        {
+            // Captures the actor instead of the slot, the game thread fills other slots meanwhile
+            ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)
+            (
+                [CubeCapture](FRHICommandListImmediate& RHICmdList)
+                {
+                    TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::ReadSurface);
+
+                    FIntPoint SizeOUT;
+                    EPixelFormat FormatOUT;
+                    CubemapHelpers::GenerateLongLatUnwrap(
+                        CubeCapture->GetCaptureComponentCube()->TextureTarget,
+                        CubeCapture->GetMutableImageDataRef(),
+                        SizeOUT,
+                        FormatOUT,
+                        CubeCapture->GetRenderTargetLongLat(),
+                        RHICmdList);
+                });
         }
+    }
+    else if (auto* Capture2D = Cast<AMTSceneCapture>(Slot.CaptureData.Capture))
+    {
+        Capture2D->SetActorTransform(CaptureTransform);
+
+        Capture2D->GetCaptureComponent2D()->UpdateSceneCaptureContents(GetWorld()->Scene);
 
         ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)
         (
-            [this](FRHICommandListImmediate& RHICmdList)
+            [Capture2D](FRHICommandListImmediate& RHICmdList)
             {
                 TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::ReadSurface);
 
-                for (const auto& CaptureData : CaptureQueue)
-                {
-                    if (CaptureData.Capture->IsA<AMTSceneCaptureCube>())
-                    {
-                        auto* CubeCapture = CastChecked<AMTSceneCaptureCube>(CaptureData.Capture);
-
-                        FIntPoint SizeOUT;
-                        EPixelFormat FormatOUT;
-                        CubemapHelpers::GenerateLongLatUnwrap(
-                            CubeCapture->GetCaptureComponentCube()->TextureTarget,
-                            CubeCapture->GetMutableImageDataRef(),
-                            SizeOUT,
-                            FormatOUT,
-                            CubeCapture->GetRenderTargetLongLat(),
-                            RHICmdList);
-                    }
-                    else if (CaptureData.Capture->IsA<AMTSceneCapture>())
-                    {
-                        auto* Capture2D = CastChecked<AMTSceneCapture>(CaptureData.Capture);
-
-                        const auto* Resource = Capture2D->GetCaptureComponent2D()
-                                                   ->TextureTarget->GetRenderTargetResource();
-                        Capture2D->GetMutableImageSize() = {(int32)Resource->GetSizeX(), (int32)Resource->GetSizeY()};
-                        RHICmdList.ReadSurfaceData(
-                            Resource->GetRenderTargetTexture(),
-                            FIntRect(0, 0, Resource->GetSizeX(), Resource->GetSizeY()),
-                            Capture2D->GetMutableImageDataRef(),
-                            FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX));
-                    }
-                }
+                const auto* Resource = Capture2D->GetCaptureComponent2D()
+                                           ->TextureTarget->GetRenderTargetResource();
+                Capture2D->GetMutableImageSize() = {(int32)Resource->GetSizeX(), (int32)Resource->GetSizeY()};
+                RHICmdList.ReadSurfaceData(
+                    Resource->GetRenderTargetTexture(),
+                    FIntRect(0, 0, Resource->GetSizeX(), Resource->GetSizeY()),
+                    Capture2D->GetMutableImageDataRef(),
+                    FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX));
             });
-
-        CaptureFence.BeginFence();
     }
 
-    // Call Capture function on remaining samples
-    GotoNextSampleStep(ENextSampleStep::FindNextSampleLocation);
+    Slot.ReadbackFence.BeginFence();
+}
+
+bool UMTSamplerComponentBase::FSceneCaptureBackend::IsReadbackComplete(const int32 SlotIndex)
+{
+    return Component.CaptureSlots[SlotIndex].ReadbackFence.IsFenceComplete();
+}
+
+void UMTSamplerComponentBase::FSceneCaptureBackend::WaitForReadback(const int32 SlotIndex)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::WaitForReadSurface);
+
+    // Allow other tasks to execute, we only care that out captures are not modified
+    Component.CaptureSlots[SlotIndex].ReadbackFence.Wait(false);
+}
+
+void UMTSamplerComponentBase::FSceneCaptureBackend::CompleteCapture(const int32 SlotIndex)
+{
+    Component.CompleteCaptureSlot(SlotIndex);
 }
 
 void UMTSamplerComponentBase::GotoNextSampleStep(
     const ENextSampleStep NextStep,
-    const int32 StepWaitFrames)
+    const int32 StepWaitFrames,
+    const EMTStepReadiness Readiness)
 {
     NextSampleStep = NextStep;
     StepFrameSkips = StepWaitFrames;
+    StepReadiness = Readiness;
+
+    // Cesium reports a single load progress over all cameras of a tileset and cannot tell the loader
+    // cameras of the current sample from the prefetch cameras, the progress would include the tiles of
+    // the upcoming samples. The capture view waits for its ground and a rendered frame instead.
+    if (EnumHasAnyFlags(StepReadiness, EMTStepReadiness::Tiles) && !CesiumPrefetchCameraIDs.IsEmpty())
+    {
+        EnumRemoveFlags(StepReadiness, EMTStepReadiness::Tiles);
+        EnumAddFlags(StepReadiness, EMTStepReadiness::Ground | EMTStepReadiness::Render);
+    }
+
+    StepWaitStartTime = FPlatformTime::Seconds();
+    bIsStepRenderFenceBegun = false;
+    bIsFirstStepReadinessCheck = true;
 }
 
-void UMTSamplerComponentBase::EnqueueCapture(const FMTCaptureImagePathPair& CaptureImagePathPair)
+bool UMTSamplerComponentBase::IsStepReady(const EMTStepReadiness Readiness) const
 {
-    CaptureQueue.Add(CaptureImagePathPair);
+    if (EnumHasAnyFlags(Readiness, EMTStepReadiness::Render) && !StepRenderFence.IsFenceComplete())
+    {
+        return false;
+    }
+
+    if (EnumHasAnyFlags(Readiness, EMTStepReadiness::Tiles))
+    {
+        // Players are ignored, only the loader cameras contribute to the progress
+        for (const auto* Tileset : TActorRange<ACesium3DTileset>(GetWorld()))
+        {
+            if (Tileset->GetLoadProgress() < 100.F)
+            {
+                return false;
+            }
+        }
+    }
+
+    if (EnumHasAnyFlags(Readiness, EMTStepReadiness::Ground))
+    {
+        // Cesium builds tile collision while loading, the trace catches tiles not yet added to the scene
+        const auto MaximumHeightDifference = FVector(0., 0., 100000.);
+
+        FHitResult GroundHit;
+        GetWorld()->LineTraceSingleByObjectType(
+            GroundHit,
+            GetComponentLocation() + MaximumHeightDifference,
+            GetComponentLocation() - MaximumHeightDifference,
+            FCollisionObjectQueryParams::AllStaticObjects);
+
+        if (!GroundHit.bBlockingHit)
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 void UMTSamplerComponentBase::UpdateCesiumCameras()
@@ -340,6 +698,94 @@ void UMTSamplerComponentBase::UpdateCesiumCameras()
              {0., I * 90., 0.},
              110.});
     }
+
+    UpdatePrefetchCameras();
+}
+
+void UMTSamplerComponentBase::UpdatePrefetchCameras()
+{
+    const auto PrefetchSampleNum = GetActiveConfig()->PrefetchSampleNum;
+    const auto UpcomingTransforms =
+        PrefetchSampleNum > 0 ? GetUpcomingSampleTransforms(PrefetchSampleNum) : TArray<FTransform>();
+
+    // Cesium has no camera priorities, a smaller viewport selects coarser and fewer tiles
+    const auto ViewportSize =
+        FMath::Max(64., GetActiveConfig()->PanoramaWidth / 2. * GetActiveConfig()->PrefetchResolutionScale);
+
+    auto* CameraManager = ACesiumCameraManager::GetDefaultCameraManager(GetWorld());
+    PrefetchLocations.Reset();
+    int32 CameraIndex = 0;
+    for (const auto& UpcomingTransform : UpcomingTransforms)
+    {
+        PrefetchLocations.Add(UpcomingTransform.GetLocation());
+
+        for (int32 I = 0; I < CesiumPanoramaLoaderCameraIDs.Num(); ++I, ++CameraIndex)
+        {
+            const FCesiumCamera Camera(
+                {ViewportSize, ViewportSize}, UpcomingTransform.GetLocation(), {0., I * 90., 0.}, 110.);
+
+            if (CesiumPrefetchCameraIDs.IsValidIndex(CameraIndex))
+            {
+                CameraManager->UpdateCamera(CesiumPrefetchCameraIDs[CameraIndex], Camera);
+            }
+            else
+            {
+                CesiumPrefetchCameraIDs.Add(CameraManager->AddCamera(Camera));
+            }
+        }
+    }
+
+    // The window shrinks towards the end of the plan
+    while (CesiumPrefetchCameraIDs.Num() > CameraIndex)
+    {
+        CameraManager->RemoveCamera(CesiumPrefetchCameraIDs.Pop(false));
+    }
+
+    SetPrefetchTileMemoryBudget(
+        CesiumPrefetchCameraIDs.IsEmpty()
+            ? 0
+            : static_cast<int64>(GetActiveConfig()->PrefetchTileMemoryBudgetMB) * 1024 * 1024);
+}
+
+void UMTSamplerComponentBase::RemovePrefetchCameras()
+{
+    auto* CameraManager = ACesiumCameraManager::GetDefaultCameraManager(GetWorld());
+    for (const auto CameraID : CesiumPrefetchCameraIDs)
+    {
+        CameraManager->RemoveCamera(CameraID);
+    }
+    CesiumPrefetchCameraIDs.Reset();
+    PrefetchLocations.Reset();
+
+    SetPrefetchTileMemoryBudget(0);
+}
+
+void UMTSamplerComponentBase::SetPrefetchTileMemoryBudget(const int64 BudgetBytes)
+{
+    if (BudgetBytes == AppliedPrefetchTileMemoryBytes)
+    {
+        return;
+    }
+
+    for (const auto& Tileset : PrefetchBudgetTilesets)
+    {
+        if (Tileset.IsValid())
+        {
+            Tileset->MaximumCachedBytes -= AppliedPrefetchTileMemoryBytes;
+        }
+    }
+    PrefetchBudgetTilesets.Reset();
+
+    if (BudgetBytes > 0)
+    {
+        for (auto* Tileset : TActorRange<ACesium3DTileset>(GetWorld()))
+        {
+            Tileset->MaximumCachedBytes += BudgetBytes;
+            PrefetchBudgetTilesets.Add(Tileset);
+        }
+    }
+
+    AppliedPrefetchTileMemoryBytes = BudgetBytes;
 }
 
 FString UMTSamplerComponentBase::GetImageDir()
@@ -347,66 +793,459 @@ FString UMTSamplerComponentBase::GetImageDir()
     return FPaths::Combine(GetSessionDir(), "Images");
 }
 
-void UMTSamplerComponentBase::WaitForRenderThreadReadSurfaceAndWriteImages()
+TSharedPtr<FMTImageShardWriter> UMTSamplerComponentBase::GetImageShardWriter()
 {
-    TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::WaitForReadSurface);
+    if (!GetActiveConfig()->bWriteImageShards)
+    {
+        ImageShardWriter.Reset();
+        return nullptr;
+    }
 
-    for (auto& ImageWriteFuture : ImageWriteTaskFutures)
+    const auto ImageDir = GetImageDir();
+    if (!ImageShardWriter || ImageShardWriter->GetImageDir() != ImageDir)
     {
-        ImageWriteFuture.Wait();
+        ImageShardWriter = MakeShared<FMTImageShardWriter>(
+            ImageDir, static_cast<int64>(GetActiveConfig()->MaxImageShardSizeMB) * 1024 * 1024);
     }
 
-    ImageWriteTaskFutures.Reset();
+    return ImageShardWriter;
+}
+
+void UMTSamplerComponentBase::CompleteCaptureSlot(const int32 SlotIndex)
+{
+    auto& Slot = CaptureSlots[SlotIndex];
 
-    if (!CaptureQueue.IsEmpty())
+    if (Slot.CaptureData.CubemapSlice.IsSet())
     {
-        // Allow other tasks to execute, we only care that out captures are not modified
-        CaptureFence.Wait(false);
+        // Shared by the slices, never returned to the pool
+        auto* CubeCapture = CastChecked<AMTSceneCaptureCube>(Slot.CaptureData.Capture);
+        const TSharedRef<const TArray<FColor>> Faces =
+            MakeShared<TArray<FColor>>(MoveTemp(CubeCapture->GetMutableImageDataRef()));
+        CubeCapture->GetMutableImageDataRef() = GetImageEncoderPool().AcquirePixelBuffer();
+
+        EncodeCubemapSlice(Faces, Slot.CaptureData);
+        for (auto& CubemapSlice : Slot.CubemapSlices)
+        {
+            EncodeCubemapSlice(Faces, CubemapSlice);
+        }
+        Slot.CubemapSlices.Reset();
+
+        // Later samples at the location are cut right away
+        if (SlotIndex == CubemapSlotIndex)
+        {
+            CubemapFaces = Faces;
+            CubemapSlotIndex = INDEX_NONE;
+        }
+    }
+    else
+    {
+        EncodeCapture(Slot.CaptureData);
+    }
+
+    Slot.CaptureData = {};
+}
 
-        for (const auto& CaptureData : CaptureQueue)
+void UMTSamplerComponentBase::EncodeCubemapSlice(
+    const TSharedRef<const TArray<FColor>>& Faces,
+    FMTCaptureImagePathPair& CaptureData)
+{
+    const auto WriteResult = MakeShared<FImageWriteResult>();
+    auto ImageWriteFuture = GetImageEncoderPool().Enqueue(
+        GetImageEncoderPool().AcquirePixelBuffer(),
+        [AbsoluteImagePath = CaptureData.AbsoluteImagePath,
+         Faces,
+         FaceSize = FMath::RoundToInt(FMath::Sqrt(Faces->Num() / static_cast<double>(CubeFace_MAX))),
+         Slice = CaptureData.CubemapSlice.GetValue(),
+         Encoder = GetImageEncoder(),
+         ShardWriter = GetImageShardWriter(),
+         PyramidShortSides = GetActiveConfig()->PyramidShortSides,
+         Screening = GetFrameScreening(CaptureData),
+         WriteResult](TArray<FColor>& PixelBuffer)
         {
-            if (CaptureData.Capture->IsA<AMTSceneCaptureCube>())
+            // Built on first use, the build is spread over the task graph
+            const auto Remap = FMTCubemapRemap::GetPerspective(FaceSize, Slice);
+            Remap->Apply(*Faces, PixelBuffer);
+            if (ScreenFrame(PixelBuffer.GetData(), Remap->GetSize(), Screening, *WriteResult))
             {
-                auto* CubeCapture = CastChecked<AMTSceneCaptureCube>(CaptureData.Capture);
-                auto ImageWriteFuture = UMTSamplingFunctionLibrary::WriteCubeMapPixelBufferToFile(
-                    CaptureData.AbsoluteImagePath,
-                    CubeCapture->GetMutableImageDataRef(),
-                    {GetActiveConfig()->PanoramaWidth,
-                     CubeCapture->GetCaptureComponentCube()->TextureTarget->SizeX},
-                    {GetActiveConfig()->PanoramaTopCrop, GetActiveConfig()->PanoramaBottomCrop});
-                ImageWriteTaskFutures.Emplace(MoveTemp(ImageWriteFuture));
+                WriteResult->FileWrite = UMTSamplingFunctionLibrary::WritePixelBufferToFile(
+                    AbsoluteImagePath, PixelBuffer, Remap->GetSize(), *Encoder, ShardWriter, PyramidShortSides);
             }
-            else if (CaptureData.Capture->IsA<AMTSceneCapture>())
+        });
+    PendingImageWrites.Add({MoveTemp(ImageWriteFuture), MoveTemp(CaptureData), WriteResult});
+}
+
+TSharedRef<const FMTCubemapRemap> UMTSamplerComponentBase::GetPanoramaUnwrap(
+    const AMTSceneCaptureCube& CubeCapture) const
+{
+    // Same size the long lat unwrap produces from the cube
+    const auto FaceSize = CubeCapture.GetCaptureComponentCube()->TextureTarget->SizeX;
+    return FMTCubemapRemap::GetEquirect(
+        FaceSize,
+        {FaceSize * 2, FaceSize},
+        {GetActiveConfig()->PanoramaTopCrop, GetActiveConfig()->PanoramaBottomCrop});
+}
+
+void UMTSamplerComponentBase::EncodeCapture(FMTCaptureImagePathPair& CaptureData)
+{
+    if (auto* CubeCapture = Cast<AMTSceneCaptureCube>(CaptureData.Capture))
+    {
+        // The capture continues with a recycled buffer, the pixels are moved to the encoder
+        auto PixelBuffer = MoveTemp(CubeCapture->GetMutableImageDataRef());
+        CubeCapture->GetMutableImageDataRef() = GetImageEncoderPool().AcquirePixelBuffer();
+
+        const auto WriteResult = MakeShared<FImageWriteResult>();
+        TFuture<void> ImageWriteFuture;
+        if (GetActiveConfig()->bUnwrapPanoramaOnCPU)
+        {
+            ImageWriteFuture = GetImageEncoderPool().Enqueue(
+                MoveTemp(PixelBuffer),
+                [AbsoluteImagePath = CaptureData.AbsoluteImagePath,
+                 Unwrap = GetPanoramaUnwrap(*CubeCapture),
+                 Encoder = GetImageEncoder(),
+                 ShardWriter = GetImageShardWriter(),
+                 PyramidShortSides = GetActiveConfig()->PyramidShortSides,
+                 Screening = GetFrameScreening(CaptureData),
+                 WriteResult](TArray<FColor>& Faces)
+                {
+                    // The pooled buffer holds the faces, every encoder thread keeps its own panorama
+                    thread_local TArray<FColor> Panorama;
+                    Unwrap->Apply(Faces, Panorama);
+                    if (ScreenFrame(Panorama.GetData(), Unwrap->GetSize(), Screening, *WriteResult))
+                    {
+                        WriteResult->FileWrite = UMTSamplingFunctionLibrary::WritePixelBufferToFile(
+                            AbsoluteImagePath, Panorama, Unwrap->GetSize(), *Encoder, ShardWriter, PyramidShortSides);
+                    }
+                });
+        }
+        else
+        {
+            ImageWriteFuture = GetImageEncoderPool().Enqueue(
+                MoveTemp(PixelBuffer),
+                [AbsoluteImagePath = CaptureData.AbsoluteImagePath,
+                 Size = FIntVector2(
+                     GetActiveConfig()->PanoramaWidth,
+                     CubeCapture->GetCaptureComponentCube()->TextureTarget->SizeX),
+                 TopAndBottomCrop =
+                     FIntVector2(GetActiveConfig()->PanoramaTopCrop, GetActiveConfig()->PanoramaBottomCrop),
+                 Encoder = GetImageEncoder(),
+                 ShardWriter = GetImageShardWriter(),
+                 PyramidShortSides = GetActiveConfig()->PyramidShortSides,
+                 Screening = GetFrameScreening(CaptureData),
+                 WriteResult](const TArray<FColor>& PixelBuffer)
+                {
+                    // Only the rows that are written are scored
+                    if (!ScreenFrame(
+                            PixelBuffer.GetData() + TopAndBottomCrop.X * Size.X,
+                            {Size.X, Size.Y - TopAndBottomCrop.X - TopAndBottomCrop.Y},
+                            Screening,
+                            *WriteResult))
+                    {
+                        return;
+                    }
+
+                    WriteResult->FileWrite = UMTSamplingFunctionLibrary::WriteCubeMapPixelBufferToFile(
+                        AbsoluteImagePath,
+                        PixelBuffer,
+                        Size,
+                        TopAndBottomCrop,
+                        *Encoder,
+                        ShardWriter,
+                        PyramidShortSides);
+                });
+        }
+        PendingImageWrites.Add({MoveTemp(ImageWriteFuture), MoveTemp(CaptureData), WriteResult});
+    }
+    else if (auto* Capture2D = Cast<AMTSceneCapture>(CaptureData.Capture))
+    {
+        auto PixelBuffer = MoveTemp(Capture2D->GetMutableImageDataRef());
+        Capture2D->GetMutableImageDataRef() = GetImageEncoderPool().AcquirePixelBuffer();
+
+        const auto WriteResult = MakeShared<FImageWriteResult>();
+        auto ImageWriteFuture = GetImageEncoderPool().Enqueue(
+            MoveTemp(PixelBuffer),
+            [AbsoluteImagePath = CaptureData.AbsoluteImagePath,
+             Size = Capture2D->GetMutableImageSize(),
+             Encoder = GetImageEncoder(),
+             ShardWriter = GetImageShardWriter(),
+             PyramidShortSides = GetActiveConfig()->PyramidShortSides,
+             Screening = GetFrameScreening(CaptureData),
+             WriteResult](const TArray<FColor>& PixelBuffer)
             {
-                auto* Capture = CastChecked<AMTSceneCapture>(CaptureData.Capture);
+                if (ScreenFrame(PixelBuffer.GetData(), Size, Screening, *WriteResult))
+                {
+                    WriteResult->FileWrite = UMTSamplingFunctionLibrary::WritePixelBufferToFile(
+                        AbsoluteImagePath, PixelBuffer, Size, *Encoder, ShardWriter, PyramidShortSides);
+                }
+            });
+        PendingImageWrites.Add({MoveTemp(ImageWriteFuture), MoveTemp(CaptureData), WriteResult});
+    }
+}
 
-                auto ImageWriteFuture = UMTSamplingFunctionLibrary::WritePixelBufferToFile(
-                    CaptureData.AbsoluteImagePath,
-                    Capture->GetMutableImageDataRef(),
-                    Capture2D->GetMutableImageSize());
-                ImageWriteTaskFutures.Emplace(MoveTemp(ImageWriteFuture));
-            }
+UMTSamplerComponentBase::FFrameScreening UMTSamplerComponentBase::GetFrameScreening(
+    const FMTCaptureImagePathPair& CaptureData) const
+{
+    FFrameScreening Screening;
+    Screening.ClearColor = GetActiveConfig()->FrameClearColor;
+    Screening.MinEdgeEnergy = GetActiveConfig()->MinFrameEdgeEnergy;
+    Screening.MaxArtifactScore = GetActiveConfig()->MaxFrameArtifactScore;
+    Screening.bShouldReject = GetActiveConfig()->bRejectArtifactFrames;
+
+    Screening.DuplicateIndex = DuplicateIndex;
+    Screening.MaxDuplicateDistance = GetActiveConfig()->MaxDuplicateHammingDistance;
+    Screening.DuplicateSearchRadius = GetActiveConfig()->DuplicateSearchRadius;
+    Screening.bShouldSkipDuplicates = GetActiveConfig()->bSkipNearDuplicates;
+    Screening.SampleID = UMTSamplingFunctionLibrary::CreateSampleID(CaptureData.Sample);
+    Screening.Location = CaptureData.Location;
+    return Screening;
+}
+
+bool UMTSamplerComponentBase::ScreenFrame(
+    const FColor* Pixels,
+    const FIntVector2& Size,
+    const FFrameScreening& Screening,
+    FImageWriteResult& OutResult)
+{
+    const auto Statistics = FMTFrameStatistics::Compute(Pixels, Size, Screening.ClearColor);
+    OutResult.FrameArtifactScore = Statistics.GetArtifactScore(Screening.MinEdgeEnergy);
+    OutResult.bIsRejected = Screening.bShouldReject && OutResult.FrameArtifactScore > Screening.MaxArtifactScore;
+    if (OutResult.bIsRejected)
+    {
+        return false;
+    }
+
+    if (Screening.DuplicateIndex)
+    {
+        OutResult.PerceptualHash = FMTPerceptualHash::Compute(Pixels, Size);
+        if (const auto DuplicateSampleID = Screening.DuplicateIndex->FindOrAdd(
+                OutResult.PerceptualHash,
+                Screening.Location,
+                Screening.SampleID,
+                Screening.MaxDuplicateDistance,
+                Screening.DuplicateSearchRadius))
+        {
+            OutResult.DuplicateSampleID = DuplicateSampleID.GetValue();
+            OutResult.bIsSkippedDuplicate = Screening.bShouldSkipDuplicates;
+        }
+    }
+    return !OutResult.bIsSkippedDuplicate;
+}
+
+FMTImageEncoderPool& UMTSamplerComponentBase::GetImageEncoderPool()
+{
+    if (!ImageEncoderPool)
+    {
+        ImageEncoderPool = MakeUnique<FMTImageEncoderPool>(
+            GetActiveConfig()->ImageEncoderThreadNum, GetActiveConfig()->MaxQueuedImageNum);
+    }
+
+    return *ImageEncoderPool;
+}
+
+TSharedRef<const IMTImageEncoder> UMTSamplerComponentBase::GetImageEncoder()
+{
+    if (!ImageEncoder)
+    {
+        ImageEncoder = IMTImageEncoder::Create(GetActiveConfig()->ImageEncoder);
+    }
+
+    return ImageEncoder.ToSharedRef();
+}
+
+void UMTSamplerComponentBase::CompleteImageWrites(const bool bWaitForPendingWrites)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(MTSampling::CompleteImageWrites);
+
+    const auto SessionDir = GetSessionDir() + TEXT("/");
+
+    // Writes finish roughly in order, stop at the first one in progress
+    int32 CompletedNum = 0;
+    for (auto& PendingImageWrite : PendingImageWrites)
+    {
+        if (bWaitForPendingWrites)
+        {
+            PendingImageWrite.Future.Wait();
+        }
+        else if (!PendingImageWrite.Future.IsReady())
+        {
+            break;
+        }
+
+        // Set by the encoder thread before its future became ready, the shard writer finishes later
+        auto& ShardWrites = PendingImageWrite.Result->FileWrite.ShardWrites;
+        if (!bWaitForPendingWrites &&
+            ShardWrites.ContainsByPredicate([](const TFuture<bool>& ShardWrite) { return !ShardWrite.IsReady(); }))
+        {
+            break;
+        }
+
+        auto& CaptureData = PendingImageWrite.CaptureData;
+        const auto& WriteResult = *PendingImageWrite.Result;
+        CompletedNum++;
+
+        auto bIsSaved = WriteResult.FileWrite.bIsSaved;
+        for (auto& ShardWrite : ShardWrites)
+        {
+            bIsSaved &= ShardWrite.Get();
+        }
+
+        NearDuplicateCount += WriteResult.DuplicateSampleID != 0;
+
+        // Never written, journaled without metadata so a resumed run does not capture it again
+        if (WriteResult.bIsRejected || WriteResult.bIsSkippedDuplicate)
+        {
+            RejectedFrameCount += WriteResult.bIsRejected;
+            SkippedDuplicateCount += WriteResult.bIsSkippedDuplicate;
+            UnsavedMetadataCaptures.Add(MoveTemp(CaptureData));
+            continue;
         }
+
+        // Neither metadata nor journal entry, a resumed run captures the sample again
+        if (!bIsSaved)
+        {
+            FailedImageWriteCount++;
+            continue;
+        }
+
+        WrittenImageCount++;
+        WrittenImageBytes += WriteResult.FileWrite.EncodedBytes;
+
+        CaptureData.Sample.FrameArtifactScore = WriteResult.FrameArtifactScore;
+        CaptureData.Sample.PerceptualHash = WriteResult.PerceptualHash;
+        CaptureData.Sample.DuplicateSampleID = WriteResult.DuplicateSampleID;
+        auto RelativeImagePath = CaptureData.AbsoluteImagePath;
+        FPaths::MakePathRelativeTo(RelativeImagePath, *SessionDir);
+
+        GetSampleMetadataWriter().Add(
+            UMTSamplingFunctionLibrary::CreateSampleID(CaptureData.Sample), RelativeImagePath, CaptureData.Sample);
+        UnsavedMetadataCaptures.Add(MoveTemp(CaptureData));
+    }
+
+    PendingImageWrites.RemoveAt(0, CompletedNum, false);
+
+    if (GetSampleMetadataWriter().ShouldFlush())
+    {
+        FlushSampleMetadata();
+    }
+}
+
+void UMTSamplerComponentBase::FlushSampleMetadata()
+{
+    // Samples without metadata are not completed and captured again by the next run
+    if (!GetSampleMetadataWriter().Flush())
+    {
+        return;
+    }
+
+    for (const auto& CaptureData : UnsavedMetadataCaptures)
+    {
+        GetSampleJournal().MarkCompleted(CaptureData.SampleID, CaptureData.SamplingCursor);
     }
 
-    CaptureQueue.Reset();
+    UnsavedMetadataCaptures.Reset();
 }
 
 void UMTSamplerComponentBase::EndSampling()
 {
-    // Wait for last batch
-    WaitForRenderThreadReadSurfaceAndWriteImages();
+    // Wait for the captures still in flight
+    CaptureRing->Flush();
+    CompleteImageWrites(true);
+    bHasCubemap = false;
+    CubemapFaces.Reset();
+    FlushSampleMetadata();
+    GetSampleJournal().Flush();
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Waited %.1fs for tiles, collision and rendering, %d steps timed out"),
+        TotalReadinessWaitSeconds,
+        ReadinessTimeoutCount);
+
+    if (RejectedFrameCount > 0)
+    {
+        UE_LOG(LogTemp, Display, TEXT("Rejected %d frames as artifacts before encoding"), RejectedFrameCount);
+    }
+
+    if (FailedImageWriteCount > 0)
+    {
+        UE_LOG(
+            LogTemp,
+            Error,
+            TEXT("Failed to write %d images, a resumed run captures them again"),
+            FailedImageWriteCount);
+    }
+
+    if (NearDuplicateCount > 0)
+    {
+        // Skipped images would have been about as large as the written ones
+        const auto MeanImageBytes =
+            WrittenImageCount > 0 ? static_cast<double>(WrittenImageBytes) / WrittenImageCount : 0.;
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("%d near duplicate samples, %d skipped, saved about %.1f MiB at %.1f KiB per image"),
+            NearDuplicateCount,
+            SkippedDuplicateCount,
+            SkippedDuplicateCount * MeanImageBytes / (1024. * 1024.),
+            MeanImageBytes / 1024.);
+    }
+
+    if (PrefetchHitCount + PrefetchMissCount > 0)
+    {
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Prefetched tiles were ready for %d of %d samples"),
+            PrefetchHitCount,
+            PrefetchHitCount + PrefetchMissCount);
+    }
+
+    bIsSampling = false;
+
+    if (HasPendingSamplingRuns())
+    {
+        bIsTearDownDeferred = true;
+        return;
+    }
+
+    TearDownSampling();
+}
+
+void UMTSamplerComponentBase::EndPendingSamplingRuns()
+{
+    if (bIsTearDownDeferred && !bIsSampling && !HasPendingSamplingRuns())
+    {
+        TearDownSampling();
+    }
+}
+
+void UMTSamplerComponentBase::TearDownSampling()
+{
+    bIsTearDownDeferred = false;
+
+    RemovePrefetchCameras();
+
+    for (const auto& PanoramaCapture : PanoramaCaptures)
+    {
+        if (PanoramaCapture)
+        {
+            PanoramaCapture->Destroy();
+        }
+    }
+    for (const auto& Capture2D : Capture2Ds)
+    {
+        Capture2D->Destroy();
+    }
 
-    PanoramaCapture->Destroy();
-    Capture2D->Destroy();
+    // Finishes the last shard
+    ImageShardWriter.Reset();
+    ImageEncoderPool.Reset();
 
     // TODO refactor into GetPriamryPlayerPawn
     const auto PlayerPawn = CastChecked<AMTPlayerPawn>(
         GetWorld()->GetGameInstance()->GetPrimaryPlayerController()->GetPawn());
     PlayerPawn->GetCaptureCameraComponent()->SetActive(false);
     PlayerPawn->GetOverviewCameraComponent()->SetActive(true);
-
-    bIsSampling = false;
 }
 
 bool UMTSamplerComponentBase::ShouldSampleOnBeginPlay() const
@@ -415,16 +1254,64 @@ bool UMTSamplerComponentBase::ShouldSampleOnBeginPlay() const
 }
 
 FString UMTSamplerComponentBase::GetSessionDir() const
+{
+    return GetSessionDir(GetSessionName(), GetActiveConfig());
+}
+
+FString UMTSamplerComponentBase::GetSessionDir(
+    const FString& SessionName,
+    const UMTWayGraphSamplerConfig* SessionConfig) const
 {
     FString SessionDir = FPaths::ConvertRelativePathToFull(FPaths::Combine(
         FPaths::ProjectSavedDir(),
         TEXT("WorldIndex"),
-        GetWorld()->GetMapName(),
-        GetActiveConfig()->GetConfigName()));
+        SessionName,
+        SessionConfig->GetConfigName()));
 
     return SessionDir;
 }
 
+FString UMTSamplerComponentBase::GetSessionName() const
+{
+    return GetWorld()->GetMapName();
+}
+
+FMTSampleJournal& UMTSamplerComponentBase::GetSampleJournal()
+{
+    // Batches switch sessions between runs
+    const auto SessionDir = GetSessionDir();
+    if (!SampleJournal || SampleJournal->GetSessionDir() != SessionDir)
+    {
+        SampleJournal = MakeUnique<FMTSampleJournal>(SessionDir);
+
+        // Directory crawl only on request, e.g. after deleting broken images
+        if (FParse::Param(FCommandLine::Get(), TEXT("RepairSampleJournal")))
+        {
+            SampleJournal->RepairFromImages(GetImageDir());
+        }
+
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Resuming session %s with %d completed samples"),
+            *SessionDir,
+            SampleJournal->CompletedNum());
+    }
+
+    return *SampleJournal;
+}
+
+FMTSampleMetadataWriter& UMTSamplerComponentBase::GetSampleMetadataWriter()
+{
+    const auto SessionDir = GetSessionDir();
+    if (!SampleMetadataWriter || SampleMetadataWriter->GetSessionDir() != SessionDir)
+    {
+        SampleMetadataWriter = MakeUnique<FMTSampleMetadataWriter>(SessionDir);
+    }
+
+    return *SampleMetadataWriter;
+}
+
 TOptional<FTransform>
 UMTSamplerComponentBase::ValidateGroundAndObstructions(const bool bIgnoreObstructions) const
 {
@@ -530,6 +1417,8 @@ void UMTSamplerComponentBase::TickComponent(
 {
     Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
+    MaxFrameSecondsSinceCapture = FMath::Max(MaxFrameSecondsSinceCapture, static_cast<double>(DeltaTime));
+
     if (StepFrameSkips > 0)
     {
         StepFrameSkips--;
@@ -541,6 +1430,52 @@ void UMTSamplerComponentBase::TickComponent(
         return;
     }
 
+    if (StepReadiness != EMTStepReadiness::None)
+    {
+        // Begun after the wait frames, covers the end of frame updates of the moved rig
+        if (EnumHasAnyFlags(StepReadiness, EMTStepReadiness::Render) && !bIsStepRenderFenceBegun)
+        {
+            StepRenderFence.BeginFence();
+            bIsStepRenderFenceBegun = true;
+        }
+
+        const auto StepWaitSeconds = FPlatformTime::Seconds() - StepWaitStartTime;
+        const auto bIsStepReady = IsStepReady(StepReadiness);
+
+        // Arriving at a prefetched sample should not have to wait for its tiles. The render fence was
+        // begun this tick and is left out, the ground trace tells whether the tiles were already there.
+        if (bIsFirstStepReadinessCheck && bIsSamplePrefetched &&
+            NextSampleStep == ENextSampleStep::PreCaptureSample)
+        {
+            auto PrefetchReadiness = StepReadiness;
+            EnumRemoveFlags(PrefetchReadiness, EMTStepReadiness::Render);
+            if (IsStepReady(PrefetchReadiness))
+            {
+                PrefetchHitCount++;
+            }
+            else
+            {
+                PrefetchMissCount++;
+            }
+        }
+        bIsFirstStepReadinessCheck = false;
+
+        if (!bIsStepReady)
+        {
+            if (StepWaitSeconds < GetActiveConfig()->MaxStepWaitSeconds)
+            {
+                return;
+            }
+
+            ReadinessTimeoutCount++;
+            UE_LOG(LogTemp, Verbose, TEXT("Sample %d not ready after %.1fs"), CurrentSampleCount, StepWaitSeconds);
+        }
+
+        SampleReadinessWaitSeconds += StepWaitSeconds;
+        TotalReadinessWaitSeconds += StepWaitSeconds;
+        StepReadiness = EMTStepReadiness::None;
+    }
+
     switch (NextSampleStep)
     {
         case ENextSampleStep::InitSampling:
@@ -568,9 +1503,26 @@ FString UMTSamplerComponentBase::CreateImagePathForSample(const FMTSample& Sampl
 
     FString ImageDir = SampleWithImageID.ImageDir.IsSet() ? SampleWithImageID.ImageDir.GetValue() : GetImageDir();
 
-    FString ImageName = SampleWithImageID.ImageName.IsSet()
-                            ? SampleWithImageID.ImageName.GetValue()
-                            : UMTSamplingFunctionLibrary::CreateImageNameFromSample(SampleWithImageID);
+    FString ImageName;
+    if (SampleWithImageID.ImageName.IsSet())
+    {
+        ImageName = SampleWithImageID.ImageName.GetValue();
+    }
+    else if (GetActiveConfig()->ImageNaming == EMTSampleImageNaming::Metadata)
+    {
+        ImageName = UMTSamplingFunctionLibrary::CreateImageNameFromSample(SampleWithImageID);
+    }
+    else
+    {
+        ImageName = UMTSamplingFunctionLibrary::CreateImageNameFromSampleID(
+            UMTSamplingFunctionLibrary::CreateSampleID(SampleWithImageID));
+    }
+
+    // Names given by the sample are kept, e.g. paths of an existing dataset
+    if (!SampleWithImageID.ImageName.IsSet())
+    {
+        ImageName = FPaths::ChangeExtension(ImageName, GetImageEncoder()->GetExtension());
+    }
 
     return FPaths::Combine(ImageDir, ImageName);
 }
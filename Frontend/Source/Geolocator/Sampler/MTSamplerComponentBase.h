@@ -2,18 +2,40 @@
 
 #pragma once
 
+#include "Cesium3DTileset.h"
 #include "Components/SceneCaptureComponent2D.h"
 #include "CoreMinimal.h"
 #include "Engine/SceneCapture.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "JsonDomBuilder.h"
+#include "MTCaptureRing.h"
+#include "MTCubemapRemap.h"
+#include "MTImageEncoderPool.h"
+#include "MTPerceptualHash.h"
 #include "MTSample.h"
+#include "MTSampleJournal.h"
+#include "MTSampleMetadataWriter.h"
+#include "MTSamplingFunctionLibrary.h"
 #include "MTSceneCapture.h"
 #include "MTSceneCaptureCube.h"
 #include "MTWayGraphSamplerConfig.h"
 
 #include "MTSamplerComponentBase.generated.h"
 
+// Signals a sampling step waits for before it runs
+enum class EMTStepReadiness : uint8
+{
+    None = 0,
+    // Tilesets finished loading the tiles seen by the Cesium loader cameras. While prefetch cameras
+    // exist the capture view is covered by Ground and Render instead, see GotoNextSampleStep
+    Tiles = 1 << 0,
+    // Collision under the sampler, traced by the ground and artifact checks
+    Ground = 1 << 1,
+    // The render thread caught up with the moved capture rig
+    Render = 1 << 2,
+};
+ENUM_CLASS_FLAGS(EMTStepReadiness)
+
 USTRUCT()
 struct FMTCaptureImagePathPair
 {
@@ -21,6 +43,17 @@ struct FMTCaptureImagePathPair
 
     ASceneCapture* Capture;
     FString AbsoluteImagePath;
+
+    // Journaled once the image and metadata are written
+    uint64 SampleID = 0;
+    FMTSamplingCursor SamplingCursor;
+
+    FMTSample Sample;
+
+    FVector Location = FVector::ZeroVector;
+
+    // Set for 2D samples cut from a cube capture
+    TOptional<FMTCubemapSlice> CubemapSlice;
 };
 
 UCLASS(ClassGroup = (Custom), Abstract)
@@ -81,10 +114,51 @@ protected:
 
     void EndSampling();
 
+    // Keeps captures and Cesium cameras alive after EndSampling for the next BeginSampling
+    virtual bool HasPendingSamplingRuns() const
+    {
+        return false;
+    }
+
+    // Releases what EndSampling kept alive for pending runs once none of them are left, e.g. because
+    // the remaining runs failed before they began
+    void EndPendingSamplingRuns();
+
+    // Overrides the config for the next sampling runs, captures keep the settings of the initial config
+    void SetActiveConfig(UMTWayGraphSamplerConfig* InConfig);
+
+    // The config assigned to the component, ignores SetActiveConfig
+    UMTWayGraphSamplerConfig* GetComponentConfig() const
+    {
+        return Config;
+    }
+
     bool ShouldSampleOnBeginPlay() const;
 
     FString GetSessionDir() const;
 
+    FString GetSessionDir(const FString& SessionName, const UMTWayGraphSamplerConfig* SessionConfig) const;
+
+    // Groups the images and metadata of a run, the map name by default
+    virtual FString GetSessionName() const;
+
+    // Transforms of the samples after the current one, their tiles are loaded ahead of time
+    virtual TArray<FTransform> GetUpcomingSampleTransforms(const int32 MaxNum) const
+    {
+        return {};
+    }
+
+    // Stored with every completed sample, lets a resumed run skip to the last captured sample
+    virtual FMTSamplingCursor GetSamplingCursor() const
+    {
+        return {};
+    }
+
+    // Completed samples of the current session, opened on first use
+    FMTSampleJournal& GetSampleJournal();
+
+    FMTSampleMetadataWriter& GetSampleMetadataWriter();
+
     TOptional<FTransform>
     ValidateGroundAndObstructions(const bool bIgnoreObstructions = false) const;
 
@@ -100,8 +174,6 @@ protected:
 
     void ChangeCapture2DResolution(const FIntVector2& Resolution, const double FOVAngle = 65., bool bResizeTo512 = false)
     {
-        Capture2D->GetCaptureComponent2D()->FOVAngle = 68;
-
         // mimics torch.resize(512)
         FIntVector2 ResizedResolution = Resolution;
 
@@ -118,19 +190,24 @@ protected:
             }
         }
 
-        Capture2D->GetCaptureComponent2D()->FOVAngle = FOVAngle;
-        Capture2D->GetCaptureComponent2D()->TextureTarget->InitCustomFormat(
-            ResizedResolution.X, ResizedResolution.Y, EPixelFormat::PF_B8G8R8A8, false);
+        // Slots still in flight keep their pixels, only the render targets are resized
+        for (const auto& Capture2D : Capture2Ds)
+        {
+            Capture2D->GetCaptureComponent2D()->FOVAngle = FOVAngle;
+            Capture2D->GetCaptureComponent2D()->TextureTarget->InitCustomFormat(
+                ResizedResolution.X, ResizedResolution.Y, EPixelFormat::PF_B8G8R8A8, false);
+        }
     }
 
     FString CreateImagePathForSample(const FMTSample& Sample);
 
 private:
+    // One per capture ring slot, null until the slot captures its first panorama
     UPROPERTY()
-    TObjectPtr<AMTSceneCaptureCube> PanoramaCapture;
+    TArray<TObjectPtr<AMTSceneCaptureCube>> PanoramaCaptures;
 
     UPROPERTY()
-    TObjectPtr<AMTSceneCapture> Capture2D;
+    TArray<TObjectPtr<AMTSceneCapture>> Capture2Ds;
 
     UPROPERTY(EditAnywhere)
     bool bShouldSampleOnBeginPlay = false;
@@ -138,6 +215,9 @@ private:
     UPROPERTY(EditAnywhere)
     TObjectPtr<UMTWayGraphSamplerConfig> Config;
 
+    UPROPERTY(Transient)
+    TObjectPtr<UMTWayGraphSamplerConfig> ConfigOverride;
+
     int32 CurrentSampleCount;
 
     int32 CapturedImageCount;
@@ -146,17 +226,165 @@ private:
 
     bool bCapturePanorama = true;
 
+    bool bHasCesiumCameras = false;
+
+    // EndSampling skipped the teardown for pending runs
+    bool bIsTearDownDeferred = false;
+
     int32 CesiumGroundLoaderCameraID;
 
     TStaticArray<int32, 4> CesiumPanoramaLoaderCameraIDs;
 
+    // Four panorama directions per upcoming sample
+    TArray<int32> CesiumPrefetchCameraIDs;
+
+    TArray<FVector> PrefetchLocations;
+
+    // Added to MaximumCachedBytes of the tilesets while prefetch cameras exist
+    int64 AppliedPrefetchTileMemoryBytes = 0;
+
+    TArray<TWeakObjectPtr<ACesium3DTileset>> PrefetchBudgetTilesets;
+
+    bool bIsSamplePrefetched = false;
+
+    // Prefetched samples whose ground was loaded by the time the rig arrived
+    int32 PrefetchHitCount = 0;
+
+    int32 PrefetchMissCount = 0;
+
     double SampleArtifactProbability = 0.;
 
-    TArray<FMTCaptureImagePathPair> CaptureQueue;
+    // Validated by PreCapture, the captures of the acquired slot are moved here
+    FTransform CaptureTransform;
+
+    struct FCaptureSlot
+    {
+        FRenderCommandFence ReadbackFence;
+
+        // Capture in flight, the capture actor of the slot it was rendered with
+        FMTCaptureImagePathPair CaptureData;
+
+        // Samples at the same location cut from the cube capture of the slot once it is read back
+        TArray<FMTCaptureImagePathPair> CubemapSlices;
+    };
+
+    TArray<FCaptureSlot> CaptureSlots;
+
+    int32 CapturesPerFrame = 1;
+
+    // Cube capture the 2D samples at CubemapLocation are cut from, see bSliceFromCubemap
+    bool bHasCubemap = false;
+
+    FVector CubemapLocation = FVector::ZeroVector;
+
+    // Yaw of the first sample at the location, slices of a dataset share their remap tables
+    FQuat CubemapRotation = FQuat::Identity;
+
+    // In flight until its faces are read back
+    int32 CubemapSlotIndex = INDEX_NONE;
+
+    TSharedPtr<const TArray<FColor>> CubemapFaces;
+
+    double MaxFrameSecondsSinceCapture = 0.;
+
+    // Reads back the scene captures of the slots and passes them on to the encoder pool
+    class FSceneCaptureBackend final : public IMTCaptureBackend
+    {
+    public:
+        explicit FSceneCaptureBackend(UMTSamplerComponentBase& InComponent) : Component(InComponent)
+        {
+        }
+
+        virtual bool IsReadbackComplete(const int32 SlotIndex) override;
+
+        virtual void WaitForReadback(const int32 SlotIndex) override;
+
+        virtual void CompleteCapture(const int32 SlotIndex) override;
+
+    private:
+        UMTSamplerComponentBase& Component;
+    };
+
+    TUniquePtr<FSceneCaptureBackend> CaptureBackend;
+
+    TUniquePtr<FMTCaptureRing> CaptureRing;
+
+    // Settings of the frame checks of one capture, copied to the encoder threads
+    struct FFrameScreening
+    {
+        FColor ClearColor;
+
+        float MinEdgeEnergy = 0.F;
 
-    TArray<TFuture<void>> ImageWriteTaskFutures;
+        float MaxArtifactScore = 1.F;
 
-    FRenderCommandFence CaptureFence;
+        bool bShouldReject = false;
+
+        // Null unless near duplicates are detected
+        TSharedPtr<FMTPerceptualHashIndex> DuplicateIndex;
+
+        int32 MaxDuplicateDistance = 0;
+
+        double DuplicateSearchRadius = 0.;
+
+        bool bShouldSkipDuplicates = false;
+
+        // Metadata sample ID, near duplicates refer to it
+        uint64 SampleID = 0;
+
+        FVector Location = FVector::ZeroVector;
+    };
+
+    // Filled on an encoder thread, read once the write future is ready
+    struct FImageWriteResult
+    {
+        float FrameArtifactScore = 0.F;
+
+        bool bIsRejected = false;
+
+        uint64 PerceptualHash = 0;
+
+        // Metadata sample ID of an earlier capture with nearly the same image
+        uint64 DuplicateSampleID = 0;
+
+        bool bIsSkippedDuplicate = false;
+
+        UMTSamplingFunctionLibrary::FImageFileWrite FileWrite;
+    };
+
+    struct FPendingImageWrite
+    {
+        TFuture<void> Future;
+
+        FMTCaptureImagePathPair CaptureData;
+
+        TSharedPtr<FImageWriteResult> Result;
+    };
+
+    FFrameScreening GetFrameScreening(const FMTCaptureImagePathPair& CaptureData) const;
+
+    // Runs on the encoder threads before encoding, false if the frame must not be written
+    static bool ScreenFrame(
+        const FColor* Pixels,
+        const FIntVector2& Size,
+        const FFrameScreening& Screening,
+        FImageWriteResult& OutResult);
+
+    // Encoded and written by the encoder pool, in order of capture
+    TArray<FPendingImageWrite> PendingImageWrites;
+
+    TUniquePtr<FMTImageEncoderPool> ImageEncoderPool;
+
+    TSharedPtr<const IMTImageEncoder> ImageEncoder;
+
+    TUniquePtr<FMTSampleJournal> SampleJournal;
+
+    TUniquePtr<FMTSampleMetadataWriter> SampleMetadataWriter;
+
+    TSharedPtr<FMTImageShardWriter> ImageShardWriter;
+
+    // Written, journaled once their metadata shard is written
+    TArray<FMTCaptureImagePathPair> UnsavedMetadataCaptures;
 
     enum class ENextSampleStep
     {
@@ -170,6 +398,39 @@ private:
 
     int32 StepFrameSkips = 0;
 
+    EMTStepReadiness StepReadiness = EMTStepReadiness::None;
+
+    double StepWaitStartTime = 0.;
+
+    FRenderCommandFence StepRenderFence;
+
+    bool bIsStepRenderFenceBegun = false;
+
+    bool bIsFirstStepReadinessCheck = false;
+
+    // Accumulated over the steps of the current sample
+    double SampleReadinessWaitSeconds = 0.;
+
+    double TotalReadinessWaitSeconds = 0.;
+
+    int32 ReadinessTimeoutCount = 0;
+
+    int32 RejectedFrameCount = 0;
+
+    // Perceptual hashes of the recent samples, see bDetectNearDuplicates
+    TSharedPtr<FMTPerceptualHashIndex> DuplicateIndex;
+
+    int32 NearDuplicateCount = 0;
+
+    int32 SkippedDuplicateCount = 0;
+
+    int32 WrittenImageCount = 0;
+
+    // Encoding or saving failed, the samples stay incomplete in the journal and are captured again
+    int32 FailedImageWriteCount = 0;
+
+    int64 WrittenImageBytes = 0;
+
     UFUNCTION()
     void InitSampling();
 
@@ -182,13 +443,74 @@ private:
     UFUNCTION()
     void CaptureSample();
 
-    void GotoNextSampleStep(const ENextSampleStep NextStep, const int32 StepWaitFrames = 0);
+    // The step runs after StepWaitFrames and once the readiness signals are set or timed out
+    void GotoNextSampleStep(
+        const ENextSampleStep NextStep,
+        const int32 StepWaitFrames = 0,
+        const EMTStepReadiness Readiness = EMTStepReadiness::None);
+
+    bool IsStepReady(const EMTStepReadiness Readiness) const;
+
+    void SpawnCaptureSlot();
+
+    AMTSceneCaptureCube* SpawnPanoramaCapture();
+
+    AMTSceneCaptureCube* GetPanoramaCapture(const int32 SlotIndex);
+
+    // Moves the rig and Cesium cameras to a new sample, PreCapture runs once its tiles are loaded
+    void MoveToSample(const FTransform& SampleTransform);
+
+    // Validates the sample at the owner location, moves the rig to the validated transform and
+    // estimates its artifact probability
+    bool PlaceSample();
 
-    void EnqueueCapture(const FMTCaptureImagePathPair& CaptureImagePathPair);
+    // True if the sample was rendered, cube slices and completed samples are not
+    bool CaptureCurrentSample();
+
+    bool CaptureCubemapSlice(FMTCaptureImagePathPair&& CaptureData);
+
+    bool IsCubemapSliceLocation(const FVector& Location) const;
+
+    // Grows the 2D captures per frame while frames stay within the budget, halves them otherwise
+    void AdaptCapturesPerFrame();
+
+    // Renders the capture into the slot and starts its readback
+    void BeginCapture(const int32 SlotIndex, FMTCaptureImagePathPair&& CaptureData);
+
+    // Moves the pixels of a read back slot to the encoder pool
+    void CompleteCaptureSlot(const int32 SlotIndex);
+
+    void EncodeCapture(FMTCaptureImagePathPair& CaptureData);
+
+    // Cropped equirect table of the panorama capture, see bUnwrapPanoramaOnCPU
+    TSharedRef<const FMTCubemapRemap> GetPanoramaUnwrap(const AMTSceneCaptureCube& CubeCapture) const;
+
+    void EncodeCubemapSlice(const TSharedRef<const TArray<FColor>>& Faces, FMTCaptureImagePathPair& CaptureData);
 
     void UpdateCesiumCameras();
 
+    // Slides the prefetch window to the samples after the current one
+    void UpdatePrefetchCameras();
+
+    void RemovePrefetchCameras();
+
+    // Destroys the captures and switches back to the overview camera
+    void TearDownSampling();
+
+    void SetPrefetchTileMemoryBudget(const int64 BudgetBytes);
+
     FString GetImageDir();
 
-    void WaitForRenderThreadReadSurfaceAndWriteImages();
+    // Null unless the config writes image shards
+    TSharedPtr<FMTImageShardWriter> GetImageShardWriter();
+
+    FMTImageEncoderPool& GetImageEncoderPool();
+
+    // Shared with the encoder pool threads
+    TSharedRef<const IMTImageEncoder> GetImageEncoder();
+
+    // Passes written images on to the metadata writer, waits for writes still in progress if requested
+    void CompleteImageWrites(const bool bWaitForPendingWrites);
+
+    void FlushSampleMetadata();
 };
@@ -6,11 +6,85 @@
 #include "CubemapUnwrapUtils.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "IImageWrapper.h"
+#include "Hash/CityHash.h"
 #include "IImageWrapperModule.h"
+#include "MTImagePyramid.h"
 #include "MTSample.h"
 
 FRandomStream UMTSamplingFunctionLibrary::RandomStream;
 
+namespace
+{
+    using FImageFileWrite = UMTSamplingFunctionLibrary::FImageFileWrite;
+
+    void SaveImage(
+        const FString& FilePath,
+        TArray64<uint8>&& ImageData,
+        const TSharedPtr<FMTImageShardWriter>& ShardWriter,
+        FImageFileWrite& OutWrite)
+    {
+        // The encoder thread continues with the next image while the shard writer appends this one
+        if (ShardWriter)
+        {
+            OutWrite.ShardWrites.Add(ShardWriter->Write(FilePath, MoveTemp(ImageData)));
+            return;
+        }
+
+        if (!FFileHelper::SaveArrayToFile(ImageData, *FilePath))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to save %s"), *FilePath);
+            OutWrite.bIsSaved = false;
+        }
+    }
+
+    void SaveImage(
+        const FString& FilePath,
+        const FImageView& Image,
+        const IMTImageEncoder& Encoder,
+        const TSharedPtr<FMTImageShardWriter>& ShardWriter,
+        FImageFileWrite& OutWrite)
+    {
+        TArray64<uint8> ImgData;
+        if (!Encoder.Encode(Image, ImgData))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to encode %s"), *FilePath);
+            OutWrite.bIsSaved = false;
+            return;
+        }
+
+        OutWrite.EncodedBytes += ImgData.Num();
+        SaveImage(FilePath, MoveTemp(ImgData), ShardWriter, OutWrite);
+    }
+
+    FImageFileWrite SaveImagePyramid(
+        const FString& FilePath,
+        const FColor* Pixels,
+        const FIntVector2& Size,
+        const TConstArrayView<int32> PyramidShortSides,
+        const IMTImageEncoder& Encoder,
+        const TSharedPtr<FMTImageShardWriter>& ShardWriter)
+    {
+        FImageFileWrite Write;
+        SaveImage(
+            FilePath, FImageView((void*)Pixels, Size.X, Size.Y, ERawImageFormat::BGRA8), Encoder, ShardWriter, Write);
+
+        // Every level from the capture itself, chained levels would blur twice
+        thread_local TArray<FColor> LevelPixels;
+        for (const auto ShortSide : PyramidShortSides)
+        {
+            const auto LevelSize = FMTImagePyramid::GetLevelSize(Size, ShortSide);
+            FMTImagePyramid::Downsample(Pixels, Size, LevelSize, LevelPixels);
+            SaveImage(
+                FMTImagePyramid::GetLevelPath(FilePath, ShortSide),
+                FImageView(LevelPixels.GetData(), LevelSize.X, LevelSize.Y, ERawImageFormat::BGRA8),
+                Encoder,
+                ShardWriter,
+                Write);
+        }
+        return Write;
+    }
+}  // namespace
+
 const FRandomStream& UMTSamplingFunctionLibrary::GetRandomStream()
 {
     return RandomStream;
@@ -93,54 +167,38 @@ bool UMTSamplingFunctionLibrary::ReadPixelsFromRenderTarget(
     return true;
 }
 
-TFuture<void> UMTSamplingFunctionLibrary::WritePixelBufferToFile(
+UMTSamplingFunctionLibrary::FImageFileWrite UMTSamplingFunctionLibrary::WritePixelBufferToFile(
     const FString& FilePath,
     const TArray<FColor>& PixelBuffer,
-    const FIntVector2& Size)
+    const FIntVector2& Size,
+    const IMTImageEncoder& Encoder,
+    const TSharedPtr<FMTImageShardWriter>& ShardWriter,
+    const TConstArrayView<int32> PyramidShortSides)
 {
-    return Async(
-        EAsyncExecution::Thread,
-        [PixelBufferCopy = PixelBuffer, FilePath, Size]()
-        {
-            IImageWrapperModule& ImageWrapperModule =
-                FModuleManager::GetModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
-
-            TArray64<uint8> ImgData;
-            ImageWrapperModule.CompressImage(
-                ImgData,
-                EImageFormat::JPEG,
-                FImageView(
-                    (uint8*)(PixelBufferCopy.GetData()), Size.X, Size.Y, ERawImageFormat::BGRA8),
-                85);
-            FFileHelper::SaveArrayToFile(ImgData, *FilePath);
-        });
+    TRACE_CPUPROFILER_EVENT_SCOPE(UMTSamplingFunctionLibrary::WritePixelBufferToFile);
+
+    return SaveImagePyramid(FilePath, PixelBuffer.GetData(), Size, PyramidShortSides, Encoder, ShardWriter);
 }
 
-TFuture<void> UMTSamplingFunctionLibrary::WriteCubeMapPixelBufferToFile(
+UMTSamplingFunctionLibrary::FImageFileWrite UMTSamplingFunctionLibrary::WriteCubeMapPixelBufferToFile(
     const FString& FilePath,
     const TArray<FColor>& PixelBuffer,
     const FIntVector2& Size,
-    const FIntVector2& TopAndBottomCrop)
+    const FIntVector2& TopAndBottomCrop,
+    const IMTImageEncoder& Encoder,
+    const TSharedPtr<FMTImageShardWriter>& ShardWriter,
+    const TConstArrayView<int32> PyramidShortSides)
 {
-    return Async(
-        EAsyncExecution::Thread,
-        [PixelBufferCopy = PixelBuffer, FilePath, Size, TopAndBottomCrop]()
-        {
-            IImageWrapperModule& ImageWrapperModule =
-                FModuleManager::GetModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
-
-            TArray64<uint8> ImgData;
-            ImageWrapperModule.CompressImage(
-                ImgData,
-                EImageFormat::JPEG,
-                FImageView(
-                    (uint8*)(PixelBufferCopy.GetData() + TopAndBottomCrop.X * Size.X),
-                    Size.X,
-                    Size.Y - TopAndBottomCrop.X - TopAndBottomCrop.Y,
-                    ERawImageFormat::BGRA8),
-                85);
-            FFileHelper::SaveArrayToFile(ImgData, *FilePath);
-        });
+    TRACE_CPUPROFILER_EVENT_SCOPE(UMTSamplingFunctionLibrary::WriteCubeMapPixelBufferToFile);
+
+    // Cropped rows are skipped by offsetting into the buffer, the levels never load them
+    return SaveImagePyramid(
+        FilePath,
+        PixelBuffer.GetData() + TopAndBottomCrop.X * Size.X,
+        {Size.X, Size.Y - TopAndBottomCrop.X - TopAndBottomCrop.Y},
+        PyramidShortSides,
+        Encoder,
+        ShardWriter);
 }
 
 TArray<UMTSamplingFunctionLibrary::FLocationPathPair>
@@ -379,3 +437,22 @@ FString UMTSamplingFunctionLibrary::CreateImageNameFromSample(const FMTSample& S
         TEXT(""),  // TimeStamp
         Sample.ArtifactProbability + 0.);
 }
+
+uint64 UMTSamplingFunctionLibrary::CreateSampleID(const FMTSample& Sample)
+{
+    // Quantized like the file names, resumed runs recreate the IDs of their previous samples
+    const int64 QuantizedPose[] = {
+        FMath::RoundToInt64(Sample.LonLatAltitude.X * 1e7),
+        FMath::RoundToInt64(Sample.LonLatAltitude.Y * 1e7),
+        FMath::RoundToInt64(Sample.LonLatAltitude.Z * 1e2),
+        FMath::RoundToInt64(Sample.HeadingAngle * 1e2),
+        FMath::RoundToInt64(Sample.Pitch * 1e2),
+        FMath::RoundToInt64(Sample.Roll * 1e2)};
+
+    return CityHash64(reinterpret_cast<const char*>(QuantizedPose), sizeof(QuantizedPose));
+}
+
+FString UMTSamplingFunctionLibrary::CreateImageNameFromSampleID(const uint64 SampleID)
+{
+    return FString::Printf(TEXT("%016llx.jpg"), SampleID);
+}
@@ -9,6 +9,8 @@
 #include "CubemapUnwrapUtils.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "Engine/TextureRenderTargetCube.h"
+#include "MTImageEncoder.h"
+#include "MTImageShardWriter.h"
 #include "MTSample.h"
 #include "UObject/Object.h"
 
@@ -38,9 +40,24 @@ public:
 
     static bool ReadPixelsFromRenderTarget(UTextureRenderTarget2D* RenderTarget2D, TArray<FColor>& PixelBuffer);
     
-    static TFuture<void> WritePixelBufferToFile(const FString& FilePath, const TArray<FColor>& PixelBuffer, const FIntVector2& Size);
+    struct FImageFileWrite
+    {
+        // Encoded bytes of all levels
+        int64 EncodedBytes = 0;
+
+        // False if a level failed to encode or to save
+        bool bIsSaved = true;
+
+        // Shard appends still in flight, each set to false if its image was not flushed
+        TArray<TFuture<bool>> ShardWrites;
+    };
 
-    static TFuture<void> WriteCubeMapPixelBufferToFile(const FString& FilePath, const TArray<FColor>& PixelBuffer, const FIntVector2& Size, const FIntVector2& TopAndBottomCrop);
+    // Encodes and writes on the calling thread, see FMTImageEncoderPool. With a shard writer the image
+    // is appended to its shard instead, the returned shard writes complete once it is flushed. A level
+    // per short side is written next to it, see FMTImagePyramid.
+    static FImageFileWrite WritePixelBufferToFile(const FString& FilePath, const TArray<FColor>& PixelBuffer, const FIntVector2& Size, const IMTImageEncoder& Encoder, const TSharedPtr<FMTImageShardWriter>& ShardWriter = nullptr, const TConstArrayView<int32> PyramidShortSides = {});
+
+    static FImageFileWrite WriteCubeMapPixelBufferToFile(const FString& FilePath, const TArray<FColor>& PixelBuffer, const FIntVector2& Size, const FIntVector2& TopAndBottomCrop, const IMTImageEncoder& Encoder, const TSharedPtr<FMTImageShardWriter>& ShardWriter = nullptr, const TConstArrayView<int32> PyramidShortSides = {});
 
     struct FLocationPathPair
     {
@@ -65,6 +82,11 @@ public:
 
     static FString CreateImageNameFromSample(const FMTSample& Sample);
 
+    // Same for samples with the same pose, keys the sample in the metadata shards
+    static uint64 CreateSampleID(const FMTSample& Sample);
+
+    static FString CreateImageNameFromSampleID(const uint64 SampleID);
+
 private:
 	static FRandomStream RandomStream;
 };
@@ -2,6 +2,8 @@
 
 #include "MTWayGraphSamplerComponent.h"
 
+#include "CesiumSunSky.h"
+#include "EngineUtils.h"
 #include "Geolocator/OSM/MTOverpassConverter.h"
 #include "Geolocator/OSM/MTOverpassQuery.h"
 #include "Geolocator/WayGraph/MTChinesePostMan.h"
@@ -9,151 +11,197 @@
 #include "Kismet/KismetTextLibrary.h"
 #include "MTSample.h"
 
-UMTWayGraphSamplerComponent::UMTWayGraphSamplerComponent()
+namespace
 {
-}
+    constexpr auto StreetDataCacheFileName = TEXT("StreetDataCache.json");
 
-int32 UMTWayGraphSamplerComponent::GetEstimatedSampleCount()
-{
-    return EstimatedSampleCount;
-}
+    constexpr auto ContractionHierarchyCacheFileName = TEXT("StreetDataCache.ch");
 
-void UMTWayGraphSamplerComponent::BeginPlay()
-{
-    Super::BeginPlay();
+    void SaveStreetDataCache(const FString& FilePath, const FMTStreetData& StreetData)
+    {
+        FString StreetDataJSONString;
+        FJsonObjectConverter::UStructToJsonObjectString(StreetData, StreetDataJSONString);
+        FFileHelper::SaveStringToFile(StreetDataJSONString, *FilePath);
+    }
 
-    if (ShouldSampleOnBeginPlay())
+    // GeoRef may be null off the game thread, see FMTWayGraph::GetEdgeLength
+    double CalculateTotalPathLength(
+        const FMTWayGraph& Graph,
+        const TConstArrayView<FMTWayGraphPath> Paths,
+        const ACesiumGeoreference* GeoRef)
     {
-        if (FPaths::FileExists(GetStreetDataCacheFilePath()))
+        double TotalPathLength = 0.;
+        for (const auto& Path : Paths)
         {
-            FString StreetDataJSONString;
-            FFileHelper::LoadFileToString(StreetDataJSONString, *GetStreetDataCacheFilePath());
-            FJsonObjectConverter::JsonObjectStringToUStruct(StreetDataJSONString, &StreetData);
-            InitSamplingParameters();
-            BeginSampling();
-        }
-        else
-        {
-            OverpassQueryCompletedDelegate.BindUFunction(this, TEXT("OverpassQueryCompleted"));
-            const auto OverpassQuery =
-                MTOverpass::BuildQueryStringFromBoundingPolygon(BoundingPolygon);
-            MTOverpass::AsyncQuery(OverpassQuery, OverpassQueryCompletedDelegate);
+            for (int32 PathNodeIndex = 0; PathNodeIndex < Path.Nodes.Num() - 1; ++PathNodeIndex)
+            {
+                TotalPathLength +=
+                    Graph.GetEdgeLength(Path.Nodes[PathNodeIndex], Path.Nodes[PathNodeIndex + 1], GeoRef);
+            }
         }
+        return TotalPathLength;
     }
-}
-
-TOptional<FTransform> UMTWayGraphSamplerComponent::SampleNextLocation()
-{
-    const auto* GeoRef = ACesiumGeoreference::GetDefaultGeoreference(GetWorld());
 
-    if (CurrentPathSegmentIndex == ViewCurrentPath().Num() - 1)
+    // Runs next to the postman off the game thread, edge lengths are approximated without a georeference
+    FMTContractionHierarchy LoadOrBuildContractionHierarchy(const FMTWayGraph& Graph, const FString& FilePath)
     {
-        // GOTO next path or finish
-        CurrentPathIndex++;
-        CurrentPathSegmentIndex = 0;
-        CurrentPathSegmentStartDistance = 0.;
-        CurrentPathDistance = 0.;
-
-        if (CurrentPathIndex > StreetData.Paths.Num() - 1)
+        FMTContractionHierarchy Hierarchy;
+        if (Hierarchy.LoadFromFile(FilePath) && Hierarchy.IsBuiltFor(Graph))
         {
-            EndSampling();
-            return {};
+            return Hierarchy;
         }
 
-        CurrentSampleLocation = StreetData.Graph.GetNodeLocationUnreal(
-            ViewCurrentPath()[CurrentPathSegmentIndex], GeoRef);
+        // Graph changed or no cache yet
+        Hierarchy = FMTContractionHierarchy::Build(Graph, nullptr);
+        Hierarchy.SaveToFile(FilePath);
+        return Hierarchy;
     }
+}  // namespace
 
-    PrevSampleLocation = CurrentSampleLocation;
-    PrevWayIndex = CurrentWayIndex;
-
-    FQuat CurrentEdgeDir;
-
-    auto SegmentEndDistance = CurrentPathSegmentStartDistance;
-
-    const auto NextSampleDistance = CurrentPathDistance + GetActiveConfig()->SampleDistance;
-
-    for (; CurrentPathSegmentIndex < ViewCurrentPath().Num() - 1; ++CurrentPathSegmentIndex)
+bool FMTStreetData::LoadCache(const FString& FilePath, FMTStreetData& OutStreetData)
+{
+    FString StreetDataJSONString;
+    if (!FFileHelper::LoadFileToString(StreetDataJSONString, *FilePath) ||
+        !FJsonObjectConverter::JsonObjectStringToUStruct(StreetDataJSONString, &OutStreetData))
     {
-        const auto StartPoint = StreetData.Graph.GetNodeLocationUnreal(
-            ViewCurrentPath()[CurrentPathSegmentIndex], GeoRef);
-
-        const auto EndPoint = StreetData.Graph.GetNodeLocationUnreal(
-            ViewCurrentPath()[CurrentPathSegmentIndex + 1], GeoRef);
+        return false;
+    }
 
-        const auto SegmentLength = FVector::Dist(StartPoint, EndPoint);
+    if (OutStreetData.Version < 1)
+    {
+        OutStreetData.Graph.MigrateLegacyEdgeIndices();
+    }
+    OutStreetData.Graph.PostLoad();
+    return true;
+}
 
-        CurrentPathSegmentStartDistance = SegmentEndDistance;
-        SegmentEndDistance += SegmentLength;
+UMTWayGraphSamplerComponent::UMTWayGraphSamplerComponent()
+{
+}
 
-        if (NextSampleDistance <= SegmentEndDistance)
-        {
-            const auto Alpha = (SegmentEndDistance - NextSampleDistance) /
-                               (SegmentEndDistance - CurrentPathSegmentStartDistance);
+int32 UMTWayGraphSamplerComponent::GetEstimatedSampleCount()
+{
+    return EstimatedSampleCount;
+}
 
-            CurrentSampleLocation = FMath::Lerp(StartPoint, EndPoint, 1 - Alpha);
+void UMTWayGraphSamplerComponent::BeginPlay()
+{
+    Super::BeginPlay();
 
-            CurrentWayIndex = StreetData.Graph.GetEdgeWay(StreetData.Graph.NodePairToEdgeIndex(
-                ViewCurrentPath()[CurrentPathSegmentIndex],
-                ViewCurrentPath()[CurrentPathSegmentIndex + 1]));
+    if (ShouldSampleOnBeginPlay() && !BatchRegions.IsEmpty())
+    {
+        BeginBatch();
+        return;
+    }
 
-            CurrentEdgeDir = (EndPoint - StartPoint).Rotation().Quaternion();
+    if (ShouldSampleOnBeginPlay())
+    {
+        const auto OverpassQuery = MTOverpass::BuildQueryStringFromBoundingPolygon(BoundingPolygon);
+        const auto StreetDataCacheKey = StreetGraphSource.GetCacheKey(OverpassQuery);
 
-            break;
+        if (FPaths::FileExists(GetStreetDataCacheFilePath()) &&
+            FMTStreetData::LoadCache(GetStreetDataCacheFilePath(), StreetData))
+        {
+            // Caches without a query predate merging and are assumed to match the polygon
+            if (StreetData.OverpassQuery.IsEmpty() || StreetData.OverpassQuery == StreetDataCacheKey)
+            {
+                PrepareStreetDataAndBeginSampling(false);
+                return;
+            }
         }
 
-        CurrentSampleLocation = EndPoint;
+        // An extended bounding polygon only requires adding the new ways to the cached graph
+        bIsMergingStreetGraph =
+            StreetData.Graph.NodeNum() > 0 &&
+            MTOverpass::CanMergeQueryIntoStreetGraph(StreetData.Graph, BoundingPolygon);
+
+        OverpassQueryCompletedDelegate.BindUObject(
+            this, &UMTWayGraphSamplerComponent::OverpassQueryCompleted);
+        MTOverpass::AsyncLoadStreetGraph(
+            StreetGraphSource,
+            OverpassQuery,
+            MTOverpass::FMTGeoPolygon(BoundingPolygon),
+            bIsMergingStreetGraph ? StreetData.Graph : FMTWayGraph(),
+            OverpassQueryCompletedDelegate);
     }
+}
 
-    CurrentPathDistance = NextSampleDistance;
+void UMTWayGraphSamplerComponent::TickComponent(
+    float DeltaTime,
+    ELevelTick TickType,
+    FActorComponentTickFunction* ThisTickFunction)
+{
+    Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-    const auto SampleLocationDuplicationGrid = FVector(
-        FMath::Floor(CurrentSampleLocation.X / GetActiveConfig()->GetMinDistanceBetweenSamples()),
-        FMath::Floor(CurrentSampleLocation.Y / GetActiveConfig()->GetMinDistanceBetweenSamples()),
-        0.);
+    if (!BatchRegionStates.IsEmpty() && !IsSampling())
+    {
+        TryBeginNextBatchRegion();
+    }
+}
+
+const FMTContractionHierarchy* UMTWayGraphSamplerComponent::GetContractionHierarchy() const
+{
+    return ContractionHierarchy.GetPtrOrNull();
+}
 
-    if (SampledLocationsLSH.Contains({SampleLocationDuplicationGrid, CurrentWayIndex}))
+TOptional<FTransform> UMTWayGraphSamplerComponent::SampleNextLocation()
+{
+    if (NextPlannedSampleIndex >= SamplePlan.Num())
     {
+        EndSampling();
         return {};
     }
-    else
-    {
-        const auto PrevSampleLocationDuplicationGrid = FVector(
-            FMath::Floor(PrevSampleLocation.X / GetActiveConfig()->GetMinDistanceBetweenSamples()),
-            FMath::Floor(PrevSampleLocation.Y / GetActiveConfig()->GetMinDistanceBetweenSamples()),
-            0.);
-
-        SampledLocationsLSH.Add({SampleLocationDuplicationGrid, CurrentWayIndex});
-        SampledLocationsLSH.Add({PrevSampleLocationDuplicationGrid, CurrentWayIndex});
-        SampledLocationsLSH.Add({SampleLocationDuplicationGrid, PrevWayIndex});
 
-        // TODO deduplicate with CollectSampleMetadata
-        FString SampleName = FString::Format(
-            TEXT("{0}-{1}-{2}-{3}"),
-            {FMath::RoundToInt64(CurrentSampleLocation.X * 1000),
-             FMath::RoundToInt64(CurrentSampleLocation.Y * 1000),
-             FMath::RoundToInt64(CurrentSampleLocation.Z * 1000),
-             CurrentWayIndex});
+    const auto& PlannedSample = SamplePlan[NextPlannedSampleIndex];
+    NextPlannedSampleIndex++;
 
-        const auto RelativeFileName =
-            FPaths::Combine("./Images", FString::Format(TEXT("{0}.jpg"), {SampleName}));
+    CurrentWayIndex = PlannedSample.WayIndex;
+    return {PlannedSample.Transform};
+}
 
-        const auto AbsoluteImageFilePath =
-            FPaths::ConvertRelativePathToFull(GetSessionDir(), RelativeFileName);
+TOptional<FTransform> UMTWayGraphSamplerComponent::ValidateSampleLocation()
+{
+    return ValidateGroundAndObstructions();
+}
 
-        // Assume we are resuming previous run and don't overwrite image or metadata
-        if (FPaths::FileExists(AbsoluteImageFilePath))
+bool UMTWayGraphSamplerComponent::HasPendingSamplingRuns() const
+{
+    for (int32 RegionIndex = CurrentBatchRegionIndex + 1; RegionIndex < BatchRegionStates.Num(); ++RegionIndex)
+    {
+        if (!BatchRegionStates[RegionIndex].bHasFailed)
         {
-            return {};
+            return true;
         }
+    }
+    return false;
+}
 
-        return {FTransform(CurrentEdgeDir, CurrentSampleLocation)};
+FString UMTWayGraphSamplerComponent::GetSessionName() const
+{
+    if (BatchRegions.IsValidIndex(CurrentBatchRegionIndex))
+    {
+        return GetBatchRegionName(CurrentBatchRegionIndex);
     }
+
+    return Super::GetSessionName();
 }
 
-TOptional<FTransform> UMTWayGraphSamplerComponent::ValidateSampleLocation()
+FMTSamplingCursor UMTWayGraphSamplerComponent::GetSamplingCursor() const
 {
-    return ValidateGroundAndObstructions();
+    return {SamplePlan.GetHash(), NextPlannedSampleIndex};
+}
+
+TArray<FTransform> UMTWayGraphSamplerComponent::GetUpcomingSampleTransforms(const int32 MaxNum) const
+{
+    // The current sample was already taken from the plan
+    TArray<FTransform> UpcomingTransforms;
+    for (int32 SampleIndex = NextPlannedSampleIndex;
+         SampleIndex < FMath::Min(SamplePlan.Num(), NextPlannedSampleIndex + MaxNum);
+         ++SampleIndex)
+    {
+        UpcomingTransforms.Add(SamplePlan[SampleIndex].Transform);
+    }
+    return UpcomingTransforms;
 }
 
 FMTSample UMTWayGraphSamplerComponent::CollectSampleMetadata()
@@ -173,21 +221,36 @@ FMTSample UMTWayGraphSamplerComponent::CollectSampleMetadata()
 
 void UMTWayGraphSamplerComponent::InitSamplingParameters()
 {
-    EstimatedSampleCount = (StreetData.TotalPathLength / GetActiveConfig()->SampleDistance);
-
     const auto* GeoRef = ACesiumGeoreference::GetDefaultGeoreference(GetWorld());
+    const auto SampleDistance = GetActiveConfig()->SampleDistance;
+    const auto MinDistanceBetweenSamples = GetActiveConfig()->GetMinDistanceBetweenSamples();
+    const auto bDeduplicatePerWay = GetActiveConfig()->bDeduplicateSamplesPerWay;
+
+    if (!SamplePlan.LoadFromFile(GetSamplePlanCacheFilePath()) ||
+        !SamplePlan.IsBuiltFor(
+            StreetData.Paths, GeoRef, SampleDistance, MinDistanceBetweenSamples, bDeduplicatePerWay))
+    {
+        SamplePlan = FMTSamplePlan::Build(
+            StreetData.Graph,
+            StreetData.Paths,
+            GeoRef,
+            SampleDistance,
+            MinDistanceBetweenSamples,
+            bDeduplicatePerWay);
+        SamplePlan.SaveToFile(GetSamplePlanCacheFilePath());
+    }
 
-    CurrentPathSegmentIndex = 0;
-    CurrentPathSegmentStartDistance = 0.;
-    CurrentPathDistance = 0.;
-    CurrentPathIndex = 0;
+    // Assume we are resuming previous run, samples before the cursor were captured or invalid.
+    // Cursors of other plans are ignored, completed samples are still skipped by ID.
+    NextPlannedSampleIndex = static_cast<int32>(
+        FMath::Clamp<int64>(GetSampleJournal().GetCursor(SamplePlan.GetHash()), 0, SamplePlan.Num()));
+
+    EstimatedSampleCount = SamplePlan.Num() - NextPlannedSampleIndex;
     CurrentWayIndex = 0;
-    SampledLocationsLSH.Reset();
-    CurrentSampleLocation = StreetData.Graph.GetNodeLocationUnreal(ViewCurrentPath()[0], GeoRef);
 }
 
 void UMTWayGraphSamplerComponent::OverpassQueryCompleted(
-    const FOverPassQueryResult& Result,
+    FMTStreetGraphQueryResult& Result,
     const bool bSuccess)
 {
     if (!bSuccess)
@@ -195,40 +258,345 @@ void UMTWayGraphSamplerComponent::OverpassQueryCompleted(
         return;
     }
 
-    StreetData.Graph = MTOverpass::CreateStreetGraphFromQuery(Result, BoundingPolygon);
+    StreetData.Graph = MoveTemp(Result.Graph);
 
+    if (bIsMergingStreetGraph)
+    {
+        UE_LOG(
+            LogTemp,
+            Display,
+            TEXT("Merged %d nodes and %d edges into street graph"),
+            Result.Delta.AddedNodes.Num(),
+            Result.Delta.AddedEdges.Num());
+    }
+
+    PrepareStreetDataAndBeginSampling(true, Result.Delta.GetChangedNodes());
+}
+
+void UMTWayGraphSamplerComponent::PrepareStreetDataAndBeginSampling(
+    const bool bShouldCalculatePaths,
+    TArray<int32> ChangedNodes)
+{
+    // Nothing reads the street data until sampling begins, it is moved back once prepared
+    AsyncTask(
+        ENamedThreads::AnyBackgroundThreadNormalTask,
+        [WeakThis = TWeakObjectPtr<UMTWayGraphSamplerComponent>(this),
+         PreparedStreetData = MoveTemp(StreetData),
+         HierarchyFilePath = GetContractionHierarchyCacheFilePath(),
+         bShouldBuildHierarchy = GetActiveConfig()->bBuildContractionHierarchy,
+         bShouldCalculatePaths,
+         bIsMerging = bIsMergingStreetGraph,
+         ChangedNodes = MoveTemp(ChangedNodes)]() mutable
+        {
+            TOptional<FMTContractionHierarchy> Hierarchy;
+            if (bShouldBuildHierarchy)
+            {
+                Hierarchy = LoadOrBuildContractionHierarchy(PreparedStreetData.Graph, HierarchyFilePath);
+            }
+
+            // An extended bounding polygon only requires recalculating the paths of changed islands.
+            // Like the batch regions, edge lengths are approximated off the game thread.
+            if (bShouldCalculatePaths && bIsMerging)
+            {
+                TArray<int32> ChangedPathIndices;
+                PreparedStreetData.Paths = FMTChinesePostMan::UpdatePathsThatContainAllEdges(
+                    PreparedStreetData.Graph,
+                    nullptr,
+                    PreparedStreetData.Paths,
+                    ChangedNodes,
+                    Hierarchy.GetPtrOrNull(),
+                    &ChangedPathIndices);
+
+                UE_LOG(
+                    LogTemp,
+                    Display,
+                    TEXT("Recalculated %d of %d paths"),
+                    ChangedPathIndices.Num(),
+                    PreparedStreetData.Paths.Num());
+            }
+            else if (bShouldCalculatePaths)
+            {
+                PreparedStreetData.Paths = FMTChinesePostMan::CalculatePathsThatContainAllEdges(
+                    PreparedStreetData.Graph, nullptr, Hierarchy.GetPtrOrNull());
+            }
+
+            AsyncTask(
+                ENamedThreads::GameThread,
+                [WeakThis,
+                 PreparedStreetData = MoveTemp(PreparedStreetData),
+                 Hierarchy = MoveTemp(Hierarchy),
+                 bShouldCalculatePaths]() mutable
+                {
+                    auto* This = WeakThis.Get();
+                    if (!This)
+                    {
+                        return;
+                    }
+
+                    This->StreetData = MoveTemp(PreparedStreetData);
+                    This->ContractionHierarchy = MoveTemp(Hierarchy);
+
+                    if (bShouldCalculatePaths)
+                    {
+                        This->UpdateTotalPathLength();
+
+                        This->StreetData.OverpassQuery = This->StreetGraphSource.GetCacheKey(
+                            MTOverpass::BuildQueryStringFromBoundingPolygon(This->BoundingPolygon));
+                        This->StreetData.Version = FMTStreetData::CurrentVersion;
+
+                        SaveStreetDataCache(This->GetStreetDataCacheFilePath(), This->StreetData);
+                    }
+
+                    This->InitSamplingParameters();
+                    This->BeginSampling();
+                });
+        });
+}
+
+void UMTWayGraphSamplerComponent::UpdateTotalPathLength()
+{
     const auto* GeoRef = ACesiumGeoreference::GetDefaultGeoreference(GetWorld());
-    StreetData.Paths =
-        FMTChinesePostMan::CalculatePathsThatContainAllEdges(StreetData.Graph, GeoRef);
 
-    for (int32 PathIndex = 0; PathIndex < StreetData.Paths.Num(); ++PathIndex)
+    StreetData.TotalPathLength = CalculateTotalPathLength(StreetData.Graph, StreetData.Paths, GeoRef);
+}
+
+FString UMTWayGraphSamplerComponent::GetStreetDataCacheFilePath() const
+{
+    return FPaths::Combine(GetSessionDir(), StreetDataCacheFileName);
+}
+
+FString UMTWayGraphSamplerComponent::GetContractionHierarchyCacheFilePath() const
+{
+    return FPaths::Combine(GetSessionDir(), ContractionHierarchyCacheFileName);
+}
+
+FString UMTWayGraphSamplerComponent::GetSamplePlanCacheFilePath() const
+{
+    return FPaths::Combine(GetSessionDir(), TEXT("SamplePlan.bin"));
+}
+
+void UMTWayGraphSamplerComponent::BeginBatch()
+{
+    BatchRegionStates.SetNum(BatchRegions.Num());
+
+    for (int32 RegionIndex = 0; RegionIndex < BatchRegions.Num(); ++RegionIndex)
     {
-        for (int32 PathNodeIndex = 0; PathNodeIndex < StreetData.Paths[PathIndex].Nodes.Num() - 1;
-             ++PathNodeIndex)
+        const auto& Region = BatchRegions[RegionIndex];
+        if (!IsValid(Region.BoundingPolygon))
         {
-            const auto StartLocation = StreetData.Graph.GetNodeLocationUnreal(
-                StreetData.Paths[PathIndex].Nodes[PathNodeIndex], GeoRef);
-            const auto EndLocation = StreetData.Graph.GetNodeLocationUnreal(
-                StreetData.Paths[PathIndex].Nodes[PathNodeIndex + 1], GeoRef);
-
-            StreetData.TotalPathLength += FVector::Dist(StartLocation, EndLocation);
+            UE_LOG(LogTemp, Error, TEXT("Batch region %d has no bounding polygon"), RegionIndex);
+            BatchRegionStates[RegionIndex].bHasFailed = true;
+            continue;
         }
+
+        const auto OverpassQuery = MTOverpass::BuildQueryStringFromBoundingPolygon(Region.BoundingPolygon);
+        const auto StreetDataCacheKey = Region.StreetGraphSource.GetCacheKey(OverpassQuery);
+        const auto RegionSessionDir =
+            GetSessionDir(GetBatchRegionName(RegionIndex), GetBatchRegionConfig(RegionIndex));
+        const auto StreetDataCacheFilePath = FPaths::Combine(RegionSessionDir, StreetDataCacheFileName);
+        const auto HierarchyFilePath = FPaths::Combine(RegionSessionDir, ContractionHierarchyCacheFileName);
+
+        // Every region loads its cache, queries its graph and computes its tour independently
+        AsyncTask(
+            ENamedThreads::AnyBackgroundThreadNormalTask,
+            [WeakThis = TWeakObjectPtr<UMTWayGraphSamplerComponent>(this),
+             RegionIndex,
+             OverpassQuery,
+             StreetDataCacheKey,
+             StreetDataCacheFilePath,
+             HierarchyFilePath,
+             bShouldBuildHierarchy = GetBatchRegionConfig(RegionIndex)->bBuildContractionHierarchy]()
+            {
+                FMTStreetData CachedStreetData;
+                const auto bIsCached = FPaths::FileExists(StreetDataCacheFilePath) &&
+                                       FMTStreetData::LoadCache(StreetDataCacheFilePath, CachedStreetData) &&
+                                       CachedStreetData.OverpassQuery == StreetDataCacheKey;
+
+                TOptional<FMTContractionHierarchy> Hierarchy;
+                if (bIsCached && bShouldBuildHierarchy)
+                {
+                    Hierarchy = LoadOrBuildContractionHierarchy(CachedStreetData.Graph, HierarchyFilePath);
+                }
+
+                AsyncTask(
+                    ENamedThreads::GameThread,
+                    [WeakThis,
+                     RegionIndex,
+                     OverpassQuery,
+                     bIsCached,
+                     CachedStreetData = MoveTemp(CachedStreetData),
+                     Hierarchy = MoveTemp(Hierarchy)]() mutable
+                    {
+                        auto* This = WeakThis.Get();
+                        if (!This)
+                        {
+                            return;
+                        }
+
+                        auto& RegionState = This->BatchRegionStates[RegionIndex];
+                        if (bIsCached)
+                        {
+                            RegionState.ContractionHierarchy = MoveTemp(Hierarchy);
+                            RegionState.StreetData = MoveTemp(CachedStreetData);
+                            return;
+                        }
+
+                        const auto& Region = This->BatchRegions[RegionIndex];
+                        RegionState.QueryCompletedDelegate.BindUObject(
+                            This, &UMTWayGraphSamplerComponent::BatchRegionQueryCompleted, RegionIndex);
+                        MTOverpass::AsyncLoadStreetGraph(
+                            Region.StreetGraphSource,
+                            OverpassQuery,
+                            MTOverpass::FMTGeoPolygon(Region.BoundingPolygon),
+                            FMTWayGraph(),
+                            RegionState.QueryCompletedDelegate);
+                    });
+            });
     }
+}
 
-    FString StreetDataJSONString;
-    FJsonObjectConverter::UStructToJsonObjectString(StreetData, StreetDataJSONString);
-    FFileHelper::SaveStringToFile(StreetDataJSONString, *GetStreetDataCacheFilePath());
+void UMTWayGraphSamplerComponent::BatchRegionQueryCompleted(
+    FMTStreetGraphQueryResult& Result,
+    const bool bSuccess,
+    const int32 RegionIndex)
+{
+    if (!bSuccess)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load street graph of %s"), *GetBatchRegionName(RegionIndex));
+        BatchRegionStates[RegionIndex].bHasFailed = true;
+        return;
+    }
+
+    const auto& Region = BatchRegions[RegionIndex];
+    const auto StreetDataCacheKey = Region.StreetGraphSource.GetCacheKey(
+        MTOverpass::BuildQueryStringFromBoundingPolygon(Region.BoundingPolygon));
+    const auto RegionSessionDir =
+        GetSessionDir(GetBatchRegionName(RegionIndex), GetBatchRegionConfig(RegionIndex));
+    const auto StreetDataCacheFilePath = FPaths::Combine(RegionSessionDir, StreetDataCacheFileName);
+    const auto HierarchyFilePath = FPaths::Combine(RegionSessionDir, ContractionHierarchyCacheFileName);
+
+    AsyncTask(
+        ENamedThreads::AnyBackgroundThreadNormalTask,
+        [WeakThis = TWeakObjectPtr<UMTWayGraphSamplerComponent>(this),
+         RegionIndex,
+         Graph = MoveTemp(Result.Graph),
+         StreetDataCacheKey,
+         StreetDataCacheFilePath,
+         HierarchyFilePath,
+         bShouldBuildHierarchy = GetBatchRegionConfig(RegionIndex)->bBuildContractionHierarchy]() mutable
+        {
+            // The georeference moves between regions, edge lengths are approximated from the
+            // coordinates instead
+            FMTStreetData RegionStreetData;
+            RegionStreetData.Graph = MoveTemp(Graph);
+
+            TOptional<FMTContractionHierarchy> Hierarchy;
+            if (bShouldBuildHierarchy)
+            {
+                Hierarchy = LoadOrBuildContractionHierarchy(RegionStreetData.Graph, HierarchyFilePath);
+            }
+
+            RegionStreetData.Paths = FMTChinesePostMan::CalculatePathsThatContainAllEdges(
+                RegionStreetData.Graph, nullptr, Hierarchy.GetPtrOrNull());
+            RegionStreetData.TotalPathLength =
+                CalculateTotalPathLength(RegionStreetData.Graph, RegionStreetData.Paths, nullptr);
+            RegionStreetData.OverpassQuery = StreetDataCacheKey;
+            RegionStreetData.Version = FMTStreetData::CurrentVersion;
+
+            SaveStreetDataCache(StreetDataCacheFilePath, RegionStreetData);
+
+            AsyncTask(
+                ENamedThreads::GameThread,
+                [WeakThis,
+                 RegionIndex,
+                 RegionStreetData = MoveTemp(RegionStreetData),
+                 Hierarchy = MoveTemp(Hierarchy)]() mutable
+                {
+                    if (auto* This = WeakThis.Get())
+                    {
+                        auto& RegionState = This->BatchRegionStates[RegionIndex];
+                        RegionState.ContractionHierarchy = MoveTemp(Hierarchy);
+                        RegionState.StreetData = MoveTemp(RegionStreetData);
+                    }
+                });
+        });
+}
+
+void UMTWayGraphSamplerComponent::TryBeginNextBatchRegion()
+{
+    auto NextRegionIndex = CurrentBatchRegionIndex + 1;
+    while (BatchRegionStates.IsValidIndex(NextRegionIndex) && BatchRegionStates[NextRegionIndex].bHasFailed)
+    {
+        NextRegionIndex++;
+    }
+
+    // The remaining regions failed, nothing reuses the captures of the last sampled one
+    if (!BatchRegionStates.IsValidIndex(NextRegionIndex))
+    {
+        EndPendingSamplingRuns();
+        return;
+    }
+
+    // Regions are sampled in order, wait until the next one is prepared
+    if (!BatchRegionStates[NextRegionIndex].StreetData.IsSet())
+    {
+        return;
+    }
+
+    CurrentBatchRegionIndex = NextRegionIndex;
+    auto& RegionState = BatchRegionStates[CurrentBatchRegionIndex];
+    StreetData = MoveTemp(RegionState.StreetData.GetValue());
+    RegionState.StreetData.Reset();
+    ContractionHierarchy = MoveTemp(RegionState.ContractionHierarchy);
+    RegionState.ContractionHierarchy.Reset();
+
+    if (StreetData.Paths.IsEmpty())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Skipping %s, it has no streets"), *GetBatchRegionName(CurrentBatchRegionIndex));
+        RegionState.bHasFailed = true;
+        EndPendingSamplingRuns();
+        return;
+    }
+
+    SetActiveConfig(GetBatchRegionConfig(CurrentBatchRegionIndex));
+
+    // Unreal coordinates lose precision far away from the origin, move it into the region.
+    // The polygon is anchored to the globe and keeps its place.
+    auto* GeoRef = ACesiumGeoreference::GetDefaultGeoreference(GetWorld());
+    const auto RegionCenter =
+        MTOverpass::FMTGeoPolygon(BatchRegions[CurrentBatchRegionIndex].BoundingPolygon).GetBounds().GetCenter();
+    GeoRef->SetOriginLongitudeLatitudeHeight(FVector(RegionCenter.X, RegionCenter.Y, 0.));
+    for (auto* SunSky : TActorRange<ACesiumSunSky>(GetWorld()))
+    {
+        SunSky->UpdateSun();
+    }
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Sampling batch region %d/%d %s"),
+        CurrentBatchRegionIndex + 1,
+        BatchRegions.Num(),
+        *GetBatchRegionName(CurrentBatchRegionIndex));
 
     InitSamplingParameters();
     BeginSampling();
 }
 
-TConstArrayView<int32> UMTWayGraphSamplerComponent::ViewCurrentPath()
+FString UMTWayGraphSamplerComponent::GetBatchRegionName(const int32 RegionIndex) const
 {
-    return StreetData.Paths[CurrentPathIndex].Nodes;
+    const auto& Region = BatchRegions[RegionIndex];
+    if (!Region.Name.IsEmpty())
+    {
+        return Region.Name;
+    }
+
+    return IsValid(Region.BoundingPolygon) ? Region.BoundingPolygon->GetName()
+                                           : FString::Printf(TEXT("Region%d"), RegionIndex);
 }
 
-FString UMTWayGraphSamplerComponent::GetStreetDataCacheFilePath() const
+UMTWayGraphSamplerConfig* UMTWayGraphSamplerComponent::GetBatchRegionConfig(const int32 RegionIndex) const
 {
-    return FPaths::Combine(GetSessionDir(), TEXT("StreetDataCache.json"));
+    // Not the active config, it may still be the one of the previous region
+    return BatchRegions[RegionIndex].Config ? BatchRegions[RegionIndex].Config.Get() : GetComponentConfig();
 }
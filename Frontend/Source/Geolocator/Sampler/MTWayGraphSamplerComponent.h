@@ -5,8 +5,12 @@
 #include "../WayGraph/MTWayGraph.h"
 #include "CesiumCartographicPolygon.h"
 #include "CoreMinimal.h"
+#include "Geolocator/OSM/MTOverpassQuery.h"
+#include "Geolocator/OSM/MTStreetGraphSource.h"
 #include "Geolocator/WayGraph/MTChinesePostMan.h"
+#include "Geolocator/WayGraph/MTContractionHierarchy.h"
 #include "MTSample.h"
+#include "MTSamplePlan.h"
 #include "MTSamplerComponentBase.h"
 
 #include "MTWayGraphSamplerComponent.generated.h"
@@ -24,6 +28,41 @@ struct FMTStreetData
 
     UPROPERTY()
     double TotalPathLength = 0.;
+
+    // Query the graph was built from, used to detect an extended bounding polygon.
+    // Prefixed with the file name for offline sources, see FMTStreetGraphSource::GetCacheKey
+    UPROPERTY()
+    FString OverpassQuery;
+
+    // Caches without a version were written before edge indices became independent of the node count
+    UPROPERTY()
+    int32 Version = 0;
+
+    static constexpr int32 CurrentVersion = 1;
+
+    // Loads a StreetDataCache.json, migrates caches of older versions and prepares the graph for queries
+    static bool LoadCache(const FString& FilePath, FMTStreetData& OutStreetData);
+};
+
+USTRUCT()
+struct FMTWayGraphSamplingRegion
+{
+    GENERATED_BODY()
+
+    // Session directory of the region, defaults to the polygon name
+    UPROPERTY(EditAnywhere)
+    FString Name;
+
+    UPROPERTY(EditAnywhere)
+    TObjectPtr<ACesiumCartographicPolygon> BoundingPolygon;
+
+    UPROPERTY(EditAnywhere)
+    FMTStreetGraphSource StreetGraphSource;
+
+    // Defaults to the component config. Panorama size and tone curve always come from the component
+    // config, the captures are created once for the whole batch.
+    UPROPERTY(EditAnywhere)
+    TObjectPtr<UMTWayGraphSamplerConfig> Config;
 };
 
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
@@ -37,6 +76,14 @@ public:
     virtual int32 GetEstimatedSampleCount() override;
 
     virtual void BeginPlay() override;
+
+    virtual void TickComponent(
+        float DeltaTime,
+        ELevelTick TickType,
+        FActorComponentTickFunction* ThisTickFunction) override;
+
+    // Null unless bBuildContractionHierarchy is set in the active config
+    const FMTContractionHierarchy* GetContractionHierarchy() const;
     
 protected:
     virtual TOptional<FTransform> SampleNextLocation() override;
@@ -45,57 +92,89 @@ protected:
 
     virtual FMTSample CollectSampleMetadata() override;
 
+    virtual bool HasPendingSamplingRuns() const override;
+
+    virtual FString GetSessionName() const override;
+
+    virtual FMTSamplingCursor GetSamplingCursor() const override;
+
+    virtual TArray<FTransform> GetUpcomingSampleTransforms(const int32 MaxNum) const override;
+
 private:
     UPROPERTY(EditAnywhere)
     TObjectPtr<ACesiumCartographicPolygon> BoundingPolygon;
 
+    UPROPERTY(EditAnywhere)
+    FMTStreetGraphSource StreetGraphSource;
+
+    // Samples all regions one after another instead of BoundingPolygon. The regions can lie anywhere
+    // on the globe, their street graphs and tours are prepared in parallel while sampling.
+    UPROPERTY(EditAnywhere)
+    TArray<FMTWayGraphSamplingRegion> BatchRegions;
+
     int32 EstimatedSampleCount;
     
     FMTStreetData StreetData;
+
+    TOptional<FMTContractionHierarchy> ContractionHierarchy;
     
     int32 CurrentImageCount;
-    
-    int32 CurrentPathIndex;
 
-    int32 CurrentPathSegmentIndex;
+    FMTSamplePlan SamplePlan;
 
-    double CurrentPathSegmentStartDistance;
+    int32 NextPlannedSampleIndex = 0;
 
-    double CurrentPathDistance;
+    int32 CurrentWayIndex;
 
-    FVector CurrentSampleLocation;
+    FMTStreetGraphQueryCompletionDelegate OverpassQueryCompletedDelegate;
 
-    int32 CurrentWayIndex;
+    // True if the running query extends the cached street graph instead of replacing it
+    bool bIsMergingStreetGraph = false;
 
-    int32 PrevWayIndex;
-    
-    FVector PrevSampleLocation;
-    
-    struct FSampledLocationWithGraphEdgeID
+    struct FBatchRegionState
     {
-        FVector Location;
-        int32 WayID;
-
-        bool operator==(const FSampledLocationWithGraphEdgeID& Other) const
-        {
-            return Location == Other.Location && WayID == Other.WayID;
-        }
-
-        friend uint32 GetTypeHash(const FSampledLocationWithGraphEdgeID& InPath)
-        {
-            return GetTypeHash(InPath.Location) ^ GetTypeHash(InPath.WayID);
-        }
+        // Set once the street data is prepared, moved into StreetData when the region is sampled
+        TOptional<FMTStreetData> StreetData;
+
+        // Built next to the tour if the region config asks for it
+        TOptional<FMTContractionHierarchy> ContractionHierarchy;
+
+        bool bHasFailed = false;
+
+        FMTStreetGraphQueryCompletionDelegate QueryCompletedDelegate;
     };
-    TSet<FSampledLocationWithGraphEdgeID> SampledLocationsLSH;
 
-    FMTOverPassQueryCompletionDelegate OverpassQueryCompletedDelegate;
+    // Sized once in BeginBatch, the query delegates are referenced while the queries run
+    TArray<FBatchRegionState> BatchRegionStates;
+
+    int32 CurrentBatchRegionIndex = INDEX_NONE;
 
     void InitSamplingParameters();
-    
-    UFUNCTION()
-    void OverpassQueryCompleted(const FOverPassQueryResult& Result, const bool bSuccess);
-    
-    TConstArrayView<int32> ViewCurrentPath();
 
+    void UpdateTotalPathLength();
+
+    // Loads or builds the contraction hierarchy and calculates the paths if needed on a background
+    // task, sampling begins once both are ready. Merges only update the paths of ChangedNodes.
+    void PrepareStreetDataAndBeginSampling(const bool bShouldCalculatePaths, TArray<int32> ChangedNodes = {});
+
+    void OverpassQueryCompleted(FMTStreetGraphQueryResult& Result, const bool bSuccess);
+
+    void BeginBatch();
+
+    void BatchRegionQueryCompleted(
+        FMTStreetGraphQueryResult& Result,
+        const bool bSuccess,
+        const int32 RegionIndex);
+
+    void TryBeginNextBatchRegion();
+
+    FString GetBatchRegionName(const int32 RegionIndex) const;
+
+    UMTWayGraphSamplerConfig* GetBatchRegionConfig(const int32 RegionIndex) const;
+    
     FString GetStreetDataCacheFilePath() const;
+
+    FString GetContractionHierarchyCacheFilePath() const;
+
+    FString GetSamplePlanCacheFilePath() const;
 };
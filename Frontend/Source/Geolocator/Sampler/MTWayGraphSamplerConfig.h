@@ -3,9 +3,19 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "MTImageEncoder.h"
 
 #include "MTWayGraphSamplerConfig.generated.h"
 
+UENUM()
+enum class EMTSampleImageNaming : uint8
+{
+    // Hex sample ID, metadata is only stored in the metadata shards
+    SampleID,
+    // Metadata encoded into the file name, e.g. @UTM_east@UTM_north@...@.jpg
+    Metadata,
+};
+
 /**
  * 
  */
@@ -28,8 +38,119 @@ public:
     UPROPERTY(EditAnywhere)
     int32 PanoramaBottomCrop =  640;
 
+    // Reads back the cube faces and unwraps them on the encoder threads instead of the long lat
+    // unwrap on the render thread. Faces only the cropped rows would use are not read back.
+    UPROPERTY(EditAnywhere)
+    bool bUnwrapPanoramaOnCPU = false;
+
+    // Every image is also written downsampled to each short side, e.g. 512 for the retrieval models
+    // and 128 for thumbnails, as Images/<short side>/<image name>
+    UPROPERTY(EditAnywhere)
+    TArray<int32> PyramidShortSides;
+
+    // Captured frames are scored from their luma histogram, saturation, edges and clear color pixels
+    // before encoding. Frames above MaxFrameArtifactScore are not written when rejecting.
+    UPROPERTY(EditAnywhere)
+    bool bRejectArtifactFrames = false;
+
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0, ClampMax = 1))
+    float MaxFrameArtifactScore = 0.9F;
+
+    // Mean luma gradient below which a frame counts as flat, 0 to 1
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+    float MinFrameEdgeEnergy = 0.01F;
+
+    // Pixels with this color were never drawn to, e.g. outside of the loaded tiles
+    UPROPERTY(EditAnywhere)
+    FColor FrameClearColor = FColor::Black;
+
+    // Captured frames are hashed and compared against recent samples within DuplicateSearchRadius,
+    // frames within MaxDuplicateHammingDistance bits are flagged or, when skipping, not written
+    UPROPERTY(EditAnywhere)
+    bool bDetectNearDuplicates = false;
+
+    UPROPERTY(EditAnywhere)
+    bool bSkipNearDuplicates = false;
+
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0, ClampMax = 7))
+    int32 MaxDuplicateHammingDistance = 4;
+
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+    double DuplicateSearchRadius = 2000.;
+
+    // Recent samples compared against, older ones are forgotten
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 1))
+    int32 DuplicateHistoryNum = 4096;
+
     UPROPERTY(EditAnywhere)
     bool bShouldUseToneCurve = true;
+
+    // Sampling steps wait for tiles, collision and the render thread, but at most this long
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+    double MaxStepWaitSeconds = 10.;
+
+    // Planned samples after the current one whose tiles stream in before the rig arrives
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0, ClampMax = 16))
+    int32 PrefetchSampleNum = 2;
+
+    // Below 1 the look ahead cameras request coarser tiles than the cameras at the current sample
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0.1, ClampMax = 1))
+    double PrefetchResolutionScale = 0.5;
+
+    // Added to the tile cache of every tileset while prefetching, keeps prefetched tiles from being evicted
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+    int32 PrefetchTileMemoryBudgetMB = 512;
+
+    // 2D samples within BatchCaptureRadius of a captured sample are captured in the same frame,
+    // adapts to CaptureFrameBudgetMs. Panoramas are always captured one per frame.
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 1, ClampMax = 16))
+    int32 MaxCapturesPerFrame = 1;
+
+    UPROPERTY(EditAnywhere, meta = (EditCondition = "MaxCapturesPerFrame > 1", ClampMin = 0))
+    double BatchCaptureRadius = 2000.;
+
+    UPROPERTY(EditAnywhere, meta = (EditCondition = "MaxCapturesPerFrame > 1", ClampMin = 1))
+    double CaptureFrameBudgetMs = 50.;
+
+    // 2D samples at the same location are cut from one cube capture on the CPU instead of rendering
+    // each of them, e.g. the yaw and pitch slices of Pitts and Tokyo locations
+    UPROPERTY(EditAnywhere)
+    bool bSliceFromCubemap = false;
+
+    // Frames of captures rendered before the oldest one is read back. Each frame has
+    // MaxCapturesPerFrame slots with their own render targets.
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 1, ClampMax = 8))
+    int32 CaptureRingDepth = 2;
+
+    UPROPERTY(EditAnywhere)
+    FMTImageEncoderSettings ImageEncoder;
+
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 1))
+    int32 ImageEncoderThreadNum = 4;
+
+    // Capturing blocks once this many images wait for encoding, each holds a full pixel buffer
+    UPROPERTY(EditAnywhere, meta = (ClampMin = 1))
+    int32 MaxQueuedImageNum = 8;
+
+    // Metadata shards are written either way, the metadata file names are kept for existing datasets
+    UPROPERTY(EditAnywhere)
+    EMTSampleImageNaming ImageNaming = EMTSampleImageNaming::SampleID;
+
+    // Appends images to tar shards in the image directory instead of writing a file per image
+    UPROPERTY(EditAnywhere)
+    bool bWriteImageShards = false;
+
+    UPROPERTY(EditAnywhere, meta = (EditCondition = "bWriteImageShards", ClampMin = 1))
+    int32 MaxImageShardSizeMB = 1024;
+
+    // Samples closer than GetMinDistanceBetweenSamples are only dropped if they are on the same way,
+    // keeps views into every street of an intersection
+    UPROPERTY(EditAnywhere)
+    bool bDeduplicateSamplesPerWay = true;
+
+    // Preprocess the street graph for fast shortest path queries, cached next to the street data
+    UPROPERTY(EditAnywhere)
+    bool bBuildContractionHierarchy = false;
     
     FString GetConfigName() const;
 
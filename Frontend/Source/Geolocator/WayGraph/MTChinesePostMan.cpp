@@ -48,22 +48,48 @@ namespace
 
     void FindIslands(
         const FMTWayGraph& Graph,
+        TArray<bool>& InOutVisited,
         TArray<TArray<int32>>& OutIslands,
         TArray<TArray<int32>>& OutIslandOddNodes)
     {
         TRACE_CPUPROFILER_EVENT_SCOPE(FindIslands);
 
-        TArray<bool> Visited;
-        Visited.SetNumZeroed(Graph.NodeNum());
+        InOutVisited.SetNumZeroed(Graph.NodeNum());
 
         for (int NodeIndex = 0; NodeIndex < Graph.NodeNum(); NodeIndex++)
         {
-            if (Visited[NodeIndex] == false)
+            if (InOutVisited[NodeIndex] == false)
             {
                 DFSUtil(
                     Graph,
                     NodeIndex,
-                    Visited,
+                    InOutVisited,
+                    OutIslands.Emplace_GetRef(),
+                    OutIslandOddNodes.Emplace_GetRef());
+            }
+        }
+    }
+
+    // Only floods the islands that contain one of the start nodes
+    void FindIslandsFromNodes(
+        const FMTWayGraph& Graph,
+        const TConstArrayView<int32> StartNodes,
+        TArray<bool>& InOutVisited,
+        TArray<TArray<int32>>& OutIslands,
+        TArray<TArray<int32>>& OutIslandOddNodes)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(FindIslandsFromNodes);
+
+        InOutVisited.SetNumZeroed(Graph.NodeNum());
+
+        for (const auto StartNode : StartNodes)
+        {
+            if (InOutVisited[StartNode] == false)
+            {
+                DFSUtil(
+                    Graph,
+                    StartNode,
+                    InOutVisited,
                     OutIslands.Emplace_GetRef(),
                     OutIslandOddNodes.Emplace_GetRef());
             }
@@ -237,45 +263,110 @@ namespace
             }
         }
     }
+
+    // Islands are not connected to each other, so there is no route between their tours. Tours
+    // that follow each other are kept close by sorting them along a Morton curve over their start.
+    void SortPathsAlongMortonCurve(
+        const FMTWayGraph& Graph,
+        TArray<FMTWayGraphPath>& InOutPaths,
+        TArray<bool>& InOutIsPathChanged)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(SortPathsAlongMortonCurve);
+
+        FBox2d Bounds(ForceInit);
+        for (const auto& Path : InOutPaths)
+        {
+            const auto Location = Graph.GetNodeLocation(Path.Nodes[0]);
+            Bounds += FVector2d(Location.Lon, Location.Lat);
+        }
+        const auto Extent = Bounds.GetSize();
+
+        const auto Quantize = [](const double Value, const double Min, const double Size)
+        { return Size > 0. ? static_cast<uint32>((Value - Min) / Size * 65535.) : 0u; };
+
+        // Ties keep their order
+        TArray<TPair<uint32, int32>> Keys;
+        Keys.Reserve(InOutPaths.Num());
+        for (int32 PathIndex = 0; PathIndex < InOutPaths.Num(); ++PathIndex)
+        {
+            const auto Location = Graph.GetNodeLocation(InOutPaths[PathIndex].Nodes[0]);
+            const auto X = Quantize(Location.Lon, Bounds.Min.X, Extent.X);
+            const auto Y = Quantize(Location.Lat, Bounds.Min.Y, Extent.Y);
+            Keys.Add({FMath::MortonCode2(X) | (FMath::MortonCode2(Y) << 1), PathIndex});
+        }
+        Keys.Sort();
+
+        TArray<FMTWayGraphPath> SortedPaths;
+        TArray<bool> SortedIsPathChanged;
+        SortedPaths.Reserve(InOutPaths.Num());
+        SortedIsPathChanged.Reserve(InOutPaths.Num());
+        for (const auto& [Key, PathIndex] : Keys)
+        {
+            SortedPaths.Add(MoveTemp(InOutPaths[PathIndex]));
+            SortedIsPathChanged.Add(InOutIsPathChanged[PathIndex]);
+        }
+        InOutPaths = MoveTemp(SortedPaths);
+        InOutIsPathChanged = MoveTemp(SortedIsPathChanged);
+    }
 }  // namespace
 
 
 TArray<FMTWayGraphPath> FMTChinesePostMan::CalculatePathsThatContainAllEdges(
     const FMTWayGraph& Graph,
-    const ACesiumGeoreference* GeoRef)
+    const ACesiumGeoreference* GeoRef,
+    const FMTContractionHierarchy* Hierarchy,
+    FMTChinesePostManStats* OutStats)
+{
+    return UpdatePathsThatContainAllEdges(Graph, GeoRef, {}, {}, Hierarchy, nullptr, OutStats);
+}
+
+TArray<FMTWayGraphPath> FMTChinesePostMan::UpdatePathsThatContainAllEdges(
+    const FMTWayGraph& Graph,
+    const ACesiumGeoreference* GeoRef,
+    const TArray<FMTWayGraphPath>& PreviousPaths,
+    const TConstArrayView<int32> ChangedNodes,
+    const FMTContractionHierarchy* Hierarchy,
+    TArray<int32>* OutChangedPathIndices,
+    FMTChinesePostManStats* OutStats)
 {
     TRACE_CPUPROFILER_EVENT_SCOPE(ChinesePostMan::CalculatePathsThatContainAllEdges);
 
+    FMTChinesePostManStats Stats;
+    auto PhaseStartTime = FPlatformTime::Seconds();
+
     TArray<TArray<int32>> Islands;
     TArray<TArray<int32>> IslandsOddNodes;
+    TArray<bool> Visited;
+    TArray<FMTWayGraphPath> Result;
+    TArray<bool> IsPathChanged;
 
-    FindIslands(Graph, Islands, IslandsOddNodes);
-
-    check(Islands.Num() == IslandsOddNodes.Num())
-    TMap<int64, int32> EdgeCounts;
-    TMap<int64, double> EdgeWeights;
-
+    if (PreviousPaths.IsEmpty())
+    {
+        FindIslands(Graph, Visited, Islands, IslandsOddNodes);
+    }
+    else
     {
-        TRACE_CPUPROFILER_EVENT_SCOPE(Init);
+        // Merges only add nodes and edges, islands without changed nodes are unchanged. Only the
+        // islands of the changed nodes are flooded, they may have swallowed previous islands.
+        FindIslandsFromNodes(Graph, ChangedNodes, Visited, Islands, IslandsOddNodes);
 
-        for (int32 Node1 = 0; Node1 < Graph.NodeNum(); Node1++)
+        // A previous path covers its whole island, its first node tells whether it was swallowed
+        for (const auto& PreviousPath : PreviousPaths)
         {
-            for (int32 Node2 = Node1 + 1; Node2 < Graph.NodeNum(); Node2++)
+            if (!PreviousPath.Nodes.IsEmpty() && !Visited[PreviousPath.Nodes[0]])
             {
-                if (Graph.AreNodesConnected(Node1, Node2))
-                {
-                    const auto EdgeIndex = Graph.NodePairToEdgeIndex(Node1, Node2);
-                    EdgeCounts.Add(EdgeIndex, 1);
-                    const auto EdgeWeight = FVector::Distance(
-                        Graph.GetNodeLocationUnreal(Node1, GeoRef),
-                        Graph.GetNodeLocationUnreal(Node2, GeoRef));
-                    EdgeWeights.Add(EdgeIndex, EdgeWeight);
-                }
+                Result.Add(PreviousPath);
+                Stats.ReusedPathNum++;
             }
         }
     }
 
-    TArray<FMTWayGraphPath> Result;
+    Stats.IslandSeconds = FPlatformTime::Seconds() - PhaseStartTime;
+    Stats.IslandNum = Stats.ReusedPathNum + Islands.Num();
+
+    check(Islands.Num() == IslandsOddNodes.Num())
+    TMap<int64, int32> EdgeCounts;
+    TMap<int64, double> EdgeWeights;
 
     struct FDijsktraContext
     {
@@ -295,38 +386,82 @@ TArray<FMTWayGraphPath> FMTChinesePostMan::CalculatePathsThatContainAllEdges(
     {
         TRACE_CPUPROFILER_EVENT_SCOPE(ProcessIsland);
         check(Islands[IslandIndex].Num() > 0)
+
+        PhaseStartTime = FPlatformTime::Seconds();
+
+        {
+            TRACE_CPUPROFILER_EVENT_SCOPE(Init);
+
+            for (const auto IslandNode : Islands[IslandIndex])
+            {
+                for (const auto ConnectedNode : Graph.ViewNodesConnectedToNode(IslandNode))
+                {
+                    if (IslandNode < ConnectedNode)
+                    {
+                        const auto EdgeIndex = Graph.NodePairToEdgeIndex(IslandNode, ConnectedNode);
+                        EdgeCounts.Add(EdgeIndex, 1);
+                        const auto EdgeWeight =
+                            Graph.GetEdgeLength(IslandNode, ConnectedNode, GeoRef);
+                        EdgeWeights.Add(EdgeIndex, EdgeWeight);
+                        Stats.EdgeLength += EdgeWeight;
+                    }
+                }
+            }
+        }
         
         const auto& IslandOddNodes = IslandsOddNodes[IslandIndex];
         check(IslandOddNodes.Num() % 2 == 0);
+        Stats.OddNodeNum += IslandOddNodes.Num();
         
-        OddPrevPaths.SetNum(IslandOddNodes.Num());
-        DijsktraContexts.Reset();
         OddToOddPaths.Reset();
 
-        ParallelForWithTaskContext(
-            DijsktraContexts,
-            IslandOddNodes.Num(),
-            [](int32 ContextIndex, int32 NumContexts) { return FDijsktraContext{}; },
-            [&IslandOddNodes, &Graph, &EdgeWeights, &OddPrevPaths, &OddToOddPaths, &OddToOddLock](
-                FDijsktraContext& Context, int32 OddIndex)
+        // One upward search per odd node on the hierarchy replaces a full Dijkstra per odd node
+        if (Hierarchy)
+        {
+            const auto OddDistances = Hierarchy->FindShortestDistances(IslandOddNodes);
+            OddToOddPaths.Reserve(IslandOddNodes.Num() * (IslandOddNodes.Num() - 1) / 2);
+            for (int32 OddIndex = 0; OddIndex < IslandOddNodes.Num(); ++OddIndex)
             {
-                const auto OddStart = IslandOddNodes[OddIndex];
-
-                const auto SearchStatus = Dijsktra(
-                    Graph, OddStart, Context.DistanceCache, EdgeWeights, OddPrevPaths[OddIndex]);
-                check(SearchStatus);
-
-                OddToOddLock.Lock();
-                for (int32 OtherOddIndex = OddIndex + 1; OtherOddIndex < IslandOddNodes.Num();
-                     ++OtherOddIndex)
+                for (int32 OtherOddIndex = OddIndex + 1; OtherOddIndex < IslandOddNodes.Num(); ++OtherOddIndex)
                 {
                     OddToOddPaths.Push(
-                        {OddIndex,
-                         OtherOddIndex,
-                         Context.DistanceCache[IslandOddNodes[OtherOddIndex]]});
+                        {OddIndex, OtherOddIndex, OddDistances[OddIndex * IslandOddNodes.Num() + OtherOddIndex]});
                 }
-                OddToOddLock.Unlock();
-            });
+            }
+        }
+        else
+        {
+            OddPrevPaths.SetNum(IslandOddNodes.Num());
+            DijsktraContexts.Reset();
+
+            ParallelForWithTaskContext(
+                DijsktraContexts,
+                IslandOddNodes.Num(),
+                [](int32 ContextIndex, int32 NumContexts) { return FDijsktraContext{}; },
+                [&IslandOddNodes, &Graph, &EdgeWeights, &OddPrevPaths, &OddToOddPaths, &OddToOddLock](
+                    FDijsktraContext& Context, int32 OddIndex)
+                {
+                    const auto OddStart = IslandOddNodes[OddIndex];
+
+                    const auto SearchStatus = Dijsktra(
+                        Graph, OddStart, Context.DistanceCache, EdgeWeights, OddPrevPaths[OddIndex]);
+                    check(SearchStatus);
+
+                    OddToOddLock.Lock();
+                    for (int32 OtherOddIndex = OddIndex + 1; OtherOddIndex < IslandOddNodes.Num();
+                         ++OtherOddIndex)
+                    {
+                        OddToOddPaths.Push(
+                            {OddIndex,
+                             OtherOddIndex,
+                             Context.DistanceCache[IslandOddNodes[OtherOddIndex]]});
+                    }
+                    OddToOddLock.Unlock();
+                });
+        }
+
+        Stats.PairingSeconds += FPlatformTime::Seconds() - PhaseStartTime;
+        PhaseStartTime = FPlatformTime::Seconds();
 
         // Greedy matching
         // 2-Approximation
@@ -359,7 +494,24 @@ TArray<FMTWayGraphPath> FMTChinesePostMan::CalculatePathsThatContainAllEdges(
 
         for (const auto& MatchedEdge : MatchedEdges)
         {
+            Stats.DeadheadLength += MatchedEdge.Distance;
+
             const auto StartNode = IslandOddNodes[MatchedEdge.StartOddIndex];
+            if (Hierarchy)
+            {
+                const auto ShortestPath =
+                    Hierarchy->FindShortestPath(StartNode, IslandOddNodes[MatchedEdge.EndOddIndex]);
+                ensure(ShortestPath.IsValid());
+                for (int32 PathIndex = 0; PathIndex < ShortestPath.Nodes.Num() - 1; ++PathIndex)
+                {
+                    const auto PathNode = ShortestPath.Nodes[PathIndex];
+                    const auto NextPathNode = ShortestPath.Nodes[PathIndex + 1];
+                    ensure(Graph.AreNodesConnected(PathNode, NextPathNode));
+                    EdgeCounts[Graph.NodePairToEdgeIndex(PathNode, NextPathNode)]++;
+                }
+                continue;
+            }
+
             // StartNodeOddIndex is used to identify prevPath
             const auto& PrevPath = OddPrevPaths[MatchedEdge.StartOddIndex];
             auto CurrentPathNode = IslandOddNodes[MatchedEdge.EndOddIndex];
@@ -374,6 +526,9 @@ TArray<FMTWayGraphPath> FMTChinesePostMan::CalculatePathsThatContainAllEdges(
             }
         }
 
+        Stats.MatchingSeconds += FPlatformTime::Seconds() - PhaseStartTime;
+        PhaseStartTime = FPlatformTime::Seconds();
+
         // Pick a random node and calculate a euler Cycle for island
         const auto& IslandNodes = Islands[IslandIndex];
         if(IslandNodes.Num() > 1)
@@ -408,6 +563,8 @@ TArray<FMTWayGraphPath> FMTChinesePostMan::CalculatePathsThatContainAllEdges(
                     ensureAlwaysMsgf(NodeDegree % 2 == 0, TEXT("Node = %d, NodeDegree = %d, ConnectedNodes = %d, Neighbours = %s, StartNode = %d"), IslandNode, NodeDegree, Graph.ViewNodesConnectedToNode(IslandNode).Num(), *DbgNeighbourString, StartNode);
                 }
             }
+            IsPathChanged.SetNumZeroed(Result.Num());
+            IsPathChanged.Add(true);
             auto& NextCycle = Result.Emplace_GetRef();
             FindEulerPath(Graph, StartNode, EdgeCounts, NextCycle.Nodes);
 
@@ -431,6 +588,27 @@ TArray<FMTWayGraphPath> FMTChinesePostMan::CalculatePathsThatContainAllEdges(
                 }
             }
         }
+
+        Stats.EulerSeconds += FPlatformTime::Seconds() - PhaseStartTime;
+    }
+
+    IsPathChanged.SetNumZeroed(Result.Num());
+    SortPathsAlongMortonCurve(Graph, Result, IsPathChanged);
+
+    if (OutChangedPathIndices)
+    {
+        for (int32 PathIndex = 0; PathIndex < Result.Num(); ++PathIndex)
+        {
+            if (IsPathChanged[PathIndex])
+            {
+                OutChangedPathIndices->Add(PathIndex);
+            }
+        }
+    }
+
+    if (OutStats)
+    {
+        *OutStats = Stats;
     }
 
     return Result;
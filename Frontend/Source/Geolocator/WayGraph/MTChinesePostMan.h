@@ -3,6 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "MTContractionHierarchy.h"
 #include "MTWayGraph.h"
 
 #include "MTChinesePostMan.generated.h"
@@ -16,12 +17,56 @@ struct FMTWayGraphPath
     TArray<int32> Nodes;
 };
 
+// Phase timings and tour metrics of a single postman run, lengths are in Unreal units
+struct FMTChinesePostManStats
+{
+    double IslandSeconds = 0.;
+    // Distances between all odd nodes of an island, Dijkstra or the contraction hierarchy
+    double PairingSeconds = 0.;
+    double MatchingSeconds = 0.;
+    double EulerSeconds = 0.;
+
+    int32 IslandNum = 0;
+    int32 ReusedPathNum = 0;
+    int32 OddNodeNum = 0;
+
+    // Length of all edges of recalculated islands
+    double EdgeLength = 0.;
+
+    // Length of the shortest paths that are traversed twice to pair up odd nodes
+    double DeadheadLength = 0.;
+
+    double GetTourLength() const
+    {
+        return EdgeLength + DeadheadLength;
+    }
+};
+
 /**
  *
  */
 class GEOLOCATOR_API FMTChinesePostMan
 {
 public:
+    // GeoRef may be null for headless runs, see FMTWayGraph::GetEdgeLength.
+    // With a hierarchy built for Graph the odd node distances come from a many to many query
+    // instead of a Dijkstra per odd node. Paths are sorted so that consecutive islands are close.
     static TArray<FMTWayGraphPath>
-    CalculatePathsThatContainAllEdges(const FMTWayGraph& Graph, const ACesiumGeoreference* GeoRef);
+    CalculatePathsThatContainAllEdges(
+        const FMTWayGraph& Graph,
+        const ACesiumGeoreference* GeoRef,
+        const FMTContractionHierarchy* Hierarchy = nullptr,
+        FMTChinesePostManStats* OutStats = nullptr);
+
+    // Only recalculates paths for islands that contain one of the changed nodes e.g. after a merge,
+    // all other islands reuse their path from PreviousPaths. Only the changed islands are flooded,
+    // ChangedNodes must contain every added node and every node that gained an edge.
+    static TArray<FMTWayGraphPath> UpdatePathsThatContainAllEdges(
+        const FMTWayGraph& Graph,
+        const ACesiumGeoreference* GeoRef,
+        const TArray<FMTWayGraphPath>& PreviousPaths,
+        const TConstArrayView<int32> ChangedNodes,
+        const FMTContractionHierarchy* Hierarchy = nullptr,
+        TArray<int32>* OutChangedPathIndices = nullptr,
+        FMTChinesePostManStats* OutStats = nullptr);
 };
\ No newline at end of file
@@ -0,0 +1,340 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTCompactWayGraph.h"
+
+namespace
+{
+    void WriteVarint(TArray<uint8>& OutData, uint32 Value)
+    {
+        while (Value >= 0x80)
+        {
+            OutData.Add(static_cast<uint8>(Value | 0x80));
+            Value >>= 7;
+        }
+        OutData.Add(static_cast<uint8>(Value));
+    }
+
+    uint32 ReadVarint(const uint8*& InOutData)
+    {
+        uint32 Result = 0;
+        uint32 Shift = 0;
+        uint8 Byte;
+        do
+        {
+            Byte = *InOutData++;
+            Result |= static_cast<uint32>(Byte & 0x7F) << Shift;
+            Shift += 7;
+        } while (Byte & 0x80);
+        return Result;
+    }
+
+    uint32 ZigZagEncode(const int32 Value)
+    {
+        return (static_cast<uint32>(Value) << 1) ^ static_cast<uint32>(Value >> 31);
+    }
+
+    int32 ZigZagDecode(const uint32 Value)
+    {
+        return static_cast<int32>(Value >> 1) ^ -static_cast<int32>(Value & 1);
+    }
+}  // namespace
+
+FMTCompactWayGraph::FAdjacentNodes::FIterator::FIterator(
+    const uint8* InData,
+    const int32 InRemaining,
+    const int32 InCurrent)
+    : Data(InData)
+    , Remaining(InRemaining)
+    , Current(InCurrent)
+{
+}
+
+FMTCompactWayGraph::FAdjacentNodes::FIterator& FMTCompactWayGraph::FAdjacentNodes::FIterator::
+operator++()
+{
+    Remaining--;
+    if (Remaining > 0)
+    {
+        Current += static_cast<int32>(ReadVarint(Data));
+    }
+    return *this;
+}
+
+FMTCompactWayGraph::FAdjacentNodes::FAdjacentNodes(const uint8* InData, const int32 InNodeIndex)
+    : Data(InData)
+    , NodeIndex(InNodeIndex)
+{
+    Count = static_cast<int32>(ReadVarint(Data));
+}
+
+FMTCompactWayGraph::FAdjacentNodes::FIterator FMTCompactWayGraph::FAdjacentNodes::begin() const
+{
+    if (Count == 0)
+    {
+        return FIterator(Data, 0, INDEX_NONE);
+    }
+
+    const uint8* FirstDeltaEnd = Data;
+    const auto FirstNode = NodeIndex + ZigZagDecode(ReadVarint(FirstDeltaEnd));
+    return FIterator(FirstDeltaEnd, Count, FirstNode);
+}
+
+FMTCompactWayGraph::FAdjacentNodes::FIterator FMTCompactWayGraph::FAdjacentNodes::end() const
+{
+    return FIterator(nullptr, 0, INDEX_NONE);
+}
+
+FMTCompactWayGraph::FMTCompactWayGraph(const FMTWayGraph& Graph)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTCompactWayGraph::FMTCompactWayGraph);
+
+    Ways.Reserve(Graph.WayNum());
+    for (int32 WayIndex = 0; WayIndex < Graph.WayNum(); ++WayIndex)
+    {
+        Ways.Add({Graph.GetWayName(WayIndex), Graph.GetWayKind(WayIndex)});
+    }
+
+    WayIndexBitWidth = FMath::Max(1u, FMath::CeilLogTwo(static_cast<uint32>(Ways.Num())));
+
+    Nodes.Reserve(Graph.NodeNum());
+    AdjacencyOffsets.Reserve(Graph.NodeNum() + 1);
+    EdgeOffsets.Reserve(Graph.NodeNum() + 1);
+
+    // Edges are owned by their lower node, sized once for all of them
+    int64 UndirectedEdgeNum = 0;
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        for (const auto Neighbour : Graph.ViewNodesConnectedToNode(NodeIndex))
+        {
+            UndirectedEdgeNum += Neighbour > NodeIndex;
+        }
+    }
+    PackedEdgeWays.SetNumZeroed(static_cast<int32>(UndirectedEdgeNum * WayIndexBitWidth / 64 + 1));
+
+    TArray<int32> SortedNeighbours;
+    uint32 EdgeCount = 0;
+
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        Nodes.Add(FMTCompactCoordinates::FromOverpassCoordinates(Graph.GetNodeLocation(NodeIndex)));
+        AdjacencyOffsets.Add(AdjacencyData.Num());
+        EdgeOffsets.Add(EdgeCount);
+
+        const auto Neighbours = Graph.ViewNodesConnectedToNode(NodeIndex);
+        SortedNeighbours.Reset();
+        SortedNeighbours.Append(Neighbours.GetData(), Neighbours.Num());
+        SortedNeighbours.Sort();
+
+        WriteVarint(AdjacencyData, SortedNeighbours.Num());
+        for (int32 I = 0; I < SortedNeighbours.Num(); ++I)
+        {
+            if (I == 0)
+            {
+                WriteVarint(AdjacencyData, ZigZagEncode(SortedNeighbours[I] - NodeIndex));
+            }
+            else
+            {
+                WriteVarint(AdjacencyData, SortedNeighbours[I] - SortedNeighbours[I - 1]);
+            }
+        }
+
+        for (const auto Neighbour : SortedNeighbours)
+        {
+            if (Neighbour > NodeIndex)
+            {
+                WritePackedWay(
+                    EdgeCount, Graph.GetEdgeWay(Graph.NodePairToEdgeIndex(NodeIndex, Neighbour)));
+                EdgeCount++;
+            }
+        }
+    }
+
+    AdjacencyOffsets.Add(AdjacencyData.Num());
+    EdgeOffsets.Add(EdgeCount);
+
+    AdjacencyData.Shrink();
+}
+
+int64 FMTCompactWayGraph::NodePairToEdgeIndex(const int32 Node1, const int32 Node2) const
+{
+    if (Node1 < Node2)
+    {
+        return ((int64)Node1 << 32) | (int64)Node2;
+    }
+    else
+    {
+        return ((int64)Node2 << 32) | (int64)Node1;
+    }
+}
+
+EMTWay FMTCompactWayGraph::GetWayKind(const int32 WayIndex) const
+{
+    return Ways[WayIndex].Kind;
+}
+
+FString FMTCompactWayGraph::GetWayName(const int32 WayIndex) const
+{
+    return Ways[WayIndex].Name;
+}
+
+int32 FMTCompactWayGraph::GetEdgeWay(int64 EdgeIndex) const
+{
+    const auto LowerNode = static_cast<int32>(EdgeIndex >> 32);
+    const auto HigherNode = static_cast<int32>(EdgeIndex & 0xFFFFFFFF);
+
+    const auto EdgeRank = FindEdgeRank(LowerNode, HigherNode);
+    check(EdgeRank != INDEX_NONE);
+
+    return ReadPackedWay(EdgeRank);
+}
+
+int32 FMTCompactWayGraph::EdgeNum() const
+{
+    // Unlike FMTWayGraph this is the number of undirected edges
+    return EdgeOffsets.IsEmpty() ? 0 : static_cast<int32>(EdgeOffsets.Last());
+}
+
+int32 FMTCompactWayGraph::WayNum() const
+{
+    return Ways.Num();
+}
+
+FMTCompactWayGraph::FAdjacentNodes
+FMTCompactWayGraph::ViewNodesConnectedToNode(const int32 NodeIndex) const
+{
+    check(Nodes.IsValidIndex(NodeIndex));
+    return FAdjacentNodes(AdjacencyData.GetData() + AdjacencyOffsets[NodeIndex], NodeIndex);
+}
+
+FOverpassCoordinates FMTCompactWayGraph::GetNodeLocation(const int32 NodeIndex) const
+{
+    return Nodes[NodeIndex].ToOverpassCoordinates();
+}
+
+FVector FMTCompactWayGraph::GetNodeLocationUnreal(
+    const int32 NodeIndex,
+    const ACesiumGeoreference* GeoRef) const
+{
+    const auto NodeLocation = GetNodeLocation(NodeIndex);
+    return GeoRef->TransformLongitudeLatitudeHeightPositionToUnreal(
+        FVector{NodeLocation.Lon, NodeLocation.Lat, GeoRef->GetOriginHeight()});
+}
+
+bool FMTCompactWayGraph::AreNodesConnected(const int32 NodeIndex1, const int32 NodeIndex2) const
+{
+    check(Nodes.IsValidIndex(NodeIndex1));
+    for (const auto Neighbour : ViewNodesConnectedToNode(NodeIndex1))
+    {
+        if (Neighbour == NodeIndex2)
+        {
+            return true;
+        }
+        // Neighbours are sorted
+        if (Neighbour > NodeIndex2)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+int32 FMTCompactWayGraph::NodeNum() const
+{
+    return Nodes.Num();
+}
+
+SIZE_T FMTCompactWayGraph::GetAllocatedSize() const
+{
+    SIZE_T Result = Nodes.GetAllocatedSize() + AdjacencyOffsets.GetAllocatedSize() +
+                    AdjacencyData.GetAllocatedSize() + EdgeOffsets.GetAllocatedSize() +
+                    PackedEdgeWays.GetAllocatedSize() + Ways.GetAllocatedSize();
+    for (const auto& Way : Ways)
+    {
+        Result += Way.Name.GetAllocatedSize();
+    }
+    return Result;
+}
+
+int32 FMTCompactWayGraph::FindEdgeRank(const int32 Node, const int32 HigherNode) const
+{
+    int32 EdgeRank = EdgeOffsets[Node];
+    for (const auto Neighbour : ViewNodesConnectedToNode(Node))
+    {
+        if (Neighbour <= Node)
+        {
+            continue;
+        }
+        if (Neighbour == HigherNode)
+        {
+            return EdgeRank;
+        }
+        EdgeRank++;
+    }
+    return INDEX_NONE;
+}
+
+int32 FMTCompactWayGraph::ReadPackedWay(const int32 EdgeRank) const
+{
+    const uint64 BitIndex = static_cast<uint64>(EdgeRank) * WayIndexBitWidth;
+    const uint64 WordIndex = BitIndex / 64;
+    const uint64 BitOffset = BitIndex % 64;
+
+    uint64 Value = PackedEdgeWays[WordIndex] >> BitOffset;
+    if (BitOffset + WayIndexBitWidth > 64)
+    {
+        Value |= PackedEdgeWays[WordIndex + 1] << (64 - BitOffset);
+    }
+
+    return static_cast<int32>(Value & ((1ull << WayIndexBitWidth) - 1));
+}
+
+void FMTCompactWayGraph::WritePackedWay(const int32 EdgeRank, const int32 WayIndex)
+{
+    const uint64 BitIndex = static_cast<uint64>(EdgeRank) * WayIndexBitWidth;
+    const uint64 WordIndex = BitIndex / 64;
+    const uint64 BitOffset = BitIndex % 64;
+    const uint64 Value = static_cast<uint64>(WayIndex);
+
+    PackedEdgeWays[WordIndex] |= Value << BitOffset;
+    if (BitOffset + WayIndexBitWidth > 64)
+    {
+        PackedEdgeWays[WordIndex + 1] |= Value >> (64 - BitOffset);
+    }
+}
+
+FArchive& operator<<(FArchive& Ar, FMTCompactWayGraph& Graph)
+{
+    int32 NodeCount = Graph.Nodes.Num();
+    Ar << NodeCount;
+    if (Ar.IsLoading())
+    {
+        Graph.Nodes.SetNumUninitialized(NodeCount);
+    }
+    for (auto& Node : Graph.Nodes)
+    {
+        Ar << Node.Lat;
+        Ar << Node.Lon;
+    }
+
+    Ar << Graph.AdjacencyOffsets;
+    Graph.AdjacencyData.BulkSerialize(Ar);
+    Ar << Graph.EdgeOffsets;
+    Ar << Graph.PackedEdgeWays;
+    Ar << Graph.WayIndexBitWidth;
+
+    int32 WayCount = Graph.Ways.Num();
+    Ar << WayCount;
+    if (Ar.IsLoading())
+    {
+        Graph.Ways.SetNum(WayCount);
+    }
+    for (auto& Way : Graph.Ways)
+    {
+        Ar << Way.Name;
+        int32 Kind = static_cast<int32>(Way.Kind);
+        Ar << Kind;
+        Way.Kind = static_cast<EMTWay>(Kind);
+    }
+
+    return Ar;
+}
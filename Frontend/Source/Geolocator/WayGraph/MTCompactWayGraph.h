@@ -0,0 +1,140 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CesiumGeoreference.h"
+#include "CoreMinimal.h"
+#include "MTWayGraph.h"
+
+// Fixed point coordinates with 1e-7 degree precision, same as the OSM database uses internally
+struct FMTCompactCoordinates
+{
+    int32 Lat;
+    int32 Lon;
+
+    static constexpr double Scale = 1e7;
+
+    static FMTCompactCoordinates FromOverpassCoordinates(const FOverpassCoordinates& Coords)
+    {
+        return {
+            static_cast<int32>(FMath::RoundToInt64(Coords.Lat * Scale)),
+            static_cast<int32>(FMath::RoundToInt64(Coords.Lon * Scale))};
+    }
+
+    FOverpassCoordinates ToOverpassCoordinates() const
+    {
+        return {Lat / Scale, Lon / Scale};
+    }
+};
+
+/**
+ * Read only, memory compact version of FMTWayGraph for country sized extracts.
+ * Offers the same query API as FMTWayGraph. The samplers, the visualizer and the postman still
+ * work on FMTWayGraph, this is only built by MTWayGraphBenchmark to measure the savings.
+ *
+ * Adjacency lists are sorted and stored as varint encoded deltas in one byte stream.
+ * Way indices are stored once per undirected edge and bit packed to the smallest width that
+ * can address all ways.
+ */
+class GEOLOCATOR_API FMTCompactWayGraph
+{
+public:
+    // Decodes the adjacency list of a single node on the fly
+    class FAdjacentNodes
+    {
+    public:
+        class FIterator
+        {
+        public:
+            FIterator(const uint8* InData, const int32 InRemaining, const int32 InCurrent);
+
+            int32 operator*() const
+            {
+                return Current;
+            }
+
+            FIterator& operator++();
+
+            bool operator!=(const FIterator& Other) const
+            {
+                return Remaining != Other.Remaining;
+            }
+
+        private:
+            const uint8* Data;
+            int32 Remaining;
+            int32 Current;
+        };
+
+        FAdjacentNodes(const uint8* InData, const int32 InNodeIndex);
+
+        int32 Num() const
+        {
+            return Count;
+        }
+
+        FIterator begin() const;
+
+        FIterator end() const;
+
+    private:
+        const uint8* Data;
+        int32 NodeIndex;
+        int32 Count;
+    };
+
+    FMTCompactWayGraph() = default;
+
+    explicit FMTCompactWayGraph(const FMTWayGraph& Graph);
+
+    int64 NodePairToEdgeIndex(const int32 Node1, const int32 Node2) const;
+
+    EMTWay GetWayKind(const int32 WayIndex) const;
+
+    FString GetWayName(const int32 WayIndex) const;
+
+    int32 GetEdgeWay(int64 EdgeIndex) const;
+
+    int32 EdgeNum() const;
+
+    int32 WayNum() const;
+
+    FAdjacentNodes ViewNodesConnectedToNode(const int32 NodeIndex) const;
+
+    FOverpassCoordinates GetNodeLocation(const int32 NodeIndex) const;
+
+    FVector GetNodeLocationUnreal(const int32 NodeIndex, const ACesiumGeoreference* GeoRef) const;
+
+    bool AreNodesConnected(const int32 NodeIndex1, const int32 NodeIndex2) const;
+
+    int32 NodeNum() const;
+
+    SIZE_T GetAllocatedSize() const;
+
+    friend FArchive& operator<<(FArchive& Ar, FMTCompactWayGraph& Graph);
+
+private:
+    TArray<FMTCompactCoordinates> Nodes;
+
+    // Byte offset of each nodes adjacency list, NodeNum() + 1 entries
+    TArray<uint32> AdjacencyOffsets;
+
+    // Per node: degree, first neighbour zigzag encoded relative to the node, then ascending deltas
+    TArray<uint8> AdjacencyData;
+
+    // Index of the first edge owned by a node, edges are owned by their lower node index
+    TArray<uint32> EdgeOffsets;
+
+    TArray<uint64> PackedEdgeWays;
+
+    uint32 WayIndexBitWidth = 1;
+
+    TArray<FMTWayGraphWay> Ways;
+
+    // Returns the edge rank of the edge between Node and the higher indexed HigherNode
+    int32 FindEdgeRank(const int32 Node, const int32 HigherNode) const;
+
+    int32 ReadPackedWay(const int32 EdgeRank) const;
+
+    void WritePackedWay(const int32 EdgeRank, const int32 WayIndex);
+};
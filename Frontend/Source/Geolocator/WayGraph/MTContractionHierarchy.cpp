@@ -0,0 +1,715 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MTContractionHierarchy.h"
+
+#include "Algo/Count.h"
+#include "Algo/Reverse.h"
+#include "Hash/CityHash.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+    constexpr uint32 ContractionHierarchyFileMagic = 0x4D544348;
+
+    constexpr int32 ContractionHierarchyFileVersion = 2;
+
+    // Witness searches give up after settling this many nodes and simply add the shortcut
+    constexpr int32 MaxWitnessSettledNodes = 500;
+
+    struct FBuildEdge
+    {
+        int32 Target;
+        double Weight;
+        int32 Middle;
+    };
+
+    struct FShortcut
+    {
+        int32 From;
+        int32 To;
+        double Weight;
+        int32 Middle;
+    };
+
+    using FHeapEntry = TPair<double, int32>;
+
+    const auto HeapPredicate = [](const FHeapEntry& A, const FHeapEntry& B) { return A.Key < B.Key; };
+
+    struct FWitnessSearchContext
+    {
+        TMap<int32, double> Distances;
+        TArray<FHeapEntry> Heap;
+    };
+
+    // Dijkstra over the remaining graph that never enters ExcludedNode
+    void WitnessSearch(
+        const TArray<TArray<FBuildEdge>>& Edges,
+        const int32 StartNode,
+        const int32 ExcludedNode,
+        const double MaxDistance,
+        FWitnessSearchContext& Context)
+    {
+        Context.Distances.Reset();
+        Context.Heap.Reset();
+
+        Context.Distances.Add(StartNode, 0.);
+        Context.Heap.HeapPush({0., StartNode}, HeapPredicate);
+
+        int32 SettledNodes = 0;
+        while (!Context.Heap.IsEmpty())
+        {
+            FHeapEntry Top;
+            Context.Heap.HeapPop(Top, HeapPredicate, false);
+
+            if (Top.Key > Context.Distances[Top.Value])
+            {
+                continue;
+            }
+
+            if (Top.Key > MaxDistance || ++SettledNodes > MaxWitnessSettledNodes)
+            {
+                break;
+            }
+
+            for (const auto& Edge : Edges[Top.Value])
+            {
+                if (Edge.Target == ExcludedNode)
+                {
+                    continue;
+                }
+
+                const auto Distance = Top.Key + Edge.Weight;
+                const auto* KnownDistance = Context.Distances.Find(Edge.Target);
+                if (!KnownDistance || Distance < *KnownDistance)
+                {
+                    Context.Distances.Add(Edge.Target, Distance);
+                    Context.Heap.HeapPush({Distance, Edge.Target}, HeapPredicate);
+                }
+            }
+        }
+    }
+
+    void FindShortcuts(
+        const TArray<TArray<FBuildEdge>>& Edges,
+        const int32 Node,
+        FWitnessSearchContext& Context,
+        TArray<FShortcut>& OutShortcuts)
+    {
+        OutShortcuts.Reset();
+
+        const auto& NodeEdges = Edges[Node];
+
+        double MaxOutgoingWeight = 0.;
+        for (const auto& Edge : NodeEdges)
+        {
+            MaxOutgoingWeight = FMath::Max(MaxOutgoingWeight, Edge.Weight);
+        }
+
+        for (int32 FromIndex = 0; FromIndex < NodeEdges.Num(); ++FromIndex)
+        {
+            const auto& FromEdge = NodeEdges[FromIndex];
+
+            WitnessSearch(
+                Edges, FromEdge.Target, Node, FromEdge.Weight + MaxOutgoingWeight, Context);
+
+            for (int32 ToIndex = FromIndex + 1; ToIndex < NodeEdges.Num(); ++ToIndex)
+            {
+                const auto& ToEdge = NodeEdges[ToIndex];
+                const auto ViaDistance = FromEdge.Weight + ToEdge.Weight;
+
+                // Only strictly shorter witnesses count, otherwise two nodes of the same round
+                // could each rely on a witness through the other
+                const auto* WitnessDistance = Context.Distances.Find(ToEdge.Target);
+                if (!WitnessDistance || *WitnessDistance >= ViaDistance)
+                {
+                    OutShortcuts.Add({FromEdge.Target, ToEdge.Target, ViaDistance, Node});
+                }
+            }
+        }
+    }
+
+    void AddOrImproveEdge(
+        TArray<FBuildEdge>& InOutEdges,
+        const int32 Target,
+        const double Weight,
+        const int32 Middle)
+    {
+        for (auto& Edge : InOutEdges)
+        {
+            if (Edge.Target == Target)
+            {
+                if (Weight < Edge.Weight)
+                {
+                    Edge.Weight = Weight;
+                    Edge.Middle = Middle;
+                }
+                return;
+            }
+        }
+        InOutEdges.Add({Target, Weight, Middle});
+    }
+}  // namespace
+
+FMTContractionHierarchy FMTContractionHierarchy::Build(
+    const FMTWayGraph& Graph,
+    const ACesiumGeoreference* GeoRef)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTContractionHierarchy::Build);
+
+    FMTContractionHierarchy Result;
+    Result.NodeCount = Graph.NodeNum();
+    Result.GraphEdgeCount = CountGraphEdges(Graph);
+    Result.GraphHash = HashGraph(Graph);
+
+    TArray<TArray<FBuildEdge>> Edges;
+    Edges.SetNum(Result.NodeCount);
+
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(InitEdges);
+
+        ParallelFor(
+            Result.NodeCount,
+            [&Graph, GeoRef, &Edges](const int32 NodeIndex)
+            {
+                for (const auto ConnectedNode : Graph.ViewNodesConnectedToNode(NodeIndex))
+                {
+                    if (ConnectedNode != NodeIndex)
+                    {
+                        AddOrImproveEdge(
+                            Edges[NodeIndex],
+                            ConnectedNode,
+                            Graph.GetEdgeLength(NodeIndex, ConnectedNode, GeoRef),
+                            INDEX_NONE);
+                    }
+                }
+            });
+    }
+
+    TArray<TArray<FBuildEdge>> UpwardBuildEdges;
+    UpwardBuildEdges.SetNum(Result.NodeCount);
+
+    TArray<int32> Priorities;
+    Priorities.SetNumZeroed(Result.NodeCount);
+
+    TArray<int32> ContractedNeighbourCounts;
+    ContractedNeighbourCounts.SetNumZeroed(Result.NodeCount);
+
+    TArray<FWitnessSearchContext> SearchContexts;
+
+    // Edge difference plus contracted neighbours, keeps the hierarchy shallow and uniform
+    const auto UpdatePriorities = [&Edges, &Priorities, &ContractedNeighbourCounts, &SearchContexts](
+                                      const TArray<int32>& Nodes)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(UpdatePriorities);
+
+        SearchContexts.Reset();
+        ParallelForWithTaskContext(
+            SearchContexts,
+            Nodes.Num(),
+            [&Edges, &Nodes, &Priorities, &ContractedNeighbourCounts](
+                FWitnessSearchContext& Context, const int32 Index)
+            {
+                const auto Node = Nodes[Index];
+                TArray<FShortcut> Shortcuts;
+                FindShortcuts(Edges, Node, Context, Shortcuts);
+                Priorities[Node] =
+                    Shortcuts.Num() - Edges[Node].Num() + ContractedNeighbourCounts[Node];
+            });
+    };
+
+    TArray<int32> RemainingNodes;
+    RemainingNodes.Reserve(Result.NodeCount);
+    for (int32 NodeIndex = 0; NodeIndex < Result.NodeCount; ++NodeIndex)
+    {
+        RemainingNodes.Add(NodeIndex);
+    }
+
+    UpdatePriorities(RemainingNodes);
+
+    Result.Ranks.Init(INDEX_NONE, Result.NodeCount);
+    int32 NextRank = 0;
+
+    TArray<uint8> IsSelected;
+    TArray<int32> SelectedNodes;
+    TArray<TArray<FShortcut>> SelectedShortcuts;
+    TArray<int32> NodesToUpdate;
+    TBitArray<> NeedsUpdate(false, Result.NodeCount);
+
+    while (RemainingNodes.Num() > 0)
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(ContractRound);
+
+        // Nodes that are a strict local minimum among their remaining neighbours, ties are broken
+        // by node index so the selected nodes are never adjacent
+        IsSelected.SetNumZeroed(RemainingNodes.Num());
+        ParallelFor(
+            RemainingNodes.Num(),
+            [&RemainingNodes, &Edges, &Priorities, &IsSelected](const int32 Index)
+            {
+                const auto Node = RemainingNodes[Index];
+                for (const auto& Edge : Edges[Node])
+                {
+                    if (Priorities[Edge.Target] < Priorities[Node] ||
+                        (Priorities[Edge.Target] == Priorities[Node] && Edge.Target < Node))
+                    {
+                        IsSelected[Index] = 0;
+                        return;
+                    }
+                }
+                IsSelected[Index] = 1;
+            });
+
+        SelectedNodes.Reset();
+        for (int32 Index = 0; Index < RemainingNodes.Num(); ++Index)
+        {
+            if (IsSelected[Index])
+            {
+                SelectedNodes.Add(RemainingNodes[Index]);
+            }
+        }
+        check(SelectedNodes.Num() > 0);
+
+        SelectedShortcuts.SetNum(SelectedNodes.Num());
+        SearchContexts.Reset();
+        ParallelForWithTaskContext(
+            SearchContexts,
+            SelectedNodes.Num(),
+            [&Edges, &SelectedNodes, &SelectedShortcuts](
+                FWitnessSearchContext& Context, const int32 Index)
+            { FindShortcuts(Edges, SelectedNodes[Index], Context, SelectedShortcuts[Index]); });
+
+        NodesToUpdate.Reset();
+        for (int32 Index = 0; Index < SelectedNodes.Num(); ++Index)
+        {
+            const auto Node = SelectedNodes[Index];
+            Result.Ranks[Node] = NextRank++;
+
+            // All remaining neighbours are contracted later and therefore ranked higher
+            UpwardBuildEdges[Node] = MoveTemp(Edges[Node]);
+
+            for (const auto& Edge : UpwardBuildEdges[Node])
+            {
+                Edges[Edge.Target].RemoveAllSwap(
+                    [Node](const FBuildEdge& NeighbourEdge) { return NeighbourEdge.Target == Node; });
+                ContractedNeighbourCounts[Edge.Target]++;
+
+                if (!NeedsUpdate[Edge.Target])
+                {
+                    NeedsUpdate[Edge.Target] = true;
+                    NodesToUpdate.Add(Edge.Target);
+                }
+            }
+
+            for (const auto& Shortcut : SelectedShortcuts[Index])
+            {
+                AddOrImproveEdge(Edges[Shortcut.From], Shortcut.To, Shortcut.Weight, Shortcut.Middle);
+                AddOrImproveEdge(Edges[Shortcut.To], Shortcut.From, Shortcut.Weight, Shortcut.Middle);
+            }
+        }
+
+        RemainingNodes.RemoveAllSwap([&Result](const int32 Node)
+                                     { return Result.Ranks[Node] != INDEX_NONE; });
+
+        NodesToUpdate.RemoveAllSwap([&Result](const int32 Node)
+                                    { return Result.Ranks[Node] != INDEX_NONE; });
+        for (const auto Node : NodesToUpdate)
+        {
+            NeedsUpdate[Node] = false;
+        }
+        UpdatePriorities(NodesToUpdate);
+    }
+
+    Result.UpwardEdgeOffsets.Reserve(Result.NodeCount + 1);
+    for (int32 NodeIndex = 0; NodeIndex < Result.NodeCount; ++NodeIndex)
+    {
+        Result.UpwardEdgeOffsets.Add(Result.UpwardEdges.Num());
+        for (const auto& Edge : UpwardBuildEdges[NodeIndex])
+        {
+            Result.UpwardEdges.Add({Edge.Target, Edge.Weight, Edge.Middle});
+        }
+    }
+    Result.UpwardEdgeOffsets.Add(Result.UpwardEdges.Num());
+
+    UE_LOG(
+        LogTemp,
+        Display,
+        TEXT("Built contraction hierarchy with %d nodes and %d shortcuts"),
+        Result.NodeCount,
+        Result.ShortcutNum());
+
+    return Result;
+}
+
+FMTWayGraphShortestPath FMTContractionHierarchy::FindShortestPath(
+    const int32 StartNode,
+    const int32 EndNode) const
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTContractionHierarchy::FindShortestPath);
+
+    FMTWayGraphShortestPath Result;
+
+    TMap<int32, FSearchLabel> Forward;
+    TMap<int32, FSearchLabel> Backward;
+    const auto MeetingNode = Search(StartNode, EndNode, Forward, Backward, Result.Distance);
+    if (MeetingNode == INDEX_NONE)
+    {
+        return Result;
+    }
+
+    // Hierarchy nodes from start up to the meeting node and down to the end
+    TArray<int32> HierarchyPath;
+    for (auto Node = MeetingNode; Node != INDEX_NONE; Node = Forward[Node].Parent)
+    {
+        HierarchyPath.Add(Node);
+    }
+    Algo::Reverse(HierarchyPath);
+    for (auto Node = Backward[MeetingNode].Parent; Node != INDEX_NONE; Node = Backward[Node].Parent)
+    {
+        HierarchyPath.Add(Node);
+    }
+
+    Result.Nodes.Add(HierarchyPath[0]);
+    for (int32 PathIndex = 0; PathIndex < HierarchyPath.Num() - 1; ++PathIndex)
+    {
+        UnpackEdge(HierarchyPath[PathIndex], HierarchyPath[PathIndex + 1], Result.Nodes);
+    }
+
+    return Result;
+}
+
+double FMTContractionHierarchy::FindShortestDistance(
+    const int32 StartNode,
+    const int32 EndNode) const
+{
+    TMap<int32, FSearchLabel> Forward;
+    TMap<int32, FSearchLabel> Backward;
+    double Distance = DBL_MAX;
+    Search(StartNode, EndNode, Forward, Backward, Distance);
+    return Distance;
+}
+
+TArray<double> FMTContractionHierarchy::FindShortestDistances(const TConstArrayView<int32> Nodes) const
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTContractionHierarchy::FindShortestDistances);
+
+    struct FSearchContext
+    {
+        TArray<double> NodeDistances;
+
+        TArray<FHeapEntry> Heap;
+    };
+
+    TArray<FSearchSpace> SearchSpaces;
+    SearchSpaces.SetNum(Nodes.Num());
+    TArray<FSearchContext> SearchContexts;
+    ParallelForWithTaskContext(
+        SearchContexts,
+        Nodes.Num(),
+        [this](int32 ContextIndex, int32 NumContexts)
+        {
+            FSearchContext Context;
+            Context.NodeDistances.Init(DBL_MAX, NodeCount);
+            return Context;
+        },
+        [this, Nodes, &SearchSpaces](FSearchContext& Context, int32 NodeIndex)
+        {
+            SearchUpward(Nodes[NodeIndex], Context.NodeDistances, Context.Heap, SearchSpaces[NodeIndex]);
+        });
+
+    // Node index and distance of every search that reached a hierarchy node
+    TMap<int32, TArray<TPair<int32, double>>> Buckets;
+    for (int32 NodeIndex = 0; NodeIndex < Nodes.Num(); ++NodeIndex)
+    {
+        const auto& SearchSpace = SearchSpaces[NodeIndex];
+        for (int32 SpaceIndex = 0; SpaceIndex < SearchSpace.Nodes.Num(); ++SpaceIndex)
+        {
+            Buckets.FindOrAdd(SearchSpace.Nodes[SpaceIndex]).Add({NodeIndex, SearchSpace.Distances[SpaceIndex]});
+        }
+    }
+
+    // Edges are undirected, so the backward search of a node is its forward search. Every shortest
+    // path meets in a node that both upward searches reached.
+    TArray<double> Distances;
+    Distances.Init(DBL_MAX, Nodes.Num() * Nodes.Num());
+    ParallelFor(
+        Nodes.Num(),
+        [&Nodes, &SearchSpaces, &Buckets, &Distances](int32 NodeIndex)
+        {
+            auto* RowDistances = Distances.GetData() + NodeIndex * Nodes.Num();
+            const auto& SearchSpace = SearchSpaces[NodeIndex];
+            for (int32 SpaceIndex = 0; SpaceIndex < SearchSpace.Nodes.Num(); ++SpaceIndex)
+            {
+                for (const auto& BucketEntry : Buckets[SearchSpace.Nodes[SpaceIndex]])
+                {
+                    RowDistances[BucketEntry.Key] = FMath::Min(
+                        RowDistances[BucketEntry.Key], BucketEntry.Value + SearchSpace.Distances[SpaceIndex]);
+                }
+            }
+        });
+
+    return Distances;
+}
+
+bool FMTContractionHierarchy::IsBuiltFor(const FMTWayGraph& Graph) const
+{
+    return NodeCount == Graph.NodeNum() && GraphEdgeCount == CountGraphEdges(Graph) &&
+           UpwardEdgeOffsets.Num() == NodeCount + 1 && GraphHash == HashGraph(Graph);
+}
+
+int32 FMTContractionHierarchy::ShortcutNum() const
+{
+    return Algo::CountIf(
+        UpwardEdges, [](const FUpwardEdge& Edge) { return Edge.Middle != INDEX_NONE; });
+}
+
+bool FMTContractionHierarchy::SaveToFile(const FString& FilePath) const
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTContractionHierarchy::SaveToFile);
+
+    TArray<uint8> Data;
+    FMemoryWriter Writer(Data);
+    Writer << const_cast<FMTContractionHierarchy&>(*this);
+    return FFileHelper::SaveArrayToFile(Data, *FilePath);
+}
+
+bool FMTContractionHierarchy::LoadFromFile(const FString& FilePath)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTContractionHierarchy::LoadFromFile);
+
+    TArray<uint8> Data;
+    if (!FFileHelper::LoadFileToArray(Data, *FilePath, FILEREAD_Silent))
+    {
+        return false;
+    }
+
+    FMemoryReader Reader(Data);
+    Reader << *this;
+    if (Reader.IsError())
+    {
+        *this = {};
+        return false;
+    }
+    return true;
+}
+
+FArchive& operator<<(FArchive& Ar, FMTContractionHierarchy& Hierarchy)
+{
+    uint32 Magic = ContractionHierarchyFileMagic;
+    int32 Version = ContractionHierarchyFileVersion;
+    Ar << Magic;
+    Ar << Version;
+    if (Ar.IsLoading() &&
+        (Magic != ContractionHierarchyFileMagic || Version != ContractionHierarchyFileVersion))
+    {
+        Ar.SetError();
+        return Ar;
+    }
+
+    Ar << Hierarchy.NodeCount;
+    Ar << Hierarchy.GraphEdgeCount;
+    Ar << Hierarchy.GraphHash;
+    Ar << Hierarchy.Ranks;
+    Ar << Hierarchy.UpwardEdgeOffsets;
+    Ar << Hierarchy.UpwardEdges;
+    return Ar;
+}
+
+int32 FMTContractionHierarchy::Search(
+    const int32 StartNode,
+    const int32 EndNode,
+    TMap<int32, FSearchLabel>& OutForward,
+    TMap<int32, FSearchLabel>& OutBackward,
+    double& OutDistance) const
+{
+    check(Ranks.IsValidIndex(StartNode) && Ranks.IsValidIndex(EndNode));
+
+    OutDistance = DBL_MAX;
+    int32 MeetingNode = INDEX_NONE;
+
+    TArray<FHeapEntry> ForwardHeap;
+    TArray<FHeapEntry> BackwardHeap;
+
+    OutForward.Add(StartNode, {0., INDEX_NONE});
+    ForwardHeap.HeapPush({0., StartNode}, HeapPredicate);
+    OutBackward.Add(EndNode, {0., INDEX_NONE});
+    BackwardHeap.HeapPush({0., EndNode}, HeapPredicate);
+
+    const auto SettleNext = [this, &OutDistance, &MeetingNode](
+                                TArray<FHeapEntry>& Heap,
+                                TMap<int32, FSearchLabel>& Labels,
+                                const TMap<int32, FSearchLabel>& OtherLabels)
+    {
+        FHeapEntry Top;
+        Heap.HeapPop(Top, HeapPredicate, false);
+
+        if (Top.Key > Labels[Top.Value].Distance)
+        {
+            return;
+        }
+
+        if (const auto* OtherLabel = OtherLabels.Find(Top.Value))
+        {
+            if (Top.Key + OtherLabel->Distance < OutDistance)
+            {
+                OutDistance = Top.Key + OtherLabel->Distance;
+                MeetingNode = Top.Value;
+            }
+        }
+
+        for (int32 EdgeIndex = UpwardEdgeOffsets[Top.Value];
+             EdgeIndex < UpwardEdgeOffsets[Top.Value + 1];
+             ++EdgeIndex)
+        {
+            const auto& Edge = UpwardEdges[EdgeIndex];
+            const auto Distance = Top.Key + Edge.Weight;
+            const auto* KnownLabel = Labels.Find(Edge.Target);
+            if (!KnownLabel || Distance < KnownLabel->Distance)
+            {
+                Labels.Add(Edge.Target, {Distance, Top.Value});
+                Heap.HeapPush({Distance, Edge.Target}, HeapPredicate);
+            }
+        }
+    };
+
+    while (true)
+    {
+        const auto ForwardMin = ForwardHeap.IsEmpty() ? DBL_MAX : ForwardHeap.HeapTop().Key;
+        const auto BackwardMin = BackwardHeap.IsEmpty() ? DBL_MAX : BackwardHeap.HeapTop().Key;
+
+        // Neither search can improve the best meeting point anymore
+        if (FMath::Min(ForwardMin, BackwardMin) >= OutDistance ||
+            (ForwardHeap.IsEmpty() && BackwardHeap.IsEmpty()))
+        {
+            break;
+        }
+
+        if (ForwardMin <= BackwardMin)
+        {
+            SettleNext(ForwardHeap, OutForward, OutBackward);
+        }
+        else
+        {
+            SettleNext(BackwardHeap, OutBackward, OutForward);
+        }
+    }
+
+    return MeetingNode;
+}
+
+void FMTContractionHierarchy::SearchUpward(
+    const int32 StartNode,
+    TArray<double>& NodeDistances,
+    TArray<FHeapEntry>& Heap,
+    FSearchSpace& OutSearchSpace) const
+{
+    check(Ranks.IsValidIndex(StartNode));
+
+    OutSearchSpace.Nodes.Reset();
+    Heap.Reset();
+
+    NodeDistances[StartNode] = 0.;
+    OutSearchSpace.Nodes.Add(StartNode);
+    Heap.HeapPush({0., StartNode}, HeapPredicate);
+
+    while (!Heap.IsEmpty())
+    {
+        FHeapEntry Top;
+        Heap.HeapPop(Top, HeapPredicate, false);
+
+        if (Top.Key > NodeDistances[Top.Value])
+        {
+            continue;
+        }
+
+        for (int32 EdgeIndex = UpwardEdgeOffsets[Top.Value];
+             EdgeIndex < UpwardEdgeOffsets[Top.Value + 1];
+             ++EdgeIndex)
+        {
+            const auto& Edge = UpwardEdges[EdgeIndex];
+            const auto Distance = Top.Key + Edge.Weight;
+            if (Distance < NodeDistances[Edge.Target])
+            {
+                if (NodeDistances[Edge.Target] == DBL_MAX)
+                {
+                    OutSearchSpace.Nodes.Add(Edge.Target);
+                }
+                NodeDistances[Edge.Target] = Distance;
+                Heap.HeapPush({Distance, Edge.Target}, HeapPredicate);
+            }
+        }
+    }
+
+    OutSearchSpace.Distances.Reset(OutSearchSpace.Nodes.Num());
+    for (const auto Node : OutSearchSpace.Nodes)
+    {
+        OutSearchSpace.Distances.Add(NodeDistances[Node]);
+        NodeDistances[Node] = DBL_MAX;
+    }
+}
+
+const FMTContractionHierarchy::FUpwardEdge* FMTContractionHierarchy::FindUpwardEdge(
+    const int32 Node1,
+    const int32 Node2) const
+{
+    const auto LowerNode = Ranks[Node1] < Ranks[Node2] ? Node1 : Node2;
+    const auto HigherNode = LowerNode == Node1 ? Node2 : Node1;
+
+    for (int32 EdgeIndex = UpwardEdgeOffsets[LowerNode];
+         EdgeIndex < UpwardEdgeOffsets[LowerNode + 1];
+         ++EdgeIndex)
+    {
+        if (UpwardEdges[EdgeIndex].Target == HigherNode)
+        {
+            return &UpwardEdges[EdgeIndex];
+        }
+    }
+    return nullptr;
+}
+
+void FMTContractionHierarchy::UnpackEdge(
+    const int32 FromNode,
+    const int32 ToNode,
+    TArray<int32>& OutNodes) const
+{
+    const auto* Edge = FindUpwardEdge(FromNode, ToNode);
+    check(Edge);
+
+    if (Edge->Middle == INDEX_NONE)
+    {
+        OutNodes.Add(ToNode);
+        return;
+    }
+
+    UnpackEdge(FromNode, Edge->Middle, OutNodes);
+    UnpackEdge(Edge->Middle, ToNode, OutNodes);
+}
+
+int32 FMTContractionHierarchy::CountGraphEdges(const FMTWayGraph& Graph)
+{
+    int32 DegreeSum = 0;
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        DegreeSum += Graph.ViewNodesConnectedToNode(NodeIndex).Num();
+    }
+    return DegreeSum / 2;
+}
+
+uint64 FMTContractionHierarchy::HashGraph(const FMTWayGraph& Graph)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FMTContractionHierarchy::HashGraph);
+
+    // Node locations and adjacency, a graph with moved nodes or rewired edges needs a rebuild
+    uint64 Hash = 0;
+    for (int32 NodeIndex = 0; NodeIndex < Graph.NodeNum(); ++NodeIndex)
+    {
+        const auto Location = Graph.GetNodeLocation(NodeIndex);
+        const double Coordinates[] = {Location.Lat, Location.Lon};
+        Hash = CityHash64WithSeed(reinterpret_cast<const char*>(Coordinates), sizeof(Coordinates), Hash);
+
+        const auto ConnectedNodes = Graph.ViewNodesConnectedToNode(NodeIndex);
+        Hash = CityHash64WithSeed(
+            reinterpret_cast<const char*>(ConnectedNodes.GetData()), ConnectedNodes.NumBytes(), Hash);
+    }
+    return Hash;
+}
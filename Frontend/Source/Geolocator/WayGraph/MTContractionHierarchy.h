@@ -0,0 +1,122 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CesiumGeoreference.h"
+#include "CoreMinimal.h"
+#include "MTWayGraph.h"
+
+struct FMTWayGraphShortestPath
+{
+    double Distance = DBL_MAX;
+
+    // Original way graph nodes from start to end, shortcuts are already unpacked
+    TArray<int32> Nodes;
+
+    bool IsValid() const
+    {
+        return Nodes.Num() > 0;
+    }
+};
+
+/**
+ * Contraction hierarchy over a FMTWayGraph for fast repeated point to point queries.
+ *
+ * Nodes are contracted in rounds of independent sets, the witness searches of a round run in
+ * parallel. Every node only keeps edges to higher ranked nodes, a query is a bidirectional
+ * Dijkstra that only walks upwards. Shortcuts remember the contracted node they bypass so paths
+ * can be unpacked into original graph nodes.
+ */
+class GEOLOCATOR_API FMTContractionHierarchy
+{
+public:
+    // Edge weights are FMTWayGraph::GetEdgeLength, GeoRef may be null for headless builds
+    static FMTContractionHierarchy Build(const FMTWayGraph& Graph, const ACesiumGeoreference* GeoRef);
+
+    FMTWayGraphShortestPath FindShortestPath(const int32 StartNode, const int32 EndNode) const;
+
+    // Same as FindShortestPath but skips unpacking, DBL_MAX if the nodes are not connected
+    double FindShortestDistance(const int32 StartNode, const int32 EndNode) const;
+
+    // Distances between all pairs of Nodes, row major with Nodes.Num() columns, DBL_MAX if not connected.
+    // One upward search per node fills buckets that all other nodes scan, instead of a query per pair.
+    TArray<double> FindShortestDistances(const TConstArrayView<int32> Nodes) const;
+
+    // Checks that a loaded hierarchy was built from the same graph, compares counts and a hash
+    bool IsBuiltFor(const FMTWayGraph& Graph) const;
+
+    int32 ShortcutNum() const;
+
+    bool SaveToFile(const FString& FilePath) const;
+
+    bool LoadFromFile(const FString& FilePath);
+
+    friend FArchive& operator<<(FArchive& Ar, FMTContractionHierarchy& Hierarchy);
+
+private:
+    struct FUpwardEdge
+    {
+        int32 Target;
+
+        double Weight;
+
+        // Contracted node bypassed by a shortcut, INDEX_NONE for original edges
+        int32 Middle;
+
+        friend FArchive& operator<<(FArchive& Ar, FUpwardEdge& Edge)
+        {
+            return Ar << Edge.Target << Edge.Weight << Edge.Middle;
+        }
+    };
+
+    struct FSearchLabel
+    {
+        double Distance;
+        int32 Parent;
+    };
+
+    // Every node an upward search reached with its final distance
+    struct FSearchSpace
+    {
+        TArray<int32> Nodes;
+
+        TArray<double> Distances;
+    };
+
+    int32 NodeCount = 0;
+
+    int32 GraphEdgeCount = 0;
+
+    uint64 GraphHash = 0;
+
+    TArray<int32> Ranks;
+
+    // Index of the first upward edge of each node, NodeCount + 1 entries
+    TArray<int32> UpwardEdgeOffsets;
+
+    TArray<FUpwardEdge> UpwardEdges;
+
+    // Returns the meeting node of both searches or INDEX_NONE
+    int32 Search(
+        const int32 StartNode,
+        const int32 EndNode,
+        TMap<int32, FSearchLabel>& OutForward,
+        TMap<int32, FSearchLabel>& OutBackward,
+        double& OutDistance) const;
+
+    // Upward Dijkstra until the heap is empty. NodeDistances must be DBL_MAX for every node and is
+    // restored before returning, so one search state serves many searches.
+    void SearchUpward(
+        const int32 StartNode,
+        TArray<double>& NodeDistances,
+        TArray<TPair<double, int32>>& Heap,
+        FSearchSpace& OutSearchSpace) const;
+
+    const FUpwardEdge* FindUpwardEdge(const int32 Node1, const int32 Node2) const;
+
+    void UnpackEdge(const int32 FromNode, const int32 ToNode, TArray<int32>& OutNodes) const;
+
+    static int32 CountGraphEdges(const FMTWayGraph& Graph);
+
+    static uint64 HashGraph(const FMTWayGraph& Graph);
+};
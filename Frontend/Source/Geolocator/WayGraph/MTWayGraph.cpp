@@ -52,13 +52,14 @@ double EMTWayToScale(const EMTWay& Way)
 
 int64 FMTWayGraph::NodePairToEdgeIndex(const int32 Node1, const int32 Node2) const
 {
+    // Independent of the node count so edges stay valid when nodes are added later
     if (Node1 < Node2)
     {
-        return (int64)Node1 * (int64)NodeNum() + (int64)Node2;
+        return ((int64)Node1 << 32) | (int64)Node2;
     }
     else
     {
-        return (int64)Node2 * (int64)NodeNum() + (int64)Node1;
+        return ((int64)Node2 << 32) | (int64)Node1;
     }
 }
 
@@ -82,13 +83,28 @@ FString FMTWayGraph::GetWayName(const int32 WayIndex) const
     return Ways[WayIndex].Name;
 }
 
-int32 FMTWayGraph::AddNode(const FOverpassCoordinates& Coords)
+int32 FMTWayGraph::AddNode(const FOverpassCoordinates& Coords, const int64 OSMID)
 {
-    const int32 NodeID = Nodes.Add({Coords});
+    const int32 NodeID = Nodes.Add({Coords, OSMID});
     AdjacencyList.AddDefaulted();
+    if (OSMID != INDEX_NONE)
+    {
+        OSMIDToNodeIndex.Add(OSMID, NodeID);
+    }
     return NodeID;
 }
 
+int32 FMTWayGraph::FindNodeByOSMID(const int64 OSMID) const
+{
+    const auto* NodeIndex = OSMIDToNodeIndex.Find(OSMID);
+    return NodeIndex ? *NodeIndex : INDEX_NONE;
+}
+
+bool FMTWayGraph::HasOSMIDs() const
+{
+    return OSMIDToNodeIndex.Num() == Nodes.Num();
+}
+
 void FMTWayGraph::ConnectNodes(const int32 Node1, const int32 Node2, const int32 WayIndex)
 {
     if (WayIndex >= Ways.Num())
@@ -136,6 +152,27 @@ FMTWayGraph::GetNodeLocationUnreal(const int32 NodeIndex, const ACesiumGeorefere
         FVector{NodeLocation.Lon, NodeLocation.Lat, GeoRef->GetOriginHeight()});
 }
 
+double FMTWayGraph::GetEdgeLength(
+    const int32 NodeIndex1,
+    const int32 NodeIndex2,
+    const ACesiumGeoreference* GeoRef) const
+{
+    if (GeoRef)
+    {
+        return FVector::Distance(
+            GetNodeLocationUnreal(NodeIndex1, GeoRef), GetNodeLocationUnreal(NodeIndex2, GeoRef));
+    }
+
+    constexpr auto EarthRadiusInUnrealUnits = 6378137. * 100.;
+    const auto Location1 = GetNodeLocation(NodeIndex1);
+    const auto Location2 = GetNodeLocation(NodeIndex2);
+    const auto MeanLatitude = FMath::DegreesToRadians((Location1.Lat + Location2.Lat) * 0.5);
+    const auto DeltaX =
+        FMath::DegreesToRadians(Location2.Lon - Location1.Lon) * FMath::Cos(MeanLatitude);
+    const auto DeltaY = FMath::DegreesToRadians(Location2.Lat - Location1.Lat);
+    return FMath::Sqrt(DeltaX * DeltaX + DeltaY * DeltaY) * EarthRadiusInUnrealUnits;
+}
+
 bool FMTWayGraph::AreNodesConnected(const int32 NodeIndex1, const int32 NodeIndex2) const
 {
     check(AdjacencyList.IsValidIndex(NodeIndex1));
@@ -151,6 +188,52 @@ int32 FMTWayGraph::NodeNum() const
     return Nodes.Num();
 }
 
+SIZE_T FMTWayGraph::GetAllocatedSize() const
+{
+    SIZE_T Result = Nodes.GetAllocatedSize() + AdjacencyList.GetAllocatedSize() +
+                    EdgeData.GetAllocatedSize() + Ways.GetAllocatedSize();
+    for (const auto& Adjacency : AdjacencyList)
+    {
+        Result += Adjacency.AdjacentNodes.GetAllocatedSize();
+    }
+    for (const auto& Way : Ways)
+    {
+        Result += Way.Name.GetAllocatedSize();
+    }
+    return Result;
+}
+
+void FMTWayGraph::PostLoad()
+{
+    OSMIDToNodeIndex.Reset();
+    for (int32 NodeIndex = 0; NodeIndex < Nodes.Num(); ++NodeIndex)
+    {
+        if (Nodes[NodeIndex].OSMID != INDEX_NONE)
+        {
+            OSMIDToNodeIndex.Add(Nodes[NodeIndex].OSMID, NodeIndex);
+        }
+    }
+}
+
+void FMTWayGraph::MigrateLegacyEdgeIndices()
+{
+    const int64 LegacyNodeNum = NodeNum();
+    if (LegacyNodeNum == 0)
+    {
+        return;
+    }
+
+    TMap<int64, FMTWayGraphEdge> MigratedEdgeData;
+    MigratedEdgeData.Reserve(EdgeData.Num());
+    for (const auto& [LegacyEdgeIndex, Edge] : EdgeData)
+    {
+        const auto Node1 = static_cast<int32>(LegacyEdgeIndex / LegacyNodeNum);
+        const auto Node2 = static_cast<int32>(LegacyEdgeIndex % LegacyNodeNum);
+        MigratedEdgeData.Add(NodePairToEdgeIndex(Node1, Node2), Edge);
+    }
+    EdgeData = MoveTemp(MigratedEdgeData);
+}
+
 void DrawDebugStreetGraph(
     const UWorld* World,
     const FMTWayGraph& WayGraph,
@@ -49,6 +49,9 @@ struct FMTWayGraphNode
     
     UPROPERTY()
     FOverpassCoordinates Coords;
+
+    UPROPERTY()
+    int64 OSMID = INDEX_NONE;
 };
 
 USTRUCT()
@@ -95,7 +98,12 @@ struct FMTWayGraph
 
     FString GetWayName(const int32 WayIndex) const;
 
-    int32 AddNode(const FOverpassCoordinates& Coords);
+    int32 AddNode(const FOverpassCoordinates& Coords, const int64 OSMID = INDEX_NONE);
+
+    // Returns INDEX_NONE if no node with this OSM ID was added
+    int32 FindNodeByOSMID(const int64 OSMID) const;
+
+    bool HasOSMIDs() const;
 
     void ConnectNodes(const int32 Node1, const int32 Node2, const int32 WayIndex);
 
@@ -111,10 +119,24 @@ struct FMTWayGraph
 
     FVector GetNodeLocationUnreal(const int32 NodeIndex, const ACesiumGeoreference* GeoRef) const;
 
+    // Distance in Unreal units, without a georeference a local equirectangular approximation is used
+    double GetEdgeLength(
+        const int32 NodeIndex1,
+        const int32 NodeIndex2,
+        const ACesiumGeoreference* GeoRef) const;
+
     bool AreNodesConnected(const int32 NodeIndex1, const int32 NodeIndex2) const;
 
     int32 NodeNum() const;
 
+    SIZE_T GetAllocatedSize() const;
+
+    // Rebuilds lookups that are not serialized, call after loading a graph
+    void PostLoad();
+
+    // Edge indices used to depend on the node count, convert caches written before that
+    void MigrateLegacyEdgeIndices();
+
 private:
     UPROPERTY()
     TArray<FMTWayGraphNode> Nodes;
@@ -128,6 +150,8 @@ private:
     UPROPERTY()
     TArray<FMTWayGraphWay> Ways;
 
+    TMap<int64, int32> OSMIDToNodeIndex;
+
     friend void DrawDebugStreetGraph(
         const UWorld* World,
         const FMTWayGraph& WayGraph,
@@ -32,16 +32,21 @@ void AMTWayGraphVisualizer::BeginPlay()
         ShowBoundary();
     }
     
-    OverpassQueryCompletedDelegate.BindUFunction(this, TEXT("OverpassQueryCompleted"));
+    OverpassQueryCompletedDelegate.BindUObject(this, &AMTWayGraphVisualizer::OverpassQueryCompleted);
     if (BoundingPolygon)
     {
         const auto OverpassQuery = MTOverpass::BuildQueryStringFromBoundingPolygon(BoundingPolygon);
-        MTOverpass::AsyncQuery(OverpassQuery, OverpassQueryCompletedDelegate);
+        MTOverpass::AsyncLoadStreetGraph(
+            StreetGraphSource,
+            OverpassQuery,
+            MTOverpass::FMTGeoPolygon(BoundingPolygon),
+            {},
+            OverpassQueryCompletedDelegate);
     }
 }
 
 void AMTWayGraphVisualizer::OverpassQueryCompleted(
-    const FOverPassQueryResult& Result,
+    FMTStreetGraphQueryResult& Result,
     const bool bSuccess)
 {
     if (!bSuccess)
@@ -49,7 +54,7 @@ void AMTWayGraphVisualizer::OverpassQueryCompleted(
         return;
     }
 
-    WayGraph = MTOverpass::CreateStreetGraphFromQuery(Result, BoundingPolygon);
+    WayGraph = MoveTemp(Result.Graph);
 
     if (bShouldShowEulerTour)
     {
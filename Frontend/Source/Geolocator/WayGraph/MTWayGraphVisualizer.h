@@ -5,7 +5,8 @@
 #include "CesiumCartographicPolygon.h"
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
-#include "Geolocator/OSM/MTOverpassSchema.h"
+#include "Geolocator/OSM/MTOverpassQuery.h"
+#include "Geolocator/OSM/MTStreetGraphSource.h"
 #include "Geolocator/WayGraph/MTWayGraph.h"
 #include "MTChinesePostMan.h"
 
@@ -33,13 +34,16 @@ private:
     UPROPERTY(EditAnywhere)
     TObjectPtr<ACesiumCartographicPolygon> BoundingPolygon;
 
+    UPROPERTY(EditAnywhere)
+    FMTStreetGraphSource StreetGraphSource;
+
     UPROPERTY(EditAnywhere)
     bool bShouldShowEulerTour = false;
 
     UPROPERTY(EditAnywhere)
     bool bShouldShowBoundary = true;
 
-    FMTOverPassQueryCompletionDelegate OverpassQueryCompletedDelegate;
+    FMTStreetGraphQueryCompletionDelegate OverpassQueryCompletedDelegate;
 
     FMTWayGraph WayGraph;
 
@@ -50,8 +54,7 @@ private:
     FVector EulerAnimationZOffset = FVector(0, 0, 0);
 
     
-    UFUNCTION()
-    void OverpassQueryCompleted(const FOverPassQueryResult& Result, const bool bSuccess);
+    void OverpassQueryCompleted(FMTStreetGraphQueryResult& Result, const bool bSuccess);
 
     void ShowOverview();
         